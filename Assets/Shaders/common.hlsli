@@ -98,6 +98,15 @@ struct Vertex
     float3 tangent  : TANGENT;
 };
 
+// Per instance data of instanced draws, same layout as PerObj.
+// Unlike in cbuffers, the rows are read as they are in the buffer,
+// so the matrices are not transposed (use mul(matrix, vector))
+struct Instance
+{
+    float4x4 model2World : MODEL2WORLD;
+    float4x4 normalMat   : NORMALMAT;
+};
+
 // Vertex used in skinned meshes
 #define MaxBonesInfluence 5
 #define MaxBones 200 // Maximum number of bones in a skinned mesh
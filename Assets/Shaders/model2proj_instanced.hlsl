@@ -0,0 +1,32 @@
+
+#pragma vs main
+
+#include "common.hlsli"
+
+struct Vert2Pixel
+{
+    float4 viewPos   : SV_POSITION;
+    
+    float3 worldPos  : POSITION;
+    float3 normal    : NORMAL;
+    float2 uv        : TEXCOORD0;
+    float3 tangent   : TANGENT;
+};
+
+// Same as model2proj, with the per object data coming from the instance buffer
+Vert2Pixel main(Vertex vert, Instance inst)
+{
+    float3x3 normalMat = (float3x3)inst.normalMat;
+    float4 worldPos = mul(inst.model2World, float4(vert.position, 1.0));
+    
+    Vert2Pixel output;
+    output.viewPos   = mul(mul(worldPos, world2View), view2Proj);
+    output.worldPos  = worldPos.xyz;
+    output.normal    = normalize(mul(normalMat, vert.normal));
+    output.uv        = vert.uv;
+    output.tangent   = normalize(mul(normalMat, vert.tangent));
+    
+    // Orthogonalize the tangent with respect to normal
+    output.tangent = normalize(output.tangent - output.normal * dot(output.tangent, output.normal));
+    return output;
+}
@@ -1,5 +1,6 @@
 
 #include "base.h"
+#include "os/os_generic.h"
 #include "asset_system.h"
 #include "parser.h"
 
@@ -13,14 +14,172 @@ void AssetSystemInit()
 }
 
 
-Mesh*        GetAsset(MeshHandle handle)        { return &assetSystem.assets[handle.slot].mesh;     }
-R_Shader*    GetAsset(VertShaderHandle handle)  { return &assetSystem.assets[handle.slot].shader;   }
-R_Shader*    GetAsset(PixelShaderHandle handle) { return &assetSystem.assets[handle.slot].shader;   }
-Material*    GetAsset(MaterialHandle handle)    { return &assetSystem.assets[handle.slot].material; }
-R_Texture2D* GetAsset(Texture2DHandle handle)   { return &assetSystem.assets[handle.slot].texture2D; }
-//R_Cubemap*   GetAsset(CubemapHandle handle)     { return &assetSystem.assets[handle.slot].cubemap;   }
+bool MountAssetPack(String path)
+{
+    auto& pack = assetSystem.pack;
+    assert(!pack.file.ptr && "Only one asset pack can be mounted at a time");
+    
+    // No prefetching, only the pages of the assets actually used should be read
+    bool success = true;
+    String file = OS_MapFile(path, &success, false);
+    if(!success) return false;
+    
+    char** cursor;
+    char* c = (char*)file.ptr;
+    cursor = &c;
+    
+    bool valid = file.len >= (s64)(AlignForward(sizeof("pack")-1 + sizeof(u32), alignof(PackHeader_v0)) + sizeof(PackHeader_v0));
+    if(valid)
+    {
+        String magicBytes = Next(cursor, sizeof("pack")-1);  // Excluding null terminator
+        u32 version = Next<u32>(cursor);
+        valid = magicBytes == "pack" && version == 0;
+    }
+    
+    PackHeader_v0 header = {};
+    if(valid)
+    {
+        header = Next<PackHeader_v0>(cursor);
+        
+        u64 size = (u64)file.len;
+        valid = header.tocOffset % alignof(PackEntry_v0) == 0 &&
+                header.tocOffset <= size &&
+                header.numEntries <= (size - header.tocOffset) / sizeof(PackEntry_v0) &&
+                header.pathsOffset <= size;
+    }
+    
+    if(!valid)
+    {
+        Log("Asset pack '%.*s' is invalid or its version is unsupported.", StrPrintf(path));
+        OS_UnmapFile(file);
+        return false;
+    }
+    
+    pack.file   = file;
+    pack.header = header;
+    pack.toc    = (PackEntry*)(file.ptr + header.tocOffset);
+    pack.paths  = file.ptr + header.pathsOffset;
+    return true;
+}
+
+bool MountAssetPack(const char* path) { return MountAssetPack(ToLenStr(path)); }
+
+// Assets loaded from the pack must be released before this
+void UnmountAssetPack()
+{
+    auto& pack = assetSystem.pack;
+    if(pack.file.ptr) OS_UnmapFile(pack.file);
+    pack = {};
+}
 
-static u32 AcquireAsset(AssetKind kind, String path, bool* outNew)
+// Binary search over the table of contents. Can be used from any thread
+static bool FindInPack(String path, String* outContents)
+{
+    auto& pack = assetSystem.pack;
+    if(!pack.file.ptr) return false;
+    
+    u64 hash = HashString(path);
+    
+    // Find the first entry with this hash
+    u32 lo = 0;
+    u32 hi = pack.header.numEntries;
+    while(lo < hi)
+    {
+        u32 mid = lo + (hi - lo) / 2;
+        if(pack.toc[mid].pathHash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    for(u32 i = lo; i < pack.header.numEntries && pack.toc[i].pathHash == hash; ++i)
+    {
+        PackEntry& entry = pack.toc[i];
+        
+        // Don't trust the offsets blindly
+        u64 fileSize = (u64)pack.file.len;
+        u64 pathsSize = fileSize - pack.header.pathsOffset;
+        if(entry.pathOffset > pathsSize || entry.pathLen > pathsSize - entry.pathOffset) return false;
+        if(entry.offset > fileSize || entry.size > fileSize - entry.offset) return false;
+        
+        String entryPath = {.ptr=pack.paths + entry.pathOffset, .len=entry.pathLen};
+        if(entryPath != path) continue;
+        
+        *outContents = {.ptr=pack.file.ptr + entry.offset, .len=(s64)entry.size};
+        return true;
+    }
+    
+    return false;
+}
+
+// Returns the contents of an asset file, looking in the pack first. The
+// result must be freed with UnmapAssetFile. Can be used from any thread
+static String MapAssetFile(String path, bool* outSuccess)
+{
+    String contents = {};
+    if(FindInPack(path, &contents))
+    {
+        *outSuccess = true;
+        return contents;
+    }
+    
+#ifndef Development
+    // Shipping builds only read loose files if there is no pack
+    if(assetSystem.pack.file.ptr)
+    {
+        *outSuccess = false;
+        return {};
+    }
+#endif
+    
+    return OS_MapFile(path, outSuccess);
+}
+
+static void UnmapAssetFile(String contents)
+{
+    // Files in the pack stay mapped
+    String pack = assetSystem.pack.file;
+    if(contents.ptr >= pack.ptr && contents.ptr < pack.ptr + pack.len) return;
+    
+    OS_UnmapFile(contents);
+}
+
+// Like LoadTextFile, but goes through the pack
+static TextFileHandler LoadAssetTextFile(String path, Arena* dst)
+{
+    TextFileHandler handler = {};
+    handler.ok = true;
+    String contents = MapAssetFile(path, &handler.ok);
+    if(!handler.ok) return handler;
+    defer { UnmapAssetFile(contents); };
+    
+    char* text = (char*)ArenaAlloc(dst, contents.len + 1, 1);
+    memcpy(text, contents.ptr, contents.len);
+    text[contents.len] = '\0';
+    
+    handler.file = {.ptr=text, .len=contents.len};
+    handler.at = text;
+    return handler;
+}
+
+// Returns the default asset of the given kind if the handle is not valid
+static Asset* GetAsset(AssetKind kind, AssetHandle handle)
+{
+    Asset* asset = Lookup(&assetSystem.assets, {.id=handle.slot, .gen=handle.gen});
+    if(!asset) return &assetSystem.defaultAssets[kind];
+    
+    assert(asset->kind == kind);
+    return asset;
+}
+
+Mesh*        GetAsset(MeshHandle handle)        { return &GetAsset(Asset_Mesh, handle)->mesh;             }
+R_Shader*    GetAsset(VertShaderHandle handle)  { return &GetAsset(Asset_VertShader, handle)->shader;     }
+R_Shader*    GetAsset(PixelShaderHandle handle) { return &GetAsset(Asset_PixelShader, handle)->shader;    }
+Material*    GetAsset(MaterialHandle handle)    { return &GetAsset(Asset_Material, handle)->material;     }
+R_Texture2D* GetAsset(Texture2DHandle handle)   { return &GetAsset(Asset_Texture2D, handle)->texture2D;   }
+//R_Cubemap*   GetAsset(CubemapHandle handle)     { return &GetAsset(Asset_Cubemap, handle)->cubemap;     }
+
+static AssetHandle AcquireAsset(AssetKind kind, String path, bool* outNew)
 {
     auto& sys = assetSystem;
     auto lookup = Lookup(&sys.pathMapping, path);
@@ -30,43 +189,35 @@ static u32 AcquireAsset(AssetKind kind, String path, bool* outNew)
         
         auto value = lookup.res;
         assert(value->kind == kind);
-        
-        auto& asset = sys.assets[value->slot];
-        return value->slot;
+        return value->handle;
     }
     else
     {
         *outNew = true;
         
-        u32 slot = 0;
-        if(sys.freeSlots.len > 0)
-        {
-            slot = sys.freeSlots[sys.freeSlots.len - 1];
-            Pop(&sys.freeSlots);
-        }
-        else
-        {
-            Append(&sys.assets, {});
-            slot = sys.assets.len - 1;
-        }
-        
+        SlotKey key = Append(&sys.assets, {});
+        AssetHandle handle = {.slot=key.id, .gen=key.gen};
         
-        Append(&sys.pathMapping, path, {kind, slot});
+        Append(&sys.pathMapping, path, {kind, handle});
         
-        auto& asset = sys.assets[slot];
-        asset.kind = kind;
-        asset.slot = slot;
+        Asset* asset = Lookup(&sys.assets, key);
+        asset->kind = kind;
+        asset->handle = handle;
+        asset->path = {.ptr=ToCString(path), .len=path.len};
         
-        return slot;
+        return handle;
     }
 }
 
 static void ReleaseAsset(AssetKind kind, AssetHandle handle)
 {
     auto& sys = assetSystem;
-    assert(handle.slot < (u32)sys.assets.len);
+    SlotKey key = {.id=handle.slot, .gen=handle.gen};
+    Asset* found = Lookup(&sys.assets, key);
+    assert(found && "Trying to release an asset which has already been released");
+    if(!found) return;
     
-    auto& asset = sys.assets[handle.slot];
+    auto& asset = *found;
     assert(kind == asset.kind);
     
     
@@ -76,73 +227,77 @@ static void ReleaseAsset(AssetKind kind, AssetHandle handle)
     //if(asset.refCount == 0)
     if(false)
     {
-        // TODO: Free the resource, and also free its entry in the pathMapping table
+        // TODO: Free the resource
+        
+        Remove(&sys.pathMapping, asset.path);
+        free((void*)asset.path.ptr);
+        Remove(&sys.assets, key);
     }
 }
 
 MeshHandle AcquireMesh(String path)
 {
     bool newAsset = false;
-    u32 slot = AcquireAsset(Asset_Mesh, path, &newAsset);
+    AssetHandle handle = AcquireAsset(Asset_Mesh, path, &newAsset);
     bool ok = true;
     if(newAsset)
     {
         auto asset = LoadMesh(path, &ok);
-        assetSystem.assets[slot].mesh = asset;
+        GetAsset(Asset_Mesh, handle)->mesh = asset;
     }
-    return {slot};
+    return {handle};
 }
 
 VertShaderHandle AcquireVertShader(String path)
 {
     bool newAsset = false;
-    u32 slot = AcquireAsset(Asset_VertShader, path, &newAsset);
+    AssetHandle handle = AcquireAsset(Asset_VertShader, path, &newAsset);
     bool ok = true;
     if(newAsset)
     {
         auto asset = LoadShader(path, ShaderType_Vertex, &ok);
-        assetSystem.assets[slot].shader = asset;
+        GetAsset(Asset_VertShader, handle)->shader = asset;
     }
-    return {slot};
+    return {handle};
 }
 
 PixelShaderHandle AcquirePixelShader(String path)
 {
     bool newAsset = false;
-    u32 slot = AcquireAsset(Asset_PixelShader, path, &newAsset);
+    AssetHandle handle = AcquireAsset(Asset_PixelShader, path, &newAsset);
     bool ok = true;
     if(newAsset)
     {
         auto asset = LoadShader(path, ShaderType_Pixel, &ok);
-        assetSystem.assets[slot].shader = asset;
+        GetAsset(Asset_PixelShader, handle)->shader = asset;
     }
-    return {slot};
+    return {handle};
 }
 
 MaterialHandle AcquireMaterial(String path)
 {
     bool newAsset = false;
-    u32 slot = AcquireAsset(Asset_Material, path, &newAsset);
+    AssetHandle handle = AcquireAsset(Asset_Material, path, &newAsset);
     bool ok = true;
     if(newAsset)
     {
         auto asset = LoadMaterial(path, &ok);
-        assetSystem.assets[slot].material = asset;
+        GetAsset(Asset_Material, handle)->material = asset;
     }
-    return {slot};
+    return {handle};
 }
 
 Texture2DHandle AcquireTexture2D(String path)
 {
     bool newAsset = false;
-    u32 slot = AcquireAsset(Asset_Texture2D, path, &newAsset);
+    AssetHandle handle = AcquireAsset(Asset_Texture2D, path, &newAsset);
     bool ok = false;
     if(newAsset)
     {
         auto asset = LoadTexture2D(path, &ok);
-        assetSystem.assets[slot].texture2D = asset;
+        GetAsset(Asset_Texture2D, handle)->texture2D = asset;
     }
-    return {slot};
+    return {handle};
 }
 
 #if 0
@@ -169,18 +324,89 @@ void ReleasePixelShader(PixelShaderHandle handle)   { ReleaseAsset(Asset_PixelSh
 //void ReleaseTexture2D(Texture2DHandle handle)     { ReleaseAsset(Asset_Texture2D, handle);   }
 //void ReleaseCubemap(CubemapHandle handle)         { ReleaseAsset(Asset_Cubemap, handle);     }
 
-R_Shader LoadShader(String path, ShaderType type, bool* ok)
+#ifdef Development
+// Binaries are made by shader_importer, which only runs on Windows.
+// Until a new shader has one, CompiledShaders/<name>.shader is compiled
+// from Shaders/<name>.hlsl instead, with the entry point of its pragma
+static R_Shader LoadShaderSource(String path, ShaderType type, bool* ok)
 {
+    String dir = ToLenStr("CompiledShaders/");
+    if(path.len <= dir.len || String{.ptr=path.ptr, .len=dir.len} != dir)
+    {
+        *ok = false;
+        return {};
+    }
+    
     ScratchArena scratch;
-    \
+    StringBuilder builder = {};
+    UseArena(&builder, scratch);
+    Append(&builder, "Shaders/");
+    String name = GetPathNoExtension(path);
+    Append(&builder, {.ptr=name.ptr + dir.len, .len=name.len - dir.len});
+    Append(&builder, ".hlsl");
+    String sourcePath = ToString(&builder);
+    
     bool success = true;
-    String contents = LoadEntireFile(path, scratch, &success);
+    String source = MapAssetFile(sourcePath, &success);
     if(!success)
     {
+        *ok = false;
+        return {};
+    }
+    defer { UnmapAssetFile(source); };
+    
+    String pragma = ToLenStr(type == ShaderType_Vertex? "#pragma vs " : "#pragma ps ");
+    String entry = {};
+    for(s64 i = 0; i + pragma.len <= source.len; ++i)
+    {
+        if(String{.ptr=source.ptr + i, .len=pragma.len} != pragma) continue;
+        
+        s64 start = i + pragma.len;
+        s64 end = start;
+        while(end < source.len && (isalnum((unsigned char)source[end]) || source[end] == '_')) ++end;
+        entry = {.ptr=source.ptr + start, .len=end - start};
+        break;
+    }
+    
+    if(entry.len == 0)
+    {
+        Log("Shader source '%.*s' has no entry point for a %s", StrPrintf(sourcePath), GetShaderTypeString(type));
+        *ok = false;
+        return {};
+    }
+    
+    R_ShaderInput input = {};
+    input.hlsl      = source;
+    input.hlslPath  = sourcePath;
+    input.hlslEntry = entry;
+    auto shader = R_ShaderAlloc(input, type);
+    if(shader.type != type)
+    {
+        *ok = false;
+        return {};
+    }
+    
+    Log("'%.*s' is missing, compiled '%.*s' instead. Run shader_importer on it", StrPrintf(path), StrPrintf(sourcePath));
+    return shader;
+}
+#endif
+
+R_Shader LoadShader(String path, ShaderType type, bool* ok)
+{
+    bool success = true;
+    String contents = MapAssetFile(path, &success);
+    if(!success)
+    {
+#ifdef Development
+        auto shader = LoadShaderSource(path, type, &success);
+        if(success) return shader;
+#endif
+        
         Log("Failed to load file '%.*s'\n", StrPrintf(path));
         *ok = false;
         return {};
     }
+    defer { UnmapAssetFile(contents); };
     
     char** cursor;
     char* c = (char*)contents.ptr;
@@ -225,60 +451,103 @@ R_Shader LoadShader(String path, ShaderType type, bool* ok)
     return shader;
 }
 
-Mesh LoadMesh(String path, bool* ok)
+// Bounds of the vertices, for meshes imported before the header
+// had them. The sphere is centered on the box, which is not the
+// smallest one but is close enough for culling
+static void ComputeMeshBounds(Slice<Vertex> verts, Aabb* outAabb, Sphere* outSphere)
 {
-    ScratchArena scratch;
+    Aabb aabb = {.min={0.0f, 0.0f, 0.0f}, .max={0.0f, 0.0f, 0.0f}};
+    if(verts.len > 0) aabb = {.min=verts[0].pos, .max=verts[0].pos};
     
-    bool success = true;
-    String contents = LoadEntireFile(path, scratch, &success);
-    if(!success)
+    for(s64 i = 1; i < verts.len; ++i)
+        aabb = Union(aabb, {.min=verts[i].pos, .max=verts[i].pos});
+    
+    Vec3 center = (aabb.min + aabb.max) * 0.5f;
+    float radiusSqr = 0.0f;
+    for(s64 i = 0; i < verts.len; ++i)
     {
-        Log("Failed to load file '%.*s'", StrPrintf(path));
-        *ok = false;
-        return {};
+        Vec3 diff = verts[i].pos - center;
+        radiusSqr = max(radiusSqr, dot(diff, diff));
     }
     
+    *outAabb = aabb;
+    *outSphere = {.center=center, .radius=sqrtf(radiusSqr)};
+}
+
+// Finds the vertex and index data in the mesh file. This doesn't
+// log or touch the asset system, so it can be used from any thread.
+// Returns an error message, or null on success
+static const char* ParseMesh(String contents, StaticMeshInput* out)
+{
     char** cursor;
     char* c = (char*)contents.ptr;
     cursor = &c;
     
     String magicBytes = Next(cursor, sizeof("mesh")-1);  // Excluding null terminator
     if(magicBytes != "mesh")
+        return "the file is not a mesh";
+    
+    u32 version = Next<u32>(cursor);
+    if(version > 1)
+        return "the mesh version is unsupported";
+    
+    // v1 only appends to the v0 header
+    char* headerPtr = *cursor;
+    auto header = Next<MeshHeader_v0>(cursor);
+    
+    if(header.isSkinned)
+        return "skinned meshes are not yet supported";
+    
+    out->verts   = {(Vertex*)(headerPtr + header.vertsOffset),   header.numVerts};
+    out->indices = {(u32*)   (headerPtr + header.indicesOffset), header.numIndices};
+    
+    if(version == 0)
     {
-        Log("Attempted to load file '%.*s' as a mesh, which it is not.", StrPrintf(path));
-        *ok = false;
-        return {};
+        ComputeMeshBounds(out->verts, &out->aabb, &out->sphere);
+    }
+    else
+    {
+        char* headerCursor = headerPtr;
+        auto headerV1 = Next<MeshHeader_v1>(&headerCursor);
+        out->aabb   = {.min=headerV1.aabbMin, .max=headerV1.aabbMax};
+        out->sphere = {.center=headerV1.sphereCenter, .radius=headerV1.sphereRadius};
     }
     
-    u32 version = Next<u32>(cursor);
-    if(version != 0)
+    return nullptr;
+}
+
+// The vertex and index data is uploaded straight from the mapped file
+Mesh LoadMesh(String path, bool* ok)
+{
+    bool success = true;
+    String contents = MapAssetFile(path, &success);
+    if(!success)
     {
-        Log("Attempted to load file '%.*s' as a mesh, but its version is unsupported.", StrPrintf(path));
+        Log("Failed to load file '%.*s'", StrPrintf(path));
         *ok = false;
         return {};
     }
+    defer { UnmapAssetFile(contents); };
     
-    char* headerPtr = *cursor;
-    auto header = Next<MeshHeader_v0>(cursor);
-    
-    if(header.isSkinned)
+    StaticMeshInput input = {};
+    const char* error = ParseMesh(contents, &input);
+    if(error)
     {
-        Log("Skinned meshes are not yet supported.");
+        Log("Failed to load mesh '%.*s': %s.", StrPrintf(path), error);
         *ok = false;
         return {};
     }
     
-    Slice<Vertex> verts   = {(Vertex*)(headerPtr + header.vertsOffset),   header.numVerts};
-    Slice<u32>    indices = {(u32*)   (headerPtr + header.indicesOffset), header.numIndices};
-    auto mesh = StaticMeshAlloc({verts, indices});
+    auto mesh = StaticMeshAlloc(input);
     return mesh;
 }
 
-Material LoadMaterial(String path, bool* ok)
+// If async is true, the textures are acquired asynchronously
+static Material LoadMaterial(String path, bool* ok, bool async)
 {
     ScratchArena scratch;
     
-    TextFileHandler handler = LoadTextFile(path, scratch);
+    TextFileHandler handler = LoadAssetTextFile(path, scratch);
     if(!handler.ok)
     {
         Log("Could not load material '%.*s'", StrPrintf(path));
@@ -318,7 +587,7 @@ Material LoadMaterial(String path, bool* ok)
                 if(StringBeginsWith(texLine.text, ":/")) break;
                 
                 ConsumeNextLine(&handler);
-                Texture2DHandle handle = AcquireTexture2D(texLine.text);
+                Texture2DHandle handle = async? AcquireTexture2DAsync(texLine.text) : AcquireTexture2D(texLine.text);
                 Append(&mat.textures, handle);
             }
         }
@@ -353,26 +622,36 @@ Material LoadMaterial(String path, bool* ok)
     return mat;
 }
 
+Material LoadMaterial(String path, bool* ok)
+{
+    return LoadMaterial(path, ok, false);
+}
+
+// Decodes to RGBA8, can be used from any thread.
+// Returns null on failure, the result must be freed with stbi_image_free
+static void* DecodeTexture2D(String contents, int* outWidth, int* outHeight)
+{
+    int numChannels;
+    return stbi_load_from_memory((const stbi_uc*)contents.ptr, (int)contents.len, outWidth, outHeight, &numChannels, 4);
+}
+
 R_Texture2D LoadTexture2D(String path, bool* ok)
 {
-    ScratchArena scratch;
-    
     bool success = true;
-    String contents = LoadEntireFile(path, scratch, &success);
+    String contents = MapAssetFile(path, &success);
     if(!success)
     {
         Log("Failed to load texture '%.*s'", StrPrintf(path));
         *ok = false;
         return {};
     }
+    defer { UnmapAssetFile(contents); };
     
-    String stbImage = {0};
-    int width, height, numChannels;
-    stbImage.ptr = (char*)stbi_load_from_memory((const stbi_uc*)contents.ptr, (int)contents.len, &width, &height, &numChannels, 4);
-    stbImage.len = width * height * numChannels;
-    defer { stbi_image_free((void*)stbImage.ptr); };
+    int width, height;
+    void* pixels = DecodeTexture2D(contents, &width, &height);
+    defer { stbi_image_free(pixels); };
     
-    if(!stbImage.ptr)
+    if(!pixels)
     {
         Log("Failed to load texture '%.*s'", StrPrintf(path));
         *ok = false;
@@ -380,10 +659,221 @@ R_Texture2D LoadTexture2D(String path, bool* ok)
     }
     
     auto tex = R_Texture2DAlloc(TextureFormat_RGBA_SRGB,
-                                width, height, (void*)stbImage.ptr);
+                                width, height, pixels);
     return tex;
 }
 
+//// Async loading
+
+// Runs on a worker thread: reads and decodes the file, then hands the
+// request to the main thread. Nothing in here can touch the asset system
+// (other than the completion list) or the renderer, and it can't Log.
+static void AssetLoadJob(void* data)
+{
+    auto req = (AssetLoadRequest*)data;
+    
+    bool success = true;
+    req->file = MapAssetFile(ToLenStr(req->path), &success);
+    if(!success)
+    {
+        req->file = {};
+        req->error = "could not open the file";
+    }
+    else
+    {
+        switch(req->kind)
+        {
+            default: assert(false); break;
+            case Asset_Mesh:
+            {
+                // The upload reads the vertices straight from the mapping
+                req->error = ParseMesh(req->file, &req->mesh);
+                break;
+            }
+            case Asset_Texture2D:
+            {
+                req->pixels = DecodeTexture2D(req->file, &req->width, &req->height);
+                if(!req->pixels) req->error = "could not decode the image";
+                UnmapAssetFile(req->file);
+                req->file = {};
+                break;
+            }
+        }
+    }
+    
+    auto& sys = assetSystem;
+    AssetLoadRequest* head = sys.completedLoads.load(std::memory_order_relaxed);
+    do
+    {
+        req->next = head;
+    }
+    while(!sys.completedLoads.compare_exchange_weak(head, req, std::memory_order_release, std::memory_order_relaxed));
+}
+
+static AssetHandle AcquireAssetAsync(AssetKind kind, String path)
+{
+    auto& sys = assetSystem;
+    bool newAsset = false;
+    AssetHandle handle = AcquireAsset(kind, path, &newAsset);
+    if(!newAsset) return handle;
+    
+    Asset* asset = GetAsset(kind, handle);
+    
+    // Show the default asset until the real one is uploaded
+    Asset& defaultAsset = sys.defaultAssets[kind];
+    switch(kind)
+    {
+        default: assert(false); break;
+        case Asset_Mesh:      asset->mesh = defaultAsset.mesh;           break;
+        case Asset_Texture2D: asset->texture2D = defaultAsset.texture2D; break;
+    }
+    asset->isLoading = true;
+    
+    auto req = (AssetLoadRequest*)malloc(sizeof(AssetLoadRequest));
+    *req = {};
+    req->kind = kind;
+    req->handle = handle;
+    req->path = ToCString(path);
+    PushJob(AssetLoadJob, req, &sys.loadCounter);
+    return handle;
+}
+
+MeshHandle AcquireMeshAsync(String path)
+{
+    // No workers to load on besides the main thread (worker 0),
+    // which never runs jobs unless it waits on them
+    if(GetNumWorkers() <= 1) return AcquireMesh(path);
+    
+    return {AcquireAssetAsync(Asset_Mesh, path)};
+}
+
+Texture2DHandle AcquireTexture2DAsync(String path)
+{
+    if(GetNumWorkers() <= 1) return AcquireTexture2D(path);
+    
+    return {AcquireAssetAsync(Asset_Texture2D, path)};
+}
+
+// Material files are small and are parsed right away,
+// the textures they reference are loaded asynchronously
+MaterialHandle AcquireMaterialAsync(String path)
+{
+    bool newAsset = false;
+    AssetHandle handle = AcquireAsset(Asset_Material, path, &newAsset);
+    bool ok = true;
+    if(newAsset)
+    {
+        auto asset = LoadMaterial(path, &ok, true);
+        GetAsset(Asset_Material, handle)->material = asset;
+    }
+    return {handle};
+}
+
+MeshHandle AcquireMeshAsync(const char* path)           { return AcquireMeshAsync(ToLenStr(path));      }
+MaterialHandle AcquireMaterialAsync(const char* path)   { return AcquireMaterialAsync(ToLenStr(path));  }
+Texture2DHandle AcquireTexture2DAsync(const char* path) { return AcquireTexture2DAsync(ToLenStr(path)); }
+
+// Uploads the decoded data to the GPU and frees the request
+static void FinishAssetLoad(AssetLoadRequest* req)
+{
+    auto& sys = assetSystem;
+    defer
+    {
+        if(req->file.ptr) UnmapAssetFile(req->file);
+        if(req->pixels) stbi_image_free(req->pixels);
+        free(req->path);
+        free(req);
+    };
+    
+    // The asset could have been released in the meantime
+    Asset* asset = Lookup(&sys.assets, {.id=req->handle.slot, .gen=req->handle.gen});
+    if(!asset) return;
+    
+    asset->isLoading = false;
+    if(req->error)
+    {
+        Log("Failed to load '%s': %s.", req->path, req->error);
+        asset->isLoaded = false;
+        return;
+    }
+    
+    switch(req->kind)
+    {
+        default: assert(false); break;
+        case Asset_Mesh:
+        {
+            asset->mesh = StaticMeshAlloc(req->mesh);
+            ++sys.meshLoadCount;
+            break;
+        }
+        case Asset_Texture2D:
+        {
+            asset->texture2D = R_Texture2DAlloc(TextureFormat_RGBA_SRGB, req->width, req->height, req->pixels);
+            break;
+        }
+    }
+    
+    asset->isLoaded = true;
+}
+
+// Moves all finished loads to the upload queue, oldest first
+static void CollectCompletedLoads()
+{
+    auto& sys = assetSystem;
+    AssetLoadRequest* list = sys.completedLoads.exchange(nullptr, std::memory_order_acquire);
+    
+    // The list is in reverse completion order
+    s64 start = sys.pendingUploads.len;
+    for(AssetLoadRequest* req = list; req; req = req->next)
+        Append(&sys.pendingUploads, req);
+    
+    for(s64 i = start, j = sys.pendingUploads.len - 1; i < j; ++i, --j)
+    {
+        AssetLoadRequest* tmp = sys.pendingUploads[i];
+        sys.pendingUploads[i] = sys.pendingUploads[j];
+        sys.pendingUploads[j] = tmp;
+    }
+}
+
+void ProcessAssetLoads(double timeBudget)
+{
+    auto& sys = assetSystem;
+    CollectCompletedLoads();
+    
+    uint64_t start = OS_GetTicks();
+    s64 numUploaded = 0;
+    while(numUploaded < sys.pendingUploads.len)
+    {
+        FinishAssetLoad(sys.pendingUploads[numUploaded]);
+        ++numUploaded;
+        
+        double elapsed = OS_GetElapsedSeconds(start, OS_GetTicks());
+        if(elapsed >= timeBudget) break;
+    }
+    
+    // Shift the remaining ones to the front
+    s64 numRemaining = sys.pendingUploads.len - numUploaded;
+    if(numRemaining > 0)
+        memmove(sys.pendingUploads.ptr, sys.pendingUploads.ptr + numUploaded, numRemaining * sizeof(AssetLoadRequest*));
+    sys.pendingUploads.len = numRemaining;
+}
+
+void WaitAssetLoads()
+{
+    auto& sys = assetSystem;
+    if(GetNumWorkers() > 1) WaitJobs(&sys.loadCounter);
+    
+    CollectCompletedLoads();
+    for(int i = 0; i < sys.pendingUploads.len; ++i)
+        FinishAssetLoad(sys.pendingUploads[i]);
+    sys.pendingUploads.len = 0;
+}
+
+u32 GetMeshLoadCount()
+{
+    return assetSystem.meshLoadCount;
+}
+
 #if 0
 
 void LoadCubemap(R_Texture* cubemap, String path)
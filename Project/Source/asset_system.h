@@ -20,7 +20,9 @@ enum AssetKind
     Asset_Count
 };
 
-struct AssetHandle { u32 slot; };
+// Zero initialized handles are invalid, and handles to
+// released assets are detected thanks to the generation
+struct AssetHandle { u32 slot; u32 gen; };
 
 // These are type-safe typedefs
 struct MeshHandle        : public AssetHandle {};
@@ -40,8 +42,9 @@ struct Material
 
 struct Asset
 {
-    u32 slot;  // For debugging
+    AssetHandle handle;  // For debugging
     AssetKind kind;
+    String path;  // Owned by the asset, used to remove it from the path mapping
     // The content is set to the default asset if loading was unsuccessful
     union
     {
@@ -53,21 +56,64 @@ struct Asset
     };
     
     bool isLoaded;  // False if using a default asset because of a loading error
+    bool isLoading;  // True while an async load is in flight, the content is the default asset
+};
+
+// Result of an async load, produced by a worker thread
+// and consumed on the main thread by ProcessAssetLoads
+struct AssetLoadRequest
+{
+    AssetKind kind;
+    AssetHandle handle;
+    char* path;  // Owned by the request
+    
+    // Filled in by the worker
+    const char* error;  // Null on success
+    String file;  // Mapped file, kept until the upload if the data points into it
+    StaticMeshInput mesh;
+    void* pixels;
+    int width, height;
+    
+    AssetLoadRequest* next;
+};
+
+// Archive containing many asset files, mapped once.
+// See serialization.h for the format
+struct AssetPack
+{
+    String file;  // Empty if no pack is mounted
+    PackHeader header;
+    PackEntry* toc;
+    const char* paths;
 };
 
 struct AssetSystem
 {
-    Array<Asset> assets;
-    Array<u32>   freeSlots;
+    SlotMap<Asset> assets;
     Asset defaultAssets[Asset_Count];
     
-    struct MapValue { AssetKind kind; u32 slot; };
+    struct MapValue { AssetKind kind; AssetHandle handle; };
     StringMap<MapValue> pathMapping;
+    
+    AssetPack pack;
+    
+    // Async loading
+    JobCounter loadCounter;
+    std::atomic<AssetLoadRequest*> completedLoads;  // Pushed by workers, taken all at once by the main thread
+    Array<AssetLoadRequest*> pendingUploads;        // In completion order, main thread only
+    u32 meshLoadCount;
 };
 
 void AssetSystemInit();
 
+// Once mounted, assets are read from the pack. Files which are not in the pack are
+// read from the Assets folder in Development builds (or if no pack is mounted)
+bool MountAssetPack(String path);
+bool MountAssetPack(const char* path);
+void UnmountAssetPack();
+
 // Templatizing it is impossible (or very convoluted), trust me
+// These return the default asset if the handle is not valid
 Mesh*        GetAsset(MeshHandle handle);
 R_Shader*    GetAsset(VertShaderHandle handle);
 R_Shader*    GetAsset(PixelShaderHandle handle);
@@ -89,6 +135,26 @@ MaterialHandle AcquireMaterial(const char* path);
 Texture2DHandle AcquireTexture2D(const char* path);
 CubemapHandle AcquireCubemap(const char* path);
 
+// Async versions of the above. The handle is returned right away and
+// refers to the default asset until the file has been read and decoded
+// by a worker and uploaded by ProcessAssetLoads. Must be called from the main thread.
+MeshHandle AcquireMeshAsync(String path);
+MaterialHandle AcquireMaterialAsync(String path);
+Texture2DHandle AcquireTexture2DAsync(String path);
+
+MeshHandle AcquireMeshAsync(const char* path);
+MaterialHandle AcquireMaterialAsync(const char* path);
+Texture2DHandle AcquireTexture2DAsync(const char* path);
+
+// Performs the GPU uploads of finished async loads. To be called once per
+// frame; stops when timeBudget (in seconds) is exceeded, but always uploads at least one
+void ProcessAssetLoads(double timeBudget);
+// Blocks until all async loads in flight are finished and uploaded
+void WaitAssetLoads();
+// Incremented every time an async mesh load is uploaded, which
+// changes the bounds of the mesh without changing its handle
+u32 GetMeshLoadCount();
+
 // Hot reloading. To be performed once per frame or once per few frames
 void HotReloadAssets(Arena* frameArena);
 
@@ -402,30 +402,71 @@ Mat3 ToMat3(const Mat4& mat)
     return res;
 }
 
-// @speed
-Mat4& operator *=(Mat4& m1, Mat4 m2)
+// Result rows are linear combinations of the rows of m2. The additions
+// happen in the same order as the scalar definition (and no FMA is used),
+// so the results match it exactly, other than the sign of zeros.
+// res can alias m1 and/or m2.
+static inline void Mat4MulSimd(const Mat4& m1, const Mat4& m2, Mat4* res)
+{
+#ifdef __AVX2__
+    // Two result rows at a time
+    __m256 b0 = _mm256_broadcast_ps(&m2.rowsSimd[0]);
+    __m256 b1 = _mm256_broadcast_ps(&m2.rowsSimd[1]);
+    __m256 b2 = _mm256_broadcast_ps(&m2.rowsSimd[2]);
+    __m256 b3 = _mm256_broadcast_ps(&m2.rowsSimd[3]);
+    // Rows are loaded separately: matrices are mostly written one row at a
+    // time, and a 256-bit load of two rows just written can't be forwarded
+    __m256 a01 = _mm256_setr_m128(m1.rowsSimd[0], m1.rowsSimd[1]);
+    __m256 a23 = _mm256_setr_m128(m1.rowsSimd[2], m1.rowsSimd[3]);
+    
+    __m256 r01 =                _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0x55), b1));
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0xAA), b2));
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0xFF), b3));
+    __m256 r23 =                _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0);
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0x55), b1));
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0xAA), b2));
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0xFF), b3));
+    
+    _mm256_storeu_ps(&res->m[0][0], r01);
+    _mm256_storeu_ps(&res->m[2][0], r23);
+#else
+    __m128 b0 = m2.rowsSimd[0];
+    __m128 b1 = m2.rowsSimd[1];
+    __m128 b2 = m2.rowsSimd[2];
+    __m128 b3 = m2.rowsSimd[3];
+    for(int i = 0; i < 4; ++i)
+    {
+        __m128 a = m1.rowsSimd[i];
+        __m128 r =            _mm_mul_ps(VecSwizzle1(a, 0), b0);
+        r = _mm_add_ps(r, _mm_mul_ps(VecSwizzle1(a, 1), b1));
+        r = _mm_add_ps(r, _mm_mul_ps(VecSwizzle1(a, 2), b2));
+        r = _mm_add_ps(r, _mm_mul_ps(VecSwizzle1(a, 3), b3));
+        res->rowsSimd[i] = r;
+    }
+#endif
+}
+
+Mat4& operator *=(Mat4& m1, const Mat4& m2)
 {
-    m1 = m1 * m2;
+    Mat4MulSimd(m1, m2, &m1);
     return m1;
 }
 
 Mat4 operator *(const Mat4& m1, const Mat4& m2)
 {
     Mat4 res;
-    for(int i = 0; i < 4; ++i)
-    {
-        for(int j = 0; j < 4; ++j)
-        {
-            res.m[i][j] = 0.0f;
-            
-            for(int k = 0; k < 4; ++k)
-                res.m[i][j] += m1.m[i][k] * m2.m[k][j];
-        }
-    }
-    
+    Mat4MulSimd(m1, m2, &res);
     return res;
 }
 
+void Mat4Multiply(Slice<Mat4> dst, Slice<Mat4> a, Slice<Mat4> b)
+{
+    assert(dst.len == a.len && dst.len == b.len);
+    for(int64_t i = 0; i < dst.len; ++i)
+        Mat4MulSimd(a.ptr[i], b.ptr[i], &dst.ptr[i]);
+}
+
 Mat4 transpose(const Mat4& m)
 {
     Mat4 res
@@ -505,7 +546,49 @@ Quat operator *(Quat a, Quat b)
     return res;
 }
 
-// Rotates vector along quaternion
+// Rows of the rotation matrix of q, which is loaded as (w, x, y, z).
+// This does the same operations as the scalar formula, i.e. 1 - (yy + zz),
+// xy - wz, etc., so that results are bit-exact. The 4th component of every row is 0.
+static inline void QuatToRowsSimd(__m128 q, __m128* row0, __m128* row1, __m128* row2)
+{
+    const int w = 0, x = 1, y = 2, z = 3;
+    __m128 q2 = _mm_add_ps(q, q);
+    
+    // (yy+zz, xy-wz, xz+wy)
+    __m128 s0 = _mm_add_ps(_mm_mul_ps(VecSwizzle(q, y, x, x, w), VecSwizzle(q2, y, y, z, w)),
+                           _mm_mul_ps(_mm_mul_ps(VecSwizzle(q, z, w, w, w), VecSwizzle(q2, z, z, y, w)), _mm_setr_ps(1, -1, 1, 0)));
+    // (xy+wz, xx+zz, yz-wx)
+    __m128 s1 = _mm_add_ps(_mm_mul_ps(VecSwizzle(q, x, x, y, w), VecSwizzle(q2, y, x, z, w)),
+                           _mm_mul_ps(_mm_mul_ps(VecSwizzle(q, w, z, w, w), VecSwizzle(q2, z, z, x, w)), _mm_setr_ps(1, 1, -1, 0)));
+    // (xz-wy, yz+wx, xx+yy)
+    __m128 s2 = _mm_add_ps(_mm_mul_ps(VecSwizzle(q, x, y, x, w), VecSwizzle(q2, z, z, x, w)),
+                           _mm_mul_ps(_mm_mul_ps(VecSwizzle(q, w, w, y, w), VecSwizzle(q2, y, x, y, w)), _mm_setr_ps(-1, 1, 1, 0)));
+    
+    s0 = _mm_mul_ps(s0, _mm_setr_ps(-1, 1, 1, 0));
+    s1 = _mm_mul_ps(s1, _mm_setr_ps(1, -1, 1, 0));
+    s2 = _mm_mul_ps(s2, _mm_setr_ps(1, 1, -1, 0));
+    
+    // Diagonal: 1 - (..)
+    __m128 one = _mm_set1_ps(1.0f);
+    *row0 = _mm_blend_ps(s0, _mm_add_ps(s0, one), 0b0001);
+    *row1 = _mm_blend_ps(s1, _mm_add_ps(s1, one), 0b0010);
+    *row2 = _mm_blend_ps(s2, _mm_add_ps(s2, one), 0b0100);
+}
+
+// Same operations as normalize(Quat), i.e. x*x + y*y + z*z + w*w in this
+// order, so that results are bit-exact. q is loaded as (w, x, y, z)
+static inline __m128 QuatNormalizeSimd(__m128 q)
+{
+    __m128 sq = _mm_mul_ps(q, q);
+    __m128 sum = _mm_add_ss(VecSwizzle1(sq, 1), VecSwizzle1(sq, 2));
+    sum = _mm_add_ss(sum, VecSwizzle1(sq, 3));
+    sum = _mm_add_ss(sum, sq);
+    return _mm_div_ps(q, VecSwizzle1(_mm_sqrt_ss(sum), 0));
+}
+
+// Rotates vector along quaternion. This stays scalar: for a single vector
+// the SSE version was slower, since the rows have to be transposed
+// (see utils/math_benchmark.cpp)
 Vec3 operator *(Quat q, Vec3 v)
 {
     float num   = q.x * 2.0f;
@@ -664,19 +747,9 @@ Quat FromToRotation(Vec3 from, Vec3 to)
 
 Mat4 RotationMatrix(Quat q)
 {
-    float x = q.x * 2.0f; float y = q.y * 2.0f; float z = q.z * 2.0f;
-    float xx = q.x * x;   float yy = q.y * y;   float zz = q.z * z;
-    float xy = q.x * y;   float xz = q.x * z;   float yz = q.y * z;
-    float wx = q.w * x;   float wy = q.w * y;   float wz = q.w * z;
-    
-    // Calculate 3x3 matrix from orthonormal basis
-    Mat4 res
-    {
-        1.0f - (yy + zz), xy - wz,          xz + wy,          0.0f,
-        xy + wz,          1.0f - (xx + zz), yz - wx,          0.0f,
-        xz - wy,          yz + wx,          1.0f - (xx + yy), 0.0f,
-        0.0f,             0.0f,             0.0f,             1.0f
-    };
+    Mat4 res;
+    QuatToRowsSimd(_mm_loadu_ps(&q.w), &res.rowsSimd[0], &res.rowsSimd[1], &res.rowsSimd[2]);
+    res.rowsSimd[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
     return res;
 }
 
@@ -704,9 +777,249 @@ Mat4 TranslationMatrix(Vec3 pos)
     return res;
 }
 
+// Same as TranslationMatrix(pos) * RotationMatrix(normalize(rot)) * ScaleMatrix(scale),
+// without the matrix multiplications. Every row is the rotation row
+// scaled per column, with the translation in the last column.
+static inline void Mat4FromPosRotScaleSimd(Vec3 pos, Quat rot, Vec3 scale, Mat4* res)
+{
+    __m128 row0, row1, row2;
+    QuatToRowsSimd(QuatNormalizeSimd(_mm_loadu_ps(&rot.w)), &row0, &row1, &row2);
+    
+    __m128 s = _mm_setr_ps(scale.x, scale.y, scale.z, 0.0f);
+    res->rowsSimd[0] = _mm_blend_ps(_mm_mul_ps(row0, s), _mm_set1_ps(pos.x), 0b1000);
+    res->rowsSimd[1] = _mm_blend_ps(_mm_mul_ps(row1, s), _mm_set1_ps(pos.y), 0b1000);
+    res->rowsSimd[2] = _mm_blend_ps(_mm_mul_ps(row2, s), _mm_set1_ps(pos.z), 0b1000);
+    res->rowsSimd[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
 Mat4 Mat4FromPosRotScale(Vec3 pos, Quat rot, Vec3 scale)
 {
-    return TranslationMatrix(pos) * RotationMatrix(normalize(rot)) * ScaleMatrix(scale);
+    Mat4 res;
+    Mat4FromPosRotScaleSimd(pos, rot, scale, &res);
+    return res;
+}
+
+#ifdef __AVX2__
+// Same as QuatToRowsSimd, for two quaternions at a time (one per 128-bit lane)
+static inline void QuatToRowsSimd2(__m256 q, __m256* row0, __m256* row1, __m256* row2)
+{
+    const int w = 0, x = 1, y = 2, z = 3;
+#define VecSwizzle256(vec, x, y, z, w) _mm256_permute_ps(vec, MakeShuffleMask(x, y, z, w))
+#define SetLanes256(x, y, z, w) _mm256_setr_ps(x, y, z, w, x, y, z, w)
+    __m256 q2 = _mm256_add_ps(q, q);
+    
+    __m256 s0 = _mm256_add_ps(_mm256_mul_ps(VecSwizzle256(q, y, x, x, w), VecSwizzle256(q2, y, y, z, w)),
+                              _mm256_mul_ps(_mm256_mul_ps(VecSwizzle256(q, z, w, w, w), VecSwizzle256(q2, z, z, y, w)), SetLanes256(1, -1, 1, 0)));
+    __m256 s1 = _mm256_add_ps(_mm256_mul_ps(VecSwizzle256(q, x, x, y, w), VecSwizzle256(q2, y, x, z, w)),
+                              _mm256_mul_ps(_mm256_mul_ps(VecSwizzle256(q, w, z, w, w), VecSwizzle256(q2, z, z, x, w)), SetLanes256(1, 1, -1, 0)));
+    __m256 s2 = _mm256_add_ps(_mm256_mul_ps(VecSwizzle256(q, x, y, x, w), VecSwizzle256(q2, z, z, x, w)),
+                              _mm256_mul_ps(_mm256_mul_ps(VecSwizzle256(q, w, w, y, w), VecSwizzle256(q2, y, x, y, w)), SetLanes256(-1, 1, 1, 0)));
+    
+    s0 = _mm256_mul_ps(s0, SetLanes256(-1, 1, 1, 0));
+    s1 = _mm256_mul_ps(s1, SetLanes256(1, -1, 1, 0));
+    s2 = _mm256_mul_ps(s2, SetLanes256(1, 1, -1, 0));
+    
+    __m256 one = _mm256_set1_ps(1.0f);
+    *row0 = _mm256_blend_ps(s0, _mm256_add_ps(s0, one), 0b00010001);
+    *row1 = _mm256_blend_ps(s1, _mm256_add_ps(s1, one), 0b00100010);
+    *row2 = _mm256_blend_ps(s2, _mm256_add_ps(s2, one), 0b01000100);
+#undef VecSwizzle256
+#undef SetLanes256
+}
+#endif
+
+void Mat4FromTransforms(Slice<Mat4> dst, Slice<Transform> src)
+{
+    assert(dst.len == src.len);
+    
+    int64_t i = 0;
+#ifdef __AVX2__
+    // Two transforms at a time
+    for(; i + 1 < src.len; i += 2)
+    {
+        Transform& t0 = src.ptr[i];
+        Transform& t1 = src.ptr[i+1];
+        __m128 rot0 = QuatNormalizeSimd(_mm_loadu_ps(&t0.rotation.w));
+        __m128 rot1 = QuatNormalizeSimd(_mm_loadu_ps(&t1.rotation.w));
+        
+        __m256 row0, row1, row2;
+        QuatToRowsSimd2(_mm256_setr_m128(rot0, rot1), &row0, &row1, &row2);
+        
+        __m256 s = _mm256_setr_ps(t0.scale.x, t0.scale.y, t0.scale.z, 0.0f, t1.scale.x, t1.scale.y, t1.scale.z, 0.0f);
+        row0 = _mm256_blend_ps(_mm256_mul_ps(row0, s), _mm256_setr_m128(_mm_set1_ps(t0.position.x), _mm_set1_ps(t1.position.x)), 0b10001000);
+        row1 = _mm256_blend_ps(_mm256_mul_ps(row1, s), _mm256_setr_m128(_mm_set1_ps(t0.position.y), _mm_set1_ps(t1.position.y)), 0b10001000);
+        row2 = _mm256_blend_ps(_mm256_mul_ps(row2, s), _mm256_setr_m128(_mm_set1_ps(t0.position.z), _mm_set1_ps(t1.position.z)), 0b10001000);
+        
+        Mat4& m0 = dst.ptr[i];
+        Mat4& m1 = dst.ptr[i+1];
+        m0.rowsSimd[0] = _mm256_castps256_ps128(row0);
+        m0.rowsSimd[1] = _mm256_castps256_ps128(row1);
+        m0.rowsSimd[2] = _mm256_castps256_ps128(row2);
+        m0.rowsSimd[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        m1.rowsSimd[0] = _mm256_extractf128_ps(row0, 1);
+        m1.rowsSimd[1] = _mm256_extractf128_ps(row1, 1);
+        m1.rowsSimd[2] = _mm256_extractf128_ps(row2, 1);
+        m1.rowsSimd[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+#endif
+    
+    for(; i < src.len; ++i)
+    {
+        Transform& t = src.ptr[i];
+        Mat4FromPosRotScaleSimd(t.position, t.rotation, t.scale, &dst.ptr[i]);
+    }
+}
+
+// With one register per component, each lane is a different transform,
+// so the formulas are the scalar ones (normalize, then RotationMatrix)
+// and give the same results. The columns of each row are then transposed
+// into the rows of the destination matrices.
+#ifdef __AVX2__
+static inline void StoreRows8(Mat4* dst, int row, __m256 c0, __m256 c1, __m256 c2, __m256 c3)
+{
+    __m256 t0 = _mm256_unpacklo_ps(c0, c1);
+    __m256 t1 = _mm256_unpackhi_ps(c0, c1);
+    __m256 t2 = _mm256_unpacklo_ps(c2, c3);
+    __m256 t3 = _mm256_unpackhi_ps(c2, c3);
+    
+    // Matrices 0-3 are in the low 128-bit lane, 4-7 in the high one
+    __m256 r04 = _mm256_shuffle_ps(t0, t2, MakeShuffleMask(0, 1, 0, 1));
+    __m256 r15 = _mm256_shuffle_ps(t0, t2, MakeShuffleMask(2, 3, 2, 3));
+    __m256 r26 = _mm256_shuffle_ps(t1, t3, MakeShuffleMask(0, 1, 0, 1));
+    __m256 r37 = _mm256_shuffle_ps(t1, t3, MakeShuffleMask(2, 3, 2, 3));
+    dst[0].rowsSimd[row] = _mm256_castps256_ps128(r04);
+    dst[1].rowsSimd[row] = _mm256_castps256_ps128(r15);
+    dst[2].rowsSimd[row] = _mm256_castps256_ps128(r26);
+    dst[3].rowsSimd[row] = _mm256_castps256_ps128(r37);
+    dst[4].rowsSimd[row] = _mm256_extractf128_ps(r04, 1);
+    dst[5].rowsSimd[row] = _mm256_extractf128_ps(r15, 1);
+    dst[6].rowsSimd[row] = _mm256_extractf128_ps(r26, 1);
+    dst[7].rowsSimd[row] = _mm256_extractf128_ps(r37, 1);
+}
+
+static inline void Mat4FromTransformLanes8(Mat4* dst, const TransformLanes& src, int64_t i)
+{
+    __m256 w = _mm256_loadu_ps(src.rotW + i);
+    __m256 x = _mm256_loadu_ps(src.rotX + i);
+    __m256 y = _mm256_loadu_ps(src.rotY + i);
+    __m256 z = _mm256_loadu_ps(src.rotZ + i);
+    
+    __m256 mag = _mm256_mul_ps(x, x);
+    mag = _mm256_add_ps(mag, _mm256_mul_ps(y, y));
+    mag = _mm256_add_ps(mag, _mm256_mul_ps(z, z));
+    mag = _mm256_add_ps(mag, _mm256_mul_ps(w, w));
+    mag = _mm256_sqrt_ps(mag);
+    w = _mm256_div_ps(w, mag);
+    x = _mm256_div_ps(x, mag);
+    y = _mm256_div_ps(y, mag);
+    z = _mm256_div_ps(z, mag);
+    
+    __m256 x2 = _mm256_add_ps(x, x);
+    __m256 y2 = _mm256_add_ps(y, y);
+    __m256 z2 = _mm256_add_ps(z, z);
+    __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+    __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+    __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+    
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 sx = _mm256_loadu_ps(src.scaleX + i);
+    __m256 sy = _mm256_loadu_ps(src.scaleY + i);
+    __m256 sz = _mm256_loadu_ps(src.scaleZ + i);
+    StoreRows8(dst, 0, _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+                       _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+                       _mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+                       _mm256_loadu_ps(src.posX + i));
+    StoreRows8(dst, 1, _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+                       _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+                       _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+                       _mm256_loadu_ps(src.posY + i));
+    StoreRows8(dst, 2, _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+                       _mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+                       _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+                       _mm256_loadu_ps(src.posZ + i));
+    for(int j = 0; j < 8; ++j)
+        dst[j].rowsSimd[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+}
+#endif
+
+static inline void Mat4FromTransformLanes4(Mat4* dst, const TransformLanes& src, int64_t i)
+{
+    __m128 w = _mm_loadu_ps(src.rotW + i);
+    __m128 x = _mm_loadu_ps(src.rotX + i);
+    __m128 y = _mm_loadu_ps(src.rotY + i);
+    __m128 z = _mm_loadu_ps(src.rotZ + i);
+    
+    __m128 mag = _mm_mul_ps(x, x);
+    mag = _mm_add_ps(mag, _mm_mul_ps(y, y));
+    mag = _mm_add_ps(mag, _mm_mul_ps(z, z));
+    mag = _mm_add_ps(mag, _mm_mul_ps(w, w));
+    mag = _mm_sqrt_ps(mag);
+    w = _mm_div_ps(w, mag);
+    x = _mm_div_ps(x, mag);
+    y = _mm_div_ps(y, mag);
+    z = _mm_div_ps(z, mag);
+    
+    __m128 x2 = _mm_add_ps(x, x);
+    __m128 y2 = _mm_add_ps(y, y);
+    __m128 z2 = _mm_add_ps(z, z);
+    __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+    __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+    __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+    
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sx = _mm_loadu_ps(src.scaleX + i);
+    __m128 sy = _mm_loadu_ps(src.scaleY + i);
+    __m128 sz = _mm_loadu_ps(src.scaleZ + i);
+    __m128 rows[3][4] =
+    {
+        {
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+            _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+            _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+            _mm_loadu_ps(src.posX + i)
+        },
+        {
+            _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+            _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+            _mm_loadu_ps(src.posY + i)
+        },
+        {
+            _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+            _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+            _mm_loadu_ps(src.posZ + i)
+        }
+    };
+    
+    for(int r = 0; r < 3; ++r)
+    {
+        _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+        for(int j = 0; j < 4; ++j)
+            dst[j].rowsSimd[r] = rows[r][j];
+    }
+    
+    for(int j = 0; j < 4; ++j)
+        dst[j].rowsSimd[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void Mat4FromTransforms(Slice<Mat4> dst, const TransformLanes& src)
+{
+    int64_t i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= dst.len; i += 8)
+        Mat4FromTransformLanes8(dst.ptr + i, src, i);
+#endif
+    for(; i + 4 <= dst.len; i += 4)
+        Mat4FromTransformLanes4(dst.ptr + i, src, i);
+    
+    for(; i < dst.len; ++i)
+    {
+        Vec3 pos   = {.x=src.posX[i], .y=src.posY[i], .z=src.posZ[i]};
+        Quat rot   = {.w=src.rotW[i], .x=src.rotX[i], .y=src.rotY[i], .z=src.rotZ[i]};
+        Vec3 scale = {.x=src.scaleX[i], .y=src.scaleY[i], .z=src.scaleZ[i]};
+        Mat4FromPosRotScaleSimd(pos, rot, scale, &dst.ptr[i]);
+    }
 }
 
 void PosRotScaleFromMat4(Mat4 m, Vec3* pos, Quat* rot, Vec3* scale)
@@ -1039,9 +1352,9 @@ inline void Append(StringBuilder* builder, char c)
 
 void Append(StringBuilder* builder, String str)
 {
-    int32_t oldLen = builder->str.len;
-    int32_t newLen = oldLen + (int32_t)str.len;
-    int32_t oldCapacity = builder->str.capacity;
+    int64_t oldLen = builder->str.len;
+    int64_t newLen = oldLen + str.len;
+    int64_t oldCapacity = builder->str.capacity;
     
     if(newLen > builder->str.capacity)
         builder->str.capacity = NextPowerOf2(max(oldCapacity + 1, newLen) + 1);
@@ -1068,9 +1381,9 @@ void AppendFmt(StringBuilder* builder, const char* fmt, ...)
     // this instead. TODO: Might just want to implement my own printf
     // since it's so limited.
     int len = vsnprintf(nullptr, 0, fmt, args);
-    int oldLen = builder->str.len;
-    int newLen = oldLen + len;
-    int oldCapacity = builder->str.capacity;
+    int64_t oldLen = builder->str.len;
+    int64_t newLen = oldLen + len;
+    int64_t oldCapacity = builder->str.capacity;
     
     // Do not call Append to avoid extra allocation
     if(newLen > builder->str.capacity)
@@ -1097,9 +1410,9 @@ template<typename t>
 void Put(StringBuilder* builder, t val)
 {
     uintptr_t offset = AlignForward((uintptr_t)(builder->str.ptr + builder->str.len), alignof(t)) - (uintptr_t)(void*)builder->str.ptr;
-    int oldLen = builder->str.len;
-    int newLen = (int)offset + sizeof(t);
-    int oldCapacity = builder->str.capacity;
+    int64_t oldLen = builder->str.len;
+    int64_t newLen = (int64_t)(offset + sizeof(t));
+    int64_t oldCapacity = builder->str.capacity;
     
     // TODO Duplicated code here
     if(newLen > builder->str.capacity)
@@ -1118,7 +1431,7 @@ void Put(StringBuilder* builder, t val)
     
     // Write the value in the address
     memset(&builder->str[oldLen], 0, newLen-oldLen);
-    t* addr = (t*)&builder->str[(int)offset];
+    t* addr = (t*)&builder->str[(int64_t)offset];
     *addr = val;
 }
 
@@ -1126,9 +1439,9 @@ template<typename t>
 void PutSlice(StringBuilder* builder, Slice<t> slice)
 {
     uintptr_t offset = AlignForward((uintptr_t)(builder->str.ptr + builder->str.len), alignof(t)) - (uintptr_t)(void*)builder->str.ptr;
-    int oldLen = builder->str.len;
-    int newLen = (int)offset + sizeof(t) * slice.len;
-    int oldCapacity = builder->str.capacity;
+    int64_t oldLen = builder->str.len;
+    int64_t newLen = (int64_t)(offset + sizeof(t) * slice.len);
+    int64_t oldCapacity = builder->str.capacity;
     
     // TODO Duplicated code here
     if(newLen > builder->str.capacity)
@@ -1147,7 +1460,7 @@ void PutSlice(StringBuilder* builder, Slice<t> slice)
     
     // Write the value in the address
     memset(&builder->str[oldLen], 0, newLen-oldLen);
-    t* addr = (t*)&builder->str[(int)offset];
+    t* addr = (t*)&builder->str[(int64_t)offset];
     memcpy(addr, slice.ptr, sizeof(t) * slice.len);
 }
 
@@ -1210,11 +1523,10 @@ void UseArena(Array<t>* array, Arena* arena)
 }
 
 template<typename t>
-void Resize(Array<t>* array, int newSize)
+void Resize(Array<t>* array, int64_t newSize)
 {
-    int oldLen = array->len;
-    int newLen = newSize;
-    int oldCapacity = array->capacity;
+    int64_t newLen = newSize;
+    int64_t oldCapacity = array->capacity;
     
     if(newLen > array->capacity)
         array->capacity = NextPowerOf2(max(oldCapacity + 1, newLen) + 1);
@@ -1231,15 +1543,15 @@ void Resize(Array<t>* array, int newSize)
 }
 
 template<typename t>
-void ResizeExact(Array<t>* array, int newSize)
+void ResizeExact(Array<t>* array, int64_t newSize)
 {
     array->len = newSize;
-    int oldCapacity = array->capacity;
+    int64_t oldCapacity = array->capacity;
     array->capacity = newSize;
     
     t* newPtr = nullptr;
     if(array->arena)
-        newPtr = (t*)ArenaResizeLastAlloc(array->arena, array->ptr, oldCapacity, array->capacity, alignof(t));
+        newPtr = (t*)ArenaResizeLastAlloc(array->arena, array->ptr, oldCapacity*sizeof(t), array->capacity*sizeof(t), alignof(t));
     else
         newPtr = (t*)realloc(array->ptr, array->capacity*sizeof(t));
     
@@ -1249,9 +1561,9 @@ void ResizeExact(Array<t>* array, int newSize)
 template<typename t>
 void Append(Array<t>* array, t el)
 {
-    int oldLen = array->len;
-    int newLen = oldLen + 1;
-    int oldCapacity = array->capacity;
+    int64_t oldLen = array->len;
+    int64_t newLen = oldLen + 1;
+    int64_t oldCapacity = array->capacity;
     
     if(newLen > array->capacity)
         array->capacity = NextPowerOf2(max(oldCapacity + 1, newLen) + 1);
@@ -1284,7 +1596,7 @@ Slice<t> ToSlice(Array<t>* array)
 template<typename t, size_t n>
 Slice<t> ToSlice(std::array<t, n>& array)
 {
-    return Slice<t>{array.data(), static_cast<int>(n)};
+    return Slice<t>{array.data(), static_cast<int64_t>(n)};
 }
 
 template<typename t>
@@ -1303,30 +1615,149 @@ void Free(Array<t>* array)
     array->capacity = 0;
 }
 
-// This is SipHash. Maybe there's a better hash function?
-u64 SipHash(String str, u64 seed)
+// Processes 16 bytes per step with SSE2, using the same accumulation
+// step as XXH3 (https://github.com/Cyan4973/xxHash), then mixes the
+// two lanes with the Murmur3 64 bit finalizer.
+static inline __m128i HashStringAccumulate(__m128i acc, __m128i data, __m128i key)
 {
-    size_t hash = seed;
-    for(int i = 0; i < str.len; ++i)
-        hash = RotateLeft(hash, 9) + (unsigned char) str[i];
+    __m128i dataKey = _mm_xor_si128(data, key);
+    __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+    __m128i product = _mm_mul_epu32(dataKey, dataKeyHi);
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm_add_epi64(acc, _mm_add_epi64(product, swapped));
+}
+
+u64 HashString(String str, u64 seed)
+{
+    const u64 prime1 = 0x9E3779B185EBCA87ULL;
+    const u64 prime2 = 0xC2B2AE3D27D4EB4FULL;
+    const u64 prime3 = 0x165667B19E3779F9ULL;
+    
+    const u8* data = (const u8*)str.ptr;
+    s64 len = str.len;
+    
+    __m128i key0 = _mm_set_epi64x((s64)(seed ^ prime1), (s64)(seed + prime2));
+    __m128i key1 = _mm_set_epi64x((s64)(seed - prime3), (s64)(seed ^ prime2));
+    __m128i acc0 = _mm_set_epi64x((s64)prime3, (s64)prime1);
+    __m128i acc1 = _mm_set_epi64x((s64)prime2, (s64)prime3);
+    
+    while(len >= 32)
+    {
+        acc0 = HashStringAccumulate(acc0, _mm_loadu_si128((__m128i*)data),        key0);
+        acc1 = HashStringAccumulate(acc1, _mm_loadu_si128((__m128i*)(data + 16)), key1);
+        data += 32;
+        len  -= 32;
+    }
+    
+    if(len >= 16)
+    {
+        acc0 = HashStringAccumulate(acc0, _mm_loadu_si128((__m128i*)data), key0);
+        data += 16;
+        len  -= 16;
+    }
     
-    // Thomas Wang 64-to-32 bit mix function, hopefully also works in 32 bits
-    hash ^= seed;
-    hash = (~hash) + (hash << 18);
-    hash ^= hash ^ RotateRight(hash,31);
-    hash = hash * 21;
-    hash ^= hash ^ RotateRight(hash,11);
-    hash += (hash << 6);
-    hash ^= RotateRight(hash,22);
-    return hash+seed;
+    if(len > 0)
+    {
+        alignas(16) u8 tail[16] = {0};
+        memcpy(tail, data, len);
+        acc1 = HashStringAccumulate(acc1, _mm_load_si128((__m128i*)tail), key1);
+    }
+    
+    __m128i acc = _mm_xor_si128(acc0, _mm_shuffle_epi32(acc1, _MM_SHUFFLE(1, 0, 3, 2)));
+    u64 lo = (u64)_mm_cvtsi128_si64(acc);
+    u64 hi = (u64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+    
+    u64 hash = lo ^ ((hi << 29) | (hi >> 35)) ^ ((u64)str.len * prime1);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
 }
 
-static u64 mapSizes[] =
+static u64 StringMapHash(String key)
 {
-    31, 67, 131, 257, 521, 1031,
-    2053, 4099, 8192, 16411, 32771,
-    65617,
-};
+    u64 hash = HashString(key);
+    return hash != 0 ? hash : 1;  // 0 is reserved for empty slots
+}
+
+// Returns -1 if not found
+template<typename t>
+static s64 StringMapFind(Slice<StringMapSlot<t>> slots, String key, u64 hash)
+{
+    if(slots.len <= 0) return -1;
+    
+    u64 mask = (u64)slots.len - 1;
+    u64 idx = hash & mask;
+    while(slots.ptr[idx].hash != 0)
+    {
+        auto& slot = slots.ptr[idx];
+        if(slot.hash == hash && !slot.dead && slot.key == key)
+            return (s64)idx;
+        
+        idx = (idx + 1) & mask;
+    }
+    
+    return -1;
+}
+
+// Key is assumed to not be present already
+template<typename t>
+static void StringMapInsert(Slice<StringMapSlot<t>> slots, String key, const t& value, u64 hash)
+{
+    u64 mask = (u64)slots.len - 1;
+    u64 idx = hash & mask;
+    while(slots.ptr[idx].hash != 0)
+        idx = (idx + 1) & mask;
+    
+    auto& slot = slots.ptr[idx];
+    slot.key   = key;
+    slot.value = value;
+    slot.hash  = hash;
+    slot.dead  = false;
+}
+
+// Moves up to "count" slots from the old table to the new one
+template<typename t>
+static void StringMapMigrate(StringMap<t>* map, s64 count)
+{
+    if(map->oldSlots.len <= 0) return;
+    
+    s64 end = map->migrateIdx + count;
+    if(end > map->oldSlots.len) end = map->oldSlots.len;
+    
+    for(; map->migrateIdx < end; ++map->migrateIdx)
+    {
+        auto& slot = map->oldSlots.ptr[map->migrateIdx];
+        if(slot.hash == 0 || slot.dead) continue;
+        
+        StringMapInsert(map->slots, slot.key, slot.value, slot.hash);
+        slot.dead = true;
+    }
+    
+    if(map->migrateIdx >= map->oldSlots.len)
+    {
+        free(map->oldSlots.ptr);
+        map->oldSlots   = {};
+        map->migrateIdx = 0;
+    }
+}
+
+template<typename t>
+static void StringMapGrow(StringMap<t>* map)
+{
+    // Finish the previous migration first, this is rare
+    // as it needs way fewer operations than it takes to fill
+    // the new table
+    StringMapMigrate(map, map->oldSlots.len);
+    
+    s64 newSize = map->slots.len * 2;
+    map->oldSlots   = map->slots;
+    map->migrateIdx = 0;
+    map->slots.ptr  = (StringMapSlot<t>*)calloc(newSize, sizeof(StringMapSlot<t>));
+    map->slots.len  = newSize;
+}
 
 template<typename t>
 void Append(StringMap<t>* map, String key, const t& value)
@@ -1336,67 +1767,43 @@ void Append(StringMap<t>* map, String key, const t& value)
     if(map->slots.len <= 0)  // Not initialized
     {
         // Allocate the minimum size if empty
-        map->slots.ptr = (StringMapSlot<t>*)calloc(mapSizes[0], sizeof(StringMapSlot<t>));
-        map->slots.len = mapSizes[0];
+        map->slots.ptr = (StringMapSlot<t>*)calloc(StringMapMinSize, sizeof(StringMapSlot<t>));
+        map->slots.len = StringMapMinSize;
         
         // Initialize the arena
         map->stringArena = ArenaVirtualMemInit(GB(4), MB(2));
     }
     
-    u64 hash = SipHash(key);
-    u64 idx = hash % map->slots.len;
+    StringMapMigrate(map, StringMapMigrateStep);
     
-    StringMapSlot<t>* slot = &map->slots[idx];
-    int probeIndex = 1;
-    while(slot->occupied && slot->key != key)
-    {
-        // Quadratic probing
-        idx = (hash + probeIndex * probeIndex) % map->slots.len;
-        slot = &map->slots[idx];
-        ++probeIndex;
-    }
-    
-    bool found = slot->occupied;
-    if(found)
+    u64 hash = StringMapHash(key);
+    s64 idx = StringMapFind(map->slots, key, hash);
+    if(idx != -1)
     {
         // If a slot already exists with this key,
         // simply overwrite its value
-        map->slots[idx].value = value;
+        map->slots.ptr[idx].value = value;
+        return;
     }
-    else
+    
+    s64 oldIdx = StringMapFind(map->oldSlots, key, hash);
+    if(oldIdx != -1)
     {
-        ++map->numOccupied;
-        float loadFactor = ((float)map->numOccupied / map->slots.len);
-        if(loadFactor >= StringMapMaxLoadFactor)
-        {
-            // Allocate bigger buffer
-            StringMap<t> newMap = *map;
-            ++newMap.sizeIdx;
-            assert(newMap.sizeIdx < ArrayCount(mapSizes));
-            u64 newSize = mapSizes[newMap.sizeIdx];
-            newMap.slots.ptr = (StringMapSlot<t>*)calloc(newSize, sizeof(StringMapSlot<t>));
-            newMap.slots.len = newSize;
-            
-            // Rehash all slots
-            for(int i = 0; i < map->slots.len; ++i)
-            {
-                auto& slot = map->slots[i];
-                if(slot.occupied)
-                    Append(&newMap, slot.key, slot.value);
-            }
-            
-            free(map->slots.ptr);
-            *map = newMap;
-        }
-        else
-        {
-            // Allocate string into string storage
-            String newString = ArenaPushString(&map->stringArena, key);
-            map->slots[idx].occupied = true;
-            map->slots[idx].key = newString;
-            map->slots[idx].value = value;
-        }
+        // Not migrated yet, move it now (the key is already allocated)
+        auto& oldSlot = map->oldSlots.ptr[oldIdx];
+        oldSlot.dead = true;
+        StringMapInsert(map->slots, oldSlot.key, value, hash);
+        return;
     }
+    
+    ++map->numOccupied;
+    float loadFactor = (float)map->numOccupied / map->slots.len;
+    if(loadFactor >= StringMapMaxLoadFactor)
+        StringMapGrow(map);
+    
+    // Allocate string into string storage
+    String newString = ArenaPushString(&map->stringArena, key);
+    StringMapInsert(map->slots, newString, value, hash);
 }
 
 template<typename t>
@@ -1408,11 +1815,17 @@ void Append(StringMap<t>* map, const char* key, const t& value)
 template<typename t>
 LookupResult<t> Lookup(StringMap<t>* map, String key)
 {
-    u64 idx = LookupIdx(map, key);
-    // Not found
-    if(idx == -1) return {.res={}, .found = false};
+    if(key.len <= 0 || map->slots.len <= 0) return {.res={}, .found = false};
+    
+    u64 hash = StringMapHash(key);
+    s64 idx = StringMapFind(map->slots, key, hash);
+    if(idx != -1) return {.res=&map->slots.ptr[idx].value, .found = true};
     
-    return {.res=&map->slots[idx].value, .found = true};
+    idx = StringMapFind(map->oldSlots, key, hash);
+    if(idx != -1) return {.res=&map->oldSlots.ptr[idx].value, .found = true};
+    
+    // Not found
+    return {.res={}, .found = false};
 }
 
 template<typename t>
@@ -1422,125 +1835,405 @@ LookupResult<t> Lookup(StringMap<t>* map, const char* key)
 }
 
 template<typename t>
-u64 LookupIdx(StringMap<t>* map, String key)
+void Remove(StringMap<t>* map, String key)
 {
-    if(key.len <= 0 || map->slots.len <= 0) return -1;
+    if(key.len <= 0 || map->slots.len <= 0) return;
     
-    u64 hash = SipHash(key);
-    u64 idx = hash % map->slots.len;
+    StringMapMigrate(map, StringMapMigrateStep);
     
-    StringMapSlot<t>* slot = &map->slots[idx];
-    int probeIndex = 1;
-    while(slot->occupied && slot->key != key)
+    u64 hash = StringMapHash(key);
+    s64 found = StringMapFind(map->slots, key, hash);
+    if(found != -1)
     {
-        // Quadratic probing
-        idx = (hash + probeIndex * probeIndex) % map->slots.len;
-        slot = &map->slots[idx];
-        ++probeIndex;
+        // Backward shift deletion: move back the following elements of
+        // the cluster, as long as the hole is not before their home slot.
+        // The hashes are cached so no string is hashed or compared here
+        u64 mask = (u64)map->slots.len - 1;
+        u64 hole = (u64)found;
+        u64 idx  = (hole + 1) & mask;
+        while(map->slots.ptr[idx].hash != 0)
+        {
+            u64 home = map->slots.ptr[idx].hash & mask;
+            if(((idx - home) & mask) >= ((idx - hole) & mask))
+            {
+                map->slots.ptr[hole] = map->slots.ptr[idx];
+                hole = idx;
+            }
+            
+            idx = (idx + 1) & mask;
+        }
+        
+        map->slots.ptr[hole] = {};
+        --map->numOccupied;
+        return;
     }
     
-    bool found = slot->occupied;
-    if(!found) return -1;
+    // The old table is only being drained,
+    // so we don't need to keep it compact
+    found = StringMapFind(map->oldSlots, key, hash);
+    if(found != -1)
+    {
+        map->oldSlots.ptr[found].dead = true;
+        --map->numOccupied;
+    }
+}
+
+template<typename t>
+void Remove(StringMap<t>* map, const char* key)
+{
+    Remove(map, ToLenStr(key));
+}
+
+template<typename k>
+static u64 HashMapHash(const k& key)
+{
+    return Murmur64(&key, sizeof(k));
+}
+
+template<typename k, typename v>
+static void HashMapSetMeta(HashMap<k, v>* map, u32 slot, u8 value)
+{
+    map->meta[slot] = value;
     
-    return idx;
+    // Keep the mirrored group up to date, so that
+    // unaligned group loads never need to wrap around
+    if(slot < HashMapGroupSize)
+        map->meta[map->capacity + slot] = value;
 }
 
+// Returns the first empty slot in the probe sequence of the given hash
 template<typename k, typename v>
-v* Append(HashMap<k, v>* map, k key, const v& value)
+static u32 HashMapFindEmpty(HashMap<k, v>* map, u64 hash)
 {
-    // TODO TODO TODO @speed
-    // This is just O(n) instead of O(1)
+    u32 mask = (u32)map->capacity - 1;
+    u32 pos = (u32)hash & mask;
+    while(true)
+    {
+        __m128i group = _mm_loadu_si128((__m128i*)(map->meta + pos));
+        u32 empties = (u32)_mm_movemask_epi8(group);
+        if(empties)
+            return (pos + CountTrailingZeros(empties)) & mask;
+        
+        pos = (pos + HashMapGroupSize) & mask;
+    }
+}
+
+// Returns -1 if not found
+template<typename k, typename v>
+static s32 HashMapFind(HashMap<k, v>* map, const k& key, u64 hash)
+{
+    if(map->capacity <= 0) return -1;
     
-    int found = -1;
-    for(int i = 0; i < map->keys.len; ++i)
+    u32 mask = (u32)map->capacity - 1;
+    u32 pos = (u32)hash & mask;
+    __m128i h2 = _mm_set1_epi8((char)(hash >> 57));
+    while(true)
     {
-        if(memcmp(&key, &map->keys[i], sizeof(k)) == 0)
+        __m128i group = _mm_loadu_si128((__m128i*)(map->meta + pos));
+        u32 matches = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, h2));
+        u32 empties = (u32)_mm_movemask_epi8(group);
+        
+        // Without tombstones, the key can only be
+        // found before the first empty slot
+        if(empties)
+            matches &= (empties & (0 - empties)) - 1;
+        
+        while(matches)
         {
-            found = i;
-            break;
+            u32 slot = (pos + CountTrailingZeros(matches)) & mask;
+            if(memcmp(&map->keys[slot], &key, sizeof(k)) == 0)
+                return (s32)slot;
+            
+            matches &= matches - 1;
         }
+        
+        if(empties) return -1;
+        pos = (pos + HashMapGroupSize) & mask;
     }
+}
+
+template<typename k, typename v>
+static void HashMapGrow(HashMap<k, v>* map)
+{
+    HashMap<k, v> newMap = {};
+    newMap.arena    = map->arena;
+    newMap.capacity = map->capacity > 0 ? map->capacity * 2 : HashMapGroupSize;
+    newMap.count    = map->count;
+    
+    // Keys, values and metadata are all in the same block
+    size_t keysSize   = sizeof(k) * newMap.capacity;
+    size_t valuesOff  = AlignForward(keysSize, alignof(v));
+    size_t metaOff    = valuesOff + sizeof(v) * newMap.capacity;
+    size_t blockSize  = metaOff + newMap.capacity + HashMapGroupSize;
+    size_t blockAlign = max((int)alignof(k), (int)alignof(v));
+    
+    u8* block = nullptr;
+    if(map->arena)
+        block = (u8*)ArenaAlloc(map->arena, blockSize, blockAlign);
+    else
+        block = (u8*)malloc(blockSize);
+    
+    newMap.keys   = (k*)block;
+    newMap.values = (v*)(block + valuesOff);
+    newMap.meta   = block + metaOff;
+    memset(newMap.meta, HashMapEmpty, newMap.capacity + HashMapGroupSize);
     
-    if(found == -1)  // Not found
+    // Reinsert everything, no key comparisons needed
+    for(int32_t i = 0; i < map->capacity; ++i)
     {
-        Append(&map->keys, key);
-        Append(&map->values, value);
-        return &map->values[map->values.len - 1];
+        if(map->meta[i] & HashMapEmpty) continue;
+        
+        u64 hash = HashMapHash(map->keys[i]);
+        u32 slot = HashMapFindEmpty(&newMap, hash);
+        HashMapSetMeta(&newMap, slot, (u8)(hash >> 57));
+        newMap.keys[slot]   = map->keys[i];
+        newMap.values[slot] = map->values[i];
     }
-    else
+    
+    Free(map);
+    *map = newMap;
+}
+
+template<typename k, typename v>
+void UseArena(HashMap<k, v>* map, Arena* arena)
+{
+    assert(map->capacity == 0);
+    map->arena = arena;
+}
+
+template<typename k, typename v>
+v* Append(HashMap<k, v>* map, k key, const v& value)
+{
+    u64 hash = HashMapHash(key);
+    s32 found = HashMapFind(map, key, hash);
+    if(found != -1)
     {
         map->values[found] = value;
         return &map->values[found];
     }
+    
+    // Max load factor is 7/8
+    if((map->count + 1) * 8 > map->capacity * 7)
+        HashMapGrow(map);
+    
+    u32 slot = HashMapFindEmpty(map, hash);
+    HashMapSetMeta(map, slot, (u8)(hash >> 57));
+    map->keys[slot]   = key;
+    map->values[slot] = value;
+    ++map->count;
+    return &map->values[slot];
 }
 
 template<typename k, typename v>
 LookupResult<v> Lookup(HashMap<k, v>* map, k key)
 {
-    // TODO TODO TODO @speed
-    // This is just O(n) instead of O(1)
+    s32 found = HashMapFind(map, key, HashMapHash(key));
+    if(found == -1) return {{}, false};
+    return {&map->values[found], true};
+}
+
+template<typename k, typename v>
+void Remove(HashMap<k, v>* map, k key)
+{
+    s32 found = HashMapFind(map, key, HashMapHash(key));
+    if(found == -1) return;
     
-    int found = -1;
-    for(int i = 0; i < map->keys.len; ++i)
+    // Backward shift deletion: move back the following elements of
+    // the cluster, as long as the hole is not before their home slot
+    u32 mask = (u32)map->capacity - 1;
+    u32 hole = (u32)found;
+    u32 slot = (hole + 1) & mask;
+    while(!(map->meta[slot] & HashMapEmpty))
     {
-        if(memcmp(&key, &map->keys[i], sizeof(k)) == 0)
+        u32 home = (u32)HashMapHash(map->keys[slot]) & mask;
+        if(((slot - home) & mask) >= ((slot - hole) & mask))
         {
-            found = i;
-            break;
+            map->keys[hole]   = map->keys[slot];
+            map->values[hole] = map->values[slot];
+            HashMapSetMeta(map, hole, map->meta[slot]);
+            hole = slot;
         }
+        
+        slot = (slot + 1) & mask;
     }
     
-    if(found == -1) return {{}, false};
-    return {&map->values[found], true};
+    HashMapSetMeta(map, hole, HashMapEmpty);
+    --map->count;
 }
 
 template<typename k, typename v>
-void Remove(HashMap<k, v>* map, k key)
+void Free(HashMap<k, v>* map)
+{
+    // Keys, values and metadata are all in the same block
+    if(!map->arena) free(map->keys);
+    
+    map->keys     = 0;
+    map->values   = 0;
+    map->meta     = 0;
+    map->count    = 0;
+    map->capacity = 0;
+}
+
+template<typename k, typename v>
+bool IsOccupied(HashMap<k, v>* map, int32_t slot)
+{
+    assert(slot >= 0 && slot < map->capacity);
+    return !(map->meta[slot] & HashMapEmpty);
+}
+
+template<typename t>
+void UseArena(SlotMap<t>* map, Arena* arena)
+{
+    UseArena(&map->dense, arena);
+}
+
+template<typename t>
+SlotKey Append(SlotMap<t>* map, const t& el)
 {
-    int found = -1;
-    for(int i = 0; i < map->keys.len; ++i)
+    u32 id = 0;
+    if(map->freeHead > 0)
     {
-        if(memcmp(&key, &map->keys[i], sizeof(k)) == 0)
-        {
-            found = i;
-            break;
-        }
+        id = map->freeHead - 1;
+        map->freeHead = map->sparse[id].idx;
+    }
+    else
+    {
+        // Ids and dense indices are 32 bit, and (u32)-1 is used as the null id
+        assert(map->sparse.len < (s64)UINT32_MAX && "Too many elements in slot map");
+        Append(&map->sparse, {.idx=0, .gen=0});
+        id = (u32)(map->sparse.len - 1);
     }
     
-    if(found != -1)  // Found something
+    SlotMapSlot& slot = map->sparse[id];
+    slot.idx = (u32)map->dense.len;
+    ++slot.gen;
+    
+    Append(&map->dense, el);
+    Append(&map->denseToSparse, id);
+    return {.id=id, .gen=slot.gen};
+}
+
+template<typename t>
+t* Lookup(SlotMap<t>* map, SlotKey key)
+{
+    if(key.id >= (u32)map->sparse.len) return nullptr;
+    
+    SlotMapSlot slot = map->sparse[key.id];
+    if(slot.gen != key.gen || !(slot.gen & 1)) return nullptr;
+    
+    return &map->dense[slot.idx];
+}
+
+template<typename t>
+t* Remove(SlotMap<t>* map, SlotKey key)
+{
+    if(!Lookup(map, key)) return nullptr;
+    
+    SlotMapSlot& slot = map->sparse[key.id];
+    u32 idx = slot.idx;
+    ++slot.gen;
+    slot.idx = map->freeHead;
+    map->freeHead = key.id + 1;
+    
+    // Fill the hole with the last element
+    u32 lastIdx = (u32)(map->dense.len - 1);
+    t* moved = nullptr;
+    if(idx != lastIdx)
     {
-        auto lastIdx = map->keys.len - 1;
-        map->keys[found] = map->keys[lastIdx];
-        map->values[found] = map->values[lastIdx];
-        Pop(&map->keys);
-        Pop(&map->values);
+        map->dense[idx] = map->dense[lastIdx];
+        map->denseToSparse[idx] = map->denseToSparse[lastIdx];
+        map->sparse[map->denseToSparse[idx]].idx = idx;
+        moved = &map->dense[idx];
     }
+    
+    Pop(&map->dense);
+    Pop(&map->denseToSparse);
+    return moved;
 }
 
-template<typename k, typename v>
-void Free(HashMap<k, v>* map)
+template<typename t>
+SlotKey GetKey(SlotMap<t>* map, t* el)
 {
-    Free(&map->keys);
-    Free(&map->values);
+    u32 idx = (u32)(el - map->dense.ptr);
+    assert(idx < (u32)map->dense.len);
+    
+    u32 id = map->denseToSparse[idx];
+    return {.id=id, .gen=map->sparse[id].gen};
+}
+
+template<typename t>
+Slice<t> ToSlice(SlotMap<t>* map)
+{
+    return ToSlice(&map->dense);
+}
+
+template<typename t>
+void Free(SlotMap<t>* map)
+{
+    Free(&map->dense);
+    Free(&map->denseToSparse);
+    Free(&map->sparse);
+    map->freeHead = 0;
 }
 
 template<typename t>
 void Free(StringMap<t>* map)
 {
+    if(map->slots.len <= 0) return;
+    
     ArenaFreeAll(&map->stringArena);
     ArenaReleaseMem(&map->stringArena);
     free(map->slots.ptr);
+    free(map->oldSlots.ptr);
+    *map = {};
 }
 
 #ifdef _WIN32
-void* MemReserve(uint64_t size)
+void* MemReserve(uint64_t size, bool hugePages)
 {
+    // NOTE: Large pages on Windows need to be committed all at
+    // once (and require a special privilege), which doesn't work
+    // with how arenas commit memory, so hugePages is ignored here.
+    (void)hugePages;
+    
     void* res = VirtualAlloc(0, size, MEM_RESERVE, PAGE_READWRITE);
     assert(res && "VirtualAlloc failed.");
     if(!res) abort();
     
     return res;
 }
+#elif defined(__linux__)
+#define HugePageSize MB(2)
+void* MemReserve(uint64_t size, bool hugePages)
+{
+    if(!hugePages)
+    {
+        void* res = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        assert(res != MAP_FAILED && "mmap failed.");
+        if(res == MAP_FAILED) abort();
+        return res;
+    }
+    
+    // Huge pages need to be aligned to the huge page size, so
+    // reserve a bit more and unmap the unaligned parts.
+    // The caller is expected to pass a multiple of HugePageSize.
+    uint64_t toReserve = size + HugePageSize;
+    void* res = mmap(0, toReserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(res != MAP_FAILED && "mmap failed.");
+    if(res == MAP_FAILED) abort();
+    
+    uintptr_t start   = (uintptr_t)res;
+    uintptr_t aligned = (start + HugePageSize - 1) & ~(uintptr_t)(HugePageSize - 1);
+    uintptr_t end     = start + toReserve;
+    if(aligned > start)
+        munmap((void*)start, aligned - start);
+    if(end > aligned + size)
+        munmap((void*)(aligned + size), end - (aligned + size));
+    
+    // This is only a hint, it's fine if it fails (e.g. THP disabled)
+    madvise((void*)aligned, size, MADV_HUGEPAGE);
+    return (void*)aligned;
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -1552,6 +2245,34 @@ void MemCommit(void* mem, uint64_t size)
     assert(res && "VirtualAlloc failed.");
     if(!res) abort();
 }
+#elif defined(__linux__)
+void MemCommit(void* mem, uint64_t size)
+{
+    int res = mprotect(mem, size, PROT_READ | PROT_WRITE);
+    assert(res == 0 && "mprotect failed.");
+    if(res != 0) abort();
+}
+#else
+#error "Unimplemented for this OS!"
+#endif
+
+#ifdef _WIN32
+void MemDecommit(void* mem, uint64_t size)
+{
+    bool ok = VirtualFree(mem, size, MEM_DECOMMIT);
+    assert(ok && "VirtualFree failed.");
+    if(!ok) abort();
+}
+#elif defined(__linux__)
+void MemDecommit(void* mem, uint64_t size)
+{
+    // MADV_DONTNEED frees the pages right away (they read back as zero),
+    // and PROT_NONE makes sure that stray accesses still fault
+    int res = madvise(mem, size, MADV_DONTNEED);
+    res |= mprotect(mem, size, PROT_NONE);
+    assert(res == 0 && "madvise/mprotect failed.");
+    if(res != 0) abort();
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -1563,6 +2284,13 @@ void MemFree(void* mem, uint64_t size)
     assert(ok && "VirtualFree failed.");
     if(!ok) abort();
 }
+#elif defined(__linux__)
+void MemFree(void* mem, uint64_t size)
+{
+    int res = munmap(mem, size);
+    assert(res == 0 && "munmap failed.");
+    if(res != 0) abort();
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -1570,7 +2298,7 @@ void MemFree(void* mem, uint64_t size)
 ////
 // Memory Allocations
 
-inline static uintptr_t AlignForward(uintptr_t ptr, size_t align)
+uintptr_t AlignForward(uintptr_t ptr, size_t align)
 {
     assert(IsPowerOf2(align));
     
@@ -1598,17 +2326,22 @@ void ArenaInit(Arena* arena,
     arena->offset     = 0;
     arena->prevOffset = 0;
     arena->commitSize = commitSize;
+    arena->committed  = 0;
+    arena->peak       = 0;
     
     if(commitSize > 0)
+    {
         MemCommit(backingBuffer, commitSize);
+        arena->committed = commitSize;
+    }
 }
 
-Arena ArenaVirtualMemInit(size_t reserveSize, size_t commitSize)
+Arena ArenaVirtualMemInit(size_t reserveSize, size_t commitSize, bool hugePages)
 {
     assert(commitSize > 0);
     
     Arena result = {0};
-    result.buffer     = (unsigned char*)MemReserve(reserveSize);
+    result.buffer     = (unsigned char*)MemReserve(reserveSize, hugePages);
     result.length     = reserveSize;
     result.offset     = 0;
     result.prevOffset = 0;
@@ -1616,10 +2349,38 @@ Arena ArenaVirtualMemInit(size_t reserveSize, size_t commitSize)
     
     assert(result.buffer);
     MemCommit(result.buffer, commitSize);
+    result.committed = commitSize;
     
     return result;
 }
 
+// Commits memory (in blocks of commitSize) so that
+// at least the first "size" bytes of the buffer are usable
+static void ArenaCommitUpTo(Arena* arena, size_t size)
+{
+    if(arena->commitSize == 0 || size <= arena->committed) return;
+    
+    size_t toCommit = size + arena->commitSize - 1;
+    toCommit -= toCommit % arena->commitSize;
+    if(toCommit > arena->length) toCommit = arena->length;
+    
+    MemCommit(arena->buffer + arena->committed, toCommit - arena->committed);
+    arena->committed = toCommit;
+}
+
+void ArenaTrim(Arena* arena, size_t keepSize)
+{
+    if(arena->commitSize == 0) return;
+    
+    size_t keep = arena->offset > keepSize ? arena->offset : keepSize;
+    keep += arena->commitSize - 1;
+    keep -= keep % arena->commitSize;
+    if(keep >= arena->committed) return;
+    
+    MemDecommit(arena->buffer + keep, arena->committed - keep);
+    arena->committed = keep;
+}
+
 // TODO: Handle exceeding the buffer size
 void* ArenaAlloc(Arena* arena, size_t size, size_t align)
 {
@@ -1633,21 +2394,12 @@ void* ArenaAlloc(Arena* arena, size_t size, size_t align)
     if(offset + size <= arena->length)
     {
         uintptr_t nextOffset = offset + size;
-        
-        if(arena->commitSize > 0)
-        {
-            uintptr_t commitAligned = nextOffset - (nextOffset %
-                                                    arena->commitSize); 
-            if(commitAligned > arena->offset)
-            {
-                size_t toCommit = commitAligned + arena->commitSize;
-                MemCommit(arena->buffer, toCommit);
-            }
-        }
+        ArenaCommitUpTo(arena, nextOffset);
         
         void* ptr = &arena->buffer[offset];
         arena->offset  = nextOffset;
         arena->prevOffset = offset;
+        if(nextOffset > arena->peak) arena->peak = nextOffset;
         
         // Zero new memory for debugging
 #ifndef NDEBUG
@@ -1678,21 +2430,11 @@ void* ArenaResizeLastAlloc(Arena* arena, void* oldMemory, size_t oldSize, size_t
     {
         if((arena->buffer + arena->prevOffset) == oldMem)
         {
-            auto prevOffset = arena->offset;
             arena->offset = arena->prevOffset + newSize;
             if(newSize > oldSize)
             {
-                // Commit if needed
-                if(arena->commitSize > 0)
-                {
-                    uintptr_t commitAligned = arena->offset - (arena->offset %
-                                                               arena->commitSize); 
-                    if(commitAligned > prevOffset)
-                    {
-                        size_t toCommit = commitAligned + arena->commitSize;
-                        MemCommit(arena->buffer, toCommit);
-                    }
-                }
+                ArenaCommitUpTo(arena, arena->offset);
+                if(arena->offset > arena->peak) arena->peak = arena->offset;
                 
                 memset(&arena->buffer[arena->prevOffset + oldSize], 0, newSize - oldSize);
             }
@@ -2085,6 +2827,14 @@ char* GetExecutablePath()
     GetModuleFileName(nullptr, res, MAX_PATH);
     return res;
 }
+#elif defined(__linux__)
+char* GetExecutablePath()
+{
+    char* res = (char*)malloc(PATH_MAX);
+    ssize_t len = readlink("/proc/self/exe", res, PATH_MAX - 1);
+    res[len > 0 ? len : 0] = '\0';
+    return res;
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -2094,6 +2844,11 @@ bool B_SetCurrentDirectory(const char* path)
 {
     return SetCurrentDirectory(path);
 }
+#elif defined(__linux__)
+bool B_SetCurrentDirectory(const char* path)
+{
+    return chdir(path) == 0;
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -2126,6 +2881,13 @@ char* B_GetCurrentDirectory(Arena* dst)
     GetCurrentDirectory(MAX_PATH, res);
     return res;
 }
+#elif defined(__linux__)
+char* B_GetCurrentDirectory(Arena* dst)
+{
+    char* res = (char*)ArenaAlloc(dst, PATH_MAX, 1);
+    if(!getcwd(res, PATH_MAX)) res[0] = '\0';
+    return res;
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -2258,6 +3020,11 @@ void B_Sleep(uint64_t millis)
 {
     Sleep((DWORD)millis);
 }
+#elif defined(__linux__)
+void B_Sleep(uint64_t millis)
+{
+    usleep((useconds_t)(millis * 1000));
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -2267,6 +3034,11 @@ void DebugMessage(const char* message)
 {
     OutputDebugString(message);
 }
+#elif defined(__linux__)
+void DebugMessage(const char* message)
+{
+    fputs(message, stderr);
+}
 #else
 #error "Unimplemented for this OS!"
 #endif
@@ -2295,6 +3067,412 @@ bool B_IsDebuggerPresent()
 {
     return IsDebuggerPresent();
 }
+#elif defined(__linux__)
+bool B_IsDebuggerPresent()
+{
+    // A non zero TracerPid in /proc/self/status means
+    // that some process (likely a debugger) is attached
+    FILE* file = fopen("/proc/self/status", "rb");
+    if(!file) return false;
+    defer { fclose(file); };
+    
+    char line[256];
+    while(fgets(line, sizeof(line), file))
+    {
+        if(strncmp(line, "TracerPid:", 10) == 0)
+            return atoi(line + 10) != 0;
+    }
+    
+    return false;
+}
 #else
 #error "Unimplemented for this OS!"
-#endif
\ No newline at end of file
+#endif
+////
+// Job system
+
+struct Job
+{
+    JobProc proc;
+    void* data;
+    JobCounter* counter;
+};
+
+// Chase-Lev work-stealing deque, with the memory orderings from
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al. 2013).
+// Fixed capacity, so no buffer reclamation is needed.
+struct JobQueue
+{
+    alignas(64) std::atomic<s64> top;
+    alignas(64) std::atomic<s64> bottom;
+    alignas(64) Job jobs[JobQueueSize];
+};
+
+struct JobSystem
+{
+    int numWorkers;
+    JobQueue* queues;  // One per worker
+    std::atomic<bool> running;
+    std::atomic<s32> numSleeping;
+    
+#ifdef _WIN32
+    HANDLE* threads;
+    HANDLE wakeSemaphore;
+#elif defined(__linux__)
+    pthread_t* threads;
+    sem_t wakeSemaphore;
+#endif
+};
+
+static JobSystem jobSystem = {};
+static thread_local int jobWorkerIdx = -1;
+static thread_local u32 jobRandomState = 0;
+
+// Can only be called by the owner
+static bool JobQueuePush(JobQueue* queue, Job job)
+{
+    s64 b = queue->bottom.load(std::memory_order_relaxed);
+    s64 t = queue->top.load(std::memory_order_acquire);
+    if(b - t >= JobQueueSize) return false;
+    
+    queue->jobs[b & (JobQueueSize-1)] = job;
+    queue->bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+// Can only be called by the owner
+static bool JobQueuePop(JobQueue* queue, Job* outJob)
+{
+    s64 b = queue->bottom.load(std::memory_order_relaxed) - 1;
+    queue->bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 t = queue->top.load(std::memory_order_relaxed);
+    
+    if(t > b)  // Empty
+    {
+        queue->bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    *outJob = queue->jobs[b & (JobQueueSize-1)];
+    if(t == b)  // Last job, race against the thieves
+    {
+        bool won = queue->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        queue->bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    
+    return true;
+}
+
+// Can be called by any thread
+static bool JobQueueSteal(JobQueue* queue, Job* outJob)
+{
+    s64 t = queue->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 b = queue->bottom.load(std::memory_order_acquire);
+    if(t >= b) return false;
+    
+    // This read can be torn if the owner is wrapping around, but
+    // in that case top has changed and the CAS below fails
+    Job job = queue->jobs[t & (JobQueueSize-1)];
+    if(!queue->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return false;
+    
+    *outJob = job;
+    return true;
+}
+
+static void RunJob(Job job)
+{
+    job.proc(job.data);
+    if(job.counter)
+        job.counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+// Looks in this worker's queue first, then tries
+// to steal from the others starting from a random one
+static bool GetJob(Job* outJob)
+{
+    int workerIdx = jobWorkerIdx;
+    if(JobQueuePop(&jobSystem.queues[workerIdx], outJob))
+        return true;
+    
+    // Xorshift
+    u32 x = jobRandomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    jobRandomState = x;
+    
+    int numWorkers = jobSystem.numWorkers;
+    int start = (int)(x % (u32)numWorkers);
+    for(int i = 0; i < numWorkers; ++i)
+    {
+        int victim = (start + i) % numWorkers;
+        if(victim == workerIdx) continue;
+        
+        if(JobQueueSteal(&jobSystem.queues[victim], outJob))
+            return true;
+    }
+    
+    return false;
+}
+
+static void WakeWorkers(int count);
+static void WaitForWork();
+
+static void WorkerLoop(int workerIdx)
+{
+    jobWorkerIdx   = workerIdx;
+    jobRandomState = 0x9E3779B9u * (u32)(workerIdx + 1);
+    InitScratchArenas();
+    
+    while(jobSystem.running.load(std::memory_order_acquire))
+    {
+        Job job;
+        if(GetJob(&job))
+        {
+            RunJob(job);
+            continue;
+        }
+        
+        // Announce that we're going to sleep, then look again,
+        // so that a job pushed in the meantime is not missed
+        jobSystem.numSleeping.fetch_add(1, std::memory_order_seq_cst);
+        bool found = GetJob(&job);
+        if(!found && jobSystem.running.load(std::memory_order_acquire))
+            WaitForWork();
+        jobSystem.numSleeping.fetch_sub(1, std::memory_order_seq_cst);
+        
+        if(found) RunJob(job);
+    }
+    
+    for(int i = 0; i < NumScratchArenas; ++i)
+        ArenaReleaseMem(&scratchArenas[i]);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI WorkerThreadProc(void* arg)
+{
+    WorkerLoop((int)(intptr_t)arg);
+    return 0;
+}
+
+static int GetNumCores()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+static void StartWorkerThreads()
+{
+    int numThreads = jobSystem.numWorkers - 1;
+    jobSystem.wakeSemaphore = CreateSemaphore(0, 0, LONG_MAX, 0);
+    jobSystem.threads = (HANDLE*)malloc(sizeof(HANDLE) * max(numThreads, 1));
+    for(int i = 0; i < numThreads; ++i)
+    {
+        jobSystem.threads[i] = CreateThread(0, 0, WorkerThreadProc, (void*)(intptr_t)(i+1), 0, 0);
+        assert(jobSystem.threads[i] && "CreateThread failed.");
+    }
+}
+
+static void JoinWorkerThreads()
+{
+    int numThreads = jobSystem.numWorkers - 1;
+    for(int i = 0; i < numThreads; ++i)
+    {
+        WaitForSingleObject(jobSystem.threads[i], INFINITE);
+        CloseHandle(jobSystem.threads[i]);
+    }
+    
+    CloseHandle(jobSystem.wakeSemaphore);
+    free(jobSystem.threads);
+}
+
+static void WakeWorkers(int count)
+{
+    ReleaseSemaphore(jobSystem.wakeSemaphore, count, 0);
+}
+
+static void WaitForWork()
+{
+    WaitForSingleObject(jobSystem.wakeSemaphore, INFINITE);
+}
+#elif defined(__linux__)
+static void* WorkerThreadProc(void* arg)
+{
+    WorkerLoop((int)(intptr_t)arg);
+    return nullptr;
+}
+
+static int GetNumCores()
+{
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+static void StartWorkerThreads()
+{
+    int numThreads = jobSystem.numWorkers - 1;
+    sem_init(&jobSystem.wakeSemaphore, 0, 0);
+    jobSystem.threads = (pthread_t*)malloc(sizeof(pthread_t) * max(numThreads, 1));
+    for(int i = 0; i < numThreads; ++i)
+    {
+        int res = pthread_create(&jobSystem.threads[i], 0, WorkerThreadProc, (void*)(intptr_t)(i+1));
+        assert(res == 0 && "pthread_create failed.");
+    }
+}
+
+static void JoinWorkerThreads()
+{
+    int numThreads = jobSystem.numWorkers - 1;
+    for(int i = 0; i < numThreads; ++i)
+        pthread_join(jobSystem.threads[i], 0);
+    
+    sem_destroy(&jobSystem.wakeSemaphore);
+    free(jobSystem.threads);
+}
+
+static void WakeWorkers(int count)
+{
+    for(int i = 0; i < count; ++i)
+        sem_post(&jobSystem.wakeSemaphore);
+}
+
+static void WaitForWork()
+{
+    // Retry if interrupted by a signal
+    while(sem_wait(&jobSystem.wakeSemaphore) != 0) {}
+}
+#else
+#error "Unimplemented for this OS!"
+#endif
+
+void InitJobSystem(int numWorkers)
+{
+    assert(jobSystem.numWorkers == 0 && "Job system was already initialized.");
+    
+    if(numWorkers <= 0) numWorkers = GetNumCores();
+    numWorkers = max(numWorkers, 1);
+    
+    jobSystem.numWorkers = numWorkers;
+    jobSystem.queues = (JobQueue*)_aligned_malloc(sizeof(JobQueue) * numWorkers, alignof(JobQueue));
+    for(int i = 0; i < numWorkers; ++i)
+    {
+        jobSystem.queues[i].top.store(0, std::memory_order_relaxed);
+        jobSystem.queues[i].bottom.store(0, std::memory_order_relaxed);
+    }
+    
+    jobSystem.numSleeping.store(0);
+    jobSystem.running.store(true);
+    
+    // The main thread is worker 0
+    jobWorkerIdx   = 0;
+    jobRandomState = 0x9E3779B9u;
+    
+    StartWorkerThreads();
+}
+
+void ShutdownJobSystem()
+{
+    jobSystem.running.store(false, std::memory_order_release);
+    WakeWorkers(jobSystem.numWorkers);
+    JoinWorkerThreads();
+    
+    _aligned_free(jobSystem.queues);
+    jobSystem.queues     = nullptr;
+    jobSystem.numWorkers = 0;
+    jobWorkerIdx = -1;
+}
+
+int GetNumWorkers()
+{
+    return jobSystem.numWorkers;
+}
+
+int GetWorkerIdx()
+{
+    return jobWorkerIdx;
+}
+
+void PushJob(JobProc proc, void* data, JobCounter* counter)
+{
+    assert(jobWorkerIdx >= 0 && "Jobs can only be pushed from the main thread or from other jobs.");
+    
+    if(counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+    
+    Job job = { .proc=proc, .data=data, .counter=counter };
+    if(!JobQueuePush(&jobSystem.queues[jobWorkerIdx], job))
+    {
+        RunJob(job);
+        return;
+    }
+    
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(jobSystem.numSleeping.load(std::memory_order_relaxed) > 0)
+        WakeWorkers(1);
+}
+
+void WaitJobs(JobCounter* counter)
+{
+    assert(jobWorkerIdx >= 0);
+    
+    while(counter->value.load(std::memory_order_acquire) > 0)
+    {
+        Job job;
+        if(GetJob(&job))
+            RunJob(job);
+        else
+            _mm_pause();
+    }
+}
+
+template<typename t, typename f>
+void ParallelFor(Slice<t> slice, s64 batchSize, const f& func)
+{
+    if(slice.len <= 0) return;
+    if(batchSize <= 0) batchSize = 1;
+    
+    // Batches are handed out from a shared index rather than being
+    // pushed one by one, which balances the load and needs no allocations.
+    struct Context
+    {
+        Slice<t> slice;
+        s64 batchSize;
+        const f* func;
+        std::atomic<s64> nextBatch;
+    };
+    
+    Context ctx;
+    ctx.slice     = slice;
+    ctx.batchSize = batchSize;
+    ctx.func      = &func;
+    ctx.nextBatch.store(0, std::memory_order_relaxed);
+    
+    JobProc proc = [](void* data)
+    {
+        Context* ctx = (Context*)data;
+        while(true)
+        {
+            s64 start = ctx->nextBatch.fetch_add(1, std::memory_order_relaxed) * ctx->batchSize;
+            if(start >= ctx->slice.len) break;
+            
+            s64 end = start + ctx->batchSize;
+            if(end > ctx->slice.len) end = ctx->slice.len;
+            for(s64 i = start; i < end; ++i)
+                (*ctx->func)(ctx->slice.ptr[i], i);
+        }
+    };
+    
+    s64 numBatches = (slice.len + batchSize - 1) / batchSize;
+    s64 numJobs = (numBatches < GetNumWorkers() ? numBatches : GetNumWorkers()) - 1;
+    
+    JobCounter counter = {};
+    for(s64 i = 0; i < numJobs; ++i)
+        PushJob(proc, &ctx, &counter);
+    
+    proc(&ctx);
+    WaitJobs(&counter);
+}
@@ -5,20 +5,56 @@
 #include <cstdio>
 #include <stdlib.h>
 #include <cstdint>
+#include <cstddef>
 #include <cstring>
 #include <cstdarg>
 #include <string>
+#include <array>  // Used by ToSlice, MSVC only includes it indirectly through <string>
 #include <cmath>
+#include <cfloat>
 #include <cassert>
+#include <atomic>
 #include <xmmintrin.h>
+#ifdef _MSC_VER
 #include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
 
 // For small platform dependent utility functions
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #elif defined(__linux__)
-#error "Not currently supported"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <malloc.h>
+
+// MSVC CRT functions used in this codebase
+inline void* _aligned_malloc(size_t size, size_t align) { return aligned_alloc(align, (size + align - 1) & ~(align - 1)); }
+inline void  _aligned_free(void* mem) { free(mem); }
+
+// There's no aligned realloc on Linux, so this always moves the memory
+inline void* _aligned_realloc(void* mem, size_t size, size_t align)
+{
+    if(!mem) return _aligned_malloc(size, align);
+    if(size == 0)
+    {
+        free(mem);
+        return nullptr;
+    }
+    
+    void* res = _aligned_malloc(size, align);
+    if(!res) return nullptr;  // Like realloc, the old block is left untouched
+    
+    size_t oldSize = malloc_usable_size(mem);
+    memcpy(res, mem, oldSize < size? oldSize : size);
+    free(mem);
+    return res;
+}
 #elif defined(__APPLE__)
 #error "Not currently supported"
 #else
@@ -86,6 +122,29 @@ typedef unsigned char uchar;
 #define RotateLeft(val, n)    (((val) << (n)) | ((val) >> (SizeTBits - (n))))
 #define RotateRight(val, n)   (((val) >> (n)) | ((val) << (SizeTBits - (n))))
 
+// Index of the least significant set bit. Undefined for n == 0
+inline u32 CountTrailingZeros(u32 n)
+{
+#ifdef _MSC_VER
+    unsigned long res;
+    _BitScanForward(&res, n);
+    return (u32)res;
+#else
+    return (u32)__builtin_ctz(n);
+#endif
+}
+
+inline u32 CountTrailingZeros(u64 n)
+{
+#ifdef _MSC_VER
+    unsigned long res;
+    _BitScanForward64(&res, n);
+    return (u32)res;
+#else
+    return (u32)__builtin_ctzll(n);
+#endif
+}
+
 // This is for custom printf-like functions, which benefit from the same
 // compilation messages that actual printf gets when getting some format
 // specifiers wrong, for example.
@@ -146,6 +205,16 @@ inline int min(int i1, int i2)
     return i1 < i2 ? i1 : i2;
 }
 
+inline int64_t max(int64_t i1, int64_t i2)
+{
+    return i1 < i2 ? i2 : i1;
+}
+
+inline int64_t min(int64_t i1, int64_t i2)
+{
+    return i1 < i2 ? i1 : i2;
+}
+
 inline float max(float f1, float f2)
 {
     return f1 < f2 ? f2 : f1;
@@ -221,6 +290,32 @@ inline int32_t NextPowerOf2(int32_t n)
     return n;
 }
 
+inline uint64_t NextPowerOf2(uint64_t n)
+{
+    --n;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    n |= n >> 32;
+    ++n;
+    return n;
+}
+
+inline int64_t NextPowerOf2(int64_t n)
+{
+    --n;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    n |= n >> 32;
+    ++n;
+    return n;
+}
+
 inline float Deg2Rad(float deg)
 {
     return deg * Pi / 180;
@@ -355,7 +450,7 @@ struct Mat4
 
 Mat3 ToMat3(const Mat4& mat);
 
-Mat4& operator *=(Mat4& m1, Mat4 m2);
+Mat4& operator *=(Mat4& m1, const Mat4& m2);
 Mat4 operator *(const Mat4& m1, const Mat4& m2);
 
 Mat4 transpose(const Mat4& m);
@@ -377,6 +472,7 @@ struct Quat
 
 Quat& operator *=(Quat& a, Quat b);
 Quat operator *(Quat a, Quat b);
+Vec3 operator *(Quat q, Vec3 v);  // Rotates vector along quaternion
 
 Quat normalize(Quat q);
 float magnitude(Quat q);
@@ -392,10 +488,29 @@ struct Transform
     Vec3 scale;
 };
 
+// Transforms in structure of arrays layout (see EntityTransforms).
+// Every pointer is the start of an array with the same length
+struct TransformLanes
+{
+    const float* posX, *posY, *posZ;
+    const float* rotW, *rotX, *rotY, *rotZ;
+    const float* scaleX, *scaleY, *scaleZ;
+};
+
 Mat4 RotationMatrix(Quat rot);
 Mat4 ScaleMatrix(Vec3 scale);
 Mat4 TranslationMatrix(Vec3 pos);
 Mat4 Mat4FromPosRotScale(Vec3 pos, Quat rot, Vec3 scale);
+template<typename t>
+struct Slice;
+
+// Batched versions, to compose many transforms in a single call.
+// These use AVX2 when compiled with it, SSE otherwise
+void Mat4FromTransforms(Slice<Mat4> dst, Slice<Transform> src);
+// dst[i] is built from index i of each lane. Components are loaded directly
+// from the lanes, 8 transforms at a time with AVX2 and 4 with SSE
+void Mat4FromTransforms(Slice<Mat4> dst, const TransformLanes& src);
+void Mat4Multiply(Slice<Mat4> dst, Slice<Mat4> a, Slice<Mat4> b);  // dst[i] = a[i] * b[i], dst can alias a or b
 void PosRotScaleFromMat4(Mat4 mat, Vec3* pos, Quat* rot, Vec3* scale);
 Vec3 QuatToEulerRad(Quat q);
 Quat EulerRadToQuat(Vec3 euler);
@@ -451,7 +566,22 @@ void WriteToFile(String s, FILE* file);
 
 ////
 // Basic data structures
-struct Arena;
+
+// Defined here because some data structures embed one
+struct Arena
+{
+    unsigned char* buffer;
+    size_t length;
+    size_t offset;
+    size_t prevOffset;
+    
+    // Commit memory in blocks of size
+    // commitSize; if == 0, then it never
+    // commits (useful for stack-allocated arenas)
+    size_t commitSize;
+    size_t committed;  // Size of the committed prefix of the buffer
+    size_t peak;       // Highest offset ever reached, for profiling
+};
 
 template<typename t>
 struct Slice
@@ -478,29 +608,29 @@ template<typename t>
 struct Array
 {
     t* ptr = 0;
-    int32_t len = 0;
-    int32_t capacity = 0;
+    int64_t len = 0;
+    int64_t capacity = 0;
     Arena* arena = 0;
     
 #ifdef BoundsChecking
     // For reading the value
-    inline t  operator [](int idx) const { assert(idx < len); return ptr[idx]; };
+    inline t  operator [](int64_t idx) const { assert(idx >= 0 && idx < len); return ptr[idx]; };
     // For writing to the value (this returns a left-value)
-    inline t& operator [](int idx) { assert(idx < len); return ptr[idx]; };
+    inline t& operator [](int64_t idx) { assert(idx >= 0 && idx < len); return ptr[idx]; };
 #else
     // For reading the value
-    inline t  operator [](int idx) const { return ptr[idx]; };
+    inline t  operator [](int64_t idx) const { return ptr[idx]; };
     // For writing to the value (this returns a left-value)
-    inline t& operator [](int idx) { return ptr[idx]; };
+    inline t& operator [](int64_t idx) { return ptr[idx]; };
 #endif
 };
 
 template<typename t>
 void UseArena(Array<t>* array, Arena* arena);
 template<typename t>
-void Resize(Array<t>* array, int newSize);
+void Resize(Array<t>* array, int64_t newSize);
 template<typename t>
-void ResizeExact(Array<t>* array, int newSize);
+void ResizeExact(Array<t>* array, int64_t newSize);
 template<typename t>
 void Append(Array<t>* array, t el);
 template<typename t>
@@ -515,14 +645,23 @@ template<typename t>
 void Free(Array<t>* array);
 
 // Dynamically growing string table.
-// This structure allocates its own strings
+// This structure allocates its own strings.
+// Open addressing with linear probing and a power of 2 capacity.
+// The full hash is kept in each slot, so probing rarely needs to
+// compare strings and growing never needs to hash them again.
+// Growing is incremental: the previous table is kept around and
+// drained into the new one a few slots per Append/Remove, so that
+// a single insertion never pays for rehashing the whole table.
 #define StringMapMaxLoadFactor 0.8f
+#define StringMapMinSize 32
+#define StringMapMigrateStep 32  // Number of old slots moved on each Append/Remove
 template<typename t>
 struct StringMapSlot
 {
     String key;
     t value;
-    bool occupied;
+    u64 hash;  // 0 means the slot is empty
+    bool dead; // Only used in the table being drained (already moved or removed)
 };
 
 template<typename t>
@@ -531,8 +670,11 @@ struct StringMap
     Arena stringArena;
     
     Slice<StringMapSlot<t>> slots;
-    int numOccupied;
-    int sizeIdx;  // Index into the array of map sizes
+    int64_t numOccupied;  // Including the ones still in oldSlots
+    
+    // Table being drained into slots, if currently growing
+    Slice<StringMapSlot<t>> oldSlots;
+    int64_t migrateIdx;
 };
 
 template<typename t>
@@ -542,7 +684,7 @@ struct LookupResult
     bool found;
 };
 
-u64 SipHash(String str, u64 seed = 0x31415926);
+u64 HashString(String str, u64 seed = 0x31415926);
 template<typename t>
 void Append(StringMap<t>* map, String key, const t& value);
 template<typename t>
@@ -552,19 +694,35 @@ LookupResult<t> Lookup(StringMap<t>* map, String key);
 template<typename t>
 LookupResult<t> Lookup(StringMap<t>* map, const char* key);
 template<typename t>
-u64 LookupIdx(StringMap<t>* map, String key);  // Returns -1 if not found
+void Remove(StringMap<t>* map, String key);
+template<typename t>
+void Remove(StringMap<t>* map, const char* key);
 template<typename t>
 void Free(StringMap<t>* map);
 
 // Dynamically growing table of generic key and values
-// Keys are assumed to be small.
+// Keys are assumed to be small, and are compared bytewise.
+// This is an open addressing table with linear probing and a
+// power of 2 capacity. Each slot has a metadata byte (either empty
+// or 7 bits of the hash) so that probing can check 16 slots at a
+// time with SSE2. Removal shifts the following elements back, so
+// there are no tombstones. Like Array, it uses an arena if provided.
+// Should be zero initialized
+#define HashMapGroupSize 16
+#define HashMapEmpty 0x80
 template<typename k, typename v>
 struct HashMap
 {
-    Array<k> keys;
-    Array<v> values;
+    k* keys = 0;
+    v* values = 0;
+    u8* meta = 0;  // capacity + HashMapGroupSize bytes, the tail mirrors the first group
+    int32_t count = 0;
+    int32_t capacity = 0;
+    Arena* arena = 0;
 };
 
+template<typename k, typename v>
+void UseArena(HashMap<k, v>* map, Arena* arena);
 template<typename k, typename v>
 v* Append(HashMap<k, v>* map, k key, const v& value);
 template<typename k, typename v>
@@ -573,12 +731,70 @@ template<typename k, typename v>
 void Remove(HashMap<k, v>* map, k key);
 template<typename k, typename v>
 void Free(HashMap<k, v>* map);
+// For iteration, slots go from 0 to capacity-1
+template<typename k, typename v>
+bool IsOccupied(HashMap<k, v>* map, int32_t slot);
+
+// Generational slot map. Elements are densely packed, so iterating
+// over "dense" only touches live elements. Keys index a sparse array
+// of slots, each holding the dense index and a generation, which is
+// incremented on removal so that stale keys are detected. Generations
+// start at 1, so a zero initialized key is never valid.
+// Removal moves the last element into the hole, so pointers to
+// elements are only valid until the next Remove.
+// Like Array, the dense array uses an arena if provided (if nothing else
+// allocates from it, the array grows in place and insertions keep pointers valid)
+// Should be zero initialized
+struct SlotKey
+{
+    u32 id;
+    u32 gen;
+};
+
+struct SlotMapSlot
+{
+    u32 idx;  // Index in the dense array if used, next free slot + 1 otherwise
+    u32 gen;  // Odd if used, even if free
+};
+
+template<typename t>
+struct SlotMap
+{
+    Array<t> dense;
+    Array<u32> denseToSparse;
+    Array<SlotMapSlot> sparse;
+    u32 freeHead;  // First free slot + 1, 0 if there are none
+};
+
+template<typename t>
+void UseArena(SlotMap<t>* map, Arena* arena);
+template<typename t>
+SlotKey Append(SlotMap<t>* map, const t& el);
+// Returns null if the key is stale
+template<typename t>
+t* Lookup(SlotMap<t>* map, SlotKey key);
+// Returns the address of the element which was moved in place of the
+// removed one, or null if there was none (or if the key was stale)
+template<typename t>
+t* Remove(SlotMap<t>* map, SlotKey key);
+// el needs to point to an element of the map
+template<typename t>
+SlotKey GetKey(SlotMap<t>* map, t* el);
+template<typename t>
+Slice<t> ToSlice(SlotMap<t>* map);
+template<typename t>
+void Free(SlotMap<t>* map);
 
 ////
 // Memory allocation
 
-void* MemReserve(uint64_t size);
+// If hugePages is true, the OS is asked to back the memory with
+// huge pages where possible (transparent huge pages on Linux). Only
+// worth it for big arenas which will actually use a lot of memory.
+void* MemReserve(uint64_t size, bool hugePages = false);
 void MemCommit(void* mem, uint64_t size);
+// Gives the physical pages back to the OS, but keeps the address range reserved
+void MemDecommit(void* mem, uint64_t size);
 void MemFree(void* mem, uint64_t size);
 
 #define ArenaDefAlign sizeof(void*)
@@ -588,19 +804,6 @@ void MemFree(void* mem, uint64_t size);
 #define ArenaAllocArray(type, size, arenaPtr) (type*)ArenaAlloc(arenaPtr, sizeof(type)*(size), alignof(type));
 #define ArenaZAllocArray(type, size, arenaPtr) (type*)ArenaZAlloc(arenaPtr, sizeof(type)*(size), alignof(type));
 
-struct Arena
-{
-    unsigned char* buffer;
-    size_t length;
-    size_t offset;
-    size_t prevOffset;
-    
-    // Commit memory in blocks of size
-    // commitSize; if == 0, then it never
-    // commits (useful for stack-allocated arenas)
-    size_t commitSize;
-};
-
 // Can be used like:
 // ArenaTemp tempGuard = Arena_TempBegin(arena);
 // defer { Arena_TempEnd(tempGuard); };
@@ -669,7 +872,7 @@ uintptr_t AlignForward(uintptr_t ptr, size_t align);
 // Initialize the arena with a pre-allocated buffer
 void ArenaInit(Arena* arena, void* backingBuffer,
                size_t backingBufferLength, size_t commitSize);
-Arena ArenaVirtualMemInit(size_t reserveSize, size_t commitSize);
+Arena ArenaVirtualMemInit(size_t reserveSize, size_t commitSize, bool hugePages = false);
 void* ArenaAlloc(Arena* arena,
                  size_t size, size_t align = ArenaDefAlign);
 void* ArenaZAlloc(Arena* arena, size_t size, size_t align = ArenaDefAlign);
@@ -699,6 +902,11 @@ inline void ArenaFreeAll(Arena* arena)
     arena->prevOffset = 0;
 }
 
+// Gives the committed memory past max(offset, keepSize) back to the OS.
+// ArenaFreeAll never decommits anything, so a single spike would keep
+// its memory committed forever; this can be called after it to fix that.
+void ArenaTrim(Arena* arena, size_t keepSize = 0);
+
 inline void ArenaReleaseMem(Arena* arena)
 {
     MemFree(arena->buffer, arena->length);
@@ -791,6 +999,42 @@ TextFileHandler LoadTextFile(String path, Arena* dst);
 TextLine ConsumeNextLine(TextFileHandler* handler);
 TwoStrings BreakByChar(TextLine line, char c);
 
+////
+// Job system
+
+// Fixed pool of worker threads (one per core, the main thread counts
+// as worker 0). Each worker owns a Chase-Lev deque: the owner pushes
+// and pops jobs at the bottom, while idle workers steal from the top
+// of the other deques. Dependencies are expressed with counters: each
+// job decrements its counter when done, and WaitJobs keeps running other
+// jobs until the counter reaches zero, so the waiting thread never idles.
+// Every worker has its own set of scratch arenas, so jobs can use
+// ScratchArena as usual.
+// Jobs can only be pushed from the main thread and from other jobs.
+#define JobQueueSize 4096  // Per worker, must be a power of 2
+
+typedef void (*JobProc)(void* data);
+
+// Should be zero initialized
+struct JobCounter
+{
+    std::atomic<s32> value;
+};
+
+// numWorkers includes the main thread; -1 means one per core.
+void InitJobSystem(int numWorkers = -1);
+void ShutdownJobSystem();
+int GetNumWorkers();
+int GetWorkerIdx();  // Returns -1 if this is not a job system thread
+// If the queue is full, the job is run immediately
+void PushJob(JobProc proc, void* data, JobCounter* counter = nullptr);
+void WaitJobs(JobCounter* counter);
+
+// Calls func(el, idx) on every element of slice, split in batches of
+// batchSize elements over all workers. Returns when all calls are done.
+template<typename t, typename f>
+void ParallelFor(Slice<t> slice, s64 batchSize, const f& func);
+
 ////
 // Miscellaneous
 
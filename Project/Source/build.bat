@@ -18,7 +18,12 @@ set source_files=..\Source\unity_build.cpp
 set lib_files=User32.lib opengl32.lib GDI32.lib D3D11.lib dxgi.lib dxguid.lib Dwmapi.lib Shcore.lib Ole32.lib
 set output_name=graphics_test.exe
 
-set common=/nologo /std:c++20 /FC /W3 /we4062 /we4714 /we6340 /we6284 /we6273 /D_CRT_SECURE_NO_WARNINGS %include_dirs% %source_files% /link %lib_dirs% %lib_files% /out:%output_name%
+REM The SIMD paths (8 wide transforms, culling and ray tests) need AVX2, so the
+REM game needs a Haswell or later CPU. FMA contraction stays off: /fp:precise
+REM (the default) doesn't contract, so the SIMD and scalar math give the same bits
+set arch=/arch:AVX2
+
+set common=/nologo /std:c++20 /FC /W3 %arch% /we4062 /we4714 /we6340 /we6284 /we6273 /D_CRT_SECURE_NO_WARNINGS %include_dirs% %source_files% /link %lib_dirs% %lib_files% /out:%output_name%
 
 REM Generate introspection info from the metaprogram
 cl /Zi /std:c++20 /nologo /FC ..\Source\metaprogram.cpp
@@ -40,28 +40,9 @@ bool RayBoxIntersection(Ray ray, Quat rot, Aabb local)
     return RayAabbIntersection(ray, local);
 }
 
-// From: https://tavianator.com/2011/ray_box.html
 bool RayAabbIntersection(Ray ray, Aabb aabb)
 {
-    double tx1 = (aabb.min.x - ray.ori.x) / ray.dir.x;
-    double tx2 = (aabb.max.x - ray.ori.x) / ray.dir.x;
-    
-    double tmin = min(tx1, tx2);
-    double tmax = max(tx1, tx2);
-    
-    double ty1 = (aabb.min.y - ray.ori.y) / ray.dir.y;
-    double ty2 = (aabb.max.y - ray.ori.y) / ray.dir.y;
-    
-    tmin = max(tmin, min(ty1, ty2));
-    tmax = min(tmax, max(ty1, ty2));
-    
-    double tz1 = (aabb.min.z - ray.ori.z) / ray.dir.z;
-    double tz2 = (aabb.max.z - ray.ori.z) / ray.dir.z;
-    
-    tmin = max(tmin, min(tz1, tz2));
-    tmax = min(tmax, max(tz1, tz2));
-    
-    return tmax >= tmin;
+    return RayAabbDst(ray, aabb) != FLT_MAX;
 }
 
 float RayPlaneDst(Ray ray, Vec3 p, Vec3 normal)
@@ -80,4 +61,1253 @@ float RayPlaneDst(Ray ray, Vec3 p, Vec3 normal)
     // intersection is behind the ray; which
     // results in a missed intersection
     return FLT_MAX;
-}
\ No newline at end of file
+}
+
+// Directions with components this close to 0 are nudged away
+// from it, so that the reciprocal is a large finite number
+// instead of an infinity. Otherwise (min - ori) * invDir can
+// be 0 * inf = NaN for axis aligned rays starting on the plane
+// of a face, and the min/max chains would give the wrong result.
+#define RayMinDirComponent 1e-20f
+
+RayInv MakeRayInv(Ray ray)
+{
+    Vec3 dir = ray.dir;
+    if(fabsf(dir.x) < RayMinDirComponent) dir.x = copysignf(RayMinDirComponent, dir.x);
+    if(fabsf(dir.y) < RayMinDirComponent) dir.y = copysignf(RayMinDirComponent, dir.y);
+    if(fabsf(dir.z) < RayMinDirComponent) dir.z = copysignf(RayMinDirComponent, dir.z);
+    return {.ori=ray.ori, .invDir={.x=1.0f / dir.x, .y=1.0f / dir.y, .z=1.0f / dir.z}};
+}
+
+// From: https://tavianator.com/2011/ray_box.html
+// Boxes behind the ray are not hit, as tmin starts at 0
+float RayAabbDst(RayInv ray, Aabb aabb)
+{
+    float tmin = 0.0f;
+    float tmax = FLT_MAX;
+    
+    float tx1 = (aabb.min.x - ray.ori.x) * ray.invDir.x;
+    float tx2 = (aabb.max.x - ray.ori.x) * ray.invDir.x;
+    tmin = max(tmin, min(tx1, tx2));
+    tmax = min(tmax, max(tx1, tx2));
+    
+    float ty1 = (aabb.min.y - ray.ori.y) * ray.invDir.y;
+    float ty2 = (aabb.max.y - ray.ori.y) * ray.invDir.y;
+    tmin = max(tmin, min(ty1, ty2));
+    tmax = min(tmax, max(ty1, ty2));
+    
+    float tz1 = (aabb.min.z - ray.ori.z) * ray.invDir.z;
+    float tz2 = (aabb.max.z - ray.ori.z) * ray.invDir.z;
+    tmin = max(tmin, min(tz1, tz2));
+    tmax = min(tmax, max(tz1, tz2));
+    
+    return tmin <= tmax? tmin : FLT_MAX;
+}
+
+float RayAabbDst(Ray ray, Aabb aabb)
+{
+    return RayAabbDst(MakeRayInv(ray), aabb);
+}
+
+// SIMD ray/box tests. Same as the scalar version, but each
+// lane has a different box (or a different ray, for packets)
+
+static inline __m128 RaySlabs4(__m128 ori[3], __m128 invDir[3], __m128 boxMin[3], __m128 boxMax[3])
+{
+    __m128 tmin = _mm_setzero_ps();
+    __m128 tmax = _mm_set1_ps(FLT_MAX);
+    for(int i = 0; i < 3; ++i)
+    {
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(boxMin[i], ori[i]), invDir[i]);
+        __m128 t2 = _mm_mul_ps(_mm_sub_ps(boxMax[i], ori[i]), invDir[i]);
+        tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+        tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+    }
+    
+    __m128 hit = _mm_cmple_ps(tmin, tmax);
+    return _mm_blendv_ps(_mm_set1_ps(FLT_MAX), tmin, hit);
+}
+
+__m128 RayAabb4Dst(RayInv ray, const Aabb4& boxes)
+{
+    __m128 ori[3]    = { _mm_set1_ps(ray.ori.x), _mm_set1_ps(ray.ori.y), _mm_set1_ps(ray.ori.z) };
+    __m128 invDir[3] = { _mm_set1_ps(ray.invDir.x), _mm_set1_ps(ray.invDir.y), _mm_set1_ps(ray.invDir.z) };
+    __m128 boxMin[3] = { boxes.minX, boxes.minY, boxes.minZ };
+    __m128 boxMax[3] = { boxes.maxX, boxes.maxY, boxes.maxZ };
+    return RaySlabs4(ori, invDir, boxMin, boxMax);
+}
+
+__m128 RayPacket4AabbDst(const RayPacket4& rays, Aabb aabb)
+{
+    __m128 ori[3]    = { rays.oriX, rays.oriY, rays.oriZ };
+    __m128 invDir[3] = { rays.invDirX, rays.invDirY, rays.invDirZ };
+    __m128 boxMin[3] = { _mm_set1_ps(aabb.min.x), _mm_set1_ps(aabb.min.y), _mm_set1_ps(aabb.min.z) };
+    __m128 boxMax[3] = { _mm_set1_ps(aabb.max.x), _mm_set1_ps(aabb.max.y), _mm_set1_ps(aabb.max.z) };
+    return RaySlabs4(ori, invDir, boxMin, boxMax);
+}
+
+#ifdef __AVX2__
+static inline __m256 RaySlabs8(__m256 ori[3], __m256 invDir[3], __m256 boxMin[3], __m256 boxMax[3])
+{
+    __m256 tmin = _mm256_setzero_ps();
+    __m256 tmax = _mm256_set1_ps(FLT_MAX);
+    for(int i = 0; i < 3; ++i)
+    {
+        __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(boxMin[i], ori[i]), invDir[i]);
+        __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(boxMax[i], ori[i]), invDir[i]);
+        tmin = _mm256_max_ps(tmin, _mm256_min_ps(t1, t2));
+        tmax = _mm256_min_ps(tmax, _mm256_max_ps(t1, t2));
+    }
+    
+    __m256 hit = _mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ);
+    return _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), tmin, hit);
+}
+
+__m256 RayAabb8Dst(RayInv ray, const Aabb8& boxes)
+{
+    __m256 ori[3]    = { _mm256_set1_ps(ray.ori.x), _mm256_set1_ps(ray.ori.y), _mm256_set1_ps(ray.ori.z) };
+    __m256 invDir[3] = { _mm256_set1_ps(ray.invDir.x), _mm256_set1_ps(ray.invDir.y), _mm256_set1_ps(ray.invDir.z) };
+    __m256 boxMin[3] = { boxes.minX, boxes.minY, boxes.minZ };
+    __m256 boxMax[3] = { boxes.maxX, boxes.maxY, boxes.maxZ };
+    return RaySlabs8(ori, invDir, boxMin, boxMax);
+}
+
+__m256 RayPacket8AabbDst(const RayPacket8& rays, Aabb aabb)
+{
+    __m256 ori[3]    = { rays.oriX, rays.oriY, rays.oriZ };
+    __m256 invDir[3] = { rays.invDirX, rays.invDirY, rays.invDirZ };
+    __m256 boxMin[3] = { _mm256_set1_ps(aabb.min.x), _mm256_set1_ps(aabb.min.y), _mm256_set1_ps(aabb.min.z) };
+    __m256 boxMax[3] = { _mm256_set1_ps(aabb.max.x), _mm256_set1_ps(aabb.max.y), _mm256_set1_ps(aabb.max.z) };
+    return RaySlabs8(ori, invDir, boxMin, boxMax);
+}
+#endif
+
+// Conversions to the SIMD layouts. Empty boxes have all coordinates
+// at +infinity, so both slab distances are infinities of the same sign
+// on every axis, which is always a miss
+
+Aabb4 MakeAabb4(Slice<Aabb> boxes)
+{
+    assert(boxes.len <= 4);
+    alignas(16) float lanes[6][4];
+    for(int i = 0; i < 4; ++i)
+    {
+        Aabb box = {.min={INFINITY, INFINITY, INFINITY}, .max={INFINITY, INFINITY, INFINITY}};
+        if(i < boxes.len) box = boxes[i];
+        lanes[0][i] = box.min.x; lanes[1][i] = box.min.y; lanes[2][i] = box.min.z;
+        lanes[3][i] = box.max.x; lanes[4][i] = box.max.y; lanes[5][i] = box.max.z;
+    }
+    
+    Aabb4 res;
+    res.minX = _mm_load_ps(lanes[0]); res.minY = _mm_load_ps(lanes[1]); res.minZ = _mm_load_ps(lanes[2]);
+    res.maxX = _mm_load_ps(lanes[3]); res.maxY = _mm_load_ps(lanes[4]); res.maxZ = _mm_load_ps(lanes[5]);
+    return res;
+}
+
+RayPacket4 MakeRayPacket4(Slice<Ray> rays)
+{
+    assert(rays.len > 0 && rays.len <= 4);
+    alignas(16) float lanes[6][4];
+    for(int i = 0; i < 4; ++i)
+    {
+        RayInv ray = MakeRayInv(rays[i < rays.len? i : 0]);
+        lanes[0][i] = ray.ori.x;    lanes[1][i] = ray.ori.y;    lanes[2][i] = ray.ori.z;
+        lanes[3][i] = ray.invDir.x; lanes[4][i] = ray.invDir.y; lanes[5][i] = ray.invDir.z;
+    }
+    
+    RayPacket4 res;
+    res.oriX    = _mm_load_ps(lanes[0]); res.oriY    = _mm_load_ps(lanes[1]); res.oriZ    = _mm_load_ps(lanes[2]);
+    res.invDirX = _mm_load_ps(lanes[3]); res.invDirY = _mm_load_ps(lanes[4]); res.invDirZ = _mm_load_ps(lanes[5]);
+    return res;
+}
+
+#ifdef __AVX2__
+Aabb8 MakeAabb8(Slice<Aabb> boxes)
+{
+    assert(boxes.len <= 8);
+    alignas(32) float lanes[6][8];
+    for(int i = 0; i < 8; ++i)
+    {
+        Aabb box = {.min={INFINITY, INFINITY, INFINITY}, .max={INFINITY, INFINITY, INFINITY}};
+        if(i < boxes.len) box = boxes[i];
+        lanes[0][i] = box.min.x; lanes[1][i] = box.min.y; lanes[2][i] = box.min.z;
+        lanes[3][i] = box.max.x; lanes[4][i] = box.max.y; lanes[5][i] = box.max.z;
+    }
+    
+    Aabb8 res;
+    res.minX = _mm256_load_ps(lanes[0]); res.minY = _mm256_load_ps(lanes[1]); res.minZ = _mm256_load_ps(lanes[2]);
+    res.maxX = _mm256_load_ps(lanes[3]); res.maxY = _mm256_load_ps(lanes[4]); res.maxZ = _mm256_load_ps(lanes[5]);
+    return res;
+}
+
+RayPacket8 MakeRayPacket8(Slice<Ray> rays)
+{
+    assert(rays.len > 0 && rays.len <= 8);
+    alignas(32) float lanes[6][8];
+    for(int i = 0; i < 8; ++i)
+    {
+        RayInv ray = MakeRayInv(rays[i < rays.len? i : 0]);
+        lanes[0][i] = ray.ori.x;    lanes[1][i] = ray.ori.y;    lanes[2][i] = ray.ori.z;
+        lanes[3][i] = ray.invDir.x; lanes[4][i] = ray.invDir.y; lanes[5][i] = ray.invDir.z;
+    }
+    
+    RayPacket8 res;
+    res.oriX    = _mm256_load_ps(lanes[0]); res.oriY    = _mm256_load_ps(lanes[1]); res.oriZ    = _mm256_load_ps(lanes[2]);
+    res.invDirX = _mm256_load_ps(lanes[3]); res.invDirY = _mm256_load_ps(lanes[4]); res.invDirZ = _mm256_load_ps(lanes[5]);
+    return res;
+}
+#endif
+
+Sphere4 MakeSphere4(Slice<Sphere> spheres)
+{
+    assert(spheres.len <= 4);
+    alignas(16) float lanes[4][4];
+    for(int i = 0; i < 4; ++i)
+    {
+        Sphere sphere = {.center={0.0f, 0.0f, 0.0f}, .radius=-INFINITY};
+        if(i < spheres.len) sphere = spheres[i];
+        lanes[0][i] = sphere.center.x; lanes[1][i] = sphere.center.y; lanes[2][i] = sphere.center.z;
+        lanes[3][i] = sphere.radius;
+    }
+    
+    Sphere4 res;
+    res.centerX = _mm_load_ps(lanes[0]); res.centerY = _mm_load_ps(lanes[1]); res.centerZ = _mm_load_ps(lanes[2]);
+    res.radius  = _mm_load_ps(lanes[3]);
+    return res;
+}
+
+#ifdef __AVX2__
+Sphere8 MakeSphere8(Slice<Sphere> spheres)
+{
+    assert(spheres.len <= 8);
+    alignas(32) float lanes[4][8];
+    for(int i = 0; i < 8; ++i)
+    {
+        Sphere sphere = {.center={0.0f, 0.0f, 0.0f}, .radius=-INFINITY};
+        if(i < spheres.len) sphere = spheres[i];
+        lanes[0][i] = sphere.center.x; lanes[1][i] = sphere.center.y; lanes[2][i] = sphere.center.z;
+        lanes[3][i] = sphere.radius;
+    }
+    
+    Sphere8 res;
+    res.centerX = _mm256_load_ps(lanes[0]); res.centerY = _mm256_load_ps(lanes[1]); res.centerZ = _mm256_load_ps(lanes[2]);
+    res.radius  = _mm256_load_ps(lanes[3]);
+    return res;
+}
+#endif
+
+// From: Gribb, Hartmann, "Fast extraction of viewing frustum planes
+// from the world-view-projection matrix" (2001)
+Frustum MakeFrustum(Mat4 world2Proj)
+{
+    const Mat4& m = world2Proj;
+    Vec4 planes[5] =
+    {
+        m.rows[3] + m.rows[0],  // Left
+        m.rows[3] - m.rows[0],  // Right
+        m.rows[3] + m.rows[1],  // Bottom
+        m.rows[3] - m.rows[1],  // Top
+        m.rows[3] - m.rows[2],  // Far
+    };
+    
+    // Normalize so that the sphere tests can compare with the radius
+    Frustum res;
+    for(int i = 0; i < ArrayCount(planes); ++i)
+    {
+        float len = magnitude(Vec3{.x=planes[i].x, .y=planes[i].y, .z=planes[i].z});
+        res.planes[i] = planes[i] / len;
+    }
+    
+    return res;
+}
+
+bool FrustumAabbVisible(const Frustum& frustum, Aabb aabb)
+{
+    for(int i = 0; i < ArrayCount(frustum.planes); ++i)
+    {
+        Vec4 p = frustum.planes[i];
+        
+        // Corner of the box furthest along the normal
+        float x = p.x >= 0.0f? aabb.max.x : aabb.min.x;
+        float y = p.y >= 0.0f? aabb.max.y : aabb.min.y;
+        float z = p.z >= 0.0f? aabb.max.z : aabb.min.z;
+        if(p.x*x + p.y*y + p.z*z + p.w < 0.0f) return false;
+    }
+    
+    return true;
+}
+
+bool FrustumSphereVisible(const Frustum& frustum, Sphere sphere)
+{
+    Vec3 c = sphere.center;
+    for(int i = 0; i < ArrayCount(frustum.planes); ++i)
+    {
+        Vec4 p = frustum.planes[i];
+        if(p.x*c.x + p.y*c.y + p.z*c.z + p.w < -sphere.radius) return false;
+    }
+    
+    return true;
+}
+
+int FrustumAabb4Visible(const Frustum& frustum, const Aabb4& boxes)
+{
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for(int i = 0; i < ArrayCount(frustum.planes); ++i)
+    {
+        Vec4 p = frustum.planes[i];
+        
+        // The plane is the same for all lanes, so the corner can be picked outside of SIMD
+        __m128 x = p.x >= 0.0f? boxes.maxX : boxes.minX;
+        __m128 y = p.y >= 0.0f? boxes.maxY : boxes.minY;
+        __m128 z = p.z >= 0.0f? boxes.maxZ : boxes.minZ;
+        __m128 dst = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), x), _mm_mul_ps(_mm_set1_ps(p.y), y)),
+                                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.z), z), _mm_set1_ps(p.w)));
+        visible = _mm_and_ps(visible, _mm_cmpge_ps(dst, _mm_setzero_ps()));
+    }
+    
+    return _mm_movemask_ps(visible);
+}
+
+int FrustumSphere4Visible(const Frustum& frustum, const Sphere4& spheres)
+{
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), spheres.radius);
+    for(int i = 0; i < ArrayCount(frustum.planes); ++i)
+    {
+        Vec4 p = frustum.planes[i];
+        __m128 dst = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), spheres.centerX), _mm_mul_ps(_mm_set1_ps(p.y), spheres.centerY)),
+                                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.z), spheres.centerZ), _mm_set1_ps(p.w)));
+        visible = _mm_and_ps(visible, _mm_cmpge_ps(dst, negRadius));
+    }
+    
+    return _mm_movemask_ps(visible);
+}
+
+#ifdef __AVX2__
+int FrustumAabb8Visible(const Frustum& frustum, const Aabb8& boxes)
+{
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for(int i = 0; i < ArrayCount(frustum.planes); ++i)
+    {
+        Vec4 p = frustum.planes[i];
+        
+        // The plane is the same for all lanes, so the corner can be picked outside of SIMD
+        __m256 x = p.x >= 0.0f? boxes.maxX : boxes.minX;
+        __m256 y = p.y >= 0.0f? boxes.maxY : boxes.minY;
+        __m256 z = p.z >= 0.0f? boxes.maxZ : boxes.minZ;
+        __m256 dst = _mm256_fmadd_ps(_mm256_set1_ps(p.x), x,
+                     _mm256_fmadd_ps(_mm256_set1_ps(p.y), y,
+                     _mm256_fmadd_ps(_mm256_set1_ps(p.z), z, _mm256_set1_ps(p.w))));
+        visible = _mm256_and_ps(visible, _mm256_cmp_ps(dst, _mm256_setzero_ps(), _CMP_GE_OQ));
+    }
+    
+    return _mm256_movemask_ps(visible);
+}
+
+int FrustumSphere8Visible(const Frustum& frustum, const Sphere8& spheres)
+{
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), spheres.radius);
+    for(int i = 0; i < ArrayCount(frustum.planes); ++i)
+    {
+        Vec4 p = frustum.planes[i];
+        __m256 dst = _mm256_fmadd_ps(_mm256_set1_ps(p.x), spheres.centerX,
+                     _mm256_fmadd_ps(_mm256_set1_ps(p.y), spheres.centerY,
+                     _mm256_fmadd_ps(_mm256_set1_ps(p.z), spheres.centerZ, _mm256_set1_ps(p.w))));
+        visible = _mm256_and_ps(visible, _mm256_cmp_ps(dst, negRadius, _CMP_GE_OQ));
+    }
+    
+    return _mm256_movemask_ps(visible);
+}
+#endif
+
+Slice<u32> FrustumCull(const Frustum& frustum, Slice<Aabb> boxes, Slice<Sphere> spheres, Arena* arena)
+{
+    assert(boxes.len == spheres.len);
+    u32* visible = ArenaAllocArray(u32, boxes.len, arena);
+    s64 count = 0;
+    
+#ifdef __AVX2__
+    const s64 groupSize = 8;
+#else
+    const s64 groupSize = 4;
+#endif
+    
+    for(s64 i = 0; i < boxes.len; i += groupSize)
+    {
+        s64 n = min(groupSize, boxes.len - i);
+        Slice<Aabb> groupBoxes = {.ptr=boxes.ptr + i, .len=n};
+        Slice<Sphere> groupSpheres = {.ptr=spheres.ptr + i, .len=n};
+        
+        // The sphere test is cheaper, and the box test
+        // is skipped if it already rejects the whole group
+#ifdef __AVX2__
+        int mask = FrustumSphere8Visible(frustum, MakeSphere8(groupSpheres));
+        if(mask) mask &= FrustumAabb8Visible(frustum, MakeAabb8(groupBoxes));
+#else
+        int mask = FrustumSphere4Visible(frustum, MakeSphere4(groupSpheres));
+        if(mask) mask &= FrustumAabb4Visible(frustum, MakeAabb4(groupBoxes));
+#endif
+        
+        for(int j = 0; j < n; ++j)
+        {
+            if(mask & (1 << j))
+                visible[count++] = (u32)(i + j);
+        }
+    }
+    
+    return {.ptr=visible, .len=count};
+}
+
+// From: Arvo, "Transforming axis-aligned bounding boxes", Graphics Gems (1990)
+Aabb TransformAabb(Aabb aabb, Mat4 transform)
+{
+    const Mat4& m = transform;
+    Vec3 center  = (aabb.min + aabb.max) * 0.5f;
+    Vec3 extents = (aabb.max - aabb.min) * 0.5f;
+    
+    Vec3 newCenter =
+    {
+        .x = m.m11*center.x + m.m12*center.y + m.m13*center.z + m.m14,
+        .y = m.m21*center.x + m.m22*center.y + m.m23*center.z + m.m24,
+        .z = m.m31*center.x + m.m32*center.y + m.m33*center.z + m.m34,
+    };
+    
+    Vec3 newExtents =
+    {
+        .x = fabsf(m.m11)*extents.x + fabsf(m.m12)*extents.y + fabsf(m.m13)*extents.z,
+        .y = fabsf(m.m21)*extents.x + fabsf(m.m22)*extents.y + fabsf(m.m23)*extents.z,
+        .z = fabsf(m.m31)*extents.x + fabsf(m.m32)*extents.y + fabsf(m.m33)*extents.z,
+    };
+    
+    return {.min=newCenter - newExtents, .max=newCenter + newExtents};
+}
+
+Sphere TransformSphere(Sphere sphere, Mat4 transform)
+{
+    const Mat4& m = transform;
+    Vec3 c = sphere.center;
+    Vec3 newCenter =
+    {
+        .x = m.m11*c.x + m.m12*c.y + m.m13*c.z + m.m14,
+        .y = m.m21*c.x + m.m22*c.y + m.m23*c.z + m.m24,
+        .z = m.m31*c.x + m.m32*c.y + m.m33*c.z + m.m34,
+    };
+    
+    // Squared lengths of the transformed basis vectors
+    float scaleX = m.m11*m.m11 + m.m21*m.m21 + m.m31*m.m31;
+    float scaleY = m.m12*m.m12 + m.m22*m.m22 + m.m32*m.m32;
+    float scaleZ = m.m13*m.m13 + m.m23*m.m23 + m.m33*m.m33;
+    float maxScale = sqrtf(max(scaleX, max(scaleY, scaleZ)));
+    return {.center=newCenter, .radius=sphere.radius * maxScale};
+}
+
+Aabb Union(Aabb a, Aabb b)
+{
+    Aabb res;
+    res.min.x = min(a.min.x, b.min.x);
+    res.min.y = min(a.min.y, b.min.y);
+    res.min.z = min(a.min.z, b.min.z);
+    res.max.x = max(a.max.x, b.max.x);
+    res.max.y = max(a.max.y, b.max.y);
+    res.max.z = max(a.max.z, b.max.z);
+    return res;
+}
+
+bool Contains(Aabb container, Aabb aabb)
+{
+    return container.min.x <= aabb.min.x && container.min.y <= aabb.min.y && container.min.z <= aabb.min.z &&
+           container.max.x >= aabb.max.x && container.max.y >= aabb.max.y && container.max.z >= aabb.max.z;
+}
+
+float SurfaceArea(Aabb aabb)
+{
+    Vec3 d = aabb.max - aabb.min;
+    return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+}
+
+static Aabb Enlarge(Aabb aabb, float margin)
+{
+    Vec3 m = {.x=margin, .y=margin, .z=margin};
+    return {.min=aabb.min - m, .max=aabb.max + m};
+}
+
+// Aabb tree.
+// The insertion and balancing strategy is the one from Box2D's
+// b2DynamicTree: new leaves are paired with the sibling which minimizes
+// the surface area heuristic (the area of the new parent plus the area
+// increase of all its ancestors), and then AVL-like rotations keep the
+// tree balanced on the way back to the root.
+
+static u32 AllocNode(AabbTree* tree)
+{
+    u32 node = tree->freeList;
+    if(node != AabbTreeNull)
+    {
+        tree->freeList = tree->nodes[node].parent;
+    }
+    else
+    {
+        assert(tree->nodes.len < (s64)AabbTreeNull && "Too many nodes in aabb tree");
+        Append(&tree->nodes, {});
+        node = (u32)(tree->nodes.len - 1);
+    }
+    
+    tree->nodes[node].wide     = AabbTreeNull;
+    tree->nodes[node].changed  = true;
+    tree->nodes[node].enlarged = false;
+    return node;
+}
+
+static void FreeWideNode(AabbTree* tree, u32 wideNode)
+{
+    tree->wide[wideNode].children[0] = tree->wideFreeList;
+    tree->wideFreeList = wideNode;
+}
+
+static void FreeNode(AabbTree* tree, u32 node)
+{
+    // The wide field of leaves is a lane, not a wide node
+    if(tree->nodes[node].height > 0 && tree->nodes[node].wide != AabbTreeNull)
+        FreeWideNode(tree, tree->nodes[node].wide);
+    
+    tree->nodes[node].parent = tree->freeList;
+    tree->nodes[node].height = -1;
+    tree->freeList = node;
+}
+
+// Any change in a subtree changes the boxes of all its ancestors, so
+// once a node is marked all of its ancestors are already marked too
+static void MarkChanged(AabbTree* tree, u32 node)
+{
+    while(node != AabbTreeNull && !tree->nodes[node].changed)
+    {
+        tree->nodes[node].changed = true;
+        node = tree->nodes[node].parent;
+    }
+}
+
+// Performs a left or right rotation if node a is imbalanced.
+// Returns the new root of the subtree
+static u32 Balance(AabbTree* tree, u32 a)
+{
+    auto& nodes = tree->nodes;
+    if(nodes[a].height < 2) return a;
+    
+    u32 b = nodes[a].left;
+    u32 c = nodes[a].right;
+    s32 balance = nodes[c].height - nodes[b].height;
+    
+    // Symmetric cases, the taller child takes the place of a
+    if(balance > 1 || balance < -1)
+    {
+        bool rotateRight = balance > 1;
+        u32 up    = rotateRight? c : b;
+        u32 other = rotateRight? b : c;
+        u32 f = nodes[up].left;
+        u32 g = nodes[up].right;
+        
+        // a is on the path being fixed, so it's already marked
+        nodes[up].changed = true;
+        
+        // Swap a and up
+        nodes[up].left = a;
+        nodes[up].parent = nodes[a].parent;
+        nodes[a].parent = up;
+        
+        u32 upParent = nodes[up].parent;
+        if(upParent == AabbTreeNull)
+            tree->root = up;
+        else if(nodes[upParent].left == a)
+            nodes[upParent].left = up;
+        else
+            nodes[upParent].right = up;
+        
+        // The taller grandchild stays with up, the other one goes to a
+        u32 keep = nodes[f].height > nodes[g].height? f : g;
+        u32 give = keep == f? g : f;
+        nodes[up].right = keep;
+        if(rotateRight)
+            nodes[a].right = give;
+        else
+            nodes[a].left = give;
+        nodes[give].parent = a;
+        
+        nodes[a].aabb    = Union(nodes[other].aabb, nodes[give].aabb);
+        nodes[a].height  = 1 + max(nodes[other].height, nodes[give].height);
+        nodes[up].aabb   = Union(nodes[a].aabb, nodes[keep].aabb);
+        nodes[up].height = 1 + max(nodes[a].height, nodes[keep].height);
+        return up;
+    }
+    
+    return a;
+}
+
+// Refits and rebalances the ancestors, starting from node. Stops
+// early once a node is left unchanged, as its ancestors will be too
+static void FixUpwards(AabbTree* tree, u32 node)
+{
+    auto& nodes = tree->nodes;
+    while(node != AabbTreeNull)
+    {
+        u32 balanced = Balance(tree, node);
+        bool rotated = balanced != node;
+        node = balanced;
+        
+        u32 left  = nodes[node].left;
+        u32 right = nodes[node].right;
+        s32 height = 1 + max(nodes[left].height, nodes[right].height);
+        Aabb aabb  = Union(nodes[left].aabb, nodes[right].aabb);
+        if(!rotated && height == nodes[node].height && memcmp(&aabb, &nodes[node].aabb, sizeof(Aabb)) == 0)
+            break;
+        
+        nodes[node].height = height;
+        nodes[node].aabb   = aabb;
+        node = nodes[node].parent;
+    }
+}
+
+// The search for the sibling starts from the start node, which
+// should either be the root or a node whose box contains the leaf's
+static void InsertLeaf(AabbTree* tree, u32 leaf, u32 start)
+{
+    tree->nodes[leaf].changed = true;
+    if(tree->root == AabbTreeNull)
+    {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = AabbTreeNull;
+        return;
+    }
+    
+    // Find the best sibling
+    Aabb leafAabb = tree->nodes[leaf].aabb;
+    u32 sibling = start;
+    while(tree->nodes[sibling].height > 0)
+    {
+        auto& node = tree->nodes[sibling];
+        float area = SurfaceArea(node.aabb);
+        float combinedArea = SurfaceArea(Union(node.aabb, leafAabb));
+        
+        // Cost of creating a new parent for this node and the new leaf
+        float cost = 2.0f * combinedArea;
+        // Minimum cost of pushing the leaf further down the tree
+        float inheritanceCost = 2.0f * (combinedArea - area);
+        
+        float childCosts[2];
+        u32 children[2] = {node.left, node.right};
+        for(int i = 0; i < 2; ++i)
+        {
+            auto& child = tree->nodes[children[i]];
+            float unionArea = SurfaceArea(Union(child.aabb, leafAabb));
+            if(child.height == 0)
+                childCosts[i] = unionArea + inheritanceCost;
+            else
+                childCosts[i] = unionArea - SurfaceArea(child.aabb) + inheritanceCost;
+        }
+        
+        if(cost < childCosts[0] && cost < childCosts[1])
+            break;
+        
+        sibling = childCosts[0] < childCosts[1]? children[0] : children[1];
+    }
+    
+    // Create the new parent
+    u32 oldParent = tree->nodes[sibling].parent;
+    u32 newParent = AllocNode(tree);
+    auto& nodes = tree->nodes;
+    nodes[newParent].parent   = oldParent;
+    nodes[newParent].left     = sibling;
+    nodes[newParent].right    = leaf;
+    nodes[newParent].aabb     = Union(leafAabb, nodes[sibling].aabb);
+    nodes[newParent].height   = nodes[sibling].height + 1;
+    nodes[newParent].userData = 0;
+    
+    if(oldParent == AabbTreeNull)
+        tree->root = newParent;
+    else if(nodes[oldParent].left == sibling)
+        nodes[oldParent].left = newParent;
+    else
+        nodes[oldParent].right = newParent;
+    
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    
+    MarkChanged(tree, oldParent);
+    FixUpwards(tree, oldParent);
+}
+
+// Returns the node which took the place of the leaf's parent
+static u32 RemoveLeaf(AabbTree* tree, u32 leaf)
+{
+    auto& nodes = tree->nodes;
+    if(leaf == tree->root)
+    {
+        tree->root = AabbTreeNull;
+        return AabbTreeNull;
+    }
+    
+    // The sibling takes the place of the parent
+    u32 parent = nodes[leaf].parent;
+    u32 grandParent = nodes[parent].parent;
+    u32 sibling = nodes[parent].left == leaf? nodes[parent].right : nodes[parent].left;
+    
+    nodes[sibling].parent = grandParent;
+    FreeNode(tree, parent);
+    
+    if(grandParent == AabbTreeNull)
+    {
+        tree->root = sibling;
+        return sibling;
+    }
+    
+    if(nodes[grandParent].left == parent)
+        nodes[grandParent].left = sibling;
+    else
+        nodes[grandParent].right = sibling;
+    
+    MarkChanged(tree, grandParent);
+    FixUpwards(tree, grandParent);
+    return sibling;
+}
+
+u32 AabbTreeInsert(AabbTree* tree, Aabb aabb, u32 userData)
+{
+    u32 leaf = AllocNode(tree);
+    auto& node = tree->nodes[leaf];
+    node.aabb     = Enlarge(aabb, AabbTreeMargin);
+    node.exact    = aabb;
+    node.parent   = AabbTreeNull;
+    node.left     = AabbTreeNull;
+    node.right    = AabbTreeNull;
+    node.height   = 0;
+    node.userData = userData;
+    
+    InsertLeaf(tree, leaf, tree->root);
+    return leaf;
+}
+
+void AabbTreeRemove(AabbTree* tree, u32 leaf)
+{
+    assert(tree->nodes[leaf].height == 0);
+    RemoveLeaf(tree, leaf);
+    FreeNode(tree, leaf);
+}
+
+// Leaves which didn't change place get the new box in
+// the wide copy too, the others will be rebuilt anyway
+static void SetExactAabb(AabbTree* tree, u32 leaf, Aabb aabb)
+{
+    auto& node = tree->nodes[leaf];
+    node.exact = aabb;
+    if(node.changed || node.wide == AabbTreeNull) return;
+    
+    u32 lane = node.wide % AabbTreeWidth;
+    auto& wideNode = tree->wide[node.wide / AabbTreeWidth];
+    wideNode.minX[lane] = aabb.min.x; wideNode.minY[lane] = aabb.min.y; wideNode.minZ[lane] = aabb.min.z;
+    wideNode.maxX[lane] = aabb.max.x; wideNode.maxY[lane] = aabb.max.y; wideNode.maxZ[lane] = aabb.max.z;
+}
+
+// Enlarged box stored in the leaves. The prediction is limited to
+// the size of the box, so that teleporting objects don't end up with huge boxes
+static Aabb PredictAabb(Aabb aabb, Vec3 displacement)
+{
+    Aabb fat = Enlarge(aabb, AabbTreeMargin);
+    Vec3 size = aabb.max - aabb.min;
+    Vec3 d = displacement * AabbTreeDisplacementMultiplier;
+    d.x = clamp(d.x, -size.x, size.x);
+    d.y = clamp(d.y, -size.y, size.y);
+    d.z = clamp(d.z, -size.z, size.z);
+    if(d.x < 0.0f) fat.min.x += d.x; else fat.max.x += d.x;
+    if(d.y < 0.0f) fat.min.y += d.y; else fat.max.y += d.y;
+    if(d.z < 0.0f) fat.min.z += d.z; else fat.max.z += d.z;
+    return fat;
+}
+
+// Nothing to do if the enlarged box still fits, unless it's become
+// way too large (e.g. the object has been scaled down or has stopped)
+static bool LeafStillFits(Aabb treeAabb, Aabb aabb, Aabb fat)
+{
+    return Contains(treeAabb, aabb) && Contains(Enlarge(fat, 4.0f * AabbTreeMargin), treeAabb);
+}
+
+bool AabbTreeMove(AabbTree* tree, u32 leaf, Aabb aabb, Vec3 displacement)
+{
+    assert(tree->nodes[leaf].height == 0);
+    SetExactAabb(tree, leaf, aabb);
+    
+    Aabb fat = PredictAabb(aabb, displacement);
+    if(LeafStillFits(tree->nodes[leaf].aabb, aabb, fat))
+        return false;
+    
+    // Objects usually move only by a little, so instead of searching
+    // the whole tree, the search starts from the closest ancestor which
+    // already contains the new box. All ancestors of that node would
+    // contain the leaf anyway, so they don't contribute to its cost
+    u32 start = RemoveLeaf(tree, leaf);
+    while(start != AabbTreeNull && !Contains(tree->nodes[start].aabb, fat))
+        start = tree->nodes[start].parent;
+    
+    tree->nodes[leaf].aabb = fat;
+    InsertLeaf(tree, leaf, start != AabbTreeNull? start : tree->root);
+    return true;
+}
+
+// Insertions keep the height at ~1.44*log2(n) with AVL balancing, and
+// BuildSubtree at AabbTreeMaxBuildDepth + log2(n). The wide tree is at
+// most as tall, and at most AabbTreeWidth-1 more nodes are on the stack
+// for each of its levels, so this is plenty
+#define AabbTreeMaxStack 1024
+
+// Subtree which is placed as a whole by BuildSubtree
+struct AabbTreeBuildItem
+{
+    Aabb aabb;
+    Vec3 center;
+    u32 node;
+};
+
+#define AabbTreeNumBins 16
+// Below this depth, splits ignore the boxes and just halve the items,
+// which bounds the height of the result
+#define AabbTreeMaxBuildDepth 40
+
+static float GetAxis(Vec3 v, int axis)
+{
+    return axis == 0? v.x : axis == 1? v.y : v.z;
+}
+
+static u32 BinIndex(float center, float lo, float scale)
+{
+    return (u32)min((int)((center - lo) * scale), AabbTreeNumBins - 1);
+}
+
+// Builds a subtree over the items, top-down, with the binned surface
+// area heuristic. Returns its root
+static u32 BuildSubtree(AabbTree* tree, AabbTreeBuildItem* items, s64 count, int depth)
+{
+    if(count == 1) return items[0].node;
+    
+    Aabb aabb = items[0].aabb;
+    Aabb centers = {.min=items[0].center, .max=items[0].center};
+    for(s64 i = 1; i < count; ++i)
+    {
+        aabb = Union(aabb, items[i].aabb);
+        centers = Union(centers, {.min=items[i].center, .max=items[i].center});
+    }
+    
+    // Split on the axis along which the centers are spread the most
+    Vec3 extents = centers.max - centers.min;
+    int axis = 0;
+    if(extents.y > extents.x) axis = 1;
+    if(extents.z > GetAxis(extents, axis)) axis = 2;
+    float lo = GetAxis(centers.min, axis);
+    float extent = GetAxis(extents, axis);
+    
+    s64 mid = count / 2;
+    if(extent > 0.0f && depth < AabbTreeMaxBuildDepth)
+    {
+        float scale = AabbTreeNumBins / extent;
+        Aabb binAabbs[AabbTreeNumBins];
+        s64 binCounts[AabbTreeNumBins] = {};
+        for(s64 i = 0; i < count; ++i)
+        {
+            u32 bin = BinIndex(GetAxis(items[i].center, axis), lo, scale);
+            binAabbs[bin] = binCounts[bin] == 0? items[i].aabb : Union(binAabbs[bin], items[i].aabb);
+            ++binCounts[bin];
+        }
+        
+        // Cost of the right side when splitting before each bin
+        float rightCosts[AabbTreeNumBins];
+        s64 rightCounts[AabbTreeNumBins];
+        Aabb right = {};
+        s64 rightCount = 0;
+        for(int b = AabbTreeNumBins - 1; b > 0; --b)
+        {
+            if(binCounts[b] > 0)
+            {
+                right = rightCount == 0? binAabbs[b] : Union(right, binAabbs[b]);
+                rightCount += binCounts[b];
+            }
+            
+            rightCosts[b]  = rightCount * SurfaceArea(right);
+            rightCounts[b] = rightCount;
+        }
+        
+        int bestBin = 0;
+        float bestCost = FLT_MAX;
+        Aabb left = {};
+        s64 leftCount = 0;
+        for(int b = 1; b < AabbTreeNumBins; ++b)
+        {
+            if(binCounts[b-1] > 0)
+            {
+                left = leftCount == 0? binAabbs[b-1] : Union(left, binAabbs[b-1]);
+                leftCount += binCounts[b-1];
+            }
+            
+            if(leftCount == 0 || rightCounts[b] == 0) continue;
+            
+            float cost = leftCount * SurfaceArea(left) + rightCosts[b];
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                bestBin = b;
+            }
+        }
+        
+        // The centers are spread over more than one bin,
+        // so there's always a split with both sides non-empty
+        assert(bestBin > 0);
+        s64 i = 0;
+        s64 j = count - 1;
+        while(i <= j)
+        {
+            if(BinIndex(GetAxis(items[i].center, axis), lo, scale) < (u32)bestBin)
+                ++i;
+            else
+                std::swap(items[i], items[j--]);
+        }
+        
+        mid = i;
+    }
+    
+    u32 node  = AllocNode(tree);
+    u32 left  = BuildSubtree(tree, items, mid, depth + 1);
+    u32 right = BuildSubtree(tree, items + mid, count - mid, depth + 1);
+    
+    auto& nodes = tree->nodes;
+    nodes[node].aabb     = aabb;
+    nodes[node].left     = left;
+    nodes[node].right    = right;
+    nodes[node].height   = 1 + max(nodes[left].height, nodes[right].height);
+    nodes[node].userData = 0;
+    nodes[left].parent   = node;
+    nodes[right].parent  = node;
+    return node;
+}
+
+void AabbTreeMove(AabbTree* tree, Slice<u32> leaves, Slice<Aabb> aabbs)
+{
+    assert(leaves.len == aabbs.len);
+    auto& nodes = tree->nodes;
+    
+    // Most leaves only need their exact box updated. The ancestors of
+    // the others are marked as enlarged, up to the root
+    bool anyEnlarged = false;
+    for(s64 i = 0; i < leaves.len; ++i)
+    {
+        auto& node = nodes[leaves[i]];
+        assert(node.height == 0);
+        
+        Aabb aabb = aabbs[i];
+        Vec3 displacement = (aabb.min + aabb.max - node.exact.min - node.exact.max) * 0.5f;
+        SetExactAabb(tree, leaves[i], aabb);
+        
+        Aabb fat = PredictAabb(aabb, displacement);
+        if(LeafStillFits(node.aabb, aabb, fat)) continue;
+        
+        node.aabb = fat;
+        node.changed = true;
+        for(u32 p = node.parent; p != AabbTreeNull && !nodes[p].enlarged; p = nodes[p].parent)
+            nodes[p].enlarged = true;
+        
+        anyEnlarged = true;
+    }
+    
+    if(!anyEnlarged || nodes[tree->root].height == 0) return;
+    
+    // Instead of reinserting the leaves one by one, which is slow and
+    // tends to degrade the tree, the enlarged part is rebuilt as a
+    // whole (as in Box2D v3). Its nodes are freed, and what hangs from
+    // them (the moved leaves and the untouched subtrees) is placed again
+    ScratchArena scratch;
+    Array<AabbTreeBuildItem> items = {};
+    UseArena(&items, scratch);
+    
+    u32 stack[AabbTreeMaxStack];
+    int top = 0;
+    stack[top++] = tree->root;
+    while(top > 0)
+    {
+        u32 n = stack[--top];
+        auto& node = nodes[n];
+        if(!node.enlarged)
+        {
+            Append(&items, {.aabb=node.aabb, .center=(node.aabb.min + node.aabb.max) * 0.5f, .node=n});
+            continue;
+        }
+        
+        assert(top + 2 <= AabbTreeMaxStack);
+        stack[top++] = node.left;
+        stack[top++] = node.right;
+        FreeNode(tree, n);
+    }
+    
+    // As many nodes were freed as will be allocated, so this doesn't grow the array
+    tree->root = BuildSubtree(tree, items.ptr, items.len, 0);
+    nodes[tree->root].parent = AabbTreeNull;
+}
+
+void FreeAabbTree(AabbTree* tree)
+{
+    Free(&tree->nodes);
+    Free(&tree->wide);
+    tree->root = AabbTreeNull;
+    tree->freeList = AabbTreeNull;
+    tree->wideFreeList = AabbTreeNull;
+}
+
+static u32 AllocWideNode(AabbTree* tree)
+{
+    u32 wideNode = tree->wideFreeList;
+    if(wideNode != AabbTreeNull)
+    {
+        tree->wideFreeList = tree->wide[wideNode].children[0];
+        return wideNode;
+    }
+    
+    Resize(&tree->wide, tree->wide.len + 1);
+    return (u32)(tree->wide.len - 1);
+}
+
+// Collapses the binary subtree at root (which is not a leaf) into
+// wide nodes, and returns the top one. The children with the largest
+// area are opened first, as they're the most likely to be hit. Wide
+// nodes of subtrees which didn't change since they were built are reused
+static u32 UpdateWideNode(AabbTree* tree, u32 root)
+{
+    auto& nodes = tree->nodes;
+    if(!nodes[root].changed && nodes[root].wide != AabbTreeNull)
+        return nodes[root].wide;
+    
+    u32 lanes[AabbTreeWidth] = {nodes[root].left, nodes[root].right};
+    int numLanes = 2;
+    while(numLanes < AabbTreeWidth)
+    {
+        int open = -1;
+        float openArea = -1.0f;
+        for(int i = 0; i < numLanes; ++i)
+        {
+            if(nodes[lanes[i]].height == 0) continue;
+            
+            float area = SurfaceArea(nodes[lanes[i]].aabb);
+            if(area > openArea)
+            {
+                open = i;
+                openArea = area;
+            }
+        }
+        
+        if(open == -1) break;
+        
+        // The opened node becomes part of this wide node
+        auto& opened = nodes[lanes[open]];
+        if(opened.wide != AabbTreeNull)
+            FreeWideNode(tree, opened.wide);
+        opened.wide = AabbTreeNull;
+        opened.changed = false;
+        
+        lanes[open] = opened.left;
+        lanes[numLanes++] = opened.right;
+    }
+    
+    u32 idx = nodes[root].wide;
+    if(idx == AabbTreeNull)
+        idx = AllocWideNode(tree);
+    nodes[root].wide = idx;
+    nodes[root].changed = false;
+    
+    // Written at the end, since the wide array can
+    // grow in the recursive calls
+    AabbTreeWideNode wideNode = {};
+    for(int i = 0; i < AabbTreeWidth; ++i)
+    {
+        Aabb box = {.min={INFINITY, INFINITY, INFINITY}, .max={INFINITY, INFINITY, INFINITY}};
+        if(i < numLanes)
+        {
+            auto& node = nodes[lanes[i]];
+            if(node.height == 0)
+            {
+                box = node.exact;
+                wideNode.children[i] = node.userData;
+                wideNode.leafMask |= 1 << i;
+                node.wide = idx * AabbTreeWidth + i;
+                node.changed = false;
+            }
+            else
+            {
+                box = node.aabb;
+                wideNode.children[i] = UpdateWideNode(tree, lanes[i]);
+            }
+        }
+        
+        wideNode.minX[i] = box.min.x; wideNode.minY[i] = box.min.y; wideNode.minZ[i] = box.min.z;
+        wideNode.maxX[i] = box.max.x; wideNode.maxY[i] = box.max.y; wideNode.maxZ[i] = box.max.z;
+    }
+    
+    tree->wide[idx] = wideNode;
+    return idx;
+}
+
+void AabbTreeUpdateWide(AabbTree* tree)
+{
+    // A single leaf is tested directly
+    if(tree->root != AabbTreeNull && tree->nodes[tree->root].height > 0)
+        UpdateWideNode(tree, tree->root);
+}
+
+// Distances to the children of a wide node (see RayAabb4Dst), written
+// to dsts. Returns the mask of the lanes which are closer than maxDst
+static inline u32 RayWideNodeDst(RayInv ray, const AabbTreeWideNode& node, float maxDst, float* dsts)
+{
+#ifdef __AVX2__
+    Aabb8 boxes =
+    {
+        .minX=_mm256_loadu_ps(node.minX), .minY=_mm256_loadu_ps(node.minY), .minZ=_mm256_loadu_ps(node.minZ),
+        .maxX=_mm256_loadu_ps(node.maxX), .maxY=_mm256_loadu_ps(node.maxY), .maxZ=_mm256_loadu_ps(node.maxZ)
+    };
+    __m256 res = RayAabb8Dst(ray, boxes);
+    _mm256_storeu_ps(dsts, res);
+    return (u32)_mm256_movemask_ps(_mm256_cmp_ps(res, _mm256_set1_ps(maxDst), _CMP_LT_OQ));
+#else
+    Aabb4 boxes =
+    {
+        .minX=_mm_loadu_ps(node.minX), .minY=_mm_loadu_ps(node.minY), .minZ=_mm_loadu_ps(node.minZ),
+        .maxX=_mm_loadu_ps(node.maxX), .maxY=_mm_loadu_ps(node.maxY), .maxZ=_mm_loadu_ps(node.maxZ)
+    };
+    __m128 res = RayAabb4Dst(ray, boxes);
+    _mm_storeu_ps(dsts, res);
+    return (u32)_mm_movemask_ps(_mm_cmplt_ps(res, _mm_set1_ps(maxDst)));
+#endif
+}
+
+
+struct AabbTreeStackEntry
+{
+    u32 node;
+    float dst;
+};
+
+// Closest first traversal, which skips subtrees
+// farther away than the closest hit found so far
+RayHit Raycast(AabbTree* tree, Ray ray)
+{
+    RayHit res = {.dst=FLT_MAX, .userData=AabbTreeNull};
+    if(tree->root == AabbTreeNull) return res;
+    
+    RayInv rayInv = MakeRayInv(ray);
+    auto& root = tree->nodes[tree->root];
+    if(root.height == 0)
+    {
+        res.dst = RayAabbDst(rayInv, root.exact);
+        if(res.dst != FLT_MAX) res.userData = root.userData;
+        return res;
+    }
+    
+    AabbTreeUpdateWide(tree);
+    auto& wide = tree->wide;
+    
+    AabbTreeStackEntry stack[AabbTreeMaxStack];
+    int top = 0;
+    stack[top++] = {.node=root.wide, .dst=0.0f};
+    while(top > 0)
+    {
+        AabbTreeStackEntry entry = stack[--top];
+        if(entry.dst >= res.dst) continue;
+        
+        auto& node = wide[entry.node];
+        float dsts[AabbTreeWidth];
+        u32 hitMask = RayWideNodeDst(rayInv, node, res.dst, dsts);
+        
+        // Leaves hold the exact boxes, so their hits are final
+        for(u32 leaves = hitMask & node.leafMask; leaves; leaves &= leaves - 1)
+        {
+            u32 i = CountTrailingZeros(leaves);
+            if(dsts[i] < res.dst)
+            {
+                res.dst = dsts[i];
+                res.userData = node.children[i];
+            }
+        }
+        
+        // Sorted from the farthest to the nearest, so that the nearest
+        // child is visited first. They're all prefetched, as the time
+        // is mostly spent waiting for the nodes when they're not cached
+        AabbTreeStackEntry children[AabbTreeWidth];
+        int numChildren = 0;
+        for(u32 inner = hitMask & ~node.leafMask; inner; inner &= inner - 1)
+        {
+            u32 i = CountTrailingZeros(inner);
+            if(dsts[i] >= res.dst) continue;
+            
+            int j = numChildren++;
+            for(; j > 0 && children[j-1].dst < dsts[i]; --j)
+                children[j] = children[j-1];
+            children[j] = {.node=node.children[i], .dst=dsts[i]};
+            
+            const char* child = (const char*)&wide[node.children[i]];
+            for(int k = 0; k < (int)sizeof(AabbTreeWideNode); k += 64)
+                _mm_prefetch(child + k, _MM_HINT_T0);
+        }
+        
+        assert(top + numChildren <= AabbTreeMaxStack);
+        for(int i = 0; i < numChildren; ++i)
+            stack[top++] = children[i];
+    }
+    
+    return res;
+}
+
+Slice<RayHit> RaycastAll(AabbTree* tree, Ray ray, Arena* arena)
+{
+    Array<RayHit> hits = {};
+    UseArena(&hits, arena);
+    if(tree->root == AabbTreeNull) return ToSlice(&hits);
+    
+    RayInv rayInv = MakeRayInv(ray);
+    auto& root = tree->nodes[tree->root];
+    if(root.height == 0)
+    {
+        float dst = RayAabbDst(rayInv, root.exact);
+        if(dst != FLT_MAX)
+            Append(&hits, {.dst=dst, .userData=root.userData});
+        return ToSlice(&hits);
+    }
+    
+    AabbTreeUpdateWide(tree);
+    auto& wide = tree->wide;
+    
+    u32 stack[AabbTreeMaxStack];
+    int top = 0;
+    stack[top++] = root.wide;
+    while(top > 0)
+    {
+        auto& node = wide[stack[--top]];
+        float dsts[AabbTreeWidth];
+        for(u32 hitMask = RayWideNodeDst(rayInv, node, FLT_MAX, dsts); hitMask; hitMask &= hitMask - 1)
+        {
+            u32 i = CountTrailingZeros(hitMask);
+            if(node.leafMask & (1 << i))
+            {
+                Append(&hits, {.dst=dsts[i], .userData=node.children[i]});
+            }
+            else
+            {
+                assert(top < AabbTreeMaxStack);
+                stack[top++] = node.children[i];
+            }
+        }
+    }
+    
+    // Insertion sort, a single ray usually hits only a handful of objects
+    for(s64 i = 1; i < hits.len; ++i)
+    {
+        RayHit hit = hits[i];
+        s64 j = i - 1;
+        for(; j >= 0 && hits[j].dst > hit.dst; --j)
+            hits[j+1] = hits[j];
+        hits[j+1] = hit;
+    }
+    
+    return ToSlice(&hits);
+}
@@ -15,6 +15,136 @@ struct Aabb
     Vec3 max;
 };
 
+struct Sphere
+{
+    Vec3 center;
+    float radius;
+};
+
+// Planes of a view frustum, as (normal, offset) with the normal
+// pointing inside: dot(normal, p) + offset >= 0 for points inside.
+// There is no near plane, see MakeFrustum
+struct Frustum
+{
+    Vec4 planes[5];
+};
+
+// Ray with the reciprocal of the direction precomputed,
+// for testing the same ray against many boxes. Direction components
+// smaller than RayMinDirComponent are clamped to it (keeping the sign),
+// so the reciprocal stays finite and the slab math never produces NaNs
+struct RayInv
+{
+    Vec3 ori;
+    Vec3 invDir;
+};
+
+// Groups of boxes and rays in structure of arrays layout,
+// for testing them against each other with SIMD
+struct Aabb4
+{
+    __m128 minX, minY, minZ;
+    __m128 maxX, maxY, maxZ;
+};
+
+struct RayPacket4
+{
+    __m128 oriX, oriY, oriZ;
+    __m128 invDirX, invDirY, invDirZ;
+};
+
+struct Sphere4
+{
+    __m128 centerX, centerY, centerZ;
+    __m128 radius;
+};
+
+#ifdef __AVX2__
+struct Aabb8
+{
+    __m256 minX, minY, minZ;
+    __m256 maxX, maxY, maxZ;
+};
+
+struct RayPacket8
+{
+    __m256 oriX, oriY, oriZ;
+    __m256 invDirX, invDirY, invDirZ;
+};
+
+struct Sphere8
+{
+    __m256 centerX, centerY, centerZ;
+    __m256 radius;
+};
+#endif
+
+// Dynamic bounding volume hierarchy, for ray queries
+// on sets of objects that are added, removed and moved
+// over time. Leaves store enlarged boxes (by AabbTreeMargin,
+// and in the direction of movement) so that small movements
+// don't require changing the tree. The exact boxes are kept
+// in the leaves too, for the final hit tests.
+#define AabbTreeNull ((u32)-1)
+#define AabbTreeMargin 0.1f
+#define AabbTreeDisplacementMultiplier 4.0f
+
+struct AabbTreeNode
+{
+    Aabb aabb;
+    Aabb exact;  // Only used by leaves, the box as passed by the user
+    u32 parent;  // Next free node for nodes in the free list
+    u32 left;
+    u32 right;
+    s32 height;  // 0 for leaves, -1 for free nodes
+    u32 userData;  // Only used by leaves
+    
+    // Wide node built from this subtree, AabbTreeNull if none. For
+    // leaves, it's the index of the wide node * AabbTreeWidth + the lane
+    u32 wide;
+    // Set on a node and all its ancestors when the subtree
+    // changes, until the wide copy is brought up to date
+    bool changed;
+    // Set by the batched AabbTreeMove on the ancestors of
+    // leaves which moved out of their box, until they're rebuilt
+    bool enlarged;
+};
+
+// Copy of the tree with AabbTreeWidth children per node, which is
+// what the queries traverse: one SIMD test covers all the children, so
+// there are fewer (and bigger) loads than with the binary nodes. Only
+// the parts which changed are rebuilt. Lanes of leaves hold the exact boxes
+#ifdef __AVX2__
+#define AabbTreeWidth 8
+#else
+#define AabbTreeWidth 4
+#endif
+
+struct AabbTreeWideNode
+{
+    // Empty lanes have all coordinates at +infinity, like in MakeAabb4
+    float minX[AabbTreeWidth], minY[AabbTreeWidth], minZ[AabbTreeWidth];
+    float maxX[AabbTreeWidth], maxY[AabbTreeWidth], maxZ[AabbTreeWidth];
+    u32 children[AabbTreeWidth];  // Index of the wide node, or userData for leaves. Next free node in children[0]
+    u32 leafMask;  // Bit i is set if lane i is a leaf
+};
+
+struct AabbTree
+{
+    Array<AabbTreeNode> nodes;
+    u32 root = AabbTreeNull;
+    u32 freeList = AabbTreeNull;
+    
+    Array<AabbTreeWideNode> wide;
+    u32 wideFreeList = AabbTreeNull;
+};
+
+struct RayHit
+{
+    float dst;  // FLT_MAX if nothing was hit
+    u32 userData;
+};
+
 // Ray manipulation
 Ray CameraRay(int screenX, int screenY, Vec3 pos, Quat rot, float horizontalFov);
 Ray TransformRay(Ray ray, Quat rot);
@@ -24,3 +154,78 @@ Ray TransformRay(Ray ray, Quat rot);
 bool RayBoxIntersection(Ray ray, Quat rot, Aabb local);
 bool RayAabbIntersection(Ray ray, Aabb aabb);
 float RayPlaneDst(Ray ray, Vec3 p, Vec3 normal);
+// Distance at which the ray enters the box, 0 if it starts inside
+float RayAabbDst(Ray ray, Aabb aabb);
+float RayAabbDst(RayInv ray, Aabb aabb);
+
+// SIMD versions of RayAabbDst, which return the distance for
+// each lane. Rays lying on a face of a box count as hitting it
+__m128 RayAabb4Dst(RayInv ray, const Aabb4& boxes);
+__m128 RayPacket4AabbDst(const RayPacket4& rays, Aabb aabb);
+#ifdef __AVX2__
+__m256 RayAabb8Dst(RayInv ray, const Aabb8& boxes);
+__m256 RayPacket8AabbDst(const RayPacket8& rays, Aabb aabb);
+#endif
+
+// Conversions to the SIMD layouts. Lanes past the end of
+// the slice get empty boxes, which are never hit, copies
+// of the first ray (whose results should be ignored) and
+// spheres with a radius of -infinity, which are never visible
+RayInv MakeRayInv(Ray ray);
+Aabb4 MakeAabb4(Slice<Aabb> boxes);
+RayPacket4 MakeRayPacket4(Slice<Ray> rays);
+Sphere4 MakeSphere4(Slice<Sphere> spheres);
+#ifdef __AVX2__
+Aabb8 MakeAabb8(Slice<Aabb> boxes);
+RayPacket8 MakeRayPacket8(Slice<Ray> rays);
+Sphere8 MakeSphere8(Slice<Sphere> spheres);
+#endif
+
+// Frustum culling.
+// world2Proj goes from world space to clip space, with either the
+// OpenGL or the D3D depth range. The near plane is left out since
+// it depends on the range, and the side planes already reject
+// everything behind the viewer
+Frustum MakeFrustum(Mat4 world2Proj);
+// Conservative tests, true if the bounds are at least partially inside
+bool FrustumAabbVisible(const Frustum& frustum, Aabb aabb);
+bool FrustumSphereVisible(const Frustum& frustum, Sphere sphere);
+// SIMD versions, which return a bit mask of the visible lanes
+int FrustumAabb4Visible(const Frustum& frustum, const Aabb4& boxes);
+int FrustumSphere4Visible(const Frustum& frustum, const Sphere4& spheres);
+#ifdef __AVX2__
+int FrustumAabb8Visible(const Frustum& frustum, const Aabb8& boxes);
+int FrustumSphere8Visible(const Frustum& frustum, const Sphere8& spheres);
+#endif
+// Indices of the objects whose box and sphere both pass the test.
+// boxes and spheres are in world space and have the same length
+Slice<u32> FrustumCull(const Frustum& frustum, Slice<Aabb> boxes, Slice<Sphere> spheres, Arena* arena);
+
+// Bounds utilities
+Aabb TransformAabb(Aabb aabb, Mat4 transform);
+// The radius is scaled by the largest scale of the transform
+Sphere TransformSphere(Sphere sphere, Mat4 transform);
+Aabb Union(Aabb a, Aabb b);
+bool Contains(Aabb container, Aabb aabb);
+float SurfaceArea(Aabb aabb);
+
+// Aabb tree manipulation.
+// Insert returns the leaf index, which stays the same until it's removed
+u32 AabbTreeInsert(AabbTree* tree, Aabb aabb, u32 userData);
+void AabbTreeRemove(AabbTree* tree, u32 leaf);
+// Displacement is the movement since the last call, used to
+// predict where the object will be. Returns true if the leaf had to be reinserted
+bool AabbTreeMove(AabbTree* tree, u32 leaf, Aabb aabb, Vec3 displacement);
+// Same for many leaves at once, with the displacement taken from the
+// previous boxes. Cheaper than moving them one by one when many don't fit anymore
+void AabbTreeMove(AabbTree* tree, Slice<u32> leaves, Slice<Aabb> aabbs);
+void FreeAabbTree(AabbTree* tree);
+// Rebuilds the parts of the wide copy which changed. The queries
+// call it too, calling it beforehand keeps the cost out of them
+void AabbTreeUpdateWide(AabbTree* tree);
+
+// Aabb tree queries. The enlarged boxes only decide which subtrees
+// are visited, hits and distances come from the exact boxes of the
+// leaves. RaycastAll returns the hits sorted by distance
+RayHit Raycast(AabbTree* tree, Ray ray);
+Slice<RayHit> RaycastAll(AabbTree* tree, Ray ray, Arena* arena);
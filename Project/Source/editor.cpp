@@ -2,6 +2,7 @@
 #include "editor.h"
 #include "imgui/imgui_internal.h"
 #include "generated/introspection.h"
+#include "renderer_frontend.h"
 
 // Need it for gizmo intersection
 #include "collision.h"
@@ -146,7 +147,6 @@ Editor InitEditor(EntityManager* man)
     
     // Rendering
     //state.selectedFramebuffer = R_CreateFramebuffer(0, 0, true, R_TexR8UI, true, false);
-    //state.entityIdFramebuffer = R_CreateFramebuffer(0, 0, true, R_TexR32I, true, false);
     return state;
 }
 
@@ -212,35 +212,32 @@ void UpdateEditor(Editor* editor, float deltaTime)
             Entity* selected = GetEntity(man, e->selected[0]);
             if(selected)
             {
-                isInteractingWithGizmos = TranslationGizmo("EntityTranslate", e, &selected->pos);
+                Vec3 pos = GetPos(man, selected);
+                isInteractingWithGizmos = TranslationGizmo("EntityTranslate", e, &pos);
+                SetPos(man, selected, pos);
             }
         }
     }
     
     // Clicking on entities
     {
-#if 0
         if(!isInteractingWithGizmos && PressedKey(input, Keycode_LMouse))
         {
-            int width, height;
-            OS_GetClientAreaSize(&width, &height);
-            
-            R_SetFramebuffer(e->entityIdFramebuffer);
-            int picked = R_ReadIntPixelFromFramebuffer(input.mouseX, height - input.mouseY);
-            int numEntities = man->bases.len;
-            assert(picked >= -1 && picked < numEntities);
-            
-            R_SetFramebuffer(R_DefaultFramebuffer());
-            if(picked != -1)
+            // Picks the closest entity using the bounds from the
+            // last UpdateWorldTransforms, so the GPU isn't involved
+            Ray cameraRay = CameraRay((int)input.mouseX, (int)input.mouseY, e->camPos, e->camRot, e->camParams.fov);
+            UpdateBounds(man);
+            RayHit hit = Raycast(&man->bounds, cameraRay);
+            Entity* picked = hit.dst != FLT_MAX? GetEntity(man, hit.userData) : nullptr;
+            if(picked)
             {
-                SelectEntity(e, GetEntity(man, picked));
+                SelectEntity(e, picked);
             }
             else if(!input.unfilteredKeys[Keycode_Ctrl])
             {
                 Free(&e->selected);
             }
         }
-#endif
     }
     
     // Entity list window
@@ -258,7 +255,7 @@ void UpdateEditor(Editor* editor, float deltaTime)
             {
                 Entity* ent = GetEntity(man, e->selected[i]);
                 if(ent)
-                    DestroyEntity(ent);
+                    DestroyEntity(man, ent);
             }
         }
     }
@@ -357,6 +354,14 @@ void UpdateEditor(Editor* editor, float deltaTime)
     if(e->statsWindowOpen)
     {
         ImGui::Begin("Stats", &e->statsWindowOpen);
+        
+        RenderStats stats = GetRenderStats();
+        ImGui::Text("Draws: %u", stats.draws);
+        ImGui::Text("Instances: %u", stats.instances);
+        ImGui::Text("Culled: %u", stats.culled);
+        ImGui::Text("State changes: %u", stats.stateChanges);
+        ImGui::Text("Skipped binds: %u", stats.skippedBinds);
+        
         ImGui::End();
     }
 }
@@ -371,7 +376,6 @@ void RenderEditor(Editor* e, float deltaTime)
     if(width <= 0 || height <= 0) return;
     
     R_ResizeFramebuffer(&e->selectedFramebuffer, width, height);
-    R_ResizeFramebuffer(&e->entityIdFramebuffer, width, height);
     
     // Render pass for selected entities
     R_Shader model2Proj = GetShaderByPath("CompiledShaders/model2proj.shader", ShaderKind_Vertex);
@@ -391,8 +395,8 @@ void RenderEditor(Editor* e, float deltaTime)
             if(!ent) continue;
             if(ent->flags & EntityFlags_Destroyed) continue;
             
-            Mat4 model = ComputeWorldTransform(man, ent);
-            Mat3 normal = ToMat3(transpose(ComputeTransformInverse(model)));
+            Mat4 model = GetWorldTransform(man, ent);
+            Mat3 normal = ToMat3(GetNormalTransform(man, ent));
             R_SetPerObjData(model, normal);
             R_DrawMesh(ent->mesh);
         }
@@ -402,33 +406,6 @@ void RenderEditor(Editor* e, float deltaTime)
         R_AlphaBlending(true);
     }
     
-#if 0
-    // Render pass for entity ids (clicking on entities to select them)
-    {
-        /*
-        R_SetFramebuffer(e->entityIdFramebuffer);
-        R_Pipeline paintId = GetPipelineByPath("CompiledShaders/model2proj.shader", "CompiledShaders/paint_int.shader");
-        R_SetPipeline(paintId);
-        R_ClearFrameInt(-1, -1, -1, -1);
-        */
-        
-        for_live_entities(man, ent)
-        {
-            Mat4 model = ComputeWorldTransform(man, ent);
-            Mat3 normal = ToMat3(transpose(ComputeTransformInverse(model)));
-            R_SetPerObjData(model, normal);
-            
-            // Upload the int uniform here
-            R_UniformValue uniforms[] = { MakeUniformInt(GetId(man, ent)) };
-            R_SetCodeConstants(ent->shader, ArrToSlice(uniforms));
-            
-            R_DrawMesh(ent->mesh);
-        }
-        
-        R_SetFramebuffer(R_DefaultFramebuffer());
-    }
-#endif
-    
     // Draw outline of selected objects
     {
         // Choose color of outline
@@ -471,8 +448,9 @@ void RenderEditor(Editor* e, float deltaTime)
         R_ClearDepth();
         
         auto& table = e->widgetTable;
-        for(int i = 0; i < table.keys.len; ++i)
+        for(int i = 0; i < table.capacity; ++i)
         {
+            if(!IsOccupied(&table, i)) continue;
             Widget* w = &table.values[i];
             
             // TODO: Instead of doing this weird screen to world transformation
@@ -583,8 +561,6 @@ void ShowEntityList(Editor* e)
 {
     EntityManager* man = e->man;
     
-    Slice<Slice<Entity*>> childrenPerEntity = e->man->liveChildrenPerEntity;
-    
     ImGui::Begin("Entities");
     defer { ImGui::End(); };
     
@@ -610,11 +586,11 @@ void ShowEntityList(Editor* e)
     for_live_entities(man, ent)
     {
         if(!GetMount(man, ent))
-            ShowEntityAndChildren(e, ent, childrenPerEntity);
+            ShowEntityAndChildren(e, ent);
     }
 }
 
-void ShowEntityAndChildren(Editor* e, Entity* entity, Slice<Slice<Entity*>> childrenPerEntity)
+void ShowEntityAndChildren(Editor* e, Entity* entity)
 {
     EntityManager* man = e->man;
     
@@ -633,7 +609,7 @@ void ShowEntityAndChildren(Editor* e, Entity* entity, Slice<Slice<Entity*>> chil
     
     ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_SpanAvailWidth;
     bool isLeaf = false;
-    if(childrenPerEntity[id].len == 0)
+    if(!FirstChild(man, entity))
     {
         flags |= ImGuiTreeNodeFlags_Leaf;
         isLeaf = true;
@@ -661,8 +637,8 @@ void ShowEntityAndChildren(Editor* e, Entity* entity, Slice<Slice<Entity*>> chil
         const ImGuiPayload* payload = ImGui::AcceptDragDropPayload("EntityListNode");
         if(payload)
         {
-            Entity* draggedFrom = *(Entity**)payload->Data;
-            if(draggedFrom && !IsChild(man, entity, draggedFrom))
+            Entity* draggedFrom = GetEntity(man, *(EntityKey*)payload->Data);
+            if(draggedFrom && draggedFrom != entity && !IsChild(man, entity, draggedFrom))
             {
                 MountEntity(man, draggedFrom, entity);
             }
@@ -673,7 +649,8 @@ void ShowEntityAndChildren(Editor* e, Entity* entity, Slice<Slice<Entity*>> chil
     
     if(ImGui::BeginDragDropSource())
     {
-        ImGui::SetDragDropPayload("EntityListNode", &entity, sizeof(Entity*));
+        EntityKey key = GetKey(man, entity);
+        ImGui::SetDragDropPayload("EntityListNode", &key, sizeof(EntityKey));
         ImGui::EndDragDropSource();
     }
     
@@ -689,12 +666,10 @@ void ShowEntityAndChildren(Editor* e, Entity* entity, Slice<Slice<Entity*>> chil
     // Children visualization
     if(nodeOpen)
     {
-        Slice<Entity*> children = childrenPerEntity[GetId(man, entity)];
-        for(int i = 0; i < children.len; ++i)
+        for_children(man, ent, entity)
         {
-            Entity* ent = children[i];
             if(!(ent->flags & EntityFlags_Destroyed))
-                ShowEntityAndChildren(e, ent, childrenPerEntity);
+                ShowEntityAndChildren(e, ent);
         }
         
         ImGui::TreePop();
@@ -1004,7 +979,7 @@ void ShowConsole(Editor* e)
     
     // TODO: display items starting from the bottom
     
-    if (ImGui::SmallButton("Add Debug Text"))  { Log("%d some text", console.items.len); Log("some more text"); Log("display very important message here!"); }
+    if (ImGui::SmallButton("Add Debug Text"))  { Log("%d some text", (int)console.items.len); Log("some more text"); Log("display very important message here!"); }
     ImGui::SameLine();
     if (ImGui::SmallButton("Add Debug Error")) { Log("[error] something went wrong"); }
     ImGui::SameLine();
@@ -1191,6 +1166,15 @@ void ShowStructControl(MetaStruct metaStruct, Editor* e, void* address)
         if(metaType == Meta_Unknown) continue;
         if(!member.showEditor)       continue;
         
+        // External members are edited through a copy
+        alignas(16) char externalValue[64];
+        if(member.get)
+        {
+            assert(member.size <= (int)sizeof(externalValue));
+            memberPtr = externalValue;
+            member.get(e->man, address, memberPtr);
+        }
+        
         ImGui::PushID(member.cName);
         ImGui::PushID(i);
         
@@ -1231,6 +1215,9 @@ void ShowStructControl(MetaStruct metaStruct, Editor* e, void* address)
             Meta_RecursiveCases(ShowStructControl, e, memberPtr);
         }
         
+        if(member.set)
+            member.set(e->man, address, memberPtr);
+        
         ImGui::PopID();
         ImGui::PopID();
     }
@@ -1341,9 +1328,9 @@ void RemoveUnusedWidgets(HashMap<ImGuiID, Widget>* table)
     Array<ImGuiID> unused = {};
     UseArena(&unused, scratch);
     
-    for(int i = 0; i < table->values.len; ++i)
+    for(int i = 0; i < table->capacity; ++i)
     {
-        if(table->values[i].lastUsedFrame < Widget::frameCounter)
+        if(IsOccupied(table, i) && table->values[i].lastUsedFrame < Widget::frameCounter)
             Append(&unused, table->keys[i]);
     }
     
@@ -42,7 +42,6 @@ struct Editor
     
     // Rendering
     R_Framebuffer selectedFramebuffer;  // Serves to draw selected objects to
-    R_Framebuffer entityIdFramebuffer;  // Serves to draw entity id to (for clicking on entities)
     
     // Entity list query
     Array<QueryElement> queryElements;
@@ -84,7 +83,7 @@ void UpdateEditor(Editor* editor, float deltaTime);
 void RenderEditor(Editor* editor, float deltaTime);
 void ShowMainMenuBar(Editor* editor);
 void ShowEntityList(Editor* editor);
-void ShowEntityAndChildren(Editor* editor, Entity* entity, Slice<Slice<Entity*>> childrenPerEntity);
+void ShowEntityAndChildren(Editor* editor, Entity* entity);
 void UpdateEditorCamera(Editor* editor, float deltaTime);
 
 int GetEntitySelectionId(Editor* ui, Entity* entity);
@@ -95,7 +94,7 @@ void ClearLog();
 // We're also calling printf every time we log.
 // this is in part to enable the compiler warnings
 // we get when getting the format specifier wrong.
-#define Log(fmt, ...) do { EditorLog(fmt, __VA_ARGS__); printf(fmt "\n", __VA_ARGS__); } while(0)
+#define Log(fmt, ...) do { EditorLog(fmt, ##__VA_ARGS__); printf(fmt "\n", ##__VA_ARGS__); } while(0)
 void EditorLog(const char* fmt, ...);
 void ExecuteCommand(const char* command);
 int TextEditCallback(ImGuiInputTextCallbackData* data);
@@ -18,10 +18,12 @@ EntityManager InitEntityManager()
     const char* raptoidMat   = "Raptoid/raptoid.mat";
     
     // This should be generated by the metaprogram
-    static Arena baseArena   = ArenaVirtualMemInit(GB(4), MB(2));
+    // These only reserve address space. The dense arrays grow to the next
+    // power of 2, so each arena fits tens of millions of entities of its kind
+    static Arena baseArena   = ArenaVirtualMemInit(GB(16), MB(2), true);
     static Arena cameraArena = ArenaVirtualMemInit(MB(64), MB(2));
-    static Arena playerArena = ArenaVirtualMemInit(MB(64), MB(2));
-    static Arena pointLightArena = ArenaVirtualMemInit(GB(1), MB(2));
+    static Arena playerArena = ArenaVirtualMemInit(GB(4), MB(2));
+    static Arena pointLightArena = ArenaVirtualMemInit(GB(4), MB(2));
     UseArena(&man->bases, &baseArena);
     UseArena(&man->cameras, &cameraArena);
     UseArena(&man->players, &playerArena);
@@ -31,18 +33,17 @@ EntityManager InitEntityManager()
     // TODO: Figure out how we want to do scene loading
     
     auto raptoid = NewEntity(man);
-    raptoid->mesh = AcquireMesh(raptoidPath);
-    raptoid->material = AcquireMaterial(raptoidMat);
+    raptoid->mesh = AcquireMeshAsync(raptoidPath);
+    raptoid->material = AcquireMaterialAsync(raptoidMat);
     
     auto quadEnt = NewEntity(man);
-    quadEnt->mesh = AcquireMesh(cubePath);
-    quadEnt->material = AcquireMaterial(raptoidMat);
+    quadEnt->mesh = AcquireMeshAsync(cubePath);
+    quadEnt->material = AcquireMaterialAsync(raptoidMat);
     
     auto camera = NewEntity<Camera>(man);
     camera->base->flags |= EntityFlags_NoMesh;
-    camera->base->pos.z = -8.0f;
-    camera->base->pos.y = 7.0f;
-    camera->base->rot *= AngleAxis(Vec3::right, Deg2Rad(20.0f));
+    SetPos(man, camera->base, {.x=0.0f, .y=7.0f, .z=-8.0f});
+    SetRot(man, camera->base, GetRot(man, camera->base) * AngleAxis(Vec3::right, Deg2Rad(20.0f)));
     camera->fov      = 90.0f;
     camera->nearClip = 0.1f;
     camera->farClip  = 1000.0f;
@@ -50,9 +51,9 @@ EntityManager InitEntityManager()
     man->mainCamera = GetKey(man, camera->base);
     
     auto player = NewEntity<Player>(man);
-    player->base->mesh = AcquireMesh(cylinderPath);
-    player->base->material = AcquireMaterial("player.mat");
-    player->base->scale = {0.5f, 1.0f, 0.5f};
+    player->base->mesh = AcquireMeshAsync(cylinderPath);
+    player->base->material = AcquireMaterialAsync("player.mat");
+    SetScale(man, player->base, {0.5f, 1.0f, 0.5f});
     player->gravity = 20.0f;
     player->jumpVel = 10.0f;
     player->moveSpeed = 4.0f;
@@ -65,18 +66,17 @@ EntityManager InitEntityManager()
     
     {
         Entity* e   = NewEntity(man);
-        e->mesh     = AcquireMesh(spherePath);
-        e->material = AcquireMaterial(raptoidMat);
-        e->pos.x = pos;
-        e->pos.z = -3.0f;
+        e->mesh     = AcquireMeshAsync(spherePath);
+        e->material = AcquireMaterialAsync(raptoidMat);
+        SetPos(man, e, {.x=pos, .y=0.0f, .z=-3.0f});
         pos += 3.0f;
     }
     
     {
         Entity* e = NewEntity(man);
-        e->mesh = AcquireMesh(spherePath);
-        e->material = AcquireMaterial(raptoidMat);
-        e->pos.x = pos;
+        e->mesh = AcquireMeshAsync(spherePath);
+        e->material = AcquireMaterialAsync(raptoidMat);
+        SetPos(man, e, {.x=pos, .y=0.0f, .z=0.0f});
         pos += 3.0f;
     }
     
@@ -85,9 +85,9 @@ EntityManager InitEntityManager()
         for(int i = 0; i < 7; ++i)
         {
             e[i] = NewEntity(man);
-            e[i]->mesh = AcquireMesh(raptoidPath);
-            e[i]->material = AcquireMaterial(raptoidMat);
-            e[i]->pos.x = pos;
+            e[i]->mesh = AcquireMeshAsync(raptoidPath);
+            e[i]->material = AcquireMaterialAsync(raptoidMat);
+            SetPos(man, e[i], {.x=pos, .y=0.0f, .z=0.0f});
             pos += 3.0f;
         }
         
@@ -107,6 +107,47 @@ void FreeEntities(EntityManager* man)
     Free(&man->players);
     Free(&man->pointLights);
     static_assert(4 == Entity_Count, "All entity type arrays should be freed");
+    Free(&man->toDestroy);
+    
+    auto& local = man->localTransforms;
+    Free(&local.posX);
+    Free(&local.posY);
+    Free(&local.posZ);
+    Free(&local.rotW);
+    Free(&local.rotX);
+    Free(&local.rotY);
+    Free(&local.rotZ);
+    Free(&local.scaleX);
+    Free(&local.scaleY);
+    Free(&local.scaleZ);
+    
+    auto& cache = man->transforms;
+    Free(&cache.order);
+    Free(&cache.levelStarts);
+    Free(&cache.parents);
+    Free(&cache.forceUpdate);
+    Free(&cache.updated);
+    Free(&cache.locals.posX);
+    Free(&cache.locals.posY);
+    Free(&cache.locals.posZ);
+    Free(&cache.locals.rotW);
+    Free(&cache.locals.rotX);
+    Free(&cache.locals.rotY);
+    Free(&cache.locals.rotZ);
+    Free(&cache.locals.scaleX);
+    Free(&cache.locals.scaleY);
+    Free(&cache.locals.scaleZ);
+    Free(&cache.localMats);
+    Free(&cache.world);
+    Free(&cache.normal);
+    
+    Free(&man->intervals.preorder);
+    Free(&man->intervals.pre);
+    Free(&man->intervals.post);
+    
+    FreeAabbTree(&man->bounds);
+    Free(&man->boundsLeaves);
+    Free(&man->boundsDirty);
 }
 
 void MainUpdate(EntityManager* man, Editor* editor, float deltaTime, Arena* frameArena, CamParams* outCam)
@@ -130,11 +171,6 @@ void MainUpdate(EntityManager* man, Editor* editor, float deltaTime, Arena* fram
     OS_GetClientAreaSize(&width, &height);
     float aspectRatio = (float)width / (float)height;
     
-    // Per frame computations
-    {
-        man->liveChildrenPerEntity = ComputeAllLiveChildrenForEachEntity(man, frameArena);
-    }
-    
     // Set the camera to be the editor's by default
     outCam->pos = editor->camPos;
     outCam->rot = editor->camRot;
@@ -154,8 +190,8 @@ void MainUpdate(EntityManager* man, Editor* editor, float deltaTime, Arena* fram
         auto cam = GetDerived<Camera>(man, man->mainCamera);
         if(cam)
         {
-            outCam->pos = cam->base->pos;
-            outCam->rot = cam->base->rot;
+            outCam->pos = GetPos(man, cam->base);
+            outCam->rot = GetRot(man, cam->base);
             outCam->fov = cam->fov;
             outCam->nearClip = cam->nearClip;
             outCam->farClip = cam->farClip;
@@ -171,16 +207,100 @@ void MainUpdate(EntityManager* man, Editor* editor, float deltaTime, Arena* fram
     // End of frame activities
     {
         CommitDestroy(man);
+        UpdateWorldTransforms(man);
     }
 }
 
-void UpdateEntities(EntityManager* man, float deltaTime)
+#define EntityUpdateBatchSize 64
+
+// Calls update(derived, cmds) on every live entity of type t.
+// Each batch records its writes to other entities in its own command
+// buffer, and the buffers are applied in order once all batches are done
+template<typename t, typename f>
+static void UpdateInBatches(EntityManager* man, bool parallel, const f& update)
 {
-    Player* player = nullptr;
+    SlotMap<t>* map = GetSlotMapFromType<t>(man);
+    s64 numEntities = map->dense.len;
+    s64 numBatches = (numEntities + EntityUpdateBatchSize - 1) / EntityUpdateBatchSize;
+    if(numBatches <= 0) return;
     
-    for_live_derived(man, p, Player)
+    ScratchArena scratch;
+    EntityCommandBuffer* buffers = ArenaZAllocArray(EntityCommandBuffer, numBatches, scratch);
+    
+    auto updateBatch = [&](EntityCommandBuffer& cmds, s64 batch)
     {
-        UpdatePlayer(man, p, deltaTime);
+        s64 start = batch * EntityUpdateBatchSize;
+        s64 end = start + EntityUpdateBatchSize < numEntities ? start + EntityUpdateBatchSize : numEntities;
+        for(s64 i = start; i < end; ++i)
+        {
+            t* derived = &map->dense.ptr[i];
+            if(derived->base->flags & EntityFlags_Destroyed) continue;
+            
+            update(derived, &cmds);
+        }
+    };
+    
+    if(parallel)
+    {
+        ParallelFor(Slice<EntityCommandBuffer>{.ptr=buffers, .len=numBatches}, 1, updateBatch);
+    }
+    else
+    {
+        for(s64 i = 0; i < numBatches; ++i)
+            updateBatch(buffers[i], i);
+    }
+    
+    for(s64 i = 0; i < numBatches; ++i)
+    {
+        ApplyCommands(man, &buffers[i]);
+        Free(&buffers[i].commands);
+    }
+}
+
+void UpdateEntities(EntityManager* man, float deltaTime, bool parallel)
+{
+    // Kinds are updated one after the other, so an update
+    // function sees the commands of the previous kinds applied
+    UpdateInBatches<Player>(man, parallel, [&](Player* p, EntityCommandBuffer* cmds)
+    {
+        UpdatePlayer(man, p, deltaTime, cmds);
+    });
+}
+
+void PushSetPos(EntityCommandBuffer* cmds, EntityKey target, Vec3 pos)
+{
+    EntityCommand cmd = {.kind=EntityCmd_SetPos, .target=target};
+    cmd.pos = pos;
+    Append(&cmds->commands, cmd);
+}
+
+void PushSetRot(EntityCommandBuffer* cmds, EntityKey target, Quat rot)
+{
+    EntityCommand cmd = {.kind=EntityCmd_SetRot, .target=target};
+    cmd.rot = rot;
+    Append(&cmds->commands, cmd);
+}
+
+void PushDestroy(EntityCommandBuffer* cmds, EntityKey target)
+{
+    EntityCommand cmd = {.kind=EntityCmd_Destroy, .target=target};
+    Append(&cmds->commands, cmd);
+}
+
+void ApplyCommands(EntityManager* man, EntityCommandBuffer* cmds)
+{
+    for(s64 i = 0; i < cmds->commands.len; ++i)
+    {
+        EntityCommand& cmd = cmds->commands[i];
+        Entity* target = GetEntity(man, cmd.target);
+        if(!target) continue;
+        
+        switch(cmd.kind)
+        {
+            case EntityCmd_SetPos:  SetPos(man, target, cmd.pos); break;
+            case EntityCmd_SetRot:  SetRot(man, target, cmd.rot); break;
+            case EntityCmd_Destroy: DestroyEntity(man, target);   break;
+        }
     }
 }
 
@@ -196,13 +316,13 @@ EntityKind GetEntityKindFromType()
     else if constexpr (std::is_same_v<t, PointLight>)
         return Entity_PointLight;
     else
-        static_assert(false, "This type is not derived from entity");
+        static_assert(sizeof(t) == 0, "This type is not derived from entity");
     
     static_assert(4 == Entity_Count, "Every derived type must have a corresponding if");
 }
 
 template<typename t>
-Array<t>* GetArrayFromType(EntityManager* man)
+SlotMap<t>* GetSlotMapFromType(EntityManager* man)
 {
     if constexpr (std::is_same_v<t, Entity>)
         return &man->bases;
@@ -213,7 +333,7 @@ Array<t>* GetArrayFromType(EntityManager* man)
     else if constexpr (std::is_same_v<t, PointLight>)
         return &man->pointLights;
     else
-        static_assert(false, "This type is not derived from entity");
+        static_assert(sizeof(t) == 0, "This type is not derived from entity");
     
     static_assert(4 == Entity_Count, "Every derived type must have a corresponding if");
 }
@@ -241,17 +361,20 @@ bool IsKeyNull(EntityKey key)
 
 Entity* GetEntity(EntityManager* man, EntityKey key)
 {
-    if(IsKeyNull(key)) return nullptr;
-    
-    Entity* res = &man->bases[key.id];
-    if(res->gen != key.gen) return nullptr;
-    
-    return res;
+    return Lookup(&man->bases, {.id=key.id, .gen=key.gen});
 }
 
 Entity* GetEntity(EntityManager* man, u32 id)
 {
-    return &man->bases[id];
+    if(id >= (u32)man->bases.sparse.len) return nullptr;
+    return Lookup(&man->bases, {.id=id, .gen=man->bases.sparse[id].gen});
+}
+
+// Derived entities are owned by their base, so the id is enough
+template<typename t>
+static t* GetDerivedFromId(SlotMap<t>* map, u32 id)
+{
+    return &map->dense[map->sparse[id].idx];
 }
 
 template<typename t>
@@ -259,19 +382,16 @@ t* GetDerived(EntityManager* man, EntityKey key)
 {
     static_assert(!std::is_same_v<t, Entity>, "Use GetEntity instead.");
     
-    if(IsKeyNull(key)) return nullptr;
-    
-    Entity* res = &man->bases[key.id];
-    if(res->gen != key.gen) return nullptr;
+    Entity* res = GetEntity(man, key);
+    if(!res) return nullptr;
     
     if(res->derivedKind != GetEntityKindFromType<t>()) return nullptr;
     
-    Array<t>* derivedArray = GetArrayFromType<t>(man);
-    return derivedArray->ptr + res->derivedId;
+    return GetDerivedFromId(GetSlotMapFromType<t>(man), res->derivedId);
 }
 
 template<typename t>
-t* GetDerived(Entity* entity)
+t* GetDerived(EntityManager* man, Entity* entity)
 {
     static_assert(!std::is_same_v<t, Entity>, "Use GetEntity instead.");
     
@@ -279,8 +399,7 @@ t* GetDerived(Entity* entity)
     
     if(entity->derivedKind != GetEntityKindFromType<t>()) return nullptr;
     
-    Array<t>* derivedArray = GetArrayFromType<t>();
-    return derivedArray->ptr + entity->derivedId;
+    return GetDerivedFromId(GetSlotMapFromType<t>(man), entity->derivedId);
 }
 
 void* GetDerivedAddr(EntityManager* man, Entity* entity)
@@ -289,9 +408,9 @@ void* GetDerivedAddr(EntityManager* man, Entity* entity)
     {
         case Entity_None: return nullptr;
         case Entity_Count: return nullptr;
-        case Entity_Player: return (void*)&man->players[entity->derivedId];
-        case Entity_Camera: return (void*)&man->cameras[entity->derivedId];
-        case Entity_PointLight: return (void*)&man->pointLights[entity->derivedId];
+        case Entity_Player: return (void*)GetDerivedFromId(&man->players, entity->derivedId);
+        case Entity_Camera: return (void*)GetDerivedFromId(&man->cameras, entity->derivedId);
+        case Entity_PointLight: return (void*)GetDerivedFromId(&man->pointLights, entity->derivedId);
     }
     
     return nullptr;
@@ -301,17 +420,15 @@ EntityKey GetKey(EntityManager* man, Entity* entity)
 {
     if(!entity) return NullKey();
     
-    u32 id = (u32)(entity - man->bases.ptr);
-    u16 gen = entity->gen;
-    return {id, gen};
+    SlotKey key = GetKey(&man->bases, entity);
+    return {.id=key.id, .gen=key.gen};
 }
 
 u32 GetId(EntityManager* man, Entity* entity)
 {
     if(!entity) return (u32)-1;
     
-    u32 id = (u32)(entity - man->bases.ptr);
-    return id;
+    return GetKey(&man->bases, entity).id;
 }
 
 Entity* GetMount(EntityManager* man, Entity* entity)
@@ -320,6 +437,179 @@ Entity* GetMount(EntityManager* man, Entity* entity)
     return GetEntity(man, entity->mount);
 }
 
+// The length is kept to a multiple of 8 so that the arrays can be
+// processed in full SIMD lanes; the new entries are zeroed, so that
+// the padding never contains NaNs or denormals
+static void GrowTransformLanes(EntityTransforms* t, s64 minLen)
+{
+    if(minLen <= t->posX.len) return;
+    
+    s64 oldLen = t->posX.len;
+    s64 newLen = (s64)AlignForward((uintptr_t)minLen, 8);
+    Array<float>* arrays[] = { &t->posX, &t->posY, &t->posZ, &t->rotW, &t->rotX, &t->rotY, &t->rotZ, &t->scaleX, &t->scaleY, &t->scaleZ };
+    for(int i = 0; i < ArrayCount(arrays); ++i)
+    {
+        Resize(arrays[i], newLen);
+        memset(arrays[i]->ptr + oldLen, 0, sizeof(float) * (newLen - oldLen));
+    }
+}
+
+// Makes sure the local transform arrays have an entry for the given id
+static void GrowLocalTransforms(EntityManager* man, u32 id)
+{
+    GrowTransformLanes(&man->localTransforms, (s64)id + 1);
+}
+
+static Transform GetLocalTransform(EntityManager* man, u32 id)
+{
+    auto& t = man->localTransforms;
+    Transform res = {};
+    res.position = {.x=t.posX[id], .y=t.posY[id], .z=t.posZ[id]};
+    res.rotation.w = t.rotW[id];
+    res.rotation.x = t.rotX[id];
+    res.rotation.y = t.rotY[id];
+    res.rotation.z = t.rotZ[id];
+    res.scale = {.x=t.scaleX[id], .y=t.scaleY[id], .z=t.scaleZ[id]};
+    return res;
+}
+
+static void SetLocalTransform(EntityManager* man, u32 id, Transform value)
+{
+    auto& t = man->localTransforms;
+    t.posX[id] = value.position.x;
+    t.posY[id] = value.position.y;
+    t.posZ[id] = value.position.z;
+    t.rotW[id] = value.rotation.w;
+    t.rotX[id] = value.rotation.x;
+    t.rotY[id] = value.rotation.y;
+    t.rotZ[id] = value.rotation.z;
+    t.scaleX[id] = value.scale.x;
+    t.scaleY[id] = value.scale.y;
+    t.scaleZ[id] = value.scale.z;
+}
+
+Vec3 GetPos(EntityManager* man, Entity* entity)
+{
+    auto& t = man->localTransforms;
+    u32 id = GetId(man, entity);
+    return {.x=t.posX[id], .y=t.posY[id], .z=t.posZ[id]};
+}
+
+Quat GetRot(EntityManager* man, Entity* entity)
+{
+    auto& t = man->localTransforms;
+    u32 id = GetId(man, entity);
+    Quat res = {};
+    res.w = t.rotW[id];
+    res.x = t.rotX[id];
+    res.y = t.rotY[id];
+    res.z = t.rotZ[id];
+    return res;
+}
+
+Vec3 GetScale(EntityManager* man, Entity* entity)
+{
+    auto& t = man->localTransforms;
+    u32 id = GetId(man, entity);
+    return {.x=t.scaleX[id], .y=t.scaleY[id], .z=t.scaleZ[id]};
+}
+
+void SetPos(EntityManager* man, Entity* entity, Vec3 pos)
+{
+    auto& t = man->localTransforms;
+    u32 id = GetId(man, entity);
+    t.posX[id] = pos.x;
+    t.posY[id] = pos.y;
+    t.posZ[id] = pos.z;
+}
+
+void SetRot(EntityManager* man, Entity* entity, Quat rot)
+{
+    auto& t = man->localTransforms;
+    u32 id = GetId(man, entity);
+    t.rotW[id] = rot.w;
+    t.rotX[id] = rot.x;
+    t.rotY[id] = rot.y;
+    t.rotZ[id] = rot.z;
+}
+
+void SetScale(EntityManager* man, Entity* entity, Vec3 scale)
+{
+    auto& t = man->localTransforms;
+    u32 id = GetId(man, entity);
+    t.scaleX[id] = scale.x;
+    t.scaleY[id] = scale.y;
+    t.scaleZ[id] = scale.z;
+}
+
+// Makes sure the transform cache has an entry for every entity id
+static void GrowTransformCache(EntityManager* man)
+{
+    auto& cache = man->transforms;
+    s64 numIds = man->bases.sparse.len;
+    s64 oldLen = cache.world.len;
+    if(numIds <= oldLen) return;
+    
+    Resize(&cache.parents, numIds);
+    Resize(&cache.forceUpdate, numIds);
+    Resize(&cache.updated, numIds);
+    Resize(&cache.world, numIds);
+    Resize(&cache.normal, numIds);
+    Resize(&man->boundsLeaves, numIds);
+    Resize(&man->boundsDirty, numIds);
+    GrowTransformLanes(&cache.locals, numIds);
+    Resize(&cache.localMats, cache.locals.posX.len);
+    
+    for(s64 i = oldLen; i < numIds; ++i)
+    {
+        man->boundsLeaves[i] = AabbTreeNull;
+        man->boundsDirty[i]  = false;
+        cache.parents[i]     = (u32)-1;
+        cache.forceUpdate[i] = true;
+        cache.updated[i]     = false;
+        cache.world[i]       = Mat4::identity;
+        cache.normal[i]      = Mat4::identity;
+    }
+}
+
+// Adds the entity to the children list of its mount
+static void LinkToMount(EntityManager* man, Entity* entity, Entity* mount)
+{
+    u32 id = GetId(man, entity);
+    entity->prevSibling = NullEntityId;
+    entity->nextSibling = mount->firstChild;
+    if(mount->firstChild != NullEntityId)
+        GetEntity(man, mount->firstChild)->prevSibling = id;
+    mount->firstChild = id;
+}
+
+// Removes the entity from the children list of its mount
+static void UnlinkFromMount(EntityManager* man, Entity* entity)
+{
+    Entity* mount = GetMount(man, entity);
+    if(!mount) return;
+    
+    if(entity->prevSibling != NullEntityId)
+        GetEntity(man, entity->prevSibling)->nextSibling = entity->nextSibling;
+    else
+        mount->firstChild = entity->nextSibling;
+    
+    if(entity->nextSibling != NullEntityId)
+        GetEntity(man, entity->nextSibling)->prevSibling = entity->prevSibling;
+    
+    entity->prevSibling = NullEntityId;
+    entity->nextSibling = NullEntityId;
+}
+
+// To be called when an entity is created or mounted to a different entity
+static void InvalidateHierarchy(EntityManager* man, Entity* entity)
+{
+    GrowTransformCache(man);
+    man->transforms.forceUpdate[GetId(man, entity)] = true;
+    man->transforms.orderDirty = true;
+    man->intervals.dirty = true;
+}
+
 void MountEntity(EntityManager* man, Entity* entity, Entity* mountTo)
 {
     if(!GetMount(man, entity) && !mountTo) return;
@@ -330,9 +620,13 @@ void MountEntity(EntityManager* man, Entity* entity, Entity* mountTo)
     
     // First, get the current world transform of both entities
     Mat4 worldEntity = ComputeWorldTransform(man, entity);
+    InvalidateHierarchy(man, entity);
+    UnlinkFromMount(man, entity);
     if(!mountTo)
     {
-        PosRotScaleFromMat4(worldEntity, &entity->pos, &entity->rot, &entity->scale);
+        Transform local = {};
+        PosRotScaleFromMat4(worldEntity, &local.position, &local.rotation, &local.scale);
+        SetLocalTransform(man, GetId(man, entity), local);
         entity->mount = NullKey();
         return;
     }
@@ -342,21 +636,26 @@ void MountEntity(EntityManager* man, Entity* entity, Entity* mountTo)
     // Then turn it into a relative transform
     // with respect to the mounted entity
     worldEntity = ComputeTransformInverse(worldMountTo) * worldEntity;
-    PosRotScaleFromMat4(worldEntity, &entity->pos, &entity->rot, &entity->scale);
+    Transform local = {};
+    PosRotScaleFromMat4(worldEntity, &local.position, &local.rotation, &local.scale);
+    SetLocalTransform(man, GetId(man, entity), local);
     
     entity->mount = GetKey(man, mountTo);
+    LinkToMount(man, entity, mountTo);
 }
 
 Mat4 ComputeWorldTransform(EntityManager* man, Entity* entity)
 {
     if(!entity) return Mat4::identity;
     
-    Mat4 worldTransform = Mat4FromPosRotScale(entity->pos, entity->rot, entity->scale);
+    Transform local = GetLocalTransform(man, GetId(man, entity));
+    Mat4 worldTransform = Mat4FromPosRotScale(local.position, local.rotation, local.scale);
     
     Entity* mount = GetMount(man, entity);
     while(mount)
     {
-        Mat4 transform = Mat4FromPosRotScale(mount->pos, mount->rot, mount->scale);
+        Transform mountLocal = GetLocalTransform(man, GetId(man, mount));
+        Mat4 transform = Mat4FromPosRotScale(mountLocal.position, mountLocal.rotation, mountLocal.scale);
         worldTransform = transform * worldTransform;
         
         mount = GetMount(man, mount);
@@ -373,33 +672,282 @@ Mat4 ConvertToLocalTransform(EntityManager* man, Entity* entity, Mat4 world)
     return ComputeTransformInverse(mountTransform) * world;
 }
 
-Entity* NewEntity(EntityManager* man)
+// Sorts live entities by depth with a counting sort, so that mounts
+// always precede the entities mounted to them. This is O(n) as the
+// depth of each entity is computed only once.
+static void RebuildTransformOrder(EntityManager* man)
 {
-    u32 freeSlot = 0;
-    if(man->freeBases.len > 0)
+    auto& cache = man->transforms;
+    auto& bases = man->bases;
+    ScratchArena scratch;
+    
+    const u32 unknown = (u32)-1;
+    s64 numIds = cache.world.len;
+    u32* depths = ArenaAllocArray(u32, numIds, scratch);
+    u32* stack  = ArenaAllocArray(u32, numIds, scratch);
+    for(s64 i = 0; i < numIds; ++i)
+        depths[i] = unknown;
+    
+    for(s64 i = 0; i < bases.dense.len; ++i)
     {
-        freeSlot = man->freeBases[man->freeBases.len - 1];
-        --man->freeBases.len;
+        Entity* mount = GetMount(man, &bases.dense[i]);
+        cache.parents[bases.denseToSparse[i]] = mount? GetId(man, mount) : unknown;
+    }
+    
+    u32 numLevels = 0;
+    for(s64 i = 0; i < bases.dense.len; ++i)
+    {
+        // Go up until an entity with known depth (or the root) is found
+        u32 id = bases.denseToSparse[i];
+        int top = 0;
+        while(id != unknown && depths[id] == unknown)
+        {
+            stack[top++] = id;
+            id = cache.parents[id];
+        }
+        
+        // Then go back down
+        u32 depth = id == unknown? 0 : depths[id] + 1;
+        while(top > 0)
+            depths[stack[--top]] = depth++;
         
-        // Wipe out everything except for the generation
-        u32 gen = man->bases[freeSlot].gen;
-        man->bases[freeSlot] = {0};
-        man->bases[freeSlot].gen = gen;
+        if(depth > numLevels) numLevels = depth;
     }
-    else
+    
+    Resize(&cache.levelStarts, numLevels + 1);
+    for(u32 i = 0; i <= numLevels; ++i)
+        cache.levelStarts[i] = 0;
+    
+    for(s64 i = 0; i < bases.dense.len; ++i)
+        ++cache.levelStarts[depths[bases.denseToSparse[i]] + 1];
+    for(u32 i = 1; i <= numLevels; ++i)
+        cache.levelStarts[i] += cache.levelStarts[i-1];
+    
+    // The stack is not needed anymore, reuse it for the insertion point of each level
+    u32* cursors = stack;
+    for(u32 i = 0; i < numLevels; ++i)
+        cursors[i] = cache.levelStarts[i];
+    
+    Resize(&cache.order, bases.dense.len);
+    for(s64 i = 0; i < bases.dense.len; ++i)
+    {
+        u32 id = bases.denseToSparse[i];
+        cache.order[cursors[depths[id]]++] = id;
+    }
+    
+    cache.orderDirty = false;
+}
+
+// Bounds stored in the mesh file (or computed on load for older
+// files). Entities with EntityFlags_NoMesh get a small box centered
+// on the origin, so they can still be clicked on
+Aabb GetLocalAabb(EntityManager* man, Entity* entity)
+{
+    if(entity->flags & EntityFlags_NoMesh)
+    {
+        Vec3 extents = {.x=0.25f, .y=0.25f, .z=0.25f};
+        return {.min=-extents, .max=extents};
+    }
+    
+    return GetAsset(entity->mesh)->aabb;
+}
+
+// Bit i is set if a[i] and b[i] differ, for 8 consecutive floats. Bits
+// are compared, so that even NaNs don't cause updates every frame
+static inline u32 DifferentLanes8(const float* a, const float* b)
+{
+#ifdef __AVX2__
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)a), _mm256_loadu_si256((const __m256i*)b));
+    u32 eqMask = (u32)_mm256_movemask_ps(_mm256_castsi256_ps(eq));
+#else
+    __m128i eqLo = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+    __m128i eqHi = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(a + 4)), _mm_loadu_si128((const __m128i*)(b + 4)));
+    u32 eqMask = (u32)_mm_movemask_ps(_mm_castsi128_ps(eqLo)) | ((u32)_mm_movemask_ps(_mm_castsi128_ps(eqHi)) << 4);
+#endif
+    return ~eqMask & 0xFF;
+}
+
+void UpdateWorldTransforms(EntityManager* man)
+{
+    auto& cache = man->transforms;
+    
+    GrowTransformCache(man);
+    if(cache.orderDirty)
+        RebuildTransformOrder(man);
+    
+    // Local matrices are rebuilt straight from the lanes, 8 consecutive ids
+    // at a time, for the groups where any local transform changed. Here
+    // updated only means that the local transform changed, the hierarchy
+    // is taken into account below
+    EntityTransforms& src = man->localTransforms;
+    EntityTransforms& dst = cache.locals;
+    Array<float>* srcLanes[] = { &src.posX, &src.posY, &src.posZ, &src.rotW, &src.rotX, &src.rotY, &src.rotZ, &src.scaleX, &src.scaleY, &src.scaleZ };
+    Array<float>* dstLanes[] = { &dst.posX, &dst.posY, &dst.posZ, &dst.rotW, &dst.rotX, &dst.rotY, &dst.rotZ, &dst.scaleX, &dst.scaleY, &dst.scaleZ };
+    s64 numIds = cache.updated.len;
+    assert(src.posX.len >= dst.posX.len && dst.posX.len >= numIds);
+    for(s64 i = 0; i < numIds; i += 8)
     {
-        Append(&man->bases, {0});
-        freeSlot = man->bases.len - 1;
+        s64 groupLen = min(numIds - i, (s64)8);
+        u32 changed = 0;
+        for(int j = 0; j < ArrayCount(srcLanes); ++j)
+            changed |= DifferentLanes8(srcLanes[j]->ptr + i, dstLanes[j]->ptr + i);
+        for(s64 j = 0; j < groupLen; ++j)
+            changed |= (u32)cache.forceUpdate[i + j] << j;
+        
+        for(s64 j = 0; j < groupLen; ++j)
+        {
+            cache.updated[i + j] = (changed >> j) & 1;
+            cache.forceUpdate[i + j] = false;
+        }
+        
+        if(!changed) continue;
+        
+        for(int j = 0; j < ArrayCount(srcLanes); ++j)
+            memcpy(dstLanes[j]->ptr + i, srcLanes[j]->ptr + i, sizeof(float) * 8);
+        
+        TransformLanes lanes =
+        {
+            .posX=dst.posX.ptr + i, .posY=dst.posY.ptr + i, .posZ=dst.posZ.ptr + i,
+            .rotW=dst.rotW.ptr + i, .rotX=dst.rotX.ptr + i, .rotY=dst.rotY.ptr + i, .rotZ=dst.rotZ.ptr + i,
+            .scaleX=dst.scaleX.ptr + i, .scaleY=dst.scaleY.ptr + i, .scaleZ=dst.scaleZ.ptr + i
+        };
+        Mat4FromTransforms({.ptr=cache.localMats.ptr + i, .len=8}, lanes);
     }
     
-    Entity* entity = &man->bases[freeSlot];
-    entity->pos = {0};
-    entity->rot = Quat::identity;
-    entity->scale = {.x=1.0f, .y=1.0f, .z=1.0f};
-    entity->mount = NullKey();
-    entity->mesh     = {};
-    entity->material = {};
-    return entity;
+    ScratchArena scratch;
+    s64 maxBatch = cache.order.len;
+    u32*  batchIds   = ArenaAllocArray(u32, maxBatch, scratch);
+    Mat4* batchLocal = ArenaAllocArray(Mat4, maxBatch, scratch);
+    Mat4* batchMount = ArenaAllocArray(Mat4, maxBatch, scratch);
+    Mat4* batchWorld = ArenaAllocArray(Mat4, maxBatch, scratch);
+    
+    // Each level only depends on the previous one, so the changed
+    // transforms of each level are computed in a single batch
+    for(s64 level = 0; level < cache.levelStarts.len - 1; ++level)
+    {
+        s64 batchLen = 0;
+        for(u32 i = cache.levelStarts[level]; i < cache.levelStarts[level+1]; ++i)
+        {
+            u32 id = cache.order[i];
+            u32 parent = cache.parents[id];
+            bool changed = cache.updated[id] || (parent != (u32)-1 && cache.updated[parent]);
+            cache.updated[id] = changed;
+            if(!changed) continue;
+            
+            batchIds[batchLen]   = id;
+            batchLocal[batchLen] = cache.localMats[id];
+            batchMount[batchLen] = parent == (u32)-1? Mat4::identity : cache.world[parent];
+            ++batchLen;
+        }
+        
+        if(batchLen <= 0) continue;
+        
+        Slice<Mat4> world = {.ptr=batchWorld, .len=batchLen};
+        Mat4Multiply(world, {.ptr=batchMount, .len=batchLen}, {.ptr=batchLocal, .len=batchLen});
+        
+        for(s64 i = 0; i < batchLen; ++i)
+        {
+            u32 id = batchIds[i];
+            cache.world[id]  = world[i];
+            cache.normal[id] = transpose(ComputeTransformInverse(world[i]));
+            man->boundsDirty[id] = true;
+        }
+    }
+    
+    man->worldTransforms  = ToSlice(&cache.world);
+    man->normalTransforms = ToSlice(&cache.normal);
+}
+
+// Only the editor queries the bounds, so instead of moving the leaves
+// in the transform update every frame, they are moved here in a
+// single batch when needed
+void UpdateBounds(EntityManager* man)
+{
+    auto& cache = man->transforms;
+    
+    // Meshes which finished loading change the bounds of
+    // the entities using them, even if they didn't move
+    u32 meshLoads = GetMeshLoadCount();
+    bool meshesLoaded = meshLoads != man->boundsMeshLoads;
+    man->boundsMeshLoads = meshLoads;
+    
+    ScratchArena scratch;
+    s64 numIds = man->boundsDirty.len;
+    u32*  leaves = ArenaAllocArray(u32, numIds, scratch);
+    Aabb* aabbs  = ArenaAllocArray(Aabb, numIds, scratch);
+    s64 numMoved = 0;
+    for(s64 i = 0; i < numIds; ++i)
+    {
+        u32 id = (u32)i;
+        if(!man->boundsDirty[id] && !meshesLoaded) continue;
+        
+        // Entities created after the last UpdateWorldTransforms
+        // don't have a world transform yet
+        Entity* entity = GetEntity(man, id);
+        if(!entity || cache.forceUpdate[id]) continue;
+        if(!man->boundsDirty[id] && (entity->flags & EntityFlags_NoMesh)) continue;
+        
+        man->boundsDirty[id] = false;
+        Aabb aabb = TransformAabb(GetLocalAabb(man, entity), cache.world[id]);
+        if(man->boundsLeaves[id] == AabbTreeNull)
+        {
+            man->boundsLeaves[id] = AabbTreeInsert(&man->bounds, aabb, id);
+        }
+        else
+        {
+            leaves[numMoved] = man->boundsLeaves[id];
+            aabbs[numMoved]  = aabb;
+            ++numMoved;
+        }
+    }
+    
+    AabbTreeMove(&man->bounds, {.ptr=leaves, .len=numMoved}, {.ptr=aabbs, .len=numMoved});
+    AabbTreeUpdateWide(&man->bounds);
+}
+
+// Falls back to computing it if the entity has been created
+// or remounted after the last UpdateWorldTransforms
+Mat4 GetWorldTransform(EntityManager* man, Entity* entity)
+{
+    if(!entity) return Mat4::identity;
+    
+    u32 id = GetId(man, entity);
+    if(id >= (u32)man->worldTransforms.len || man->transforms.forceUpdate[id])
+        return ComputeWorldTransform(man, entity);
+    
+    return man->worldTransforms[id];
+}
+
+Mat4 GetNormalTransform(EntityManager* man, Entity* entity)
+{
+    if(!entity) return Mat4::identity;
+    
+    u32 id = GetId(man, entity);
+    if(id >= (u32)man->normalTransforms.len || man->transforms.forceUpdate[id])
+        return transpose(ComputeTransformInverse(ComputeWorldTransform(man, entity)));
+    
+    return man->normalTransforms[id];
+}
+
+Entity* NewEntity(EntityManager* man)
+{
+    Entity entity = {0};
+    entity.mount = NullKey();
+    entity.mesh     = {};
+    entity.material = {};
+    entity.firstChild  = NullEntityId;
+    entity.nextSibling = NullEntityId;
+    entity.prevSibling = NullEntityId;
+    
+    Append(&man->bases, entity);
+    Entity* res = &man->bases.dense[man->bases.dense.len - 1];
+    
+    u32 id = GetId(man, res);
+    GrowLocalTransforms(man, id);
+    SetLocalTransform(man, id, {.position={0}, .rotation=Quat::identity, .scale={.x=1.0f, .y=1.0f, .z=1.0f}});
+    
+    InvalidateHierarchy(man, res);
+    return res;
 }
 
 // Default constructor for a given derived type
@@ -414,154 +962,273 @@ t* NewEntity(EntityManager* man)
     {
         auto base = NewEntity(man);
         
-        Array<t>* array = GetArrayFromType<t>(man);
-        Append(array, {0});
+        SlotMap<t>* map = GetSlotMapFromType<t>(man);
+        SlotKey key = Append(map, {0});
         
-        t* derived = array->ptr + array->len - 1;
+        t* derived = GetDerivedFromId(map, key.id);
         derived->base = base;
         base->derivedKind = GetEntityKindFromType<t>();
-        base->derivedId = array->len - 1;
+        base->derivedId = key.id;
         return derived;
     }
 }
 
-void DestroyEntity(Entity* entity)
+void DestroyEntity(EntityManager* man, Entity* entity)
 {
     if(!entity) return;
+    if(entity->flags & EntityFlags_Destroyed) return;
+    
     entity->flags |= EntityFlags_Destroyed;
+    Append(&man->toDestroy, GetKey(man, entity));
 }
 
+template<typename t>
+static void RemoveDerived(SlotMap<t>* map, u32 id)
+{
+    Remove(map, {.id=id, .gen=map->sparse[id].gen});
+}
+
+// Removes the derived entity, if present
+static void DestroyDerived(EntityManager* man, Entity* entity)
+{
+    switch(entity->derivedKind)
+    {
+        case Entity_None: break;
+        case Entity_Count: break;
+        case Entity_Player: RemoveDerived(&man->players, entity->derivedId); break;
+        case Entity_Camera: RemoveDerived(&man->cameras, entity->derivedId); break;
+        case Entity_PointLight: RemoveDerived(&man->pointLights, entity->derivedId); break;
+    }
+    
+    static_assert(4 == Entity_Count, "Every derived type must have a corresponding case");
+}
+
+// Only touches the destroyed entities and their subtrees,
+// so it costs nothing if nothing has been destroyed
 void CommitDestroy(EntityManager* man)
 {
-    for(u32 i = 0; i < (u32)man->bases.len; ++i)
+    if(man->toDestroy.len <= 0) return;
+    defer { man->toDestroy.len = 0; };
+    
+    // The stack uses the heap, as two arrays can't grow on the same arena at once
+    ScratchArena scratch;
+    Array<u32> ids = {};
+    Array<u32> stack = {};
+    UseArena(&ids, scratch);
+    
+    // Gather the entities mounted (directly or indirectly) to
+    // destroyed entities, they are destroyed as well
+    for(s64 i = 0; i < man->toDestroy.len; ++i)
     {
-        Entity* ent = &man->bases[i];
-        u32 entId = i;
+        Entity* root = GetEntity(man, man->toDestroy[i]);
+        if(!root) continue;
         
-        bool toBeDestroyed = ent->flags & EntityFlags_Destroyed;
-        if(!toBeDestroyed) // Check mounts as well
+        // If a mount is being destroyed, this subtree is visited from there
+        bool mountDestroyed = false;
+        for(Entity* mount = GetMount(man, root); mount; mount = GetMount(man, mount))
         {
-            Entity* mount = ent;
-            while(mount)
+            if(mount->flags & EntityFlags_Destroyed)
             {
-                if(mount->flags & EntityFlags_Destroyed)
-                {
-                    toBeDestroyed = true;
-                    break;
-                }
-                
-                mount = GetMount(man, mount);
+                mountDestroyed = true;
+                break;
             }
         }
         
-        if(toBeDestroyed)
+        if(mountDestroyed) continue;
+        
+        UnlinkFromMount(man, root);
+        
+        Append(&stack, GetId(man, root));
+        while(stack.len > 0)
         {
-            // Destroy this entity completely (add it to the freeBases array)
-            Append(&man->freeBases, entId);
-            ent->flags |= EntityFlags_Destroyed;
-            
-            // This nullifies all references to this entity
-            ++ent->gen;
+            u32 id = stack[stack.len - 1];
+            Pop(&stack);
+            Append(&ids, id);
             
-            // TODO: @leak Remove entity from derived type array as well
+            Entity* ent = GetEntity(man, id);
+            ent->flags |= EntityFlags_Destroyed;
+            for(u32 child = ent->firstChild; child != NullEntityId; child = GetEntity(man, child)->nextSibling)
+                Append(&stack, child);
+        }
+    }
+    
+    Free(&stack);
+    
+    // Then remove them. Removing moves the last entity in place of the
+    // removed one, so entities are looked up by id every time
+    for(s64 i = 0; i < ids.len; ++i)
+    {
+        Entity* ent = GetEntity(man, ids[i]);
+        DestroyDerived(man, ent);
+        
+        // Entities which haven't been through UpdateWorldTransforms yet don't have a leaf
+        if(ids[i] < (u32)man->boundsLeaves.len && man->boundsLeaves[ids[i]] != AabbTreeNull)
+        {
+            AabbTreeRemove(&man->bounds, man->boundsLeaves[ids[i]]);
+            man->boundsLeaves[ids[i]] = AabbTreeNull;
         }
+        
+        // This nullifies all references to this entity
+        Entity* moved = Remove(&man->bases, GetKey(&man->bases, ent));
+        
+        // The derived entity of the moved one needs to point to its new address.
+        // All derived types have the pointer to the base as the first member.
+        if(moved && moved->derivedKind != Entity_None)
+            *(Entity**)GetDerivedAddr(man, moved) = moved;
     }
     
+    man->transforms.orderDirty = true;
+    man->intervals.dirty = true;
 }
 
 // Entity iteration
-Entity* FirstLive(EntityManager* man)
+// Entities are densely packed in the slot maps, which are kept in
+// sync by NewEntity and CommitDestroy, so there are no dead slots to
+// skip. The only entities to skip are those destroyed in the current
+// frame, and there can only be any if something is waiting for
+// CommitDestroy. In the common case iteration is a plain linear scan,
+// which doesn't even touch the base entities when iterating derived ones.
+template<typename t>
+static t* SkipDestroyed(EntityManager* man, SlotMap<t>* map, s64 idx)
 {
-    u32 id = 0;
-    while(id < (u32)man->bases.len && (man->bases[id].flags & EntityFlags_Destroyed))
-        ++id;
+    if(man->toDestroy.len > 0)
+    {
+        while(idx < map->dense.len)
+        {
+            Entity* base;
+            if constexpr (std::is_same_v<t, Entity>)
+                base = &map->dense.ptr[idx];
+            else
+                base = map->dense.ptr[idx].base;
+            
+            if(!(base->flags & EntityFlags_Destroyed)) break;
+            ++idx;
+        }
+    }
     
-    if(id >= (u32)man->bases.len) return nullptr;
+    if(idx >= map->dense.len) return nullptr;
     
-    return &man->bases[id];
+    return &map->dense.ptr[idx];
+}
+
+Entity* FirstLive(EntityManager* man)
+{
+    return SkipDestroyed(man, &man->bases, 0);
 }
 
 Entity* NextLive(EntityManager* man, Entity* current)
 {
     if(!current) return nullptr;
     
-    u32 id = GetKey(man, current).id + 1;
-    while(id < (u32)man->bases.len && (man->bases[id].flags & EntityFlags_Destroyed))
-        ++id;
-    
-    if(id >= (u32)man->bases.len) return nullptr;
-    
-    return &man->bases[id];
+    return SkipDestroyed(man, &man->bases, current - man->bases.dense.ptr + 1);
 }
 
 template<typename t>
 t* FirstDerivedLive(EntityManager* man)
 {
-    u32 id = 0;
-    Array<t>* array = GetArrayFromType<t>(man);
-    while(id < (u32)array->len && ((*array)[id].base->flags & EntityFlags_Destroyed))
-        ++id;
-    
-    if(id >= (u32)array->len) return nullptr;
-    
-    return array->ptr + id;
+    return SkipDestroyed(man, GetSlotMapFromType<t>(man), 0);
 }
 
 template<typename t>
 t* NextDerivedLive(EntityManager* man, t* current)
 {
-    u32 id = GetKey(man, current->base).id + 1;
-    Array<t>* array = GetArrayFromType<t>(man);
-    while(id < (u32)array->len && ((*array)[id].base->flags & EntityFlags_Destroyed))
-        ++id;
-    
-    if(id >= (u32)array->len) return nullptr;
+    if(!current) return nullptr;
     
-    return array->ptr + id;
+    SlotMap<t>* map = GetSlotMapFromType<t>(man);
+    return SkipDestroyed(man, map, current - map->dense.ptr + 1);
+}
+
+Entity* FirstChild(EntityManager* man, Entity* entity)
+{
+    if(!entity || entity->firstChild == NullEntityId) return nullptr;
+    return GetEntity(man, entity->firstChild);
 }
 
-Slice<Slice<Entity*>> ComputeAllLiveChildrenForEachEntity(EntityManager* man, Arena* dst)
+Entity* NextSibling(EntityManager* man, Entity* entity)
 {
-    auto resPtr = ArenaZAllocArray(Slice<Entity*>, man->bases.len, dst);
-    Slice<Slice<Entity*>> res = {.ptr = resPtr, .len = man->bases.len };
+    if(!entity || entity->nextSibling == NullEntityId) return nullptr;
+    return GetEntity(man, entity->nextSibling);
+}
+
+// Numbers the entities with a depth first traversal of the mount
+// hierarchy, in O(n). Only done when the hierarchy has changed
+static void UpdateHierarchyIntervals(EntityManager* man)
+{
+    auto& iv = man->intervals;
+    if(!iv.dirty) return;
+    
+    auto& bases = man->bases;
+    s64 numIds = bases.sparse.len;
+    Resize(&iv.pre, numIds);
+    Resize(&iv.post, numIds);
+    Resize(&iv.preorder, bases.dense.len);
     
     ScratchArena scratch;
-    auto ptr = ArenaZAllocArray(Array<Entity*>, man->bases.len, dst);
-    Slice<Array<Entity*>> childrenPerEntity = {.ptr = ptr, .len = man->bases.len };
-    defer
-    {
-        for(int i = 0; i < childrenPerEntity.len; ++i)
-            Free(&childrenPerEntity[i]);
-    };
+    u32* stack = ArenaAllocArray(u32, bases.dense.len, scratch);
     
-    for_live_entities(man, ent)
+    u32 count = 0;
+    for(s64 i = 0; i < bases.dense.len; ++i)
     {
-        Entity* mount = GetMount(man, ent);
-        if(mount && !(mount->flags & EntityFlags_Destroyed))
+        Entity* root = &bases.dense[i];
+        if(GetMount(man, root)) continue;
+        
+        int top = 0;
+        stack[top++] = bases.denseToSparse[i];
+        while(top > 0)
         {
-            u32 id = GetId(man, mount);
-            Append(&childrenPerEntity[id], ent);
+            u32 id = stack[--top];
+            iv.pre[id]  = count;
+            iv.post[id] = count + 1;
+            iv.preorder[count] = id;
+            ++count;
+            
+            for_children(man, child, GetEntity(man, id))
+                stack[top++] = GetId(man, child);
         }
     }
     
-    for(int i = 0; i < childrenPerEntity.len; ++i)
-        res[i] = CopyToArena(&childrenPerEntity[i], dst);
-    return res;
+    assert(count == (u32)bases.dense.len && "The mount hierarchy contains a cycle");
+    
+    // Descendants come after their ancestors, so going backwards
+    // each subtree is complete by the time it's propagated up
+    for(s64 i = (s64)count - 1; i >= 0; --i)
+    {
+        u32 id = iv.preorder[i];
+        Entity* mount = GetMount(man, GetEntity(man, id));
+        if(!mount) continue;
+        
+        u32 mountId = GetId(man, mount);
+        if(iv.post[id] > iv.post[mountId])
+            iv.post[mountId] = iv.post[id];
+    }
+    
+    iv.dirty = false;
 }
 
 bool IsChild(EntityManager* man, Entity* suspectedChild, Entity* entity)
 {
-    Slice<Entity*> children = man->liveChildrenPerEntity[GetId(man, entity)];
-    for(int i = 0; i < children.len; ++i)
-    {
-        if(suspectedChild == children[i] || IsChild(man, suspectedChild, children[i]))
-            return true;
-    }
+    if(!entity || !suspectedChild) return false;
     
-    return false;
+    UpdateHierarchyIntervals(man);
+    
+    auto& iv = man->intervals;
+    u32 child = GetId(man, suspectedChild);
+    u32 id = GetId(man, entity);
+    return iv.pre[id] < iv.pre[child] && iv.pre[child] < iv.post[id];
+}
+
+Slice<u32> GetSubtree(EntityManager* man, Entity* entity)
+{
+    if(!entity) return {};
+    
+    UpdateHierarchyIntervals(man);
+    
+    auto& iv = man->intervals;
+    u32 id = GetId(man, entity);
+    return {.ptr=iv.preorder.ptr + iv.pre[id], .len=iv.post[id] - iv.pre[id]};
 }
 
-void UpdatePlayer(EntityManager* man, Player* player, float deltaTime)
+void UpdatePlayer(EntityManager* man, Player* player, float deltaTime, EntityCommandBuffer* cmds)
 {
     Input input = GetInput();
     
@@ -604,13 +1271,14 @@ void UpdatePlayer(EntityManager* man, Player* player, float deltaTime)
         if(cam)
         {
             // Apply the camera's rotation to the movement
-            Vec3 forward = cam->base->rot * Vec3::forward;
+            Quat camRot = GetRot(man, cam->base);
+            Vec3 forward = camRot * Vec3::forward;
             if(std::abs(dot(forward, Vec3::up)) > 0.99f)
-                forward = cam->base->rot * Vec3::up;
+                forward = camRot * Vec3::up;
             forward.y = 0.0f;
             forward = normalize(forward);
             
-            Vec3 right = cam->base->rot * Vec3::right;
+            Vec3 right = camRot * Vec3::right;
             right.y = 0.0f;
             right = normalize(right);
             
@@ -622,27 +1290,28 @@ void UpdatePlayer(EntityManager* man, Player* player, float deltaTime)
         player->speed = horizontalSpeed + Vec3::up * player->speed.y;
     }
     
-    player->base->pos += player->speed * deltaTime;
+    Vec3 playerPos = GetPos(man, player->base) + player->speed * deltaTime;
     
     // "Simulating" collision and ground detection
-    if(player->base->pos.y <= 0.0f)
+    if(playerPos.y <= 0.0f)
     {
         player->grounded = true;
-        player->base->pos.y = 0.0f;
+        playerPos.y = 0.0f;
     }
     
+    SetPos(man, player->base, playerPos);
+    
     // Camera movement
     {
         Camera* camera = GetDerived<Camera>(man, man->mainCamera);
         if(!camera) return;
         
         // Camera rotation
-        Quat& rot = camera->base->rot;
         const float rotateXSpeed = Deg2Rad(140);
         const float rotateYSpeed = Deg2Rad(100);
         const float mouseSensitivity = Deg2Rad(0.2f);  // Degrees per pixel
-        static float angleX = 0.0f;
-        static float angleY = 0.0f;
+        float& angleX = player->camAngleX;
+        float& angleY = player->camAngleY;
         
         angleX += rotateXSpeed * input.gamepad.rightStick.x * deltaTime;
         angleY += rotateYSpeed * input.gamepad.rightStick.y * deltaTime;
@@ -651,13 +1320,12 @@ void UpdatePlayer(EntityManager* man, Player* player, float deltaTime)
         
         Quat yRot = AngleAxis(Vec3::left, angleY);
         Quat xRot = AngleAxis(Vec3::up, angleX);
-        rot = xRot * yRot;
+        Quat rot = xRot * yRot;
+        PushSetRot(cmds, man->mainCamera, rot);
         
         // Camera position
-        Vec3& pos = camera->base->pos;
-        
         const float dist = 10.0f;
-        Vec3 focalPoint = player->base->pos;
-        pos = focalPoint - dist * (rot * Vec3::forward);
+        Vec3 focalPoint = playerPos;
+        PushSetPos(cmds, man->mainCamera, focalPoint - dist * (rot * Vec3::forward));
     }
 }
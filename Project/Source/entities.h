@@ -3,6 +3,7 @@
 
 #include "os/os_generic.h"
 #include "renderer_backend/generic.h"
+#include "collision.h"
 
 enum EntityFlags
 {
@@ -23,6 +24,8 @@ enum EntityKind: u8
     Entity_Count
 };
 
+#define NullEntityId ((u32)-1)
+
 struct EntityKey
 {
     u32 id;
@@ -32,23 +35,23 @@ struct EntityKey
 template<typename t>
 struct DerivedKey
 {
-    u16 id;
+    u32 id;
     u32 gen;
 };
 
 introspect()
 struct Entity
 {
-    // These are local with respect to the mounted entity
+    // These are local with respect to the mounted entity. They're
+    // stored in EntityManager::localTransforms, use the accessors
     nice_name("Position");
-    Vec3 pos;
+    external_member(Vec3, pos, EntityManager, GetPos, SetPos);
     nice_name("Rotation");
-    Quat rot;
+    external_member(Quat, rot, EntityManager, GetRot, SetRot);
     nice_name("Scale");
-    Vec3 scale;
+    external_member(Vec3, scale, EntityManager, GetScale, SetScale);
     
     u16 flags;
-    u32 gen;
     
     MeshHandle     mesh;
     MaterialHandle material;
@@ -60,10 +63,19 @@ struct Entity
     // We have the option to get the derived
     // entity, though it's a bit harder than the other way around
     EntityKind derivedKind;
-    u16 derivedId;  // Index in the corresponding array
+    u32 derivedId;  // Id in the corresponding slot map (stable until the entity is destroyed)
     
     EntityKey mount;
-    u16 mountBone;
+    u32 mountBone;
+    
+    // Entities mounted to this one, as a doubly linked list of
+    // entity ids. Maintained by NewEntity, MountEntity and CommitDestroy
+    editor_hide;
+    u32 firstChild;
+    editor_hide;
+    u32 nextSibling;
+    editor_hide;
+    u32 prevSibling;
 };
 
 introspect()
@@ -85,6 +97,12 @@ struct Player
     editor_hide;
     bool grounded;
     
+    // Orientation of the camera orbiting around the player
+    editor_hide;
+    float camAngleX;
+    editor_hide;
+    float camAngleY;
+    
     // Movement constants
     float gravity;
     float jumpVel;
@@ -104,29 +122,120 @@ struct PointLight
     Vec3 offset;
 };
 
+// Local transforms of all entities, in structure of arrays layout
+// and indexed by entity id, so that transform passes only load what
+// they use. The length is always a multiple of 8, so SIMD code can
+// process 4 or 8 consecutive ids without handling the tail.
+struct EntityTransforms
+{
+    Array<float> posX, posY, posZ;
+    Array<float> rotW, rotX, rotY, rotZ;
+    Array<float> scaleX, scaleY, scaleZ;
+};
+
+// World transforms, cached between frames and updated
+// by UpdateWorldTransforms. Arrays are indexed by entity id,
+// except for order and levelStarts.
+struct TransformCache
+{
+    // Live entity ids, sorted by depth in the mount hierarchy,
+    // so that mounts come before the entities mounted to them.
+    // Only rebuilt when the hierarchy changes
+    Array<u32> order;
+    Array<u32> levelStarts;  // Start of each depth level in order, plus the end
+    bool orderDirty;
+    
+    Array<u32> parents;  // (u32)-1 for entities which are not mounted
+    Array<u8> forceUpdate;  // Set for new and remounted entities
+    Array<u8> updated;  // Whether the world transform changed in the last update
+    
+    // Local transforms the cached matrices were computed with, and
+    // their matrices. Padded to a multiple of 8 like localTransforms
+    EntityTransforms locals;
+    Array<Mat4> localMats;
+    
+    Array<Mat4> world;
+    Array<Mat4> normal;  // Inverse transpose of world
+};
+
+// Euler tour of the mount hierarchy. The subtree of an entity (itself
+// included) is the contiguous range [pre, post) of preorder.
+// pre and post are indexed by entity id
+struct HierarchyIntervals
+{
+    Array<u32> preorder;  // Entity ids
+    Array<u32> pre;
+    Array<u32> post;
+    bool dirty;  // Recomputed lazily on the next query
+};
+
+// Writes to entities other than the one being updated (like the
+// player moving the camera) are recorded during the update phase and
+// applied afterwards, so that entities can be updated in parallel
+enum EntityCommandKind
+{
+    EntityCmd_SetPos,
+    EntityCmd_SetRot,
+    EntityCmd_Destroy,
+};
+
+struct EntityCommand
+{
+    EntityCommandKind kind;
+    EntityKey target;
+    union
+    {
+        Vec3 pos;
+        Quat rot;
+    };
+};
+
+// One for each batch of updated entities. Buffers are applied in
+// batch order, which is the same as the dense order of the entities,
+// so the result doesn't depend on how batches were scheduled
+struct EntityCommandBuffer
+{
+    Array<EntityCommand> commands;
+};
+
 struct EntityManager
 {
     EntityKey mainCamera;  // Used by the renderer
     
-    // NOTE: Arenas are used for all entity arrays here, which
-    // ensures pointer stability. This is so we can simply put
-    // a pointer the base entity in the derived entity, instead
-    // of using an index and call a function every time which is
-    // a lot less ergonomic
+    // NOTE: Entities are stored in slot maps, so that iteration
+    // only touches live entities. The dense arrays are based on
+    // arenas, which ensures pointer stability on insertion. This is
+    // so we can simply put a pointer to the base entity in the derived
+    // entity, instead of using an index and call a function every time
+    // which is a lot less ergonomic. Elements are moved only when
+    // destroying entities (in CommitDestroy), which patches the pointers.
     
     // Info all entities have in common
-    Array<Entity> bases;
-    Array<u32> freeBases;
+    SlotMap<Entity> bases;
+    
+    SlotMap<Camera> cameras;
+    SlotMap<Player> players;
+    SlotMap<PointLight> pointLights;
+    
+    Array<EntityKey> toDestroy;  // Entities passed to DestroyEntity, removed in CommitDestroy
     
-    Array<Camera> cameras;
-    Array<Player> players;
-    Array<PointLight> pointLights;
+    EntityTransforms localTransforms;
+    TransformCache transforms;
+    HierarchyIntervals intervals;
+    
+    // World space bounds of all entities, for ray picking. Only
+    // brought up to date by UpdateBounds, right before the queries
+    AabbTree bounds;
+    Array<u32> boundsLeaves;  // Leaf of each entity id in bounds, AabbTreeNull if not inserted
+    Array<u8> boundsDirty;  // Set by UpdateWorldTransforms, cleared by UpdateBounds
+    u32 boundsMeshLoads;  // GetMeshLoadCount() at the last update of bounds
     
     // Per frame data
     
-    // NOTE: This is editor only for now. It's a bit
-    // expensive so it shouldn't be computed every frame in release
-    Slice<Slice<Entity*>> liveChildrenPerEntity;
+    // Computed by UpdateWorldTransforms, indexed by entity id.
+    // To be used by the renderer and the editor
+    Slice<Mat4> worldTransforms;
+    Slice<Mat4> normalTransforms;
     
     Array<PointLight> framePointLights;
 };
@@ -137,14 +246,16 @@ EntityManager InitEntityManager();
 void FreeEntities(EntityManager* man);
 void MainUpdate(EntityManager* man, Editor* ui, float deltaTime, Arena* frameArena, CamParams* outCam);
 //void MainRender(EntityManager* man, Editor* ui, float deltaTime, Arena* frameArena);
-void UpdateEntities(EntityManager* man, float deltaTime);
+// Updates each kind of entity in batches, which run on the job system
+// if parallel is true. Both modes produce bit-identical results
+void UpdateEntities(EntityManager* man, float deltaTime, bool parallel = true);
 
 // Entity manipulation.
 // All functions returning entity pointers can return null
 template<typename t>
 EntityKind GetEntityKindFromType(EntityManager* man);
 template<typename t>
-Array<t>* GetArrayFromType(EntityManager* man);
+SlotMap<t>* GetSlotMapFromType(EntityManager* man);
 
 bool operator ==(EntityKey k1, EntityKey k2);
 bool operator !=(EntityKey k1, EntityKey k2);
@@ -165,19 +276,41 @@ u32 GetId(EntityManager* man, Entity* entity);
 template<typename t>
 DerivedKey<t> GetDerivedKey(EntityManager* man, t* derived);
 Entity* GetMount(EntityManager* man, Entity* entity);
+// Local transform accessors
+Vec3 GetPos(EntityManager* man, Entity* entity);
+Quat GetRot(EntityManager* man, Entity* entity);
+Vec3 GetScale(EntityManager* man, Entity* entity);
+void SetPos(EntityManager* man, Entity* entity, Vec3 pos);
+void SetRot(EntityManager* man, Entity* entity, Quat rot);
+void SetScale(EntityManager* man, Entity* entity, Vec3 scale);
 // Pass null to mountTo to unmount from any entity
 void MountEntity(EntityManager* man, Entity* entity, Entity* mountTo);
+// Walks the mount chain, use GetWorldTransform when the
+// transforms computed at the end of the last update are enough
 Mat4 ComputeWorldTransform(EntityManager* man, Entity* entity);
+Mat4 GetWorldTransform(EntityManager* man, Entity* entity);
+Mat4 GetNormalTransform(EntityManager* man, Entity* entity);
+// Computes the world transforms of the entities whose local
+// transform (or the one of any of their mounts) has changed
+void UpdateWorldTransforms(EntityManager* man);
 Mat4 ConvertToLocalTransform(EntityManager* man, Entity* entity, Mat4 world);
+// Bounds of the mesh (or a small box for entities without one), in local space
+Aabb GetLocalAabb(EntityManager* man, Entity* entity);
+// Moves the entities whose world transform changed since the last call
+// in EntityManager::bounds. To be called before querying it
+void UpdateBounds(EntityManager* man);
 
 Entity* NewEntity(EntityManager* man);
 template<typename t>
 t* NewEntity(EntityManager* man);
 
-void DestroyEntity(Entity* entity);
-void CommitDestroy(EntityManager* entities);
+// The entity (and all entities mounted to it) will
+// be removed at the end of the frame by CommitDestroy
+void DestroyEntity(EntityManager* man, Entity* entity);
+void CommitDestroy(EntityManager* man);
 
-// Entity iteration
+// Entity iteration, in dense order. Entities destroyed in
+// the current frame (not yet committed) are skipped
 Entity* FirstLive(EntityManager* man);
 Entity* NextLive(EntityManager* man, Entity* current);
 template<typename t>
@@ -188,11 +321,26 @@ t* NextDerivedLive(EntityManager* man, t* current);
 #define for_live_entities(manager, name) for(Entity* name = FirstLive(manager); name; name = NextLive(manager, name))
 #define for_live_derived(manager, name, type) for(type* name = FirstDerivedLive<type>(manager); name; name = NextDerivedLive<type>(manager, name))
 
+// Direct children only, in no particular order
+Entity* FirstChild(EntityManager* man, Entity* entity);
+Entity* NextSibling(EntityManager* man, Entity* entity);
+
+#define for_children(manager, name, parent) for(Entity* name = FirstChild(manager, parent); name; name = NextSibling(manager, name))
+
 // Utilities
-// Slices only contain direct children
-Slice<Slice<Entity*>> ComputeAllLiveChildrenForEachEntity(EntityManager* man, Arena* dst);
 // Checks if an entity is a direct or indirect child of another
 bool IsChild(EntityManager* man, Entity* suspectedChild, Entity* entity);
+// Ids of the entity and everything mounted to it (directly or indirectly),
+// in depth first order. Valid until the hierarchy changes
+Slice<u32> GetSubtree(EntityManager* man, Entity* entity);
+
+// Deferred writes, see EntityCommandBuffer
+void PushSetPos(EntityCommandBuffer* cmds, EntityKey target, Vec3 pos);
+void PushSetRot(EntityCommandBuffer* cmds, EntityKey target, Quat rot);
+void PushDestroy(EntityCommandBuffer* cmds, EntityKey target);
+void ApplyCommands(EntityManager* man, EntityCommandBuffer* cmds);
 
-// Gameplay code
-void UpdatePlayer(EntityManager* man, Player* player, float deltaTime);
+// Gameplay code.
+// Update functions can freely read any entity and write the one
+// being updated; all other writes go through the command buffer
+void UpdatePlayer(EntityManager* man, Player* player, float deltaTime, EntityCommandBuffer* cmds);
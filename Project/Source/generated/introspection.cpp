@@ -16,17 +16,19 @@
 
 MemberDefinition _membersOfEntity[] =
 {
-{ { Meta_Vec3 }, offsetof(Entity, pos), sizeof(((Entity*)0)->pos), StrLit("Entity"), "Entity", StrLit("Position"), "Position", 0, true},
-{ { Meta_Quat }, offsetof(Entity, rot), sizeof(((Entity*)0)->rot), StrLit("Entity"), "Entity", StrLit("Rotation"), "Rotation", 0, true},
-{ { Meta_Vec3 }, offsetof(Entity, scale), sizeof(((Entity*)0)->scale), StrLit("Entity"), "Entity", StrLit("Scale"), "Scale", 0, true},
+{ { Meta_Vec3 }, -1, sizeof(Vec3), StrLit("Entity"), "Entity", StrLit("Position"), "Position", 0, true, [](void* context, void* structPtr, void* dst) { *(Vec3*)dst = GetPos((EntityManager*)context, (Entity*)structPtr); }, [](void* context, void* structPtr, void* src) { SetPos((EntityManager*)context, (Entity*)structPtr, *(Vec3*)src); } },
+{ { Meta_Quat }, -1, sizeof(Quat), StrLit("Entity"), "Entity", StrLit("Rotation"), "Rotation", 0, true, [](void* context, void* structPtr, void* dst) { *(Quat*)dst = GetRot((EntityManager*)context, (Entity*)structPtr); }, [](void* context, void* structPtr, void* src) { SetRot((EntityManager*)context, (Entity*)structPtr, *(Quat*)src); } },
+{ { Meta_Vec3 }, -1, sizeof(Vec3), StrLit("Entity"), "Entity", StrLit("Scale"), "Scale", 0, true, [](void* context, void* structPtr, void* dst) { *(Vec3*)dst = GetScale((EntityManager*)context, (Entity*)structPtr); }, [](void* context, void* structPtr, void* src) { SetScale((EntityManager*)context, (Entity*)structPtr, *(Vec3*)src); } },
 { { Meta_Unknown }, offsetof(Entity, flags), sizeof(((Entity*)0)->flags), StrLit("Entity"), "Entity", StrLit("Flags"), "Flags", 0, true},
-{ { Meta_Unknown }, offsetof(Entity, gen), sizeof(((Entity*)0)->gen), StrLit("Entity"), "Entity", StrLit("Gen"), "Gen", 0, true},
 { { Meta_Unknown }, offsetof(Entity, mesh), sizeof(((Entity*)0)->mesh), StrLit("Entity"), "Entity", StrLit("Mesh"), "Mesh", 0, true},
 { { Meta_Unknown }, offsetof(Entity, material), sizeof(((Entity*)0)->material), StrLit("Entity"), "Entity", StrLit("Material"), "Material", 0, true},
 { { Meta_Unknown }, offsetof(Entity, derivedKind), sizeof(((Entity*)0)->derivedKind), StrLit("Entity"), "Entity", StrLit("Derived Kind"), "Derived Kind", 0, true},
 { { Meta_Unknown }, offsetof(Entity, derivedId), sizeof(((Entity*)0)->derivedId), StrLit("Entity"), "Entity", StrLit("Derived Id"), "Derived Id", 0, true},
 { { Meta_Unknown }, offsetof(Entity, mount), sizeof(((Entity*)0)->mount), StrLit("Entity"), "Entity", StrLit("Mount"), "Mount", 0, true},
 { { Meta_Unknown }, offsetof(Entity, mountBone), sizeof(((Entity*)0)->mountBone), StrLit("Entity"), "Entity", StrLit("Mount Bone"), "Mount Bone", 0, true},
+{ { Meta_Unknown }, offsetof(Entity, firstChild), sizeof(((Entity*)0)->firstChild), StrLit("Entity"), "Entity", StrLit("First Child"), "First Child", 0, false},
+{ { Meta_Unknown }, offsetof(Entity, nextSibling), sizeof(((Entity*)0)->nextSibling), StrLit("Entity"), "Entity", StrLit("Next Sibling"), "Next Sibling", 0, false},
+{ { Meta_Unknown }, offsetof(Entity, prevSibling), sizeof(((Entity*)0)->prevSibling), StrLit("Entity"), "Entity", StrLit("Prev Sibling"), "Prev Sibling", 0, false},
 };
 
 MetaStruct metaEntity =
@@ -48,6 +50,8 @@ MemberDefinition _membersOfPlayer[] =
 { { Meta_Unknown }, offsetof(Player, base), sizeof(((Player*)0)->base), StrLit("Player"), "Player", StrLit("Base"), "Base", 0, true},
 { { Meta_Vec3 }, offsetof(Player, speed), sizeof(((Player*)0)->speed), StrLit("Player"), "Player", StrLit("Speed"), "Speed", 0, false},
 { { Meta_Bool }, offsetof(Player, grounded), sizeof(((Player*)0)->grounded), StrLit("Player"), "Player", StrLit("Grounded"), "Grounded", 0, false},
+{ { Meta_Float }, offsetof(Player, camAngleX), sizeof(((Player*)0)->camAngleX), StrLit("Player"), "Player", StrLit("Cam Angle X"), "Cam Angle X", 0, false},
+{ { Meta_Float }, offsetof(Player, camAngleY), sizeof(((Player*)0)->camAngleY), StrLit("Player"), "Player", StrLit("Cam Angle Y"), "Cam Angle Y", 0, false},
 { { Meta_Float }, offsetof(Player, gravity), sizeof(((Player*)0)->gravity), StrLit("Player"), "Player", StrLit("Gravity"), "Gravity", 0, true},
 { { Meta_Float }, offsetof(Player, jumpVel), sizeof(((Player*)0)->jumpVel), StrLit("Player"), "Player", StrLit("Jump Vel"), "Jump Vel", 0, true},
 { { Meta_Float }, offsetof(Player, moveSpeed), sizeof(((Player*)0)->moveSpeed), StrLit("Player"), "Player", StrLit("Move Speed"), "Move Speed", 0, true},
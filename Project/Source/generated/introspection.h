@@ -38,6 +38,10 @@ struct MemberDefinition
     const char* cNiceName;
     int version;
     bool showEditor;
+    
+    // Only for external members, which have no offset
+    void (*get)(void* context, void* structPtr, void* dst);
+    void (*set)(void* context, void* structPtr, void* src);
 };
 
 struct MetaStruct
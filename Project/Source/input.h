@@ -88,4 +88,5 @@ void ApplyDeadzones(OS_GamepadState* gamepadState);
 bool IsGamepadStateNull(OS_GamepadState gamepadState);
 InputDominator FindDominatingGamepad(OS_InputState input, InputDominator prevDom);
 bool PressedKey(Input input, VirtualKeycode key);
+bool PressedGamepadButton(Input input, GamepadButtonField button);
 bool PressedUnfilteredKey(Input input, VirtualKeycode key);
\ No newline at end of file
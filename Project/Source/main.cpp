@@ -14,11 +14,17 @@ int main()
     InitScratchArenas();
     InitPermArena();
     
+    InitJobSystem();
+    defer { ShutdownJobSystem(); };
+    
     OS_Init("Simple Game Engine");
     defer { OS_Cleanup(); };
     
     SetWorkingDirRelativeToExe("../../Assets/");
     
+    // Built with utils/pack_builder, loose files are used if it's missing
+    MountAssetPack("assets.pack");
+    
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     defer
@@ -28,7 +34,9 @@ int main()
         ImGui::DestroyContext();
     };
     
-    Arena frameArena = ArenaVirtualMemInit(GB(4), MB(2));
+    Arena frameArena = ArenaVirtualMemInit(GB(4), MB(2), true);
+    size_t frameArenaPeak = 0;  // Max usage of the frame arena in the current trim period
+    u32 frameCount = 0;
     
     R_Init();
     defer { R_Cleanup(); };
@@ -85,9 +93,22 @@ int main()
         R_UpdateSwapchainSize();
         R_SetViewport(0, 0, w, h);
         
+        // Upload the assets which finished loading in the background
+        ProcessAssetLoads(0.002);
+        
         RenderFrame(&entManager, cam);
         
+        // Give back to the OS what hasn't been used in the last few
+        // seconds, so that a single spike doesn't keep memory committed
+        const u32 frameArenaTrimPeriod = 256;
+        if(frameArena.offset > frameArenaPeak) frameArenaPeak = frameArena.offset;
         ArenaFreeAll(&frameArena);
+        if(++frameCount % frameArenaTrimPeriod == 0)
+        {
+            ArenaTrim(&frameArena, frameArenaPeak);
+            frameArenaPeak = 0;
+        }
+        
         firstIter = false;
     }
     
@@ -200,6 +200,10 @@ int main()
     Println("    const char* cNiceName;");
     Println("    int version;");
     Println("    bool showEditor;");
+    Println("    ");
+    Println("    // Only for external members, which have no offset");
+    Println("    void (*get)(void* context, void* structPtr, void* dst);");
+    Println("    void (*set)(void* context, void* structPtr, void* src);");
     Println("};");
     
     Println("");
@@ -403,6 +407,37 @@ void ParseMemberList(Parser* p, String structName)
             else break;
         }
         
+        if(p->at->text == "external_member")
+        {
+            ++p->at;
+            EatRequiredToken(p, Tok_OpenParen);
+            
+            // type, name, context, getter, setter
+            String params[5] = {0};
+            for(int i = 0; i < ArrayCount(params); ++i)
+            {
+                if(i > 0) EatRequiredToken(p, Tok_Comma);
+                
+                if(p->at->kind == Tok_Ident)
+                {
+                    params[i] = p->at->text;
+                    ++p->at;
+                }
+                else
+                    ParseError(p, p->at, "Expecting identifier in external_member(...");
+            }
+            
+            EatRequiredToken(p, Tok_CloseParen);
+            EatRequiredToken(p, Tok_Semicolon);
+            
+            if(!niceNameDefined)
+                niceName = GetNiceNameFromMemberName(params[1], scratch);
+            
+            PrintExternalMemberDefinition(structName, GetMetaTypeFromTypeName(params[0]), params[0], params[2], params[3], params[4],
+                                          niceName, memberVersion, showEditor);
+            continue;
+        }
+        
         if(p->at->text == "static")
         {
             // Ignore entire member
@@ -443,13 +478,7 @@ void ParseMemberList(Parser* p, String structName)
             continue;
         }
         
-        const char* metaType = "Meta_Unknown";
-        if     (typeName == "int")    metaType = "Meta_Int";
-        else if(typeName == "bool")   metaType = "Meta_Bool";
-        else if(typeName == "float")  metaType = "Meta_Float";
-        else if(typeName == "Vec3")   metaType = "Meta_Vec3";
-        else if(typeName == "Quat")   metaType = "Meta_Quat";
-        else if(typeName == "String") metaType = "Meta_String";
+        const char* metaType = GetMetaTypeFromTypeName(typeName);
         
         int numPtrs = 0;
         while(p->at->kind == Tok_Asterisk)
@@ -476,6 +505,18 @@ void ParseMemberList(Parser* p, String structName)
     }
 }
 
+const char* GetMetaTypeFromTypeName(String typeName)
+{
+    const char* metaType = "Meta_Unknown";
+    if     (typeName == "int")    metaType = "Meta_Int";
+    else if(typeName == "bool")   metaType = "Meta_Bool";
+    else if(typeName == "float")  metaType = "Meta_Float";
+    else if(typeName == "Vec3")   metaType = "Meta_Vec3";
+    else if(typeName == "Quat")   metaType = "Meta_Quat";
+    else if(typeName == "String") metaType = "Meta_String";
+    return metaType;
+}
+
 const char* BoolString(bool b)
 {
     return b ? "true" : "false";
@@ -496,6 +537,26 @@ void PrintMemberDefinition(String structName, const char* metaType, int numPoint
     Println("},");
 }
 
+void PrintExternalMemberDefinition(String structName, const char* metaType, String typeName, String context,
+                                   String getter, String setter, String niceName, int memberVersion, bool showEditor)
+{
+    Print("{ ");
+    Print("{ %s }, ", metaType);
+    Print("-1, ");
+    Print("sizeof(%.*s), ", StrPrintf(typeName));
+    Print("StrLit(\"%.*s\"), ", StrPrintf(structName));
+    Print("\"%.*s\", ", StrPrintf(structName));
+    Print("StrLit(\"%.*s\"), ", StrPrintf(niceName));
+    Print("\"%.*s\", ", StrPrintf(niceName));
+    Print("%d, ", memberVersion);
+    Print("%s, ", BoolString(showEditor));
+    Print("[](void* context, void* structPtr, void* dst) { *(%.*s*)dst = %.*s((%.*s*)context, (%.*s*)structPtr); }, ",
+          StrPrintf(typeName), StrPrintf(getter), StrPrintf(context), StrPrintf(structName));
+    Print("[](void* context, void* structPtr, void* src) { %.*s((%.*s*)context, (%.*s*)structPtr, *(%.*s*)src); } ",
+          StrPrintf(setter), StrPrintf(context), StrPrintf(structName), StrPrintf(typeName));
+    Println("},");
+}
+
 // TODO: put this is the base layer
 char ToUpperCase(char c)
 {
@@ -10,6 +10,9 @@ void ParseMemberList(Parser* p, String structName);
 
 void PrintMemberDefinition(String structName, const char* metaType, int numPointers, bool isSlice, bool isString,
                            String name, String niceName, int memberVersion, bool showEditor);
+void PrintExternalMemberDefinition(String structName, const char* metaType, String typeName, String context,
+                                   String getter, String setter, String niceName, int memberVersion, bool showEditor);
+const char* GetMetaTypeFromTypeName(String typeName);
 // Converts camel case to regular sentence, like this:
 // From: "thisIsAnExampleTest"
 // To:   "This Is An Example Test"
@@ -10,3 +10,6 @@
 #define nice_name(name)      // For redefining the name to be shown in properties panel etc.
 #define editor_hide          // If present the member will not get shown in the editor
 #define member_version(...)  // When this struct member was introduced
+// Member which is not stored in the struct, and is read and written through
+// "type getter(context*, structType*)" and "void setter(context*, structType*, type)"
+#define external_member(type, name, context, getter, setter)
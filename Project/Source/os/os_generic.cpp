@@ -2,7 +2,7 @@
 #ifdef _WIN32
 #include "os/os_windows.cpp"
 #elif defined(__linux__)
-#error "Linux operating systems not supported."
+#include "os/os_linux.cpp"
 #elif defined(__APPLE__)
 #error "Apple Operating systems not supported."
 #else
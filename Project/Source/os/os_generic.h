@@ -153,6 +153,14 @@ void OS_FixCursor(bool fix);  // The mouse delta should still be provided even a
 
 // Sound
 
+// Files
+
+// Maps the whole file in memory as read-only, which avoids copying it.
+// If prefetch is true, the OS is told that the file is going to
+// be read sequentially soon. The result must be freed with OS_UnmapFile.
+String OS_MapFile(String path, bool* outSuccess, bool prefetch = true);
+void OS_UnmapFile(String file);
+
 // Misc
 void OS_FatalError(const char* message);
 uint64_t OS_GetTicks();
@@ -0,0 +1,52 @@
+
+// NOTE: Only the parts of the OS layer which don't need a window
+// are implemented for Linux at the moment, which is what the
+// headless tools need. Windowing, input and Dear ImGui are missing.
+
+#include "os_generic.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+String OS_MapFile(String path, bool* outSuccess, bool prefetch)
+{
+    *outSuccess = false;
+    
+    ScratchArena scratch;
+    char* cPath = ArenaPushNullTermString(scratch, path);
+    
+    int file = open(cPath, O_RDONLY);
+    if(file == -1) return {};
+    defer { close(file); };
+    
+    struct stat info;
+    if(fstat(file, &info) != 0) return {};
+    
+    // Empty files can't be mapped
+    if(info.st_size == 0)
+    {
+        *outSuccess = true;
+        return {};
+    }
+    
+    // The mapping stays valid after closing the file
+    void* ptr = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if(ptr == MAP_FAILED) return {};
+    
+    // These are hints, it's fine if they fail
+    if(prefetch)
+    {
+        madvise(ptr, info.st_size, MADV_SEQUENTIAL);
+        madvise(ptr, info.st_size, MADV_WILLNEED);
+    }
+    
+    *outSuccess = true;
+    return {.ptr=(const char*)ptr, .len=(s64)info.st_size};
+}
+
+void OS_UnmapFile(String file)
+{
+    if(file.ptr) munmap((void*)file.ptr, file.len);
+}
@@ -834,6 +834,53 @@ Slice<OS_FileSystemChange> OS_ConsumeFileWatcherChanges(Arena* dst)
     return CopyToArena(&changes, dst);
 }
 
+String OS_MapFile(String path, bool* outSuccess, bool prefetch)
+{
+    *outSuccess = false;
+    
+    ScratchArena scratch;
+    char* cPath = ArenaPushNullTermString(scratch, path);
+    
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if(prefetch) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    
+    HANDLE file = CreateFile(cPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+    if(file == INVALID_HANDLE_VALUE) return {};
+    defer { CloseHandle(file); };
+    
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size)) return {};
+    
+    // Empty files can't be mapped
+    if(size.QuadPart == 0)
+    {
+        *outSuccess = true;
+        return {};
+    }
+    
+    // The view keeps the mapping alive, so the handles can be closed right away
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping) return {};
+    defer { CloseHandle(mapping); };
+    
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!ptr) return {};
+    
+    if(prefetch)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range = {.VirtualAddress=ptr, .NumberOfBytes=(SIZE_T)size.QuadPart};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+    
+    *outSuccess = true;
+    return {.ptr=(const char*)ptr, .len=(s64)size.QuadPart};
+}
+
+void OS_UnmapFile(String file)
+{
+    if(file.ptr) UnmapViewOfFile(file.ptr);
+}
+
 VirtualKeycode Win32_ConvertToCustomKeyCodes(WPARAM code)
 {
     UINT aKey = 0x41;
@@ -26,6 +26,7 @@ static D3D11_INPUT_ELEMENT_DESC D3D11_ConvertVertAttrib(R_VertAttrib attrib);
 static String D3D11_BuildDummyShaderForInputLayout(Slice<R_VertAttrib> attribs, Arena* dst);
 static D3D11_RASTERIZER_DESC D3D11_ConvertRasterizerDesc(R_RasterizerDesc desc);
 static D3D11_DEPTH_STENCIL_DESC D3D11_ConvertDepthStateDesc(R_DepthDesc desc);
+static void D3D11_TransientUnmap();
 
 // Resources
 
@@ -86,11 +87,107 @@ void R_BufferFree(R_Buffer* b)
     SafeRelease(b->handle);
 }
 
+R_Transient R_TransientAlloc(u64 size, void* data)
+{
+    auto& r = renderer;
+    
+    u64 alignedSize = (size + R_TransientAlignment - 1) & ~((u64)R_TransientAlignment - 1);
+    assert(alignedSize <= r.transient.size);
+    
+    D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+    if(r.transientOffset + alignedSize > r.transient.size)
+    {
+        // Discarding needs a new map
+        D3D11_TransientUnmap();
+        mapType = D3D11_MAP_WRITE_DISCARD;
+        r.transientOffset = 0;
+    }
+    
+    if(!r.transientMapped)
+    {
+        D3D11_MAPPED_SUBRESOURCE mappedResource = {};
+        HRESULT hr = r.context->Map((ID3D11Resource*)r.transient.handle, 0, mapType, 0, &mappedResource);
+        assert(SUCCEEDED(hr));
+        r.transientMapped = (u8*)mappedResource.pData;
+    }
+    
+    memcpy(r.transientMapped + r.transientOffset, data, size);
+    
+    R_Transient res = {};
+    res.buffer = &r.transient;
+    res.offset = (u32)r.transientOffset;
+    res.size   = (u32)alignedSize;
+    r.transientOffset += alignedSize;
+    return res;
+}
+
+void R_TransientUniformBind(R_Transient t, u32 slot, ShaderType type)
+{
+    auto& r = renderer;
+    
+    // In units of 16 byte constants
+    UINT firstConstant = t.offset / 16;
+    UINT numConstants  = t.size / 16;
+    switch(type)
+    {
+        case ShaderType_Null:   break;
+        case ShaderType_Count:  break;
+        case ShaderType_Vertex: r.context1->VSSetConstantBuffers1(slot, 1, &t.buffer->handle, &firstConstant, &numConstants); break;
+        case ShaderType_Pixel:  r.context1->PSSetConstantBuffers1(slot, 1, &t.buffer->handle, &firstConstant, &numConstants); break;
+    }
+}
+
+// The ring stays mapped between allocations, and is only unmapped
+// when the GPU is about to read it (draws and the end of the frame)
+static void D3D11_TransientUnmap()
+{
+    auto& r = renderer;
+    if(!r.transientMapped) return;
+    
+    r.context->Unmap((ID3D11Resource*)r.transient.handle, 0);
+    r.transientMapped = nullptr;
+}
+
 // Shaders
+// Only for development builds, shipped shaders are compiled offline by shader_importer
+static String D3D11_CompileHLSL(R_ShaderInput input, ShaderType type, Arena* dst)
+{
+    const char* target = type == ShaderType_Vertex? "vs_5_0" : "ps_5_0";
+    
+    ScratchArena scratch(dst);
+    ID3DBlob* bytecode = nullptr;
+    ID3DBlob* errors   = nullptr;
+    HRESULT hr = D3DCompile(input.hlsl.ptr, input.hlsl.len,
+                            ArenaPushNullTermString(scratch, input.hlslPath),  // Includes are relative to this
+                            nullptr,  // Defines
+                            D3D_COMPILE_STANDARD_FILE_INCLUDE,
+                            ArenaPushNullTermString(scratch, input.hlslEntry),
+                            target,
+                            D3DCOMPILE_ENABLE_STRICTNESS,
+                            0,
+                            &bytecode,
+                            &errors);
+    defer { SafeRelease(bytecode); SafeRelease(errors); };
+    
+    if(errors)
+        Log("%s", (char*)errors->GetBufferPointer());
+    if(FAILED(hr))
+        return {};
+    
+    return ArenaPushString(dst, {.ptr=(char*)bytecode->GetBufferPointer(), .len=(s64)bytecode->GetBufferSize()});
+}
+
 R_Shader R_ShaderAlloc(R_ShaderInput input, ShaderType type)
 {
     auto& r = renderer;
     
+    ScratchArena scratch;
+    if(input.d3d11Bytecode.len == 0 && input.hlsl.len > 0 && (type == ShaderType_Vertex || type == ShaderType_Pixel))
+    {
+        input.d3d11Bytecode = D3D11_CompileHLSL(input, type, scratch);
+        if(input.d3d11Bytecode.len == 0) return {};
+    }
+    
     R_Shader res = {};
     res.type = type;
     switch(res.type)
@@ -559,6 +656,7 @@ void R_Draw(R_Buffer* verts, R_Buffer* indices, u64 start, u64 count)
     
     if(count == 0) count = indices->size / sizeof(u32);
     
+    D3D11_TransientUnmap();
     r.context->DrawIndexed((UINT)count, (UINT)start, 0);
 }
 
@@ -572,9 +670,29 @@ void R_Draw(R_Buffer* verts, u64 start, u64 count)
     
     if(count == 0) count = verts->size / verts->stride;
     
+    D3D11_TransientUnmap();
     r.context->Draw((UINT)count, (UINT)start);
 }
 
+void R_DrawInstanced(R_Buffer* verts, R_Buffer* indices, R_Buffer* instances, u64 firstInstance, u64 numInstances,
+                     u64 start, u64 count)
+{
+    auto& r = renderer;
+    
+    // Set buffers
+    ID3D11Buffer* buffers[2] = { verts->handle, instances->handle };
+    UINT strides[2] = { verts->stride, instances->stride };
+    UINT offsets[2] = { 0, 0 };
+    r.context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    r.context->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+    r.context->IASetIndexBuffer(indices->handle, DXGI_FORMAT_R32_UINT, 0);
+    
+    if(count == 0) count = indices->size / sizeof(u32);
+    
+    D3D11_TransientUnmap();
+    r.context->DrawIndexedInstanced((UINT)count, (UINT)numInstances, (UINT)start, 0, (UINT)firstInstance);
+}
+
 // Backend state
 
 void R_Init()
@@ -712,6 +830,24 @@ void R_Init()
         hr = r.device->CreateDepthStencilView(depthStencilBuffer, nullptr, &r.screen.dsv);
         assert(SUCCEEDED(hr));
     }
+    
+    // Transient allocations
+    {
+        HRESULT hr = r.context->QueryInterface(IID_ID3D11DeviceContext1, (void**)&r.context1);
+        assert(SUCCEEDED(hr));
+        
+        // Mapping constant buffers with no-overwrite needs Windows 8
+        D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+        hr = r.device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+        assert(SUCCEEDED(hr));
+        if(!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+            OS_FatalError("D3D11 Error: Constant buffer offsetting is not supported.");
+        
+        r.transient = R_BufferAlloc(BufferFlag_Dynamic | BufferFlag_ConstantBuffer, R_TransientAlignment, R_TransientCapacity);
+        
+        // So that the first allocation maps with discard
+        r.transientOffset = r.transient.size;
+    }
 }
 
 void R_WaitLastFrame()
@@ -754,6 +890,8 @@ void R_PresentFrame()
 {
     auto& r = renderer;
     
+    D3D11_TransientUnmap();
+    
     bool vsync = true;
     HRESULT hr = r.swapchain->Present(vsync ? 1 : 0, 0);
     if(hr == DXGI_STATUS_OCCLUDED)
@@ -822,6 +960,9 @@ void R_Cleanup()
 {
     auto& r = renderer;
     
+    D3D11_TransientUnmap();
+    R_BufferFree(&r.transient);
+    SafeRelease(r.context1);
     SafeRelease(r.device);
     SafeRelease(r.context);
     SafeRelease(r.swapchain);
@@ -1082,25 +1223,28 @@ static u32 D3D11_ConvertSamplerWrap(R_SamplerWrap wrap)
 
 static D3D11_INPUT_ELEMENT_DESC D3D11_ConvertVertAttrib(R_VertAttrib attrib)
 {
-    // TODO: Look into instancing
-    
-    auto inputClass = D3D11_INPUT_PER_VERTEX_DATA;
+    auto inputClass = attrib.perInstance? D3D11_INPUT_PER_INSTANCE_DATA : D3D11_INPUT_PER_VERTEX_DATA;
+    UINT stepRate = attrib.perInstance? 1 : 0;
     switch(attrib.type)
     {
         case VertAttrib_Pos:
-        return { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, attrib.typeSlot };
+        return { "POSITION", attrib.typeSlot, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
         case VertAttrib_Normal:
-        return { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, attrib.typeSlot };
+        return { "NORMAL", attrib.typeSlot, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
         case VertAttrib_TexCoord:
-        return { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, attrib.typeSlot };
+        return { "TEXCOORD", attrib.typeSlot, DXGI_FORMAT_R32G32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
         case VertAttrib_Tangent:
-        return { "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, attrib.typeSlot };
+        return { "TANGENT", attrib.typeSlot, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
         case VertAttrib_Bitangent:
-        return { "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, attrib.typeSlot };
+        return { "BITANGENT", attrib.typeSlot, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
         case VertAttrib_ColorRGB:
-        return { "COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, attrib.typeSlot };
+        return { "COLOR", attrib.typeSlot, DXGI_FORMAT_R32G32B32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
         case VertAttrib_ColorScale:
-        return { "COLOR", 0, DXGI_FORMAT_R32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, attrib.typeSlot };
+        return { "COLOR", attrib.typeSlot, DXGI_FORMAT_R32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
+        case VertAttrib_Model2World:
+        return { "MODEL2WORLD", attrib.typeSlot, DXGI_FORMAT_R32G32B32A32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
+        case VertAttrib_NormalMat:
+        return { "NORMALMAT", attrib.typeSlot, DXGI_FORMAT_R32G32B32A32_FLOAT, attrib.bufferSlot, attrib.offset, inputClass, stepRate };
     }
     
     return {};
@@ -1116,15 +1260,18 @@ static String D3D11_BuildDummyShaderForInputLayout(Slice<R_VertAttrib> attribs,
     
     for(int i = 0; i < attribs.len; ++i)
     {
+        u32 idx = attribs[i].typeSlot;
         switch(attribs[i].type)
         {
-            case VertAttrib_Pos:        Append(&builder, "float3 pos : POSITION;\n");        break;
-            case VertAttrib_Normal:     Append(&builder, "float3 normal : NORMAL;\n");       break;
-            case VertAttrib_TexCoord:   Append(&builder, "float2 texCoord : TEXCOORD;\n");   break;
-            case VertAttrib_Tangent:    Append(&builder, "float3 tangent : TANGENT;\n");     break;
-            case VertAttrib_Bitangent:  Append(&builder, "float3 bitangent : BITANGENT;\n"); break;
-            case VertAttrib_ColorRGB:   Append(&builder, "float3 colorRGB : COLOR;\n");      break;
-            case VertAttrib_ColorScale: Append(&builder, "float colorScale : COLOR;\n");    break;
+            case VertAttrib_Pos:         AppendFmt(&builder, "float3 pos%u : POSITION%u;\n", idx, idx);           break;
+            case VertAttrib_Normal:      AppendFmt(&builder, "float3 normal%u : NORMAL%u;\n", idx, idx);          break;
+            case VertAttrib_TexCoord:    AppendFmt(&builder, "float2 texCoord%u : TEXCOORD%u;\n", idx, idx);      break;
+            case VertAttrib_Tangent:     AppendFmt(&builder, "float3 tangent%u : TANGENT%u;\n", idx, idx);        break;
+            case VertAttrib_Bitangent:   AppendFmt(&builder, "float3 bitangent%u : BITANGENT%u;\n", idx, idx);    break;
+            case VertAttrib_ColorRGB:    AppendFmt(&builder, "float3 colorRGB%u : COLOR%u;\n", idx, idx);         break;
+            case VertAttrib_ColorScale:  AppendFmt(&builder, "float colorScale%u : COLOR%u;\n", idx, idx);        break;
+            case VertAttrib_Model2World: AppendFmt(&builder, "float4 model2World%u : MODEL2WORLD%u;\n", idx, idx); break;
+            case VertAttrib_NormalMat:   AppendFmt(&builder, "float4 normalMat%u : NORMALMAT%u;\n", idx, idx);     break;
         }
     }
     
@@ -8,6 +8,7 @@
 #pragma warning(disable : 4062)
 #pragma warning(disable : 4061)
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <dxgi1_3.h>
 #include <dxgidebug.h>
 #include <d3d11sdklayers.h>
@@ -89,4 +90,14 @@ struct Renderer
     HANDLE swapchainWaitableObject;
     
     R_Framebuffer screen;
+    
+    // Needed for binding ranges of constant buffers
+    ID3D11DeviceContext1* context1;
+    
+    // Ring for R_TransientAlloc. Mapped with no-overwrite, and with
+    // discard when wrapping around, which gives it fresh memory
+    // without waiting for the GPU to be done with the old contents
+    R_Buffer transient;
+    u64 transientOffset;
+    u8* transientMapped;  // Null while the ring is unmapped
 };
@@ -5,6 +5,8 @@
 #include "renderer_backend/renderer_opengl.cpp"
 #elif defined(GFX_D3D11)
 #include "renderer_backend/d3d11.cpp"
+#elif defined(GFX_NULL)
+#include "renderer_backend/null.cpp"
 #else
 #error "No gfx api selected from the implemented ones"
 #endif
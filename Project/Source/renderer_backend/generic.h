@@ -26,6 +26,11 @@ enum R_VertAttribType
     VertAttrib_Bitangent,
     VertAttrib_ColorRGB,
     VertAttrib_ColorScale,
+    
+    // Rows of the per object matrices, for instanced
+    // draws (typeSlot is the row, from 0 to 3)
+    VertAttrib_Model2World,
+    VertAttrib_NormalMat,
 };
 
 struct R_VertAttrib
@@ -34,6 +39,7 @@ struct R_VertAttrib
     u32 typeSlot;  // One could use the same type more than once
     u32 bufferSlot;
     u32 offset;
+    bool perInstance;  // Advances once per instance instead of once per vertex
 };
 
 enum R_BlendMode
@@ -155,6 +161,12 @@ struct R_ShaderInput
     String dxil;
     String vulkanSpirv;
     String glsl;
+    
+    // Only used when there is no d3d11Bytecode, by backends which
+    // can compile HLSL. The path is used to resolve includes
+    String hlsl;
+    String hlslPath;
+    String hlslEntry;
 };
 
 // Enums info
@@ -179,10 +191,26 @@ struct R_DepthState;
 #include "renderer_backend/opengl.h"
 #elif defined(GFX_D3D11)
 #include "renderer_backend/d3d11.h"
+#elif defined(GFX_NULL)
+#include "renderer_backend/null.h"
 #else
 #error "Unsupported gfx api."
 #endif
 
+// Per frame upload memory for constant buffer data. Allocations are
+// sub-allocated linearly from one big dynamic buffer, so pushing per draw
+// data costs a copy instead of a separate buffer update. The data stays
+// valid for the commands of the current and the next frame
+#define R_TransientAlignment 256  // Required for constant buffer offsets
+#define R_TransientCapacity MB(4)
+
+struct R_Transient
+{
+    R_Buffer* buffer;
+    u32 offset;  // Multiple of R_TransientAlignment
+    u32 size;    // Rounded up to R_TransientAlignment
+};
+
 // Buffers
 R_Buffer R_BufferAlloc(R_BufferFlags flags, u32 stride, u64 size = 0, void* initData = nullptr);
 #define R_BufferAllocStruct(flags, structName) R_BufferAlloc(flags, sizeof(structName), sizeof(structName), &structName)
@@ -191,6 +219,10 @@ void R_BufferUpdate(R_Buffer* b, u64 offset, u64 size, void* data);
 #define R_BufferUpdateStruct(buffer, structVar) R_BufferUpdate(buffer, 0, sizeof(structVar), &structVar)
 void R_BufferUniformBind(R_Buffer* b, u32 slot, ShaderType type);
 void R_BufferFree(R_Buffer* b);
+// Copies size bytes of data to the per frame upload buffer
+R_Transient R_TransientAlloc(u64 size, void* data);
+#define R_TransientAllocStruct(structVar) R_TransientAlloc(sizeof(structVar), &structVar)
+void R_TransientUniformBind(R_Transient t, u32 slot, ShaderType type);
 
 // Shaders
 R_Shader R_ShaderAlloc(R_ShaderInput input, ShaderType type);
@@ -241,7 +273,7 @@ R_Framebuffer R_FramebufferAlloc(u32 width, u32 height, R_Texture2D* colorAttach
                                  u32 colorAttachmentsCount, R_Texture2D depthAttachment);
 const R_Framebuffer* R_GetScreen();
 void R_FramebufferBind(const R_Framebuffer* f);
-void R_FramebufferResize(const R_Framebuffer* f, u32 newWidth, u32 newHeight);
+void R_FramebufferResize(R_Framebuffer* f, u32 newWidth, u32 newHeight);
 void R_FramebufferClear(const R_Framebuffer* f, R_BufferMask mask);
 // Unused channels will naturally be ignored
 void R_FramebufferFillColor(const R_Framebuffer* f, u32 slot, f64 r, f64 g, f64 b, f64 a);
@@ -250,7 +282,7 @@ void R_FramebufferFillColor(const R_Framebuffer* f, u32 slot, f64 r, f64 g, f64
 // (0, 0) is located on the bottom left of the image.
 // This function returns 0 for unused channels in the corresponding index
 IVec4 R_FramebufferReadColor(const R_Framebuffer* f, u32 slot, s32 x, s32 y);
-void R_FramebufferResolve(R_Framebuffer* src, R_Framebuffer* dst);
+void R_FramebufferResolve(R_Framebuffer* src, const R_Framebuffer* dst);
 void R_FramebufferFree(R_Framebuffer* f);
 
 // Vertex layouts
@@ -262,6 +294,10 @@ void R_VertLayoutFree(R_VertLayout* layout);
 void R_SetViewport(s32 x, s32 y, s32 w, s32 h);
 void R_Draw(R_Buffer* verts, R_Buffer* indices, u64 start = 0, u64 count = 0);  // Count = 0 means the entire mesh
 void R_Draw(R_Buffer* verts, u64 start = 0, u64 count = 0);                     // Count = 0 means the entire mesh
+// The instance buffer is bound to slot 1, with the per instance
+// attributes of the bound layout reading from it
+void R_DrawInstanced(R_Buffer* verts, R_Buffer* indices, R_Buffer* instances, u64 firstInstance, u64 numInstances,
+                     u64 start = 0, u64 count = 0);
 void R_SetAlphaBlending(bool enable);
 
 // Backend state
@@ -0,0 +1,612 @@
+
+#include "renderer_backend/generic.h"
+
+static Renderer renderer;
+
+// NOTE: Apart from bookkeeping, every function here only appends
+// to the command log, so this is about as cheap as a backend can be.
+// Submission overhead measured with it is entirely frontend overhead.
+
+// Null utils
+static void Null_Record(R_NullCmdKind kind, R_NullResourceKind resource, u32 id, u64 count = 0,
+                        u32 slot = 0, ShaderType type = ShaderType_Null, u32 instances = 0);
+static u32 Null_Alloc(R_NullResourceKind resource, u64 bytes);
+static void Null_Free(R_NullResourceKind resource, u32* id, u64 bytes = 0);
+static void Null_Bind(R_NullResourceKind resource, u32 id, u32 slot = 0, ShaderType type = ShaderType_Null);
+static void Null_Upload(R_NullResourceKind resource, u32 id, u64 bytes);
+static u32 Null_FormatGetPixelSize(R_TextureFormat format);
+static void Null_TransientUnmap();
+
+// Resources
+
+// Buffers
+R_Buffer R_BufferAlloc(R_BufferFlags flags, u32 stride, u64 size, void* initData)
+{
+    R_Buffer res = {};
+    res.flags  = flags;
+    res.stride = stride;
+    res.size   = size;
+    res.id     = Null_Alloc(NullResource_Buffer, size);
+    renderer.liveBufferBytes += size;
+    if(initData) Null_Upload(NullResource_Buffer, res.id, size);
+    return res;
+}
+
+void R_BufferUpdate(R_Buffer* b, u64 offset, u64 size, void* data)
+{
+    if(size <= 0) return;
+    
+    assert(b->id != 0);
+    assert(offset + size <= b->size);
+    Null_Upload(NullResource_Buffer, b->id, size);
+}
+
+void R_BufferUniformBind(R_Buffer* b, u32 slot, ShaderType type)
+{
+    assert(b->id != 0);
+    Null_Bind(NullResource_Buffer, b->id, slot, type);
+}
+
+void R_BufferFree(R_Buffer* b)
+{
+    if(b->id == 0) return;
+    
+    renderer.liveBufferBytes -= b->size;
+    Null_Free(NullResource_Buffer, &b->id, b->size);
+}
+
+R_Transient R_TransientAlloc(u64 size, void* data)
+{
+    auto& r = renderer;
+    
+    u64 alignedSize = (size + R_TransientAlignment - 1) & ~((u64)R_TransientAlignment - 1);
+    assert(alignedSize <= r.transient.size);
+    
+    if(r.transientOffset + alignedSize > r.transient.size)
+    {
+        // Discarding needs a new map
+        Null_TransientUnmap();
+        r.transientOffset = 0;
+    }
+    
+    if(!r.transientMapped)
+    {
+        r.transientMapped = true;
+        ++r.stats.transientMaps;
+    }
+    
+    Null_Upload(NullResource_Buffer, r.transient.id, size);
+    r.stats.transientBytes += size;
+    
+    R_Transient res = {};
+    res.buffer = &r.transient;
+    res.offset = (u32)r.transientOffset;
+    res.size   = (u32)alignedSize;
+    r.transientOffset += alignedSize;
+    return res;
+}
+
+void R_TransientUniformBind(R_Transient t, u32 slot, ShaderType type)
+{
+    assert(t.buffer && t.offset + t.size <= t.buffer->size);
+    Null_Bind(NullResource_Buffer, t.buffer->id, slot, type);
+}
+
+// Shaders
+R_Shader R_ShaderAlloc(R_ShaderInput input, ShaderType type)
+{
+    R_Shader res = {};
+    res.type = type;
+    res.id   = Null_Alloc(NullResource_Shader, input.d3d11Bytecode.len);
+    return res;
+}
+
+void R_ShaderBind(R_Shader* shader)
+{
+    assert(shader->id != 0);
+    Null_Bind(NullResource_Shader, shader->id, 0, shader->type);
+}
+
+void R_ShaderFree(R_Shader* shader)
+{
+    Null_Free(NullResource_Shader, &shader->id);
+}
+
+// Rasterizer state
+R_Rasterizer R_RasterizerAlloc(R_RasterizerDesc desc)
+{
+    R_Rasterizer res = {};
+    res.desc = desc;
+    res.id   = Null_Alloc(NullResource_Rasterizer, 0);
+    return res;
+}
+
+void R_RasterizerBind(R_Rasterizer* rasterizer)
+{
+    assert(rasterizer->id != 0);
+    Null_Bind(NullResource_Rasterizer, rasterizer->id);
+}
+
+void R_RasterizerFree(R_Rasterizer* rasterizer)
+{
+    Null_Free(NullResource_Rasterizer, &rasterizer->id);
+}
+
+// Depth state
+R_DepthState R_DepthStateAlloc(R_DepthDesc desc)
+{
+    R_DepthState res = {};
+    res.desc = desc;
+    res.id   = Null_Alloc(NullResource_DepthState, 0);
+    return res;
+}
+
+void R_DepthStateBind(R_DepthState* depth)
+{
+    assert(depth->id != 0);
+    Null_Bind(NullResource_DepthState, depth->id);
+}
+
+void R_DepthStateFree(R_DepthState* depth)
+{
+    Null_Free(NullResource_DepthState, &depth->id);
+}
+
+// Textures
+R_Texture2D R_Texture2DAlloc(R_TextureFormat format, u32 width, u32 height, void* initData, R_TextureUsage usage, R_TextureMutability mutability, bool mips, u8 sampleCount)
+{
+    assert(sampleCount > 0);
+    
+    R_Texture2D res = {};
+    res.width = width;
+    res.height = height;
+    res.formatSimple = format;
+    
+    u64 size = (u64)Null_FormatGetPixelSize(format) * width * height * sampleCount;
+    res.id = Null_Alloc(NullResource_Texture2D, size);
+    if(initData) Null_Upload(NullResource_Texture2D, res.id, size);
+    return res;
+}
+
+void R_Texture2DTransfer(R_Texture2D* t, String data)
+{
+    assert(t->id != 0);
+    Null_Upload(NullResource_Texture2D, t->id, data.len);
+}
+
+void R_Texture2DBind(R_Texture2D* t, u32 slot, ShaderType type)
+{
+    assert(t->id != 0);
+    Null_Bind(NullResource_Texture2D, t->id, slot, type);
+}
+
+void R_Texture2DFree(R_Texture2D* t)
+{
+    Null_Free(NullResource_Texture2D, &t->id);
+}
+
+void R_CubemapAlloc(R_Cubemap* c, u32 width, u32 height, R_CubemapBinary initData, R_TextureUsage usage, R_TextureMutability mutability)
+{
+    *c = {};
+    c->width = width;
+    c->height = height;
+    c->id = Null_Alloc(NullResource_Cubemap, (u64)initData.len * 6);
+    if(initData.top) Null_Upload(NullResource_Cubemap, c->id, (u64)initData.len * 6);
+}
+
+void R_CubemapTransfer(R_Cubemap* c, R_CubemapBinary data)
+{
+    assert(c->id != 0);
+    Null_Upload(NullResource_Cubemap, c->id, (u64)data.len * 6);
+}
+
+void R_CubemapBind(R_Cubemap* c, u32 slot, ShaderType type)
+{
+    assert(c->id != 0);
+    Null_Bind(NullResource_Cubemap, c->id, slot, type);
+}
+
+void R_CubemapFree(R_Cubemap* c)
+{
+    Null_Free(NullResource_Cubemap, &c->id);
+}
+
+// Samplers
+R_Sampler R_SamplerAlloc(R_SamplerFilter min, R_SamplerFilter mag, R_SamplerWrap wrapU, R_SamplerWrap wrapV)
+{
+    R_Sampler res = {};
+    res.min   = min;
+    res.mag   = mag;
+    res.wrapU = wrapU;
+    res.wrapV = wrapV;
+    res.id    = Null_Alloc(NullResource_Sampler, 0);
+    return res;
+}
+
+void R_SamplerBind(R_Sampler* s, u32 slot, ShaderType type)
+{
+    assert(s->id != 0);
+    Null_Bind(NullResource_Sampler, s->id, slot, type);
+}
+
+void R_SamplerFree(R_Sampler* sampler)
+{
+    Null_Free(NullResource_Sampler, &sampler->id);
+}
+
+// Framebuffers
+R_Framebuffer R_FramebufferAlloc(u32 width, u32 height, R_Texture2D* colorAttachments, u32 colorAttachmentsCount, R_Texture2D depthStencilAttachment)
+{
+    assert(colorAttachmentsCount > 0);
+    
+    if(width < 1)  width = 1;
+    if(height < 1) height = 1;
+    
+    R_Framebuffer res = {};
+    res.width = width;
+    res.height = height;
+    res.colorFormatSimple = colorAttachments[0].formatSimple;
+    res.numColorAttachments = colorAttachmentsCount;
+    res.depth = depthStencilAttachment.id != 0;
+    res.id = Null_Alloc(NullResource_Framebuffer, 0);
+    return res;
+}
+
+const R_Framebuffer* R_GetScreen()
+{
+    return &renderer.screen;
+}
+
+void R_FramebufferBind(const R_Framebuffer* f)
+{
+    assert(f->id != 0);
+    Null_Bind(NullResource_Framebuffer, f->id);
+}
+
+void R_FramebufferResize(R_Framebuffer* f, u32 newWidth, u32 newHeight)
+{
+    f->width  = newWidth  < 1? 1 : newWidth;
+    f->height = newHeight < 1? 1 : newHeight;
+}
+
+void R_FramebufferClear(const R_Framebuffer* f, R_BufferMask mask)
+{
+    assert(f->id != 0);
+    Null_Record(NullCmd_Clear, NullResource_Framebuffer, f->id, mask);
+    ++renderer.stats.clears;
+}
+
+void R_FramebufferFillColor(const R_Framebuffer* f, u32 slot, f64 r, f64 g, f64 b, f64 a)
+{
+    assert(f->id != 0);
+    assert(slot < f->numColorAttachments);
+    Null_Record(NullCmd_Clear, NullResource_Framebuffer, f->id, BufferMask_Color, slot);
+    ++renderer.stats.clears;
+}
+
+// There's nothing to read back, it's always zero
+IVec4 R_FramebufferReadColor(const R_Framebuffer* f, u32 slot, s32 x, s32 y)
+{
+    assert(f->id != 0);
+    assert(slot < f->numColorAttachments);
+    Null_Record(NullCmd_Readback, NullResource_Framebuffer, f->id, 0, slot);
+    return {};
+}
+
+void R_FramebufferResolve(R_Framebuffer* src, const R_Framebuffer* dst)
+{
+    assert(src->id != 0 && dst->id != 0);
+    Null_Record(NullCmd_Resolve, NullResource_Framebuffer, src->id, dst->id);
+}
+
+void R_FramebufferFree(R_Framebuffer* f)
+{
+    Null_Free(NullResource_Framebuffer, &f->id);
+}
+
+// Vertex layouts
+R_VertLayout R_VertLayoutAlloc(R_VertAttrib* attributes, u32 count)
+{
+    R_VertLayout res = {};
+    res.numAttribs = count;
+    res.id = Null_Alloc(NullResource_VertLayout, 0);
+    return res;
+}
+
+void R_VertLayoutBind(R_VertLayout* layout)
+{
+    assert(layout->id != 0);
+    Null_Bind(NullResource_VertLayout, layout->id);
+}
+
+void R_VertLayoutFree(R_VertLayout* layout)
+{
+    Null_Free(NullResource_VertLayout, &layout->id);
+}
+
+// Rendering operations
+void R_SetViewport(s32 x, s32 y, s32 w, s32 h)
+{
+    Null_Record(NullCmd_SetViewport, NullResource_None, 0, (u64)w * h);
+}
+
+void R_Draw(R_Buffer* verts, R_Buffer* indices, u64 start, u64 count)
+{
+    assert(verts->id != 0 && indices->id != 0);
+    
+    if(count == 0) count = indices->size / sizeof(u32);
+    
+    Null_TransientUnmap();
+    Null_Record(NullCmd_Draw, NullResource_Buffer, verts->id, count);
+    ++renderer.stats.draws;
+    renderer.stats.vertices += count;
+}
+
+void R_Draw(R_Buffer* verts, u64 start, u64 count)
+{
+    assert(verts->id != 0);
+    
+    if(count == 0) count = verts->size / verts->stride;
+    
+    Null_TransientUnmap();
+    Null_Record(NullCmd_Draw, NullResource_Buffer, verts->id, count);
+    ++renderer.stats.draws;
+    renderer.stats.vertices += count;
+}
+
+void R_DrawInstanced(R_Buffer* verts, R_Buffer* indices, R_Buffer* instances, u64 firstInstance, u64 numInstances,
+                     u64 start, u64 count)
+{
+    assert(verts->id != 0 && indices->id != 0 && instances->id != 0);
+    assert((firstInstance + numInstances) * instances->stride <= instances->size);
+    
+    if(count == 0) count = indices->size / sizeof(u32);
+    
+    Null_TransientUnmap();
+    Null_Record(NullCmd_Draw, NullResource_Buffer, verts->id, count, 0, ShaderType_Null, (u32)numInstances);
+    ++renderer.stats.draws;
+    ++renderer.stats.instancedDraws;
+    renderer.stats.instances += numInstances;
+    renderer.stats.vertices  += count * numInstances;
+}
+
+// Recorded as a bind of no resource, with the slot set to enable
+void R_SetAlphaBlending(bool enable)
+{
+    Null_Bind(NullResource_None, 0, enable);
+}
+
+// Backend state
+
+void R_Init()
+{
+    auto& r = renderer;
+    
+    s32 w, h;
+    OS_GetClientAreaSize(&w, &h);
+    
+    r.screen = {};
+    r.screen.width  = w < 1? 1 : w;
+    r.screen.height = h < 1? 1 : h;
+    r.screen.colorFormatSimple = TextureFormat_RGBA_SRGB;
+    r.screen.numColorAttachments = 1;
+    r.screen.depth = true;
+    r.screen.id = Null_Alloc(NullResource_Framebuffer, 0);
+    
+    // Transient allocations
+    r.transient = R_BufferAlloc(BufferFlag_Dynamic | BufferFlag_ConstantBuffer, R_TransientAlignment, R_TransientCapacity);
+    
+    // So that the first allocation wraps around, like the real ring
+    r.transientOffset = r.transient.size;
+}
+
+void R_WaitLastFrame() {}
+
+void R_PresentFrame()
+{
+    auto& r = renderer;
+    
+    Null_TransientUnmap();
+    Null_Record(NullCmd_Present, NullResource_Framebuffer, r.screen.id);
+    
+    // The log of the frame that just ended is kept until the next one
+    std::swap(r.log, r.lastLog);
+    r.log.len = 0;
+    r.lastStats = r.stats;
+    r.stats = {};
+    ++r.frameCount;
+}
+
+void R_UpdateSwapchainSize()
+{
+    auto& r = renderer;
+    
+    s32 w, h;
+    OS_GetClientAreaSize(&w, &h);
+    R_FramebufferResize(&r.screen, w, h);
+}
+
+void R_Cleanup()
+{
+    auto& r = renderer;
+    
+    R_BufferFree(&r.transient);
+    R_FramebufferFree(&r.screen);
+    Free(&r.log);
+    Free(&r.lastLog);
+}
+
+// Miscellaneous
+// Same convention as D3D11, so culling and the uploaded
+// matrices match what a real backend would get
+Mat4 R_ConvertClipSpace(Mat4 mat)
+{
+    // First flip the z axis
+    mat.m13 *= -1;
+    mat.m23 *= -1;
+    mat.m33 *= -1;
+    mat.m43 = 1;
+    
+    // Convert z from [-1, 1] to [0, 1]
+    mat.m31 = 0.5f * mat.m31 + 0.5f * mat.m41;
+    mat.m32 = 0.5f * mat.m32 + 0.5f * mat.m42;
+    mat.m33 = 0.5f * mat.m33 + 0.5f * mat.m43;
+    mat.m34 = 0.5f * mat.m34 + 0.5f * mat.m44;
+    
+    return mat;
+}
+
+// Dear ImGui
+void R_ImGuiInit() {}
+void R_ImGuiShutdown() {}
+void R_ImGuiNewFrame() {}
+void R_ImGuiDrawFrame() {}
+
+// Null backend specific
+Slice<R_NullCmd> R_NullGetLastFrameLog()
+{
+    return ToSlice(&renderer.lastLog);
+}
+
+R_NullFrameStats R_NullGetLastFrameStats()
+{
+    return renderer.lastStats;
+}
+
+u32 R_NullGetLiveResources(R_NullResourceKind kind)
+{
+    assert(kind < NullResource_Count);
+    return renderer.live[kind];
+}
+
+u32 R_NullGetTotalLiveResources()
+{
+    u32 res = 0;
+    for(int i = 0; i < NullResource_Count; ++i)
+        res += renderer.live[i];
+    
+    return res;
+}
+
+u64 R_NullGetLiveBufferBytes()
+{
+    return renderer.liveBufferBytes;
+}
+
+const char* R_NullCmdKindToString(R_NullCmdKind kind)
+{
+    switch(kind)
+    {
+        case NullCmd_Alloc:       return "Alloc";
+        case NullCmd_Free:        return "Free";
+        case NullCmd_Upload:      return "Upload";
+        case NullCmd_Bind:        return "Bind";
+        case NullCmd_Draw:        return "Draw";
+        case NullCmd_Clear:       return "Clear";
+        case NullCmd_Resolve:     return "Resolve";
+        case NullCmd_Readback:    return "Readback";
+        case NullCmd_SetViewport: return "SetViewport";
+        case NullCmd_Present:     return "Present";
+        case NullCmd_Count:       return "";
+    }
+    
+    return "";
+}
+
+const char* R_NullResourceKindToString(R_NullResourceKind kind)
+{
+    switch(kind)
+    {
+        case NullResource_None:        return "None";
+        case NullResource_Buffer:      return "Buffer";
+        case NullResource_VertLayout:  return "VertLayout";
+        case NullResource_Shader:      return "Shader";
+        case NullResource_Rasterizer:  return "Rasterizer";
+        case NullResource_DepthState:  return "DepthState";
+        case NullResource_Texture2D:   return "Texture2D";
+        case NullResource_Cubemap:     return "Cubemap";
+        case NullResource_Sampler:     return "Sampler";
+        case NullResource_Framebuffer: return "Framebuffer";
+        case NullResource_Count:       return "";
+    }
+    
+    return "";
+}
+
+// Null utility functions
+
+static void Null_Record(R_NullCmdKind kind, R_NullResourceKind resource, u32 id, u64 count, u32 slot, ShaderType type, u32 instances)
+{
+    R_NullCmd cmd = {};
+    cmd.kind = kind;
+    cmd.resource = resource;
+    cmd.slot = (u8)slot;
+    cmd.shaderType = (u8)type;
+    cmd.id = id;
+    cmd.instances = instances;
+    cmd.count = count;
+    Append(&renderer.log, cmd);
+}
+
+static u32 Null_Alloc(R_NullResourceKind resource, u64 bytes)
+{
+    auto& r = renderer;
+    
+    u32 id = ++r.nextId;
+    ++r.live[resource];
+    ++r.stats.allocs;
+    Null_Record(NullCmd_Alloc, resource, id, bytes);
+    return id;
+}
+
+// Freeing a resource which was never allocated (or was already freed) is a no-op
+static void Null_Free(R_NullResourceKind resource, u32* id, u64 bytes)
+{
+    if(*id == 0) return;
+    
+    auto& r = renderer;
+    
+    assert(r.live[resource] > 0);
+    --r.live[resource];
+    ++r.stats.frees;
+    Null_Record(NullCmd_Free, resource, *id, bytes);
+    *id = 0;
+}
+
+static void Null_Bind(R_NullResourceKind resource, u32 id, u32 slot, ShaderType type)
+{
+    Null_Record(NullCmd_Bind, resource, id, 0, slot, type);
+    ++renderer.stats.binds;
+}
+
+static void Null_Upload(R_NullResourceKind resource, u32 id, u64 bytes)
+{
+    Null_Record(NullCmd_Upload, resource, id, bytes);
+    ++renderer.stats.uploads;
+    renderer.stats.bytesUploaded += bytes;
+}
+
+// Same points as the real ring: it stays mapped until the next draw
+// or the end of the frame, so that maps can be counted
+static void Null_TransientUnmap()
+{
+    renderer.transientMapped = false;
+}
+
+static u32 Null_FormatGetPixelSize(R_TextureFormat format)
+{
+    switch(format)
+    {
+        case TextureFormat_Invalid:         return 0;
+        case TextureFormat_Count:           return 0;
+        case TextureFormat_R32Int:          return 4;
+        case TextureFormat_R:               return 1;
+        case TextureFormat_RG:              return 2;
+        case TextureFormat_RGBA:            return 4;
+        case TextureFormat_RGBA_SRGB:       return 4;
+        case TextureFormat_RGBA_HDR:        return 8;
+        case TextureFormat_DepthStencil:    return 4;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,173 @@
+
+#pragma once
+
+#include "base.h"
+#include "serialization.h"
+
+// NOTE: Backend which doesn't talk to any graphics api, for headless
+// programs (benchmarks, tools, CI) which need to run the engine code
+// without a GPU or a window. Nothing is drawn, every call is instead
+// recorded in a command log, along with per frame counters, so that
+// the renderer frontend can be profiled and checked for redundant
+// binds or leaked resources.
+
+// Every resource gets a unique id on allocation, which is
+// set back to 0 when it's freed. 0 is never a valid id.
+
+struct R_Buffer
+{
+    u32 id;
+    R_BufferFlags flags;
+    u32 stride;
+    u64 size;
+};
+
+struct R_VertLayout
+{
+    u32 id;
+    u32 numAttribs;
+};
+
+struct R_Shader
+{
+    u32 id;
+    ShaderType type;
+};
+
+struct R_Rasterizer
+{
+    u32 id;
+    R_RasterizerDesc desc;
+};
+
+struct R_DepthState
+{
+    u32 id;
+    R_DepthDesc desc;
+};
+
+struct R_Texture2D
+{
+    u32 id;
+    u32 width, height;
+    R_TextureFormat formatSimple;
+};
+
+struct R_Cubemap
+{
+    u32 id;
+    u32 width, height;
+};
+
+struct R_Sampler
+{
+    u32 id;
+    R_SamplerFilter min, mag;
+    R_SamplerWrap wrapU, wrapV;
+};
+
+struct R_Framebuffer
+{
+    u32 id;
+    u32 width, height;
+    R_TextureFormat colorFormatSimple;
+    u32 numColorAttachments;
+    bool depth;
+};
+
+// Command log
+
+enum R_NullResourceKind: u8
+{
+    NullResource_None = 0,
+    NullResource_Buffer,
+    NullResource_VertLayout,
+    NullResource_Shader,
+    NullResource_Rasterizer,
+    NullResource_DepthState,
+    NullResource_Texture2D,
+    NullResource_Cubemap,
+    NullResource_Sampler,
+    NullResource_Framebuffer,
+    
+    NullResource_Count
+};
+
+enum R_NullCmdKind: u8
+{
+    NullCmd_Alloc = 0,
+    NullCmd_Free,
+    NullCmd_Upload,     // CPU to GPU transfer, including transient allocations
+    NullCmd_Bind,
+    NullCmd_Draw,
+    NullCmd_Clear,
+    NullCmd_Resolve,
+    NullCmd_Readback,
+    NullCmd_SetViewport,
+    NullCmd_Present,
+    
+    NullCmd_Count
+};
+
+struct R_NullCmd
+{
+    R_NullCmdKind kind;
+    R_NullResourceKind resource;
+    u8 slot;        // For binds
+    u8 shaderType;  // For binds
+    u32 id;         // Resource the command operates on (vertex buffer for draws)
+    u32 instances;  // For draws, 0 for non-instanced ones
+    u64 count;      // Bytes for allocs and uploads, vertices (or indices) for draws
+};
+
+// Reset at every R_PresentFrame. The first frame also
+// counts everything done between R_Init and its end
+struct R_NullFrameStats
+{
+    u32 draws;
+    u32 instancedDraws;
+    u64 instances;
+    u64 vertices;  // Indices for indexed draws
+    u32 binds;
+    u32 allocs;
+    u32 frees;
+    u32 uploads;
+    u64 bytesUploaded;
+    u64 transientBytes;  // Also counted in bytesUploaded
+    u32 transientMaps;   // Times the transient ring would be mapped
+    u32 clears;
+};
+
+struct Renderer
+{
+    R_Framebuffer screen;
+    
+    u32 nextId;
+    
+    // Commands of the frame being recorded, and of the last presented one
+    Array<R_NullCmd> log;
+    Array<R_NullCmd> lastLog;
+    R_NullFrameStats stats;
+    R_NullFrameStats lastStats;
+    u32 frameCount;
+    
+    // Not reset between frames, for catching leaks
+    u32 live[NullResource_Count];
+    u64 liveBufferBytes;
+    
+    // Same scheme as the ring of the real backends, so that
+    // wraparounds happen at the same points
+    R_Buffer transient;
+    u64 transientOffset;
+    bool transientMapped;
+};
+
+// Null backend specific
+// Commands and counters of the last frame ended by R_PresentFrame
+Slice<R_NullCmd> R_NullGetLastFrameLog();
+R_NullFrameStats R_NullGetLastFrameStats();
+u32 R_NullGetLiveResources(R_NullResourceKind kind);
+u32 R_NullGetTotalLiveResources();
+u64 R_NullGetLiveBufferBytes();
+const char* R_NullCmdKindToString(R_NullCmdKind kind);
+const char* R_NullResourceKindToString(R_NullResourceKind kind);
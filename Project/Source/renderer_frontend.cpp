@@ -66,6 +66,7 @@ enum CBufferSlot
 
 static R_VertLayout staticLayout;
 static R_VertLayout skinnedLayout;
+static R_VertLayout instancedLayout;  // Static vertices in slot 0, PerObj instances in slot 1
 
 static R_Sampler bilinear;
 
@@ -73,9 +74,22 @@ static R_Framebuffer mainFramebuffer;
 static R_Framebuffer postProcess;
 
 static R_Buffer perView;
-static R_Buffer perObj;
+static R_Buffer instanceBuffer;  // PerObj of the objects in instanced batches, rewritten every frame
 
 static VertShaderHandle staticVertShader;
+static VertShaderHandle instancedVertShader;
+
+// Batches of objects with the same mesh and material smaller
+// than this are drawn one by one, without instancing
+#define MinInstancedBatch 2
+
+// Objects drawn one by one get their PerObj data from the transient ring,
+// uploaded in spans of consecutive objects with a single allocation each,
+// so that the ring is mapped once per span instead of once per draw.
+// Each span is drawn before the next one is allocated, since allocating
+// can wrap the ring around and discard what hasn't been drawn yet
+#define PerObjStride ((sizeof(PerObj) + R_TransientAlignment - 1) & ~((u64)R_TransientAlignment - 1))
+#define MaxPerObjSpan (R_TransientCapacity / 4 / PerObjStride)
 
 static GraphicsSettings gfxSettings;
 
@@ -84,6 +98,8 @@ Mesh StaticMeshAlloc(StaticMeshInput input)
     Mesh res = {};
     res.vertBuffer = R_BufferAlloc(BufferFlag_Vertex, sizeof(Vertex), input.verts.len * sizeof(Vertex), input.verts.ptr);
     res.idxBuffer  = R_BufferAlloc(BufferFlag_Index, 4, input.indices.len * 4, input.indices.ptr);
+    res.aabb   = input.aabb;
+    res.sphere = input.sphere;
     return res;
 }
 
@@ -98,13 +114,174 @@ void MeshFree(Mesh* mesh)
     R_BufferFree(&mesh->idxBuffer);
 }
 
-static void UseMaterial(Material* mat)
+static RenderStats renderStats;
+
+RenderStats GetRenderStats()
+{
+    return renderStats;
+}
+
+// Render queue
+
+// Draws are sorted by a 64 bit key, so that the ones sharing state end up
+// next to each other. From the most significant bits to the least:
+// pass (4 bits), pixel shader (12), material (16), mesh (16), depth (16).
+// Handles are truncated to their slot, which can only make unrelated
+// draws interleave (the state tracker compares the actual resources)
+enum RenderPass
+{
+    RenderPass_Opaque = 0,
+    
+    RenderPass_Count
+};
+
+static u64 MakeDrawKey(RenderPass pass, PixelShaderHandle shader, MaterialHandle material, MeshHandle mesh, u16 depth)
+{
+    return ((u64)pass                    << 60) |
+           ((u64)(shader.slot & 0xFFF)   << 48) |
+           ((u64)(material.slot & 0xFFFF) << 32) |
+           ((u64)(mesh.slot & 0xFFFF)    << 16) |
+           ((u64)depth);
+}
+
+// Front to back, so that the depth test rejects more pixels
+static u16 QuantizeDepth(float viewDepth, float farClip)
+{
+    float t = viewDepth / farClip;
+    t = t < 0.0f? 0.0f : t > 1.0f? 1.0f : t;
+    return (u16)(t * 65535.0f);
+}
+
+// LSD radix sort, 8 bits per pass, moving the values along with the keys.
+// Passes where all keys have the same byte are skipped, which is common
+// since most scenes only use a few shaders and materials
+static void RadixSort(Slice<u64> keys, Slice<u32> values, Arena* arena)
+{
+    assert(keys.len == values.len);
+    s64 count = keys.len;
+    if(count <= 1) return;
+    
+    u64* tmpKeys   = ArenaAllocArray(u64, count, arena);
+    u32* tmpValues = ArenaAllocArray(u32, count, arena);
+    
+    s64 histograms[8][256] = {};
+    for(s64 i = 0; i < count; ++i)
+    {
+        for(int b = 0; b < 8; ++b)
+            ++histograms[b][(keys[i] >> (b * 8)) & 0xFF];
+    }
+    
+    u64* srcKeys = keys.ptr;
+    u32* srcValues = values.ptr;
+    u64* dstKeys = tmpKeys;
+    u32* dstValues = tmpValues;
+    for(int b = 0; b < 8; ++b)
+    {
+        s64* histogram = histograms[b];
+        if(histogram[(srcKeys[0] >> (b * 8)) & 0xFF] == count) continue;
+        
+        s64 offsets[256];
+        s64 sum = 0;
+        for(int i = 0; i < 256; ++i)
+        {
+            offsets[i] = sum;
+            sum += histogram[i];
+        }
+        
+        for(s64 i = 0; i < count; ++i)
+        {
+            s64 dst = offsets[(srcKeys[i] >> (b * 8)) & 0xFF]++;
+            dstKeys[dst]   = srcKeys[i];
+            dstValues[dst] = srcValues[i];
+        }
+        
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+    
+    if(srcKeys != keys.ptr)
+    {
+        memcpy(keys.ptr, srcKeys, count * sizeof(u64));
+        memcpy(values.ptr, srcValues, count * sizeof(u32));
+    }
+}
+
+// Skips binds of resources which are already bound. Only knows
+// about the binds made through it, so it should be reset
+// whenever state is bound some other way
+struct StateTracker
+{
+    R_VertLayout* layout;
+    R_Shader* vertShader;
+    R_Shader* pixelShader;
+    R_Texture2D* matTextures[MatTex9 - MatTex0 + 1];
+    R_Sampler* samplers[CodeSampler9 - CodeSampler0 + 1];
+};
+
+static void TrackedShaderBind(StateTracker* tracker, R_Shader* shader, ShaderType type)
+{
+    assert(type == ShaderType_Vertex || type == ShaderType_Pixel);
+    R_Shader*& bound = type == ShaderType_Vertex? tracker->vertShader : tracker->pixelShader;
+    if(bound == shader)
+    {
+        ++renderStats.skippedBinds;
+        return;
+    }
+    
+    R_ShaderBind(shader);
+    bound = shader;
+    ++renderStats.stateChanges;
+}
+
+static void TrackedVertLayoutBind(StateTracker* tracker, R_VertLayout* layout)
+{
+    if(tracker->layout == layout)
+    {
+        ++renderStats.skippedBinds;
+        return;
+    }
+    
+    R_VertLayoutBind(layout);
+    tracker->layout = layout;
+    ++renderStats.stateChanges;
+}
+
+static void TrackedTexture2DBind(StateTracker* tracker, R_Texture2D* texture, TextureSlot slot)
+{
+    assert(slot >= MatTex0 && slot <= MatTex9);
+    R_Texture2D*& bound = tracker->matTextures[slot - MatTex0];
+    if(bound == texture)
+    {
+        ++renderStats.skippedBinds;
+        return;
+    }
+    
+    R_Texture2DBind(texture, slot, ShaderType_Pixel);
+    bound = texture;
+    ++renderStats.stateChanges;
+}
+
+static void TrackedSamplerBind(StateTracker* tracker, R_Sampler* sampler, SamplerSlot slot)
+{
+    R_Sampler*& bound = tracker->samplers[slot - CodeSampler0];
+    if(bound == sampler)
+    {
+        ++renderStats.skippedBinds;
+        return;
+    }
+    
+    R_SamplerBind(sampler, slot, ShaderType_Pixel);
+    bound = sampler;
+    ++renderStats.stateChanges;
+}
+
+static void UseMaterial(StateTracker* tracker, Material* mat)
 {
-    R_ShaderBind(GetAsset(mat->shader));
+    TrackedShaderBind(tracker, GetAsset(mat->shader), ShaderType_Pixel);
     
     for(int i = 0; i < mat->textures.len; ++i)
     {
-        R_Texture2DBind(GetAsset(mat->textures[i]), MatTex0 + i, ShaderType_Pixel);
+        TrackedTexture2DBind(tracker, GetAsset(mat->textures[i]), (TextureSlot)(MatTex0 + i));
     }
 }
 
@@ -135,14 +312,32 @@ void RenderResourcesInit()
         skinnedLayout = R_VertLayoutAlloc(attribs, ArrayCount(attribs));
     }
     
+    {
+        R_VertAttrib attribs[] =
+        {
+            { .type=VertAttrib_Pos, .bufferSlot=0, .offset=offsetof(Vertex, pos), },
+            { .type=VertAttrib_Normal, .bufferSlot=0, .offset=offsetof(Vertex, normal), },
+            { .type=VertAttrib_TexCoord, .bufferSlot=0, .offset=offsetof(Vertex, texCoord), },
+            { .type=VertAttrib_Tangent, .bufferSlot=0, .offset=offsetof(Vertex, tangent), },
+            { .type=VertAttrib_Model2World, .typeSlot=0, .bufferSlot=1, .offset=offsetof(PerObj, model2World) + 0,  .perInstance=true },
+            { .type=VertAttrib_Model2World, .typeSlot=1, .bufferSlot=1, .offset=offsetof(PerObj, model2World) + 16, .perInstance=true },
+            { .type=VertAttrib_Model2World, .typeSlot=2, .bufferSlot=1, .offset=offsetof(PerObj, model2World) + 32, .perInstance=true },
+            { .type=VertAttrib_Model2World, .typeSlot=3, .bufferSlot=1, .offset=offsetof(PerObj, model2World) + 48, .perInstance=true },
+            { .type=VertAttrib_NormalMat, .typeSlot=0, .bufferSlot=1, .offset=offsetof(PerObj, normalMat) + 0,  .perInstance=true },
+            { .type=VertAttrib_NormalMat, .typeSlot=1, .bufferSlot=1, .offset=offsetof(PerObj, normalMat) + 16, .perInstance=true },
+            { .type=VertAttrib_NormalMat, .typeSlot=2, .bufferSlot=1, .offset=offsetof(PerObj, normalMat) + 32, .perInstance=true },
+            { .type=VertAttrib_NormalMat, .typeSlot=3, .bufferSlot=1, .offset=offsetof(PerObj, normalMat) + 48, .perInstance=true },
+        };
+        instancedLayout = R_VertLayoutAlloc(attribs, ArrayCount(attribs));
+    }
+    
     bilinear = R_SamplerAlloc();
     
     staticVertShader = AcquireVertShader("CompiledShaders/model2proj.shader");
+    instancedVertShader = AcquireVertShader("CompiledShaders/model2proj_instanced.shader");
     
     perView = R_BufferAlloc(BufferFlag_Dynamic | BufferFlag_ConstantBuffer, sizeof(PerView), sizeof(PerView), nullptr);
-    perObj  = R_BufferAlloc(BufferFlag_Dynamic | BufferFlag_ConstantBuffer, sizeof(PerObj), sizeof(PerObj), nullptr);
     
-    R_BufferUniformBind(&perObj,  PerObjSlot,  ShaderType_Vertex);
     R_BufferUniformBind(&perView, PerViewSlot, ShaderType_Vertex);
     
     R_Texture2D mainFramebufferColor = R_Texture2DAlloc(TextureFormat_RGBA_SRGB,
@@ -211,9 +406,6 @@ void RenderFrame(EntityManager* entities, CamParams cam)
     
     R_FramebufferBind(&mainFramebuffer);
     
-    R_ShaderBind(GetAsset(staticVertShader));
-    
-    
     {
         R_RasterizerDesc desc = {};
         desc.depthClipEnable = true;
@@ -230,8 +422,6 @@ void RenderFrame(EntityManager* entities, CamParams cam)
         R_DepthStateBind(&depthState);
     }
     
-    R_VertLayoutBind(&staticLayout);
-    
     // Draw entities
     R_BufferUniformBind(&perView, PerViewSlot, ShaderType_Vertex);
     
@@ -240,26 +430,150 @@ void RenderFrame(EntityManager* entities, CamParams cam)
     
     auto view2Proj = View2ProjPerspectiveMatrix(cam.nearClip, cam.farClip, cam.fov, (float)w, (float)h);
     
+    auto world2View = World2ViewMatrix(cam.pos, cam.rot);
+    
     {
         PerView data = {};
-        data.world2View = World2ViewMatrix(cam.pos, cam.rot);
+        data.world2View = world2View;
         data.view2Proj  = R_ConvertClipSpace(view2Proj);
         R_BufferUpdateStruct(&perView, data);
     }
+    
+    // Frustum culling, on the world space bounds of the meshes
+    ScratchArena scratch;
+    s64 maxDrawables = entities->bases.dense.len;
+    Entity** drawables = ArenaAllocArray(Entity*, maxDrawables, scratch);
+    Aabb*    boxes     = ArenaAllocArray(Aabb, maxDrawables, scratch);
+    Sphere*  spheres   = ArenaAllocArray(Sphere, maxDrawables, scratch);
+    s64 numDrawables = 0;
     for_live_entities(entities, ent)
     {
         if(ent->flags & EntityFlags_NoMesh) continue;
         
+        Mat4 world = GetWorldTransform(entities, ent);
+        Mesh* mesh = GetAsset(ent->mesh);
+        drawables[numDrawables] = ent;
+        boxes[numDrawables]     = TransformAabb(mesh->aabb, world);
+        spheres[numDrawables]   = TransformSphere(mesh->sphere, world);
+        ++numDrawables;
+    }
+    
+    Frustum frustum = MakeFrustum(R_ConvertClipSpace(view2Proj) * world2View);
+    Slice<u32> visible = FrustumCull(frustum, {.ptr=boxes, .len=numDrawables}, {.ptr=spheres, .len=numDrawables}, scratch);
+    
+    renderStats = {};
+    renderStats.culled = (u32)(numDrawables - visible.len);
+    
+    // Sort the visible draws by state
+    Vec3 camForward = cam.rot * Vec3::forward;
+    u64* keys = ArenaAllocArray(u64, visible.len, scratch);
+    for(s64 i = 0; i < visible.len; ++i)
+    {
+        Entity* ent = drawables[visible[i]];
+        float viewDepth = dot(spheres[visible[i]].center - cam.pos, camForward);
+        u16 depth = QuantizeDepth(viewDepth, cam.farClip);
+        keys[i] = MakeDrawKey(RenderPass_Opaque, GetAsset(ent->material)->shader, ent->material, ent->mesh, depth);
+    }
+    
+    RadixSort({.ptr=keys, .len=visible.len}, visible, scratch);
+    
+    // Consecutive objects in the queue with the same mesh and material form a batch.
+    // Big enough batches are drawn with a single instanced draw, with their
+    // PerObj data uploaded to the instance buffer all at once, in queue order
+    auto batchEnd = [&](s64 start)
+    {
+        Entity* first = drawables[visible[start]];
+        s64 end = start + 1;
+        for(; end < visible.len; ++end)
+        {
+            Entity* ent = drawables[visible[end]];
+            if(ent->mesh.slot != first->mesh.slot || ent->mesh.gen != first->mesh.gen) break;
+            if(ent->material.slot != first->material.slot || ent->material.gen != first->material.gen) break;
+        }
+        
+        return end;
+    };
+    
+    // The instanced vertex shader is compiled offline, and if it failed to
+    // load (LoadShader returns an empty shader) everything is drawn one by one
+    bool canInstance = GetAsset(instancedVertShader)->type == ShaderType_Vertex;
+    auto isInstanced = [&](s64 batchSize) { return canInstance && batchSize >= MinInstancedBatch; };
+    
+    PerObj* instances = ArenaAllocArray(PerObj, visible.len, scratch);
+    u8* singles = (u8*)ArenaAlloc(scratch, visible.len * PerObjStride, alignof(PerObj));  // Spaced by PerObjStride
+    s64 numInstances = 0;
+    s64 numSingles = 0;
+    for(s64 i = 0; i < visible.len; i = batchEnd(i))
+    {
+        s64 end = batchEnd(i);
+        bool instanced = isInstanced(end - i);
+        for(s64 j = i; j < end; ++j)
         {
-            PerObj data = {};
-            data.model2World = ComputeWorldTransform(entities, ent);
-            data.normalMat = transpose(ComputeTransformInverse(data.model2World));
-            R_BufferUpdateStruct(&perObj, data);
+            Entity* ent = drawables[visible[j]];
+            PerObj* data = instanced? &instances[numInstances++] : (PerObj*)(singles + numSingles++ * PerObjStride);
+            data->model2World = GetWorldTransform(entities, ent);
+            data->normalMat   = GetNormalTransform(entities, ent);
         }
+    }
+    
+    if(numInstances > 0)
+    {
+        u64 size = numInstances * sizeof(PerObj);
+        if(instanceBuffer.size < size)
+        {
+            if(instanceBuffer.size > 0) R_BufferFree(&instanceBuffer);
+            u64 newSize = size > instanceBuffer.size * 2? size : instanceBuffer.size * 2;
+            instanceBuffer = R_BufferAlloc(BufferFlag_Dynamic | BufferFlag_Vertex, sizeof(PerObj), newSize, nullptr);
+        }
+        
+        R_BufferUpdate(&instanceBuffer, 0, size, instances);
+    }
+    
+    StateTracker tracker = {};
+    s64 firstInstance = 0;
+    R_Transient span = {};
+    s64 spanStart = 0, spanEnd = 0;
+    s64 single = 0;
+    for(s64 i = 0; i < visible.len; i = batchEnd(i))
+    {
+        s64 end = batchEnd(i);
+        Entity* ent = drawables[visible[i]];
+        Mesh* mesh = GetAsset(ent->mesh);
         
-        R_SamplerBind(&bilinear, CodeSampler0, ShaderType_Pixel);
-        UseMaterial(GetAsset(ent->material));
-        DrawMesh(GetAsset(ent->mesh));
+        TrackedSamplerBind(&tracker, &bilinear, CodeSampler0);
+        UseMaterial(&tracker, GetAsset(ent->material));
+        
+        if(isInstanced(end - i))
+        {
+            TrackedVertLayoutBind(&tracker, &instancedLayout);
+            TrackedShaderBind(&tracker, GetAsset(instancedVertShader), ShaderType_Vertex);
+            R_DrawInstanced(&mesh->vertBuffer, &mesh->idxBuffer, &instanceBuffer, firstInstance, end - i);
+            firstInstance += end - i;
+            renderStats.instances += (u32)(end - i);
+            ++renderStats.draws;
+            continue;
+        }
+        
+        TrackedVertLayoutBind(&tracker, &staticLayout);
+        TrackedShaderBind(&tracker, GetAsset(staticVertShader), ShaderType_Vertex);
+        for(s64 j = i; j < end; ++j, ++single)
+        {
+            if(single >= spanEnd)
+            {
+                s64 spanLen = min(numSingles - single, (s64)MaxPerObjSpan);
+                span = R_TransientAlloc(spanLen * PerObjStride, singles + single * PerObjStride);
+                spanStart = single;
+                spanEnd   = single + spanLen;
+            }
+            
+            R_Transient perObj = span;
+            perObj.offset += (u32)((single - spanStart) * PerObjStride);
+            perObj.size    = (u32)PerObjStride;
+            R_TransientUniformBind(perObj, PerObjSlot, ShaderType_Vertex);
+            
+            DrawMesh(mesh);
+            ++renderStats.draws;
+        }
     }
     
     R_FramebufferResolve(&mainFramebuffer, R_GetScreen());
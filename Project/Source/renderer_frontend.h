@@ -4,6 +4,7 @@
 #include "base.h"
 #include "renderer_backend/generic.h"
 #include "serialization.h"
+#include "collision.h"
 
 struct CamParams
 {
@@ -18,12 +19,18 @@ struct Mesh
 {
     R_Buffer vertBuffer;
     R_Buffer idxBuffer;
+    
+    // In model space, used for culling and picking
+    Aabb aabb;
+    Sphere sphere;
 };
 
 struct StaticMeshInput
 {
     Slice<Vertex> verts;
     Slice<u32> indices;
+    Aabb aabb;
+    Sphere sphere;
 };
 
 struct SkinnedMeshInput
@@ -46,6 +53,18 @@ void RenderResourcesCleanup();
 struct EntityManager;
 void RenderFrame(EntityManager* entities, CamParams cam);  // Entrypoint of renderer
 
+// Counters of the last RenderFrame
+struct RenderStats
+{
+    u32 draws;
+    u32 instances;     // Objects drawn by instanced draws
+    u32 culled;        // Meshes outside of the view frustum
+    u32 stateChanges;  // Binds actually issued to the backend
+    u32 skippedBinds;  // Binds of state which was already in effect
+};
+
+RenderStats GetRenderStats();
+
 void RenderScene(EntityManager* entities, Vec3 camPos, f32 fov, f32 nearClip, f32 farClip);
 void RenderOutlines(EntityManager* entities, Vec4 color, f32 thickness = 1.0f);  // Thickness is in pixels
 void RenderOutlines(EntityManager* entities);
@@ -114,4 +114,50 @@ struct MeshHeader_v0
     u32 indicesOffset;
 };
 
-typedef MeshHeader_v0 MeshHeader;
+// Adds the bounds of the vertices, in model space
+struct MeshHeader_v1
+{
+    bool isSkinned;
+    
+    s32 numVerts;
+    s32 numIndices;
+    bool hasTextureCoords;
+    u32 vertsOffset;
+    u32 indicesOffset;
+    
+    Vec3 aabbMin;
+    Vec3 aabbMax;
+    Vec3 sphereCenter;
+    float sphereRadius;
+};
+
+typedef MeshHeader_v1 MeshHeader;
+
+// Asset packs
+
+// The file starts with magic bytes ("pack"), followed by the version number
+// and the header. All offsets are in bytes from the start of the file.
+// The table of contents is sorted by path hash (HashString with the default
+// seed), so it can be binary searched. Entries with the same hash are
+// disambiguated by comparing the paths. Paths are relative to the Assets
+// folder, use '/' as the separator and are not null terminated.
+#define PackBlobAlignment 64
+
+struct PackHeader_v0
+{
+    u32 numEntries;
+    u64 tocOffset;      // Points to an array of PackEntry_v0
+    u64 pathsOffset;    // Points to the concatenated paths
+};
+
+struct PackEntry_v0
+{
+    u64 pathHash;
+    u64 offset;         // Aligned to PackBlobAlignment
+    u64 size;
+    u32 pathOffset;     // From pathsOffset
+    u32 pathLen;
+};
+
+typedef PackHeader_v0 PackHeader;
+typedef PackEntry_v0 PackEntry;
@@ -15,4 +15,16 @@ cl /nologo /std:c++20 /FC ..\..\Source\utils\bin2h.cpp /Od %include_dirs% /link
 del bin2h.obj
 cl /nologo /Od /Zi /std:c++20 /FC ..\..\Source\utils\mesh_importer.cpp %include_dirs% /link %lib_dirs% assimp-vc143-mt.lib /out:mesh_importer.exe
 del mesh_importer.obj
-cl /nologo /Od /Zi /std:c++20 /FC /EHsc ..\..\Source\utils\shader_importer.cpp %include_dirs% /MD /link %lib_dirs% dxcompiler.lib spirv-cross-core.lib spirv-cross-glsl.lib d3d11.lib d3dcompiler.lib /out:shader_importer.exe
\ No newline at end of file
+cl /nologo /Od /Zi /std:c++20 /FC /EHsc ..\..\Source\utils\shader_importer.cpp %include_dirs% /MD /link %lib_dirs% dxcompiler.lib spirv-cross-core.lib spirv-cross-glsl.lib d3d11.lib d3dcompiler.lib /out:shader_importer.exe
+cl /nologo /Od /Zi /std:c++20 /FC /EHsc ..\..\Source\utils\pack_builder.cpp %include_dirs% /link /out:pack_builder.exe
+del pack_builder.obj
+cl /nologo /O2 /Zi /std:c++20 /FC /EHsc /arch:AVX2 ..\..\Source\utils\sim_benchmark.cpp %include_dirs% /link User32.lib Imm32.lib /out:sim_benchmark.exe
+del sim_benchmark.obj
+cl /nologo /O2 /Zi /std:c++20 /FC /EHsc /arch:AVX2 ..\..\Source\utils\render_benchmark.cpp %include_dirs% /link User32.lib Imm32.lib /out:render_benchmark.exe
+del render_benchmark.obj
+cl /nologo /O2 /Zi /std:c++20 /FC /EHsc /arch:AVX2 ..\..\Source\utils\ray_benchmark.cpp %include_dirs% /link /out:ray_benchmark.exe
+del ray_benchmark.obj
+cl /nologo /O2 /Zi /std:c++20 /FC /EHsc /arch:AVX2 ..\..\Source\utils\hashmap_benchmark.cpp %include_dirs% /link /out:hashmap_benchmark.exe
+del hashmap_benchmark.obj
+cl /nologo /O2 /Zi /std:c++20 /FC /EHsc /arch:AVX2 ..\..\Source\utils\math_benchmark.cpp %include_dirs% /link /out:math_benchmark.exe
+del math_benchmark.obj
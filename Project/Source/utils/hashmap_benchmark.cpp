@@ -0,0 +1,335 @@
+// Benchmark of HashMap, against the linear scan version it replaced
+// (kept here as a reference), at a few table sizes: lookups of keys
+// which are present and of keys which aren't, and inserting then removing
+// a key, which keeps the size constant. Lookups are checked against the
+// reference version.
+// On Linux, from this folder:
+// g++ -std=c++20 -O2 -mavx2 -mfma -I.. hashmap_benchmark.cpp -o hashmap_benchmark
+
+#include "base.cpp"
+
+#include <chrono>
+
+// NOTE: In this program we don't care about memory leaks
+// because it's a simple shortlived command line program.
+
+struct BenchConfig
+{
+    int ops           = 1000;   // Operations in each timed batch
+    double minTimeMs  = 20.0;   // Batches are repeated until at least this much time has passed
+    s64 maxRefBuild   = 100000;  // The reference is O(n^2) to build, bigger tables are filled directly
+    u32 seed          = 1;
+};
+
+// The HashMap from before the open addressing table
+template<typename k, typename v>
+struct HashMapReference
+{
+    Array<k> keys;
+    Array<v> values;
+};
+
+// Key type used by the editor widget table
+typedef u32 BenchKey;
+
+struct OpResult
+{
+    double nsPerOp;
+    s64 mismatches;  // Compared to the reference version, for lookups
+};
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args);
+template<typename k, typename v>
+v* Append(HashMapReference<k, v>* map, k key, const v& value);
+template<typename k, typename v>
+LookupResult<v> Lookup(HashMapReference<k, v>* map, k key);
+template<typename k, typename v>
+void Remove(HashMapReference<k, v>* map, k key);
+BenchKey MakeKey(s64 i);
+u32 NextRandom(u32* state);
+void PrintResult(const char* name, OpResult result, bool last);
+
+// Usage:
+// hashmap_benchmark [--ops=N] [--min-time=ms] [--max-ref-build=N] [--seed=N]
+// Results are printed to stdout as JSON.
+int main(int argCount, char** args)
+{
+    InitScratchArenas();
+    
+    BenchConfig config = {};
+    if(!ParseArgs(&config, argCount, args))
+        return 1;
+    
+    const s64 sizes[] = {10, 1000, 1000000};
+    const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+    
+    ScratchArena scratch;
+    u32 rng = config.seed? config.seed : 1;
+    
+    // Indices of the keys used by each batch, present keys are
+    // in [0, size), absent ones in [size, 2*size)
+    s64* indices = ArenaAllocArray(s64, config.ops, scratch);
+    
+    printf("{\n");
+    printf("  \"config\": {\"ops\": %d, \"minTimeMs\": %g, \"maxRefBuild\": %lld, \"seed\": %u},\n",
+           config.ops, config.minTimeMs, (long long)config.maxRefBuild, config.seed);
+    printf("  \"sizes\": [\n");
+    for(int s = 0; s < numSizes; ++s)
+    {
+        s64 size = sizes[s];
+        
+        using Clock = std::chrono::steady_clock;
+        auto elapsedNs = [](Clock::time_point start)
+        {
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        };
+        
+        // Repeats a batch of config.ops operations
+        auto run = [&](const auto& batch)
+        {
+            s64 numOps = 0;
+            auto start = Clock::now();
+            do
+            {
+                batch();
+                numOps += config.ops;
+            }
+            while(elapsedNs(start) < config.minTimeMs * 1000000.0);
+            
+            return elapsedNs(start) / numOps;
+        };
+        
+        HashMap<BenchKey, u64> map = {};
+        auto buildStart = Clock::now();
+        for(s64 i = 0; i < size; ++i)
+            Append(&map, MakeKey(i), (u64)i);
+        double buildNs = elapsedNs(buildStart) / size;
+        
+        HashMapReference<BenchKey, u64> ref = {};
+        double refBuildNs = -1.0;
+        if(size <= config.maxRefBuild)
+        {
+            auto refBuildStart = Clock::now();
+            for(s64 i = 0; i < size; ++i)
+                Append(&ref, MakeKey(i), (u64)i);
+            refBuildNs = elapsedNs(refBuildStart) / size;
+        }
+        else
+        {
+            // Keys are unique, so this is what Append would end up with
+            for(s64 i = 0; i < size; ++i)
+            {
+                Append(&ref.keys, MakeKey(i));
+                Append(&ref.values, (u64)i);
+            }
+        }
+        
+        // Lookups of present keys
+        for(int i = 0; i < config.ops; ++i)
+            indices[i] = NextRandom(&rng) % size;
+        
+        OpResult hit = {}, refHit = {};
+        u64 sum = 0;  // Keeps the lookups from being optimized away
+        hit.nsPerOp = run([&]
+        {
+            for(int i = 0; i < config.ops; ++i)
+                sum += *Lookup(&map, MakeKey(indices[i])).res;
+        });
+        refHit.nsPerOp = run([&]
+        {
+            for(int i = 0; i < config.ops; ++i)
+                sum += *Lookup(&ref, MakeKey(indices[i])).res;
+        });
+        
+        for(int i = 0; i < config.ops; ++i)
+        {
+            auto found = Lookup(&map, MakeKey(indices[i]));
+            auto refFound = Lookup(&ref, MakeKey(indices[i]));
+            hit.mismatches += !found.found || !refFound.found || *found.res != *refFound.res;
+        }
+        
+        // Lookups of absent keys
+        for(int i = 0; i < config.ops; ++i)
+            indices[i] = size + NextRandom(&rng) % size;
+        
+        OpResult miss = {}, refMiss = {};
+        miss.nsPerOp = run([&]
+        {
+            for(int i = 0; i < config.ops; ++i)
+                sum += Lookup(&map, MakeKey(indices[i])).found;
+        });
+        refMiss.nsPerOp = run([&]
+        {
+            for(int i = 0; i < config.ops; ++i)
+                sum += Lookup(&ref, MakeKey(indices[i])).found;
+        });
+        
+        for(int i = 0; i < config.ops; ++i)
+        {
+            auto found = Lookup(&map, MakeKey(indices[i]));
+            auto refFound = Lookup(&ref, MakeKey(indices[i]));
+            miss.mismatches += found.found || refFound.found;
+        }
+        
+        // Insert and remove of absent keys, each pair counts as one operation
+        OpResult churn = {}, refChurn = {};
+        churn.nsPerOp = run([&]
+        {
+            for(int i = 0; i < config.ops; ++i)
+            {
+                Append(&map, MakeKey(indices[i]), (u64)i);
+                Remove(&map, MakeKey(indices[i]));
+            }
+        });
+        refChurn.nsPerOp = run([&]
+        {
+            for(int i = 0; i < config.ops; ++i)
+            {
+                Append(&ref, MakeKey(indices[i]), (u64)i);
+                Remove(&ref, MakeKey(indices[i]));
+            }
+        });
+        
+        churn.mismatches = map.count != size;
+        refChurn.mismatches = ref.keys.len != size;
+        
+        printf("    {\"size\": %lld, \"checksum\": %llu,\n", (long long)size, (unsigned long long)sum);
+        printf("     \"build\": {\"nsPerOp\": %.2f, \"reference\": ", buildNs);
+        if(refBuildNs >= 0.0) printf("%.2f},\n", refBuildNs);
+        else                  printf("null},\n");
+        PrintResult("lookupHit", hit, false);
+        PrintResult("lookupHitReference", refHit, false);
+        PrintResult("lookupMiss", miss, false);
+        PrintResult("lookupMissReference", refMiss, false);
+        PrintResult("insertRemove", churn, false);
+        PrintResult("insertRemoveReference", refChurn, true);
+        printf("    }%s\n", s == numSizes - 1? "" : ",");
+        
+        Free(&map);
+        Free(&ref.keys);
+        Free(&ref.values);
+    }
+    
+    printf("  ]\n");
+    printf("}\n");
+    return 0;
+}
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args)
+{
+    for(int i = 1; i < argCount; ++i)
+    {
+        const char* arg = args[i];
+        const char* value = strchr(arg, '=');
+        value = value? value + 1 : "";
+        
+        if     (strncmp(arg, "--ops=", 6) == 0)            config->ops         = atoi(value);
+        else if(strncmp(arg, "--min-time=", 11) == 0)      config->minTimeMs   = atof(value);
+        else if(strncmp(arg, "--max-ref-build=", 16) == 0) config->maxRefBuild = atoll(value);
+        else if(strncmp(arg, "--seed=", 7) == 0)           config->seed        = (u32)strtoul(value, nullptr, 10);
+        else
+        {
+            fprintf(stderr, "Unknown argument '%s'\n", arg);
+            return false;
+        }
+    }
+    
+    if(config->ops <= 0 || config->minTimeMs < 0.0 || config->maxRefBuild < 0)
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// Copy of the previous HashMap functions
+template<typename k, typename v>
+v* Append(HashMapReference<k, v>* map, k key, const v& value)
+{
+    int found = -1;
+    for(int i = 0; i < map->keys.len; ++i)
+    {
+        if(memcmp(&key, &map->keys[i], sizeof(k)) == 0)
+        {
+            found = i;
+            break;
+        }
+    }
+    
+    if(found == -1)  // Not found
+    {
+        Append(&map->keys, key);
+        Append(&map->values, value);
+        return &map->values[map->values.len - 1];
+    }
+    else
+    {
+        map->values[found] = value;
+        return &map->values[found];
+    }
+}
+
+template<typename k, typename v>
+LookupResult<v> Lookup(HashMapReference<k, v>* map, k key)
+{
+    int found = -1;
+    for(int i = 0; i < map->keys.len; ++i)
+    {
+        if(memcmp(&key, &map->keys[i], sizeof(k)) == 0)
+        {
+            found = i;
+            break;
+        }
+    }
+    
+    if(found == -1) return {{}, false};
+    return {&map->values[found], true};
+}
+
+template<typename k, typename v>
+void Remove(HashMapReference<k, v>* map, k key)
+{
+    int found = -1;
+    for(int i = 0; i < map->keys.len; ++i)
+    {
+        if(memcmp(&key, &map->keys[i], sizeof(k)) == 0)
+        {
+            found = i;
+            break;
+        }
+    }
+    
+    if(found != -1)  // Found something
+    {
+        auto lastIdx = map->keys.len - 1;
+        map->keys[found] = map->keys[lastIdx];
+        map->values[found] = map->values[lastIdx];
+        Pop(&map->keys);
+        Pop(&map->values);
+    }
+}
+
+// Distinct for every i in [0, 2^32), since the multiplier is odd,
+// and scattered like the ImGui ids the editor uses
+BenchKey MakeKey(s64 i)
+{
+    return (BenchKey)((u32)i * 2654435761u);
+}
+
+u32 NextRandom(u32* state)
+{
+    // Xorshift32
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+void PrintResult(const char* name, OpResult result, bool last)
+{
+    printf("     \"%s\": {\"nsPerOp\": %.2f, \"mismatches\": %lld}%s\n",
+           name, result.nsPerOp, (long long)result.mismatches, last? "" : ",");
+}
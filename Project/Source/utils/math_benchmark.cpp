@@ -0,0 +1,392 @@
+// Checks the SIMD math functions in base.cpp against the scalar code
+// they replaced (kept here as a reference) over random inputs, and times
+// both. Differences are reported as the max distance in ULPs over all
+// output floats; +0 and -0 count as equal.
+// Mat4FromPosRotScale and RotationMatrix only have an SSE version: they
+// take a single value, which only fills half of an AVX2 register. Their 8
+// wide version is Mat4FromTransforms on structure of arrays input. Quat*Vec3
+// is scalar again, its SSE version was slower; it's still timed here.
+// On Linux, from this folder:
+// g++ -std=c++20 -O2 -mavx2 -ffp-contract=off -I.. math_benchmark.cpp -o math_benchmark
+// With -msse4.1 instead of -mavx2 the SSE versions are checked. Without
+// -ffp-contract=off, and with -mfma, GCC contracts multiplies and adds into
+// FMAs differently in the SIMD and scalar code. MSVC doesn't by default.
+
+#include "base.cpp"
+
+#include <chrono>
+
+// NOTE: In this program we don't care about memory leaks
+// because it's a simple shortlived command line program.
+
+struct BenchConfig
+{
+    int count   = 4096;  // Inputs per function
+    int repeats = 100;
+    u32 seed    = 1;
+};
+
+struct CheckResult
+{
+    double nsPerCall;
+    double refNsPerCall;
+    s64 maxUlps;
+    s64 mismatches;  // Output floats which are not the same as the reference
+};
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args);
+Mat4 Mat4MultiplyReference(const Mat4& m1, const Mat4& m2);
+Vec3 QuatVec3Reference(Quat q, Vec3 v);
+Mat4 RotationMatrixReference(Quat q);
+Mat4 Mat4FromPosRotScaleReference(Vec3 pos, Quat rot, Vec3 scale);
+s64 UlpDistance(float a, float b);
+void CompareFloats(CheckResult* res, const float* a, const float* b, s64 count);
+u32 NextRandom(u32* state);
+float RandomFloat(u32* state);
+float RandomRange(u32* state, float min, float max);
+void PrintResult(const char* name, CheckResult result, bool last);
+
+// Usage:
+// math_benchmark [--count=N] [--repeats=N] [--seed=N]
+// Results are printed to stdout as JSON. Exits with 2 if
+// any function doesn't match its reference exactly.
+int main(int argCount, char** args)
+{
+    InitScratchArenas();
+    
+    BenchConfig config = {};
+    if(!ParseArgs(&config, argCount, args))
+        return 1;
+    
+    ScratchArena scratch;
+    u32 rng = config.seed? config.seed : 1;
+    int n = config.count;
+    
+    // Inputs. Quaternions are not normalized, which
+    // RotationMatrix and Quat*Vec3 don't require either
+    Mat4* matsA = ArenaAllocArray(Mat4, n, scratch);
+    Mat4* matsB = ArenaAllocArray(Mat4, n, scratch);
+    Transform* transforms = ArenaAllocArray(Transform, n, scratch);
+    Vec3* vecs = ArenaAllocArray(Vec3, n, scratch);
+    for(int i = 0; i < n; ++i)
+    {
+        for(int j = 0; j < 4; ++j)
+        {
+            for(int k = 0; k < 4; ++k)
+            {
+                matsA[i].m[j][k] = RandomRange(&rng, -10.0f, 10.0f);
+                matsB[i].m[j][k] = RandomRange(&rng, -10.0f, 10.0f);
+            }
+        }
+        
+        Transform& t = transforms[i];
+        t.position = {RandomRange(&rng, -100.0f, 100.0f), RandomRange(&rng, -100.0f, 100.0f), RandomRange(&rng, -100.0f, 100.0f)};
+        t.rotation = {.w=RandomRange(&rng, -1.0f, 1.0f), .x=RandomRange(&rng, -1.0f, 1.0f), .y=RandomRange(&rng, -1.0f, 1.0f), .z=RandomRange(&rng, -1.0f, 1.0f)};
+        t.scale = {RandomRange(&rng, 0.1f, 10.0f), RandomRange(&rng, 0.1f, 10.0f), RandomRange(&rng, 0.1f, 10.0f)};
+        vecs[i] = {RandomRange(&rng, -100.0f, 100.0f), RandomRange(&rng, -100.0f, 100.0f), RandomRange(&rng, -100.0f, 100.0f)};
+    }
+    
+    // Same transforms, in structure of arrays layout
+    float* lanes[10];
+    for(int i = 0; i < 10; ++i)
+        lanes[i] = ArenaAllocArray(float, n, scratch);
+    
+    for(int i = 0; i < n; ++i)
+    {
+        Transform& t = transforms[i];
+        float values[10] = {t.position.x, t.position.y, t.position.z, t.rotation.w, t.rotation.x,
+                            t.rotation.y, t.rotation.z, t.scale.x, t.scale.y, t.scale.z};
+        for(int j = 0; j < 10; ++j)
+            lanes[j][i] = values[j];
+    }
+    
+    TransformLanes transformLanes =
+    {
+        .posX=lanes[0], .posY=lanes[1], .posZ=lanes[2],
+        .rotW=lanes[3], .rotX=lanes[4], .rotY=lanes[5], .rotZ=lanes[6],
+        .scaleX=lanes[7], .scaleY=lanes[8], .scaleZ=lanes[9]
+    };
+    
+    Mat4* out    = ArenaAllocArray(Mat4, n, scratch);
+    Mat4* refOut = ArenaAllocArray(Mat4, n, scratch);
+    Vec3* vecOut    = ArenaAllocArray(Vec3, n, scratch);
+    Vec3* refVecOut = ArenaAllocArray(Vec3, n, scratch);
+    
+    // Times a function which computes all n outputs. The first call
+    // isn't timed, it commits the output memory and warms up the caches
+    using Clock = std::chrono::steady_clock;
+    auto time = [&](const auto& func)
+    {
+        func();
+        auto start = Clock::now();
+        for(int r = 0; r < config.repeats; ++r)
+            func();
+        
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ((double)config.repeats * n);
+    };
+    
+    auto checkMat4 = [&](const auto& func, const auto& ref)
+    {
+        CheckResult res = {};
+        res.nsPerCall = time(func);
+        res.refNsPerCall = time(ref);
+        CompareFloats(&res, &out[0].m[0][0], &refOut[0].m[0][0], (s64)n * 16);
+        return res;
+    };
+    
+    CheckResult mul = checkMat4([&]
+    {
+        for(int i = 0; i < n; ++i)
+            out[i] = matsA[i] * matsB[i];
+    }, [&]
+    {
+        for(int i = 0; i < n; ++i)
+            refOut[i] = Mat4MultiplyReference(matsA[i], matsB[i]);
+    });
+    
+    CheckResult mulAssign = checkMat4([&]
+    {
+        for(int i = 0; i < n; ++i)
+        {
+            out[i] = matsA[i];
+            out[i] *= matsB[i];
+        }
+    }, [&]
+    {
+        for(int i = 0; i < n; ++i)
+            refOut[i] = Mat4MultiplyReference(matsA[i], matsB[i]);
+    });
+    
+    CheckResult mulBatch = checkMat4([&]
+    {
+        Mat4Multiply({.ptr=out, .len=n}, {.ptr=matsA, .len=n}, {.ptr=matsB, .len=n});
+    }, [&]
+    {
+        for(int i = 0; i < n; ++i)
+            refOut[i] = Mat4MultiplyReference(matsA[i], matsB[i]);
+    });
+    
+    CheckResult rotMat = checkMat4([&]
+    {
+        for(int i = 0; i < n; ++i)
+            out[i] = RotationMatrix(transforms[i].rotation);
+    }, [&]
+    {
+        for(int i = 0; i < n; ++i)
+            refOut[i] = RotationMatrixReference(transforms[i].rotation);
+    });
+    
+    auto refFromTransforms = [&]
+    {
+        for(int i = 0; i < n; ++i)
+        {
+            Transform& t = transforms[i];
+            refOut[i] = Mat4FromPosRotScaleReference(t.position, t.rotation, t.scale);
+        }
+    };
+    
+    CheckResult fromPosRotScale = checkMat4([&]
+    {
+        for(int i = 0; i < n; ++i)
+        {
+            Transform& t = transforms[i];
+            out[i] = Mat4FromPosRotScale(t.position, t.rotation, t.scale);
+        }
+    }, refFromTransforms);
+    
+    CheckResult fromTransforms = checkMat4([&]
+    {
+        Mat4FromTransforms({.ptr=out, .len=n}, {.ptr=transforms, .len=n});
+    }, refFromTransforms);
+    
+    CheckResult fromLanes = checkMat4([&]
+    {
+        Mat4FromTransforms({.ptr=out, .len=n}, transformLanes);
+    }, refFromTransforms);
+    
+    CheckResult rotVec = {};
+    rotVec.nsPerCall = time([&]
+    {
+        for(int i = 0; i < n; ++i)
+            vecOut[i] = transforms[i].rotation * vecs[i];
+    });
+    rotVec.refNsPerCall = time([&]
+    {
+        for(int i = 0; i < n; ++i)
+            refVecOut[i] = QuatVec3Reference(transforms[i].rotation, vecs[i]);
+    });
+    CompareFloats(&rotVec, &vecOut[0].x, &refVecOut[0].x, (s64)n * 3);
+    
+    printf("{\n");
+    printf("  \"config\": {\"count\": %d, \"repeats\": %d, \"seed\": %u, \"avx2\": %s},\n",
+           config.count, config.repeats, config.seed,
+#ifdef __AVX2__
+           "true");
+#else
+           "false");
+#endif
+    printf("  \"functions\": {\n");
+    PrintResult("Mat4*Mat4", mul, false);
+    PrintResult("Mat4*=Mat4", mulAssign, false);
+    PrintResult("Mat4Multiply", mulBatch, false);
+    PrintResult("RotationMatrix", rotMat, false);
+    PrintResult("Mat4FromPosRotScale", fromPosRotScale, false);
+    PrintResult("Mat4FromTransforms", fromTransforms, false);
+    PrintResult("Mat4FromTransformLanes", fromLanes, false);
+    PrintResult("Quat*Vec3", rotVec, true);
+    printf("  }\n");
+    printf("}\n");
+    
+    CheckResult all[] = {mul, mulAssign, mulBatch, rotMat, fromPosRotScale, fromTransforms, fromLanes, rotVec};
+    for(CheckResult& res : all)
+    {
+        if(res.mismatches > 0)
+            return 2;
+    }
+    
+    return 0;
+}
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args)
+{
+    for(int i = 1; i < argCount; ++i)
+    {
+        const char* arg = args[i];
+        const char* value = strchr(arg, '=');
+        value = value? value + 1 : "";
+        
+        if     (strncmp(arg, "--count=", 8) == 0)   config->count   = atoi(value);
+        else if(strncmp(arg, "--repeats=", 10) == 0) config->repeats = atoi(value);
+        else if(strncmp(arg, "--seed=", 7) == 0)    config->seed    = (u32)strtoul(value, nullptr, 10);
+        else
+        {
+            fprintf(stderr, "Unknown argument '%s'\n", arg);
+            return false;
+        }
+    }
+    
+    if(config->count <= 0 || config->repeats <= 0)
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// The scalar versions, from before the SIMD ones were added
+Mat4 Mat4MultiplyReference(const Mat4& m1, const Mat4& m2)
+{
+    Mat4 res;
+    for(int i = 0; i < 4; ++i)
+    {
+        for(int j = 0; j < 4; ++j)
+        {
+            res.m[i][j] = 0.0f;
+            
+            for(int k = 0; k < 4; ++k)
+                res.m[i][j] += m1.m[i][k] * m2.m[k][j];
+        }
+    }
+    
+    return res;
+}
+
+Vec3 QuatVec3Reference(Quat q, Vec3 v)
+{
+    float num   = q.x * 2.0f;
+    float num2  = q.y * 2.0f;
+    float num3  = q.z * 2.0f;
+    float num4  = q.x * num;
+    float num5  = q.y * num2;
+    float num6  = q.z * num3;
+    float num7  = q.x * num2;
+    float num8  = q.x * num3;
+    float num9  = q.y * num3;
+    float num10 = q.w * num;
+    float num11 = q.w * num2;
+    float num12 = q.w * num3;
+    Vec3 result;
+    result.x = (1.0f - (num5 + num6)) * v.x + (num7 - num12) * v.y + (num8 + num11) * v.z;
+    result.y = (num7 + num12) * v.x + (1.0f - (num4 + num6)) * v.y + (num9 - num10) * v.z;
+    result.z = (num8 - num11) * v.x + (num9 + num10) * v.y + (1.0f - (num4 + num5)) * v.z;
+    return result;
+}
+
+Mat4 RotationMatrixReference(Quat q)
+{
+    float x = q.x * 2.0f; float y = q.y * 2.0f; float z = q.z * 2.0f;
+    float xx = q.x * x;   float yy = q.y * y;   float zz = q.z * z;
+    float xy = q.x * y;   float xz = q.x * z;   float yz = q.y * z;
+    float wx = q.w * x;   float wy = q.w * y;   float wz = q.w * z;
+    
+    // Calculate 3x3 matrix from orthonormal basis
+    Mat4 res
+    {
+        1.0f - (yy + zz), xy - wz,          xz + wy,          0.0f,
+        xy + wz,          1.0f - (xx + zz), yz - wx,          0.0f,
+        xz - wy,          yz + wx,          1.0f - (xx + yy), 0.0f,
+        0.0f,             0.0f,             0.0f,             1.0f
+    };
+    return res;
+}
+
+Mat4 Mat4FromPosRotScaleReference(Vec3 pos, Quat rot, Vec3 scale)
+{
+    Mat4 res = Mat4MultiplyReference(TranslationMatrix(pos), RotationMatrixReference(normalize(rot)));
+    return Mat4MultiplyReference(res, ScaleMatrix(scale));
+}
+
+// Floats are mapped to integers in the same order, where
+// consecutive values are 1 apart. Both zeros map to 0
+s64 UlpDistance(float a, float b)
+{
+    if(a != a && b != b) return 0;  // Both NaN
+    
+    auto toOrdered = [](float f)
+    {
+        s32 bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits < 0? -(s64)(bits & 0x7FFFFFFF) : (s64)bits;
+    };
+    
+    s64 dist = toOrdered(a) - toOrdered(b);
+    return dist < 0? -dist : dist;
+}
+
+void CompareFloats(CheckResult* res, const float* a, const float* b, s64 count)
+{
+    for(s64 i = 0; i < count; ++i)
+    {
+        s64 ulps = UlpDistance(a[i], b[i]);
+        res->maxUlps = max(res->maxUlps, ulps);
+        res->mismatches += ulps != 0;
+    }
+}
+
+u32 NextRandom(u32* state)
+{
+    // Xorshift32
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+float RandomFloat(u32* state)
+{
+    return (NextRandom(state) >> 8) / (float)(1 << 24);
+}
+
+float RandomRange(u32* state, float min, float max)
+{
+    return min + RandomFloat(state) * (max - min);
+}
+
+void PrintResult(const char* name, CheckResult result, bool last)
+{
+    printf("    \"%s\": {\"nsPerCall\": %.2f, \"referenceNsPerCall\": %.2f, \"maxUlps\": %lld, \"mismatches\": %lld}%s\n",
+           name, result.nsPerCall, result.refNsPerCall, (long long)result.maxUlps, (long long)result.mismatches, last? "" : ",");
+}
@@ -50,7 +50,7 @@ int main(int argCount, char** args)
         return 1;
     }
     
-    printf("Running version %d of the model importer.\n", 0);
+    printf("Running version %d of the model importer.\n", 1);
     fflush(stdout);
     
     const char* modelPath = args[1];
@@ -110,19 +110,48 @@ int main(int argCount, char** args)
         UseArena(&binary, &arena);
         
         // NOTE: Change whenever version changes
-        const int version = 0;
+        const int version = 1;
         
         Append(&binary, "mesh");
         Put(&binary, (u32)version);
         
-        MeshHeader_v0 header = {};
+        MeshHeader_v1 header = {};
         header.isSkinned = false;
         header.numVerts = mesh->mNumVertices;
         header.numIndices = mesh->mNumFaces * 3;
         header.hasTextureCoords = true;
-        header.vertsOffset = sizeof(MeshHeader_v0);
+        header.vertsOffset = sizeof(MeshHeader_v1);
         header.indicesOffset = header.vertsOffset + sizeof(Vertex) * mesh->mNumVertices;
         
+        // Bounds, used for culling. The sphere is centered on the box
+        Vec3 aabbMin = {0};
+        Vec3 aabbMax = {0};
+        for(int j = 0; j < mesh->mNumVertices; ++j)
+        {
+            Vec3 pos = {mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z};
+            if(j == 0)
+            {
+                aabbMin = pos;
+                aabbMax = pos;
+            }
+            
+            aabbMin.x = min(aabbMin.x, pos.x); aabbMin.y = min(aabbMin.y, pos.y); aabbMin.z = min(aabbMin.z, pos.z);
+            aabbMax.x = max(aabbMax.x, pos.x); aabbMax.y = max(aabbMax.y, pos.y); aabbMax.z = max(aabbMax.z, pos.z);
+        }
+        
+        Vec3 center = (aabbMin + aabbMax) * 0.5f;
+        float radiusSqr = 0.0f;
+        for(int j = 0; j < mesh->mNumVertices; ++j)
+        {
+            Vec3 diff = Vec3{mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z} - center;
+            radiusSqr = max(radiusSqr, dot(diff, diff));
+        }
+        
+        header.aabbMin = aabbMin;
+        header.aabbMax = aabbMax;
+        header.sphereCenter = center;
+        header.sphereRadius = sqrtf(radiusSqr);
+        
         Put(&binary, header);
         
         for(int j = 0; j < mesh->mNumVertices; ++j)
@@ -0,0 +1,204 @@
+
+#include "base.cpp"
+#include "serialization.h"
+
+#include <filesystem>
+#include <algorithm>
+
+// NOTE: In this program we don't care about memory leaks
+// because it's a simple shortlived command line program.
+
+// Only these are loaded by the asset system, everything
+// else (sources for the importers, fonts, etc.) is left out
+const char* packedExtensions[] =
+{
+    "mesh", "shader", "mat", "png", "jpg", "jpeg", "tga", "bmp", "hdr"
+};
+
+struct PackFile
+{
+    String path;  // Relative to the Assets folder, with '/' separators
+    u64 hash;
+    u64 size;
+    u64 offset;
+};
+
+bool ShouldPack(String path);
+
+// Usage:
+// pack_builder.exe output.pack
+// Packs every asset in the Assets folder (and subfolders).
+// The output path is relative to the Assets folder
+int main(int argCount, char** args)
+{
+    InitScratchArenas();
+    
+    ScratchArena scratch;
+    
+    char* exePathCStr = GetExecutablePath();
+    defer { free(exePathCStr); };
+    String exePath = {.ptr = exePathCStr, .len = (s64)strlen(exePathCStr)};
+    exePath = PopLastDirFromPath(exePath);
+    
+    // Force current working directory to be the Assets folder.
+    // Currently in Project/Build/utils
+    {
+        StringBuilder builder = {};
+        UseArena(&builder, scratch);
+        Append(&builder, exePath);
+        Append(&builder, "/../../../Assets/");
+        NullTerminate(&builder);
+        B_SetCurrentDirectory(ToString(&builder).ptr);
+    }
+    
+    if(argCount < 2)
+    {
+        fprintf(stderr, "Insufficient arguments\n");
+        return 1;
+    }
+    
+    if(argCount > 2)
+    {
+        fprintf(stderr, "Too many arguments\n");
+        return 1;
+    }
+    
+    printf("Running version %d of the pack builder.\n", 0);
+    fflush(stdout);
+    
+    const char* outPath = args[1];
+    
+    // Gather files
+    Array<PackFile> files = {};
+    std::error_code err;
+    for(auto& entry : std::filesystem::recursive_directory_iterator(".", err))
+    {
+        if(!entry.is_regular_file()) continue;
+        
+        std::string relPath = entry.path().lexically_relative(".").generic_string();
+        String path = {.ptr = ToCString({relPath.c_str(), (s64)relPath.size()}), .len = (s64)relPath.size()};
+        if(!ShouldPack(path)) continue;
+        
+        PackFile file = {};
+        file.path = path;
+        file.hash = HashString(path);
+        file.size = (u64)entry.file_size();
+        Append(&files, file);
+    }
+    
+    if(err)
+    {
+        fprintf(stderr, "Error while walking the Assets folder: %s\n", err.message().c_str());
+        return 1;
+    }
+    
+    std::sort(files.ptr, files.ptr + files.len, [](const PackFile& a, const PackFile& b)
+    {
+        if(a.hash != b.hash) return a.hash < b.hash;
+        return strcmp(a.path.ptr, b.path.ptr) < 0;
+    });
+    
+    // Compute the layout
+    const u32 version = 0;
+    u64 headerOffset = AlignForward(sizeof("pack")-1 + sizeof(u32), alignof(PackHeader_v0));
+    
+    PackHeader_v0 header = {};
+    header.numEntries  = (u32)files.len;
+    header.tocOffset   = AlignForward(headerOffset + sizeof(PackHeader_v0), alignof(PackEntry_v0));
+    header.pathsOffset = header.tocOffset + sizeof(PackEntry_v0) * files.len;
+    
+    u64 pathsSize = 0;
+    for(int i = 0; i < files.len; ++i)
+        pathsSize += files[i].path.len;
+    
+    u64 cursor = header.pathsOffset + pathsSize;
+    for(int i = 0; i < files.len; ++i)
+    {
+        cursor = AlignForward(cursor, PackBlobAlignment);
+        files[i].offset = cursor;
+        cursor += files[i].size;
+    }
+    
+    // Write the file
+    FILE* outFile = fopen(outPath, "w+b");
+    if(!outFile)
+    {
+        fprintf(stderr, "Error writing to file %s.\n", outPath);
+        return 1;
+    }
+    
+    defer { fclose(outFile); };
+    
+    u64 written = 0;
+    auto writeBytes = [&](const void* data, u64 size)
+    {
+        fwrite(data, 1, size, outFile);
+        written += size;
+    };
+    auto padTo = [&](u64 offset)
+    {
+        static const char zeros[PackBlobAlignment] = {};
+        assert(offset >= written && offset - written <= PackBlobAlignment);
+        writeBytes(zeros, offset - written);
+    };
+    
+    writeBytes("pack", sizeof("pack")-1);
+    writeBytes(&version, sizeof(version));
+    padTo(headerOffset);
+    writeBytes(&header, sizeof(header));
+    padTo(header.tocOffset);
+    
+    u32 pathOffset = 0;
+    for(int i = 0; i < files.len; ++i)
+    {
+        PackEntry_v0 entry = {};
+        entry.pathHash   = files[i].hash;
+        entry.offset     = files[i].offset;
+        entry.size       = files[i].size;
+        entry.pathOffset = pathOffset;
+        entry.pathLen    = (u32)files[i].path.len;
+        writeBytes(&entry, sizeof(entry));
+        
+        pathOffset += (u32)files[i].path.len;
+    }
+    
+    for(int i = 0; i < files.len; ++i)
+        writeBytes(files[i].path.ptr, files[i].path.len);
+    
+    for(int i = 0; i < files.len; ++i)
+    {
+        ScratchArena fileScratch;
+        
+        bool ok = true;
+        String contents = LoadEntireFile(files[i].path, fileScratch, &ok);
+        if(!ok || (u64)contents.len != files[i].size)
+        {
+            fprintf(stderr, "Error reading file %s.\n", files[i].path.ptr);
+            return 1;
+        }
+        
+        padTo(files[i].offset);
+        writeBytes(contents.ptr, contents.len);
+    }
+    
+    if(ferror(outFile))
+    {
+        fprintf(stderr, "Error writing to file %s.\n", outPath);
+        return 1;
+    }
+    
+    printf("Successfully packed %lld files (%llu bytes) to '%s'\n", (long long)files.len, (unsigned long long)written, outPath);
+    return 0;
+}
+
+bool ShouldPack(String path)
+{
+    String ext = GetPathExtension(path);
+    for(int i = 0; i < ArrayCount(packedExtensions); ++i)
+    {
+        if(ext == packedExtensions[i])
+            return true;
+    }
+    
+    return false;
+}
@@ -0,0 +1,306 @@
+// Benchmark of the ray/box intersection kernels in collision.cpp: the
+// scalar version, one ray against 4 or 8 boxes and packets of 4 or 8
+// rays against one box. The previous double precision function is kept
+// here as a reference. Results are checked against the scalar version.
+// On Linux, from this folder:
+// g++ -std=c++20 -O2 -mavx2 -mfma -I.. ray_benchmark.cpp -o ray_benchmark
+
+#include "base.cpp"
+#include "os/os_generic.h"
+#include "collision.cpp"
+
+#include <chrono>
+
+// NOTE: In this program we don't care about memory leaks
+// because it's a simple shortlived command line program.
+
+struct BenchConfig
+{
+    int numBoxes  = 4096;  // Rounded up to a multiple of 8
+    int numRays   = 1024;  // Rounded up to a multiple of 8
+    int repeats   = 10;
+    float axisAlignedRatio = 0.1f;  // Rays with zero direction components
+    u32 seed      = 1;
+};
+
+struct KernelResult
+{
+    double nsPerTest;
+    s64 hits;
+    s64 mismatches;  // Compared to the scalar version
+};
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args);
+bool RayAabbIntersectionReference(Ray ray, Aabb aabb);
+u32 NextRandom(u32* state);
+float RandomFloat(u32* state);
+void PrintResult(const char* name, KernelResult result, bool last);
+
+// Usage:
+// ray_benchmark [--boxes=N] [--rays=N] [--repeats=N] [--axis-aligned=ratio] [--seed=N]
+// Results are printed to stdout as JSON.
+int main(int argCount, char** args)
+{
+    InitScratchArenas();
+    
+    BenchConfig config = {};
+    if(!ParseArgs(&config, argCount, args))
+        return 1;
+    
+    config.numBoxes = (int)AlignForward(config.numBoxes, 8);
+    config.numRays  = (int)AlignForward(config.numRays, 8);
+    s64 numTests = (s64)config.numBoxes * config.numRays * config.repeats;
+    
+    ScratchArena scratch;
+    u32 rng = config.seed? config.seed : 1;
+    
+    // Boxes scattered in a 100x100x100 cube
+    Aabb* boxes = ArenaAllocArray(Aabb, config.numBoxes, scratch);
+    for(int i = 0; i < config.numBoxes; ++i)
+    {
+        Vec3 center = {RandomFloat(&rng) * 100.0f, RandomFloat(&rng) * 100.0f, RandomFloat(&rng) * 100.0f};
+        Vec3 extents = {RandomFloat(&rng) * 5.0f, RandomFloat(&rng) * 5.0f, RandomFloat(&rng) * 5.0f};
+        boxes[i] = {.min=center - extents, .max=center + extents};
+    }
+    
+    // Some of the rays are axis aligned and start on the plane of a face,
+    // which is the case the reference version can get wrong
+    Ray* rays = ArenaAllocArray(Ray, config.numRays, scratch);
+    for(int i = 0; i < config.numRays; ++i)
+    {
+        Ray& ray = rays[i];
+        ray.ori = {RandomFloat(&rng) * 100.0f, RandomFloat(&rng) * 100.0f, RandomFloat(&rng) * 100.0f};
+        if(RandomFloat(&rng) < config.axisAlignedRatio)
+        {
+            int axis = NextRandom(&rng) % 3;
+            float sign = RandomFloat(&rng) < 0.5f? -1.0f : 1.0f;
+            ray.dir = {0.0f, 0.0f, 0.0f};
+            Aabb onBox = boxes[NextRandom(&rng) % config.numBoxes];
+            if(axis == 0) { ray.dir.x = sign; ray.ori.y = onBox.min.y; }
+            if(axis == 1) { ray.dir.y = sign; ray.ori.z = onBox.max.z; }
+            if(axis == 2) { ray.dir.z = sign; ray.ori.x = onBox.min.x; }
+        }
+        else
+        {
+            Vec3 dir = {RandomFloat(&rng) * 2.0f - 1.0f, RandomFloat(&rng) * 2.0f - 1.0f, RandomFloat(&rng) * 2.0f - 1.0f};
+            ray.dir = normalize(dir);
+        }
+    }
+    
+    // SIMD layouts
+    RayInv* rayInvs = ArenaAllocArray(RayInv, config.numRays, scratch);
+    for(int i = 0; i < config.numRays; ++i)
+        rayInvs[i] = MakeRayInv(rays[i]);
+    
+    Aabb4* boxes4 = ArenaAllocArray(Aabb4, config.numBoxes / 4, scratch);
+    for(int i = 0; i < config.numBoxes / 4; ++i)
+        boxes4[i] = MakeAabb4({.ptr=boxes + i*4, .len=4});
+    
+    RayPacket4* packets4 = ArenaAllocArray(RayPacket4, config.numRays / 4, scratch);
+    for(int i = 0; i < config.numRays / 4; ++i)
+        packets4[i] = MakeRayPacket4({.ptr=rays + i*4, .len=4});
+    
+#ifdef __AVX2__
+    Aabb8* boxes8 = ArenaAllocArray(Aabb8, config.numBoxes / 8, scratch);
+    for(int i = 0; i < config.numBoxes / 8; ++i)
+        boxes8[i] = MakeAabb8({.ptr=boxes + i*8, .len=8});
+    
+    RayPacket8* packets8 = ArenaAllocArray(RayPacket8, config.numRays / 8, scratch);
+    for(int i = 0; i < config.numRays / 8; ++i)
+        packets8[i] = MakeRayPacket8({.ptr=rays + i*8, .len=8});
+#endif
+    
+    // Results of the scalar version, indexed by ray * numBoxes + box
+    float* expected = ArenaAllocArray(float, (s64)config.numRays * config.numBoxes, scratch);
+    for(int i = 0; i < config.numRays; ++i)
+    {
+        for(int j = 0; j < config.numBoxes; ++j)
+            expected[(s64)i * config.numBoxes + j] = RayAabbDst(rayInvs[i], boxes[j]);
+    }
+    
+    // Each kernel computes the distances from a group of rays to all
+    // boxes. While timing, the same rows are overwritten for every group,
+    // so that the results stay in cache and memory bandwidth isn't measured
+    float* rows = ArenaAllocArray(float, (s64)8 * config.numBoxes, scratch);
+    auto run = [&](int groupSize, bool compareDst, const auto& kernel)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+        for(int r = 0; r < config.repeats; ++r)
+        {
+            for(int i = 0; i < config.numRays / groupSize; ++i)
+                kernel(i, rows);
+        }
+        
+        KernelResult res = {};
+        res.nsPerTest = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double)numTests;
+        
+        for(int i = 0; i < config.numRays / groupSize; ++i)
+        {
+            kernel(i, rows);
+            for(s64 j = 0; j < (s64)groupSize * config.numBoxes; ++j)
+            {
+                float exp = expected[(s64)i * groupSize * config.numBoxes + j];
+                bool hit = rows[j] != FLT_MAX;
+                res.hits += hit;
+                if(compareDst)
+                    res.mismatches += rows[j] != exp;
+                else
+                    res.mismatches += hit != (exp != FLT_MAX);
+            }
+        }
+        
+        return res;
+    };
+    
+    KernelResult scalar = run(1, true, [&](int i, float* out)
+    {
+        for(int j = 0; j < config.numBoxes; ++j)
+            out[j] = RayAabbDst(rayInvs[i], boxes[j]);
+    });
+    
+    // Only returns whether there was a hit. It doesn't exclude
+    // boxes behind the ray, so those count as mismatches too
+    KernelResult reference = run(1, false, [&](int i, float* out)
+    {
+        for(int j = 0; j < config.numBoxes; ++j)
+            out[j] = RayAabbIntersectionReference(rays[i], boxes[j])? 0.0f : FLT_MAX;
+    });
+    
+    KernelResult ray1x4 = run(1, true, [&](int i, float* out)
+    {
+        for(int j = 0; j < config.numBoxes / 4; ++j)
+            _mm_storeu_ps(&out[j*4], RayAabb4Dst(rayInvs[i], boxes4[j]));
+    });
+    
+    KernelResult packet4 = run(4, true, [&](int i, float* out)
+    {
+        for(int j = 0; j < config.numBoxes; ++j)
+        {
+            alignas(16) float dst[4];
+            _mm_store_ps(dst, RayPacket4AabbDst(packets4[i], boxes[j]));
+            for(int k = 0; k < 4; ++k)
+                out[k * config.numBoxes + j] = dst[k];
+        }
+    });
+    
+#ifdef __AVX2__
+    KernelResult ray1x8 = run(1, true, [&](int i, float* out)
+    {
+        for(int j = 0; j < config.numBoxes / 8; ++j)
+            _mm256_storeu_ps(&out[j*8], RayAabb8Dst(rayInvs[i], boxes8[j]));
+    });
+    
+    KernelResult packet8 = run(8, true, [&](int i, float* out)
+    {
+        for(int j = 0; j < config.numBoxes; ++j)
+        {
+            alignas(32) float dst[8];
+            _mm256_store_ps(dst, RayPacket8AabbDst(packets8[i], boxes[j]));
+            for(int k = 0; k < 8; ++k)
+                out[k * config.numBoxes + j] = dst[k];
+        }
+    });
+#endif
+    
+    printf("{\n");
+    printf("  \"config\": {\"boxes\": %d, \"rays\": %d, \"repeats\": %d, \"axisAligned\": %g, \"seed\": %u},\n",
+           config.numBoxes, config.numRays, config.repeats, config.axisAlignedRatio, config.seed);
+    printf("  \"kernels\": {\n");
+    PrintResult("reference", reference, false);
+    PrintResult("scalar", scalar, false);
+    PrintResult("ray1x4", ray1x4, false);
+#ifdef __AVX2__
+    PrintResult("packet4", packet4, false);
+    PrintResult("ray1x8", ray1x8, false);
+    PrintResult("packet8", packet8, true);
+#else
+    PrintResult("packet4", packet4, true);
+#endif
+    printf("  }\n");
+    printf("}\n");
+    return 0;
+}
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args)
+{
+    for(int i = 1; i < argCount; ++i)
+    {
+        const char* arg = args[i];
+        const char* value = strchr(arg, '=');
+        value = value? value + 1 : "";
+        
+        if     (strncmp(arg, "--boxes=", 8) == 0)         config->numBoxes = atoi(value);
+        else if(strncmp(arg, "--rays=", 7) == 0)          config->numRays  = atoi(value);
+        else if(strncmp(arg, "--repeats=", 10) == 0)      config->repeats  = atoi(value);
+        else if(strncmp(arg, "--axis-aligned=", 15) == 0) config->axisAlignedRatio = (float)atof(value);
+        else if(strncmp(arg, "--seed=", 7) == 0)          config->seed     = (u32)strtoul(value, nullptr, 10);
+        else
+        {
+            fprintf(stderr, "Unknown argument '%s'\n", arg);
+            return false;
+        }
+    }
+    
+    if(config->numBoxes <= 0 || config->numRays <= 0 || config->repeats <= 0)
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// The version of RayAabbIntersection before the SIMD kernels were added
+// From: https://tavianator.com/2011/ray_box.html
+bool RayAabbIntersectionReference(Ray ray, Aabb aabb)
+{
+    double tx1 = (aabb.min.x - ray.ori.x) / ray.dir.x;
+    double tx2 = (aabb.max.x - ray.ori.x) / ray.dir.x;
+    
+    double tmin = min(tx1, tx2);
+    double tmax = max(tx1, tx2);
+    
+    double ty1 = (aabb.min.y - ray.ori.y) / ray.dir.y;
+    double ty2 = (aabb.max.y - ray.ori.y) / ray.dir.y;
+    
+    tmin = max(tmin, min(ty1, ty2));
+    tmax = min(tmax, max(ty1, ty2));
+    
+    double tz1 = (aabb.min.z - ray.ori.z) / ray.dir.z;
+    double tz2 = (aabb.max.z - ray.ori.z) / ray.dir.z;
+    
+    tmin = max(tmin, min(tz1, tz2));
+    tmax = min(tmax, max(tz1, tz2));
+    
+    return tmax >= tmin;
+}
+
+u32 NextRandom(u32* state)
+{
+    // Xorshift32
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+float RandomFloat(u32* state)
+{
+    return (NextRandom(state) >> 8) / (float)(1 << 24);
+}
+
+void PrintResult(const char* name, KernelResult result, bool last)
+{
+    printf("    \"%s\": {\"nsPerTest\": %.3f, \"hits\": %lld, \"mismatches\": %lld}%s\n", name,
+           result.nsPerTest, (long long)result.hits, (long long)result.mismatches, last? "" : ",");
+}
+
+// Referenced by CameraRay in collision.cpp
+void OS_GetClientAreaSize(int* width, int* height)
+{
+    *width  = 1;
+    *height = 1;
+}
@@ -0,0 +1,335 @@
+// Headless benchmark of the renderer frontend: builds a scene of static
+// meshes, then calls RenderFrame for a number of frames with a rotating
+// camera, on top of the null graphics backend. Nothing is drawn, so
+// the timings are the CPU cost of culling, sorting and submission, and
+// the backend counters can be used to catch extra binds, uploads or leaked
+// resources. No window or GPU is needed, so it can run on a CI machine.
+// On Linux, from this folder:
+// g++ -std=c++20 -O2 -mavx2 -mfma -I.. render_benchmark.cpp -o render_benchmark -pthread
+
+#define GFX_NULL
+
+#include "metaprogram_custom_keywords.h"
+#include "generated/introspection.cpp"
+#include "base.cpp"
+#include "entities.cpp"
+#include "collision.cpp"
+#include "renderer_frontend.cpp"
+#include "renderer_backend/generic.cpp"
+
+// Referenced by the editor code in entities.cpp
+#include "imgui/imgui.cpp"
+#include "imgui/imgui_draw.cpp"
+#include "imgui/imgui_tables.cpp"
+#include "imgui/imgui_widgets.cpp"
+
+#include <chrono>
+#include <algorithm>
+
+// NOTE: In this program we don't care about memory leaks
+// because it's a simple shortlived command line program.
+
+struct BenchConfig
+{
+    int numEntities   = 10000;
+    int numMeshes     = 16;
+    int numMaterials  = 8;
+    int numShaders    = 2;
+    float extent      = 200.0f;  // Side of the square the entities are spread on, centered on the camera
+    int numFrames     = 600;
+    int warmupFrames  = 60;
+    bool dumpLog      = false;   // Prints the command log of the last frame to stderr
+    bool instancing   = true;    // If false, the instanced shader fails to load, like when it hasn't been compiled
+    bool uniqueMeshes = false;   // One mesh per entity, so that nothing is instanced and every draw uses the transient ring
+    u32 seed          = 1;
+};
+
+// Fake assets, handles are indices into these arrays
+struct BenchAssets
+{
+    Array<Mesh> meshes;
+    Array<Material> materials;
+    Array<R_Shader> pixelShaders;
+    Array<R_Texture2D> textures;
+    R_Shader vertShader;
+    R_Shader instancedVertShader;  // Left empty when instancing is disabled
+};
+
+static BenchAssets assets;
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args);
+void CreateAssets(const BenchConfig& config);
+void SpawnEntity(EntityManager* man, const BenchConfig& config, int index, u32* rng);
+u32 NextRandom(u32* state);
+float RandomFloat(u32* state);
+double Percentile(Slice<double> sorted, double p);
+
+// Usage:
+// render_benchmark [--entities=N] [--meshes=N] [--materials=N] [--shaders=N] [--extent=N]
+//                  [--frames=N] [--warmup=N] [--no-instancing] [--unique-meshes] [--dump-log] [--seed=N]
+// Results are printed to stdout as JSON.
+int main(int argCount, char** args)
+{
+    InitScratchArenas();
+    
+    BenchConfig config = {};
+    if(!ParseArgs(&config, argCount, args))
+        return 1;
+    
+    R_Init();
+    CreateAssets(config);
+    RenderResourcesInit();
+    
+    EntityManager man = {};
+    Arena baseArena = ArenaVirtualMemInit(GB(16), MB(2));
+    UseArena(&man.bases, &baseArena);
+    
+    u32 rng = config.seed? config.seed : 1;
+    for(int i = 0; i < config.numEntities; ++i)
+        SpawnEntity(&man, config, i, &rng);
+    
+    CommitDestroy(&man);
+    UpdateWorldTransforms(&man);
+    
+    CamParams cam = {};
+    cam.fov = 90.0f;
+    cam.nearClip = 0.1f;
+    cam.farClip = 1000.0f;
+    
+    ScratchArena scratch;
+    double* frameTimes = ArenaZAllocArray(double, config.numFrames, scratch);
+    double totalTime = 0.0;
+    RenderStats renderTotals = {};
+    R_NullFrameStats backendTotals = {};
+    s64 totalCmds = 0;
+    u32 liveAfterFirstFrame = 0;
+    
+    using Clock = std::chrono::steady_clock;
+    for(int frame = -config.warmupFrames; frame < config.numFrames; ++frame)
+    {
+        // One full turn every 10 seconds
+        cam.rot = AngleAxis(Vec3::up, frame / 600.0f * 2.0f * Pi);
+        
+        auto t0 = Clock::now();
+        RenderFrame(&man, cam);
+        auto t1 = Clock::now();
+        
+        if(frame >= 0)
+        {
+            double time = std::chrono::duration<double, std::nano>(t1 - t0).count();
+            frameTimes[frame] = time;
+            totalTime += time;
+            
+            RenderStats stats = GetRenderStats();
+            renderTotals.draws        += stats.draws;
+            renderTotals.instances    += stats.instances;
+            renderTotals.culled       += stats.culled;
+            renderTotals.stateChanges += stats.stateChanges;
+            renderTotals.skippedBinds += stats.skippedBinds;
+            
+            R_NullFrameStats backend = R_NullGetLastFrameStats();
+            backendTotals.draws          += backend.draws;
+            backendTotals.instancedDraws += backend.instancedDraws;
+            backendTotals.instances      += backend.instances;
+            backendTotals.vertices       += backend.vertices;
+            backendTotals.binds          += backend.binds;
+            backendTotals.allocs         += backend.allocs;
+            backendTotals.frees          += backend.frees;
+            backendTotals.uploads        += backend.uploads;
+            backendTotals.bytesUploaded  += backend.bytesUploaded;
+            backendTotals.transientBytes += backend.transientBytes;
+            backendTotals.transientMaps  += backend.transientMaps;
+            backendTotals.clears         += backend.clears;
+            totalCmds += R_NullGetLastFrameLog().len;
+            
+            // Some resources are created lazily by the first frame
+            if(frame == 0) liveAfterFirstFrame = R_NullGetTotalLiveResources();
+        }
+    }
+    
+    if(config.dumpLog)
+    {
+        Slice<R_NullCmd> log = R_NullGetLastFrameLog();
+        for(s64 i = 0; i < log.len; ++i)
+        {
+            R_NullCmd cmd = log[i];
+            fprintf(stderr, "%-11s %-11s id=%u slot=%u shader=%u count=%llu instances=%u\n",
+                    R_NullCmdKindToString(cmd.kind), R_NullResourceKindToString(cmd.resource),
+                    cmd.id, cmd.slot, cmd.shaderType, (unsigned long long)cmd.count, cmd.instances);
+        }
+    }
+    
+    Slice<double> sorted = {.ptr=frameTimes, .len=config.numFrames};
+    std::sort(sorted.ptr, sorted.ptr + sorted.len);
+    
+    double numFrames = (double)(config.numFrames > 0? config.numFrames : 1);
+    u32 liveAtEnd = R_NullGetTotalLiveResources();
+    
+    printf("{\n");
+    printf("  \"config\": {\"entities\": %d, \"meshes\": %d, \"materials\": %d, \"shaders\": %d, \"extent\": %g, \"frames\": %d, \"warmup\": %d, \"instancing\": %s, \"uniqueMeshes\": %s, \"seed\": %u},\n",
+           config.numEntities, config.numMeshes, config.numMaterials, config.numShaders, config.extent,
+           config.numFrames, config.warmupFrames, config.instancing? "true" : "false", config.uniqueMeshes? "true" : "false", config.seed);
+    printf("  \"nsPerEntity\": %.3f,\n", config.numEntities > 0? totalTime / numFrames / config.numEntities : 0.0);
+    printf("  \"frameTimeNs\": {\"mean\": %.0f, \"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f},\n",
+           totalTime / numFrames, Percentile(sorted, 0.5), Percentile(sorted, 0.99), sorted.len > 0? sorted[sorted.len-1] : 0.0);
+    
+    // Per frame means
+    printf("  \"frontend\": {\"draws\": %.1f, \"instances\": %.1f, \"culled\": %.1f, \"stateChanges\": %.1f, \"skippedBinds\": %.1f},\n",
+           renderTotals.draws / numFrames, renderTotals.instances / numFrames, renderTotals.culled / numFrames,
+           renderTotals.stateChanges / numFrames, renderTotals.skippedBinds / numFrames);
+    printf("  \"backend\": {\"commands\": %.1f, \"draws\": %.1f, \"instancedDraws\": %.1f, \"instances\": %.1f, \"vertices\": %.1f, \"binds\": %.1f,\n",
+           totalCmds / numFrames, backendTotals.draws / numFrames, backendTotals.instancedDraws / numFrames,
+           backendTotals.instances / numFrames, backendTotals.vertices / numFrames, backendTotals.binds / numFrames);
+    printf("              \"uploads\": %.1f, \"bytesUploaded\": %.1f, \"transientBytes\": %.1f, \"transientMaps\": %.1f, \"allocs\": %.1f, \"frees\": %.1f, \"clears\": %.1f},\n",
+           backendTotals.uploads / numFrames, backendTotals.bytesUploaded / numFrames, backendTotals.transientBytes / numFrames,
+           backendTotals.transientMaps / numFrames, backendTotals.allocs / numFrames, backendTotals.frees / numFrames, backendTotals.clears / numFrames);
+    
+    // Anything allocated after the first frame and never freed is a leak
+    printf("  \"liveResources\": {\"afterFirstFrame\": %u, \"end\": %u, \"bufferBytes\": %llu}\n",
+           liveAfterFirstFrame, liveAtEnd, (unsigned long long)R_NullGetLiveBufferBytes());
+    printf("}\n");
+    return liveAtEnd > liveAfterFirstFrame? 2 : 0;
+}
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args)
+{
+    for(int i = 1; i < argCount; ++i)
+    {
+        const char* arg = args[i];
+        const char* value = strchr(arg, '=');
+        value = value? value + 1 : "";
+        
+        if     (strncmp(arg, "--entities=", 11) == 0)  config->numEntities  = atoi(value);
+        else if(strncmp(arg, "--meshes=", 9) == 0)     config->numMeshes    = atoi(value);
+        else if(strncmp(arg, "--materials=", 12) == 0) config->numMaterials = atoi(value);
+        else if(strncmp(arg, "--shaders=", 10) == 0)   config->numShaders   = atoi(value);
+        else if(strncmp(arg, "--extent=", 9) == 0)     config->extent       = (float)atof(value);
+        else if(strncmp(arg, "--frames=", 9) == 0)     config->numFrames    = atoi(value);
+        else if(strncmp(arg, "--warmup=", 9) == 0)     config->warmupFrames = atoi(value);
+        else if(strncmp(arg, "--seed=", 7) == 0)       config->seed         = (u32)strtoul(value, nullptr, 10);
+        else if(strcmp(arg, "--dump-log") == 0)        config->dumpLog      = true;
+        else if(strcmp(arg, "--no-instancing") == 0)   config->instancing   = false;
+        else if(strcmp(arg, "--unique-meshes") == 0)   config->uniqueMeshes = true;
+        else
+        {
+            fprintf(stderr, "Unknown argument '%s'\n", arg);
+            return false;
+        }
+    }
+    
+    if(config->numEntities < 0 || config->numMeshes < 1 || config->numMaterials < 1 || config->numShaders < 1 ||
+       config->extent <= 0.0f || config->numFrames < 0 || config->warmupFrames < 0)
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return false;
+    }
+    
+    if(config->uniqueMeshes)
+        config->numMeshes = config->numEntities > 0? config->numEntities : 1;
+    
+    return true;
+}
+
+// All meshes are unit cubes, with unshared vertices for each face.
+// Each material has its own texture, and shaders are shared between materials
+void CreateAssets(const BenchConfig& config)
+{
+    ScratchArena scratch;
+    
+    Vertex* verts = ArenaZAllocArray(Vertex, 24, scratch);
+    u32* indices  = ArenaZAllocArray(u32, 36, scratch);
+    for(int face = 0; face < 6; ++face)
+    {
+        u32 base = face * 4;
+        u32 quad[6] = {0, 1, 2, 0, 2, 3};
+        for(int i = 0; i < 6; ++i)
+            indices[face * 6 + i] = base + quad[i];
+    }
+    
+    StaticMeshInput input = {};
+    input.verts   = {.ptr=verts, .len=24};
+    input.indices = {.ptr=indices, .len=36};
+    input.aabb    = {.min={-0.5f, -0.5f, -0.5f}, .max={0.5f, 0.5f, 0.5f}};
+    input.sphere  = {.center={0.0f, 0.0f, 0.0f}, .radius=0.8660254f};
+    for(int i = 0; i < config.numMeshes; ++i)
+        Append(&assets.meshes, StaticMeshAlloc(input));
+    
+    for(int i = 0; i < config.numShaders; ++i)
+        Append(&assets.pixelShaders, R_ShaderAlloc({}, ShaderType_Pixel));
+    
+    assets.vertShader = R_ShaderAlloc({}, ShaderType_Vertex);
+    if(config.instancing)
+        assets.instancedVertShader = R_ShaderAlloc({}, ShaderType_Vertex);
+    
+    for(int i = 0; i < config.numMaterials; ++i)
+    {
+        Append(&assets.textures, R_Texture2DAlloc(TextureFormat_RGBA_SRGB, 64, 64));
+        
+        Material mat = {};
+        mat.shader = {{.slot=(u32)(i % config.numShaders), .gen=1}};
+        Append(&mat.textures, {{.slot=(u32)i, .gen=1}});
+        Append(&assets.materials, mat);
+    }
+}
+
+void SpawnEntity(EntityManager* man, const BenchConfig& config, int index, u32* rng)
+{
+    // The random mesh is still drawn with unique meshes, so that
+    // the rest of the scene is the same
+    u32 mesh = NextRandom(rng) % config.numMeshes;
+    if(config.uniqueMeshes) mesh = (u32)index;
+    
+    Entity* entity = NewEntity(man);
+    entity->mesh     = {{.slot=mesh, .gen=1}};
+    entity->material = {{.slot=NextRandom(rng) % config.numMaterials, .gen=1}};
+    
+    Vec3 pos = {(RandomFloat(rng) - 0.5f) * config.extent, (RandomFloat(rng) - 0.5f) * 10.0f, (RandomFloat(rng) - 0.5f) * config.extent};
+    SetPos(man, entity, pos);
+    SetRot(man, entity, AngleAxis(Vec3::up, RandomFloat(rng) * 2.0f * Pi));
+}
+
+u32 NextRandom(u32* state)
+{
+    // Xorshift32
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+float RandomFloat(u32* state)
+{
+    return (NextRandom(state) >> 8) / (float)(1 << 24);
+}
+
+double Percentile(Slice<double> sorted, double p)
+{
+    if(sorted.len <= 0) return 0.0;
+    
+    s64 idx = (s64)(p * (sorted.len - 1) + 0.5);
+    return sorted[idx];
+}
+
+// Asset system, backed by the arrays in BenchAssets
+u32 GetMeshLoadCount() { return 0; }
+Mesh*        GetAsset(MeshHandle handle)        { return &assets.meshes[handle.slot]; }
+R_Shader*    GetAsset(VertShaderHandle handle)  { return handle.slot == 1? &assets.instancedVertShader : &assets.vertShader; }
+R_Shader*    GetAsset(PixelShaderHandle handle) { return &assets.pixelShaders[handle.slot]; }
+Material*    GetAsset(MaterialHandle handle)    { return &assets.materials[handle.slot]; }
+R_Texture2D* GetAsset(Texture2DHandle handle)   { return &assets.textures[handle.slot]; }
+VertShaderHandle AcquireVertShader(const char* path) { return {{.slot=strstr(path, "instanced")? 1u : 0u, .gen=1}}; }
+
+// Referenced by MainUpdate and the scene setup in entities.cpp,
+// but never called here since there's no editor or simulation
+MeshHandle AcquireMeshAsync(const char* path) { return {}; }
+MaterialHandle AcquireMaterialAsync(const char* path) { return {}; }
+void PollAndProcessInput(bool inEditor) {}
+Input GetInput() { return {}; }
+bool PressedKey(Input input, VirtualKeycode key) { return false; }
+bool PressedGamepadButton(Input input, GamepadButtonField button) { return false; }
+void OS_DearImguiBeginFrame() {}
+void OS_GetClientAreaSize(int* width, int* height) { *width = 1920; *height = 1080; }
+void UpdateEditor(Editor* editor, float deltaTime) {}
+void EditorLog(const char* fmt, ...) {}
@@ -0,0 +1,646 @@
+
+// Headless benchmark of the simulation: builds an entity manager,
+// then runs the update phase, CommitDestroy and the transform pass
+// for a number of frames with synthetic input, and casts picking rays
+// against the entity bounds. No window, renderer
+// or GPU is needed, so it can run on a CI machine.
+// On Linux, from this folder:
+// g++ -std=c++20 -O2 -mavx2 -mfma -I.. sim_benchmark.cpp -o sim_benchmark -pthread
+
+// Nothing is rendered, the renderer types are only needed by the headers
+#define GFX_NULL
+
+#include "metaprogram_custom_keywords.h"
+#include "generated/introspection.cpp"
+#include "base.cpp"
+#include "entities.cpp"
+#include "collision.cpp"
+
+// Referenced by the editor code in entities.cpp
+#include "imgui/imgui.cpp"
+#include "imgui/imgui_draw.cpp"
+#include "imgui/imgui_tables.cpp"
+#include "imgui/imgui_widgets.cpp"
+
+#include <chrono>
+#include <algorithm>
+
+// NOTE: In this program we don't care about memory leaks
+// because it's a simple shortlived command line program.
+
+struct BenchConfig
+{
+    int numEntities   = 10000;
+    int mountDepth    = 4;      // Length of the mount chains, 1 means no mounts
+    float playerRatio = 0.1f;   // The rest are plain entities
+    float lightRatio  = 0.1f;
+    int numFrames     = 1000;
+    int warmupFrames  = 60;
+    int churn         = 0;      // Entities destroyed (and respawned) each frame
+    int numPicks      = 16;     // Rays cast against the entity bounds each frame
+    int numWorkers    = -1;
+    bool parallel     = true;
+    bool verify       = false;  // Runs serial and parallel updates side by side and compares them
+    float deadRatio   = -1.0f;  // If set, only entity iteration is timed, with this ratio of destroyed entities
+    u32 seed          = 1;
+};
+
+struct BenchState
+{
+    EntityManager man;
+    Arena baseArena;
+    Arena cameraArena;
+    Arena playerArena;
+    Arena pointLightArena;
+    
+    u32 rng;
+    u32 pickRng;  // Separate, so that the number of picks doesn't change the simulation
+    int chainLen;  // Length of the mount chain currently being built
+    EntityKey chainTail;
+};
+
+static Input synthInput;
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args);
+void InitBenchState(BenchState* state, const BenchConfig& config);
+void SpawnEntity(BenchState* state, const BenchConfig& config);
+void DestroyRandomEntities(BenchState* state, const BenchConfig& config);
+void RespawnEntities(BenchState* state, const BenchConfig& config);
+int VerifyParallelUpdate(const BenchConfig& config);
+bool SameSimulationState(EntityManager* a, EntityManager* b, int frame);
+int BenchmarkLiveIteration(const BenchConfig& config);
+void UpdateSyntheticInput(int frame);
+u32 NextRandom(u32* state);
+float RandomFloat(u32* state);
+double Percentile(Slice<double> sorted, double p);
+void PrintArena(const char* name, Arena* arena, bool last);
+
+// Usage:
+// sim_benchmark [--entities=N] [--depth=N] [--players=ratio] [--lights=ratio]
+//               [--frames=N] [--warmup=N] [--churn=N] [--picks=N] [--workers=N] [--serial] [--seed=N]
+//               [--verify] [--dead=ratio]
+// Results are printed to stdout as JSON.
+// With --verify nothing is timed: the simulation is run once with serial
+// and once with parallel updates from the same seed, and the state of
+// the two is compared after every frame. Exits with 2 on a mismatch.
+// With --dead only the for_live loops are timed, see BenchmarkLiveIteration.
+int main(int argCount, char** args)
+{
+    InitScratchArenas();
+    
+    BenchConfig config = {};
+    if(!ParseArgs(&config, argCount, args))
+        return 1;
+    
+    InitJobSystem(config.numWorkers);
+    defer { ShutdownJobSystem(); };
+    
+    if(config.verify)
+        return VerifyParallelUpdate(config);
+    if(config.deadRatio >= 0.0f)
+        return BenchmarkLiveIteration(config);
+    
+    BenchState state = {};
+    InitBenchState(&state, config);
+    EntityManager* man = &state.man;
+    
+    const float deltaTime = 1.0f / 60.0f;
+    ScratchArena scratch;
+    double* frameTimes = ArenaZAllocArray(double, config.numFrames, scratch);
+    double updateTime    = 0.0;
+    double destroyTime   = 0.0;
+    double transformTime = 0.0;
+    double boundsTime    = 0.0;
+    double pickTime      = 0.0;
+    s64 entityFrames = 0;
+    s64 numHits = 0;
+    
+    using Clock = std::chrono::steady_clock;
+    for(int frame = -config.warmupFrames; frame < config.numFrames; ++frame)
+    {
+        UpdateSyntheticInput(frame);
+        
+        auto t0 = Clock::now();
+        UpdateEntities(man, deltaTime, config.parallel);
+        auto t1 = Clock::now();
+        
+        DestroyRandomEntities(&state, config);
+        CommitDestroy(man);
+        auto t2 = Clock::now();
+        UpdateWorldTransforms(man);
+        auto t3 = Clock::now();
+        
+        // Rays from above the scene, like clicking in the editor,
+        // which also only updates the bounds right before picking
+        if(config.numPicks > 0)
+            UpdateBounds(man);
+        auto t4 = Clock::now();
+        
+        s64 frameHits = 0;
+        for(int i = 0; i < config.numPicks; ++i)
+        {
+            Vec3 from = {RandomFloat(&state.pickRng) * 100.0f, 30.0f, RandomFloat(&state.pickRng) * 100.0f - 50.0f};
+            Vec3 to   = {RandomFloat(&state.pickRng) * 100.0f, RandomFloat(&state.pickRng) * 10.0f, RandomFloat(&state.pickRng) * 100.0f};
+            RayHit hit = Raycast(&man->bounds, {.ori=from, .dir=normalize(to - from)});
+            frameHits += hit.dst != FLT_MAX;
+        }
+        auto t5 = Clock::now();
+        
+        if(frame >= 0)
+        {
+            double update    = std::chrono::duration<double, std::nano>(t1 - t0).count();
+            double destroy   = std::chrono::duration<double, std::nano>(t2 - t1).count();
+            double transform = std::chrono::duration<double, std::nano>(t3 - t2).count();
+            
+            frameTimes[frame] = update + destroy + transform;
+            updateTime    += update;
+            destroyTime   += destroy;
+            transformTime += transform;
+            boundsTime    += std::chrono::duration<double, std::nano>(t4 - t3).count();
+            pickTime      += std::chrono::duration<double, std::nano>(t5 - t4).count();
+            numHits       += frameHits;
+            entityFrames  += man->bases.dense.len;
+        }
+        
+        // Respawn what was destroyed, outside of the timed section
+        RespawnEntities(&state, config);
+    }
+    
+    Slice<double> sorted = {.ptr=frameTimes, .len=config.numFrames};
+    std::sort(sorted.ptr, sorted.ptr + sorted.len);
+    
+    double totalTime = updateTime + destroyTime + transformTime;
+    double numFrames = (double)(config.numFrames > 0? config.numFrames : 1);
+    
+    printf("{\n");
+    printf("  \"config\": {\"entities\": %d, \"depth\": %d, \"players\": %g, \"lights\": %g, \"frames\": %d, \"warmup\": %d, \"churn\": %d, \"picks\": %d, \"workers\": %d, \"parallel\": %s, \"seed\": %u},\n",
+           config.numEntities, config.mountDepth, config.playerRatio, config.lightRatio, config.numFrames,
+           config.warmupFrames, config.churn, config.numPicks, GetNumWorkers(), config.parallel? "true" : "false", config.seed);
+    printf("  \"nsPerEntityFrame\": %.3f,\n", entityFrames > 0? totalTime / entityFrames : 0.0);
+    printf("  \"frameTimeNs\": {\"mean\": %.0f, \"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f},\n",
+           totalTime / numFrames, Percentile(sorted, 0.5), Percentile(sorted, 0.99), sorted.len > 0? sorted[sorted.len-1] : 0.0);
+    printf("  \"phaseMeanNs\": {\"update\": %.0f, \"commitDestroy\": %.0f, \"transforms\": %.0f},\n",
+           updateTime / numFrames, destroyTime / numFrames, transformTime / numFrames);
+    
+    // Not included in the frame times
+    double numPicks = numFrames * config.numPicks;
+    printf("  \"picking\": {\"boundsUpdateNs\": %.0f, \"nsPerRay\": %.0f, \"hitRatio\": %.3f, \"treeNodes\": %lld},\n",
+           boundsTime / numFrames, numPicks > 0? pickTime / numPicks : 0.0, numPicks > 0? numHits / numPicks : 0.0, (long long)man->bounds.nodes.len);
+    
+    // The committed size is rounded up to the commit blocks,
+    // so regressions smaller than that only show in the peak
+    printf("  \"arenas\": {\n");
+    PrintArena("bases", &state.baseArena, false);
+    PrintArena("cameras", &state.cameraArena, false);
+    PrintArena("players", &state.playerArena, false);
+    PrintArena("pointLights", &state.pointLightArena, false);
+    for(int i = 0; i < NumScratchArenas; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "mainThreadScratch%d", i);
+        ScratchArena s(i);
+        PrintArena(name, s.arena(), i == NumScratchArenas - 1);
+    }
+    printf("  }\n");
+    printf("}\n");
+    return 0;
+}
+
+bool ParseArgs(BenchConfig* config, int argCount, char** args)
+{
+    for(int i = 1; i < argCount; ++i)
+    {
+        const char* arg = args[i];
+        const char* value = strchr(arg, '=');
+        value = value? value + 1 : "";
+        
+        if     (strncmp(arg, "--entities=", 11) == 0) config->numEntities  = atoi(value);
+        else if(strncmp(arg, "--depth=", 8) == 0)     config->mountDepth   = atoi(value);
+        else if(strncmp(arg, "--players=", 10) == 0)  config->playerRatio  = (float)atof(value);
+        else if(strncmp(arg, "--lights=", 9) == 0)    config->lightRatio   = (float)atof(value);
+        else if(strncmp(arg, "--frames=", 9) == 0)    config->numFrames    = atoi(value);
+        else if(strncmp(arg, "--warmup=", 9) == 0)    config->warmupFrames = atoi(value);
+        else if(strncmp(arg, "--churn=", 8) == 0)     config->churn        = atoi(value);
+        else if(strncmp(arg, "--picks=", 8) == 0)     config->numPicks     = atoi(value);
+        else if(strncmp(arg, "--workers=", 10) == 0)  config->numWorkers   = atoi(value);
+        else if(strncmp(arg, "--seed=", 7) == 0)      config->seed         = (u32)strtoul(value, nullptr, 10);
+        else if(strcmp(arg, "--serial") == 0)         config->parallel     = false;
+        else if(strcmp(arg, "--verify") == 0)         config->verify       = true;
+        else if(strncmp(arg, "--dead=", 7) == 0)      config->deadRatio    = (float)atof(value);
+        else
+        {
+            fprintf(stderr, "Unknown argument '%s'\n", arg);
+            return false;
+        }
+    }
+    
+    if(config->numEntities < 0 || config->mountDepth < 1 || config->numFrames < 0 ||
+       config->warmupFrames < 0 || config->churn < 0 || config->numPicks < 0 || config->deadRatio > 1.0f)
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return false;
+    }
+    
+    return true;
+}
+
+void InitBenchState(BenchState* state, const BenchConfig& config)
+{
+    *state = {};
+    state->rng = config.seed? config.seed : 1;
+    state->pickRng = state->rng;
+    state->chainTail = NullKey();
+    state->baseArena       = ArenaVirtualMemInit(GB(16), MB(2));
+    state->cameraArena     = ArenaVirtualMemInit(MB(64), MB(2));
+    state->playerArena     = ArenaVirtualMemInit(GB(4), MB(2));
+    state->pointLightArena = ArenaVirtualMemInit(GB(4), MB(2));
+    
+    EntityManager* man = &state->man;
+    UseArena(&man->bases, &state->baseArena);
+    UseArena(&man->cameras, &state->cameraArena);
+    UseArena(&man->players, &state->playerArena);
+    UseArena(&man->pointLights, &state->pointLightArena);
+    static_assert(4 == Entity_Count, "Every array for each type should be based on an arena for pointer stability");
+    
+    auto camera = NewEntity<Camera>(man);
+    camera->base->flags |= EntityFlags_NoMesh;
+    man->mainCamera = GetKey(man, camera->base);
+    
+    for(int i = 0; i < config.numEntities; ++i)
+        SpawnEntity(state, config);
+    
+    CommitDestroy(man);
+    UpdateWorldTransforms(man);
+}
+
+// Entities are spawned in mount chains of config.mountDepth
+// entities, each one mounted to the previous one
+void SpawnEntity(BenchState* state, const BenchConfig& config)
+{
+    EntityManager* man = &state->man;
+    
+    Entity* entity = nullptr;
+    float kind = RandomFloat(&state->rng);
+    if(kind < config.playerRatio)
+    {
+        auto player = NewEntity<Player>(man);
+        player->gravity     = 20.0f;
+        player->jumpVel     = 10.0f;
+        player->moveSpeed   = 4.0f;
+        player->groundAccel = 40.0f;
+        entity = player->base;
+    }
+    else if(kind < config.playerRatio + config.lightRatio)
+    {
+        auto light = NewEntity<PointLight>(man);
+        light->intensity = 1.0f;
+        entity = light->base;
+        entity->flags |= EntityFlags_NoMesh;
+    }
+    else
+    {
+        entity = NewEntity(man);
+    }
+    
+    Vec3 pos = {RandomFloat(&state->rng) * 100.0f, RandomFloat(&state->rng) * 10.0f, RandomFloat(&state->rng) * 100.0f};
+    SetPos(man, entity, pos);
+    SetRot(man, entity, AngleAxis(Vec3::up, RandomFloat(&state->rng) * 2.0f * Pi));
+    
+    Entity* chainTail = GetEntity(man, state->chainTail);
+    if(chainTail && state->chainLen < config.mountDepth)
+    {
+        MountEntity(man, entity, chainTail);
+        ++state->chainLen;
+    }
+    else
+    {
+        state->chainLen = 1;
+    }
+    
+    state->chainTail = GetKey(man, entity);
+}
+
+void DestroyRandomEntities(BenchState* state, const BenchConfig& config)
+{
+    EntityManager* man = &state->man;
+    for(int i = 0; i < config.churn && man->bases.dense.len > 1; ++i)
+    {
+        Entity* toDestroy = &man->bases.dense[NextRandom(&state->rng) % man->bases.dense.len];
+        if(GetKey(man, toDestroy) != man->mainCamera)
+            DestroyEntity(man, toDestroy);
+    }
+}
+
+void RespawnEntities(BenchState* state, const BenchConfig& config)
+{
+    while(state->man.bases.dense.len < config.numEntities + 1)
+        SpawnEntity(state, config);
+}
+
+// Both simulations get the same input and random numbers, so
+// any difference comes from the order the updates ran in
+int VerifyParallelUpdate(const BenchConfig& config)
+{
+    BenchState serial = {};
+    BenchState parallel = {};
+    InitBenchState(&serial, config);
+    InitBenchState(&parallel, config);
+    
+    const float deltaTime = 1.0f / 60.0f;
+    int numFrames = config.warmupFrames + config.numFrames;
+    bool ok = SameSimulationState(&serial.man, &parallel.man, -1);
+    for(int frame = 0; ok && frame < numFrames; ++frame)
+    {
+        UpdateSyntheticInput(frame);
+        
+        BenchState* states[2] = {&serial, &parallel};
+        for(int i = 0; i < 2; ++i)
+        {
+            EntityManager* man = &states[i]->man;
+            UpdateEntities(man, deltaTime, i == 1);
+            DestroyRandomEntities(states[i], config);
+            CommitDestroy(man);
+            UpdateWorldTransforms(man);
+        }
+        
+        ok = SameSimulationState(&serial.man, &parallel.man, frame);
+        
+        RespawnEntities(&serial, config);
+        RespawnEntities(&parallel, config);
+    }
+    
+    printf("{\"verify\": {\"entities\": %d, \"frames\": %d, \"churn\": %d, \"workers\": %d, \"seed\": %u, \"ok\": %s}}\n",
+           config.numEntities, numFrames, config.churn, GetNumWorkers(), config.seed, ok? "true" : "false");
+    return ok? 0 : 2;
+}
+
+// Bitwise comparison, floats included. Pointers to the base
+// entities differ between the two managers, so they're skipped
+bool SameSimulationState(EntityManager* a, EntityManager* b, int frame)
+{
+    auto sameArray = [&](const char* name, auto& arrA, auto& arrB)
+    {
+        if(arrA.len == arrB.len && memcmp(arrA.ptr, arrB.ptr, arrA.len * sizeof(arrA.ptr[0])) == 0)
+            return true;
+        
+        fprintf(stderr, "Mismatch in %s at frame %d\n", name, frame);
+        return false;
+    };
+    
+    EntityTransforms& la = a->localTransforms;
+    EntityTransforms& lb = b->localTransforms;
+    if(a->bases.dense.len != b->bases.dense.len)
+    {
+        fprintf(stderr, "Mismatch in the number of entities at frame %d\n", frame);
+        return false;
+    }
+    
+    bool ok = true;
+    ok &= sameArray("posX", la.posX, lb.posX) && sameArray("posY", la.posY, lb.posY) && sameArray("posZ", la.posZ, lb.posZ);
+    ok &= sameArray("rotW", la.rotW, lb.rotW) && sameArray("rotX", la.rotX, lb.rotX);
+    ok &= sameArray("rotY", la.rotY, lb.rotY) && sameArray("rotZ", la.rotZ, lb.rotZ);
+    ok &= sameArray("scaleX", la.scaleX, lb.scaleX) && sameArray("scaleY", la.scaleY, lb.scaleY) && sameArray("scaleZ", la.scaleZ, lb.scaleZ);
+    ok &= sameArray("world", a->transforms.world, b->transforms.world);
+    ok &= sameArray("normal", a->transforms.normal, b->transforms.normal);
+    
+    if(a->players.dense.len != b->players.dense.len)
+    {
+        fprintf(stderr, "Mismatch in the number of players at frame %d\n", frame);
+        return false;
+    }
+    
+    for(s64 i = 0; i < a->players.dense.len; ++i)
+    {
+        Player& pa = a->players.dense[i];
+        Player& pb = b->players.dense[i];
+        bool same = GetId(a, pa.base) == GetId(b, pb.base);
+        same &= memcmp(&pa.speed, &pb.speed, sizeof(pa.speed)) == 0;
+        same &= pa.grounded == pb.grounded;
+        same &= memcmp(&pa.camAngleX, &pb.camAngleX, sizeof(float)) == 0;
+        same &= memcmp(&pa.camAngleY, &pb.camAngleY, sizeof(float)) == 0;
+        same &= memcmp(&pa.gravity, &pb.gravity, sizeof(float)) == 0;
+        same &= memcmp(&pa.jumpVel, &pb.jumpVel, sizeof(float)) == 0;
+        same &= memcmp(&pa.moveSpeed, &pb.moveSpeed, sizeof(float)) == 0;
+        same &= memcmp(&pa.groundAccel, &pb.groundAccel, sizeof(float)) == 0;
+        same &= memcmp(&pa.newGravity, &pb.newGravity, sizeof(float)) == 0;
+        if(!same)
+        {
+            fprintf(stderr, "Mismatch in player %lld at frame %d\n", (long long)i, frame);
+            return false;
+        }
+    }
+    
+    return ok;
+}
+
+// Read back into the checksum, so that the stand-in for GetKey isn't optimized away
+static u32 refKeySum = 0;
+
+// Copy of the for_live loops from before the slot maps, for comparison.
+// Destroyed entities used to stay in place, flagged, until their slot was
+// reused, so every loop had to skip them one by one. NextDerivedLive also
+// went through GetKey on every step.
+static Entity* RefNextLive(Slice<Entity> bases, s64 id)
+{
+    while(id < bases.len && (bases[id].flags & EntityFlags_Destroyed))
+        ++id;
+    
+    if(id >= bases.len) return nullptr;
+    
+    return &bases[id];
+}
+
+static Player* RefNextDerivedLive(Slice<Player> players, Slice<Entity> bases, s64 id)
+{
+    while(id < players.len && (players[id].base->flags & EntityFlags_Destroyed))
+        ++id;
+    
+    if(id >= players.len) return nullptr;
+    
+    // Stands in for the GetKey(man, current->base).id of the old version
+    refKeySum += (u32)(players[id].base - bases.ptr);
+    return &players[id];
+}
+
+// Flags config.deadRatio of the entities as destroyed, then times:
+// - the old loops, which skip the destroyed entities in place. Before
+// CommitDestroy the dense arrays have the same layout the old sparse arrays
+// had after churn, with the destroyed entities left in between live ones;
+// - the current loops in the same state, i.e. in a frame with pending destroys;
+// - the current loops after CommitDestroy, which is the common case.
+int BenchmarkLiveIteration(const BenchConfig& config)
+{
+    BenchState state = {};
+    InitBenchState(&state, config);
+    EntityManager* man = &state.man;
+    
+    s64 numSlots = man->bases.dense.len;
+    s64 numPlayerSlots = man->players.dense.len;
+    // Destroying an entity also destroys what's mounted to it, so only
+    // entities with no live children are picked, which makes the number
+    // of dead entities after CommitDestroy exactly numDead
+    s64 numDead = (s64)(config.deadRatio * (numSlots - 1));
+    while(man->toDestroy.len < numDead)
+    {
+        Entity* toDestroy = &man->bases.dense[1 + NextRandom(&state.rng) % (numSlots - 1)];  // The camera is at index 0
+        if(toDestroy->flags & EntityFlags_Destroyed) continue;
+        
+        bool liveChildren = false;
+        for(u32 child = toDestroy->firstChild; child != NullEntityId; child = GetEntity(man, child)->nextSibling)
+            liveChildren |= !(GetEntity(man, child)->flags & EntityFlags_Destroyed);
+        
+        if(!liveChildren)
+            DestroyEntity(man, toDestroy);
+    }
+    
+    using Clock = std::chrono::steady_clock;
+    int numIters = config.numFrames > 0? config.numFrames : 1;
+    u64 sum = 0;  // Keeps the loops from being optimized away
+    
+    auto timeLoop = [&](auto&& loop)
+    {
+        for(int i = 0; i < config.warmupFrames; ++i) loop();
+        auto t0 = Clock::now();
+        for(int i = 0; i < numIters; ++i) loop();
+        auto t1 = Clock::now();
+        return std::chrono::duration<double, std::nano>(t1 - t0).count() / numIters;
+    };
+    
+    Slice<Entity> bases = ToSlice(&man->bases.dense);
+    Slice<Player> players = ToSlice(&man->players.dense);
+    double oldEntities = timeLoop([&]
+    {
+        for(Entity* e = RefNextLive(bases, 0); e; e = RefNextLive(bases, e - bases.ptr + 1))
+            sum += e->flags;
+    });
+    double oldPlayers = timeLoop([&]
+    {
+        for(Player* p = RefNextDerivedLive(players, bases, 0); p; p = RefNextDerivedLive(players, bases, p - players.ptr + 1))
+            sum += p->grounded;
+    });
+    double pendingEntities = timeLoop([&]
+    {
+        for_live_entities(man, e)
+            sum += e->flags;
+    });
+    double pendingPlayers = timeLoop([&]
+    {
+        for_live_derived(man, p, Player)
+            sum += p->grounded;
+    });
+    
+    CommitDestroy(man);
+    s64 numLive = man->bases.dense.len;
+    s64 numLivePlayers = man->players.dense.len;
+    double committedEntities = timeLoop([&]
+    {
+        for_live_entities(man, e)
+            sum += e->flags;
+    });
+    double committedPlayers = timeLoop([&]
+    {
+        for_live_derived(man, p, Player)
+            sum += p->grounded;
+    });
+    
+    // The camera is not counted
+    double deadRatio = numSlots > 1? (double)(numSlots - numLive) / (numSlots - 1) : 0.0;
+    auto perLive = [](double ns, s64 live) { return live > 0? ns / live : 0.0; };
+    printf("{\n");
+    printf("  \"config\": {\"entities\": %d, \"depth\": %d, \"players\": %g, \"dead\": %g, \"iterations\": %d, \"seed\": %u},\n",
+           config.numEntities, config.mountDepth, config.playerRatio, config.deadRatio, numIters, config.seed);
+    printf("  \"deadRatio\": %.4f,\n", deadRatio);
+    printf("  \"entities\": {\"slots\": %lld, \"live\": %lld, \"nsPerLive\": {\"old\": %.3f, \"pendingDestroy\": %.3f, \"committed\": %.3f}},\n",
+           (long long)numSlots, (long long)numLive, perLive(oldEntities, numLive), perLive(pendingEntities, numLive), perLive(committedEntities, numLive));
+    printf("  \"players\": {\"slots\": %lld, \"live\": %lld, \"nsPerLive\": {\"old\": %.3f, \"pendingDestroy\": %.3f, \"committed\": %.3f}},\n",
+           (long long)numPlayerSlots, (long long)numLivePlayers, perLive(oldPlayers, numLivePlayers), perLive(pendingPlayers, numLivePlayers), perLive(committedPlayers, numLivePlayers));
+    printf("  \"checksum\": %llu\n", (unsigned long long)(sum + refKeySum));
+    printf("}\n");
+    return 0;
+}
+
+// Deterministic input, with some movement, camera
+// rotation and a jump every couple of seconds
+void UpdateSyntheticInput(int frame)
+{
+    Input& input = synthInput;
+    input.prev.gamepad = input.gamepad;
+    memcpy(input.prev.virtualKeys, input.virtualKeys, sizeof(input.virtualKeys));
+    memcpy(input.prev.unfilteredKeys, input.unfilteredKeys, sizeof(input.unfilteredKeys));
+    
+    float t = frame / 60.0f;
+    input.gamepad.leftStick  = {.x=sinf(t), .y=cosf(t * 0.7f)};
+    input.gamepad.rightStick = {.x=0.5f * sinf(t * 0.3f), .y=0.2f * cosf(t * 0.5f)};
+    input.gamepad.buttons = (frame % 120) == 0? Gamepad_A : 0;
+    input.virtualKeys[Keycode_W] = (frame / 90) % 2 == 0;
+}
+
+u32 NextRandom(u32* state)
+{
+    // Xorshift32
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+float RandomFloat(u32* state)
+{
+    return (NextRandom(state) >> 8) / (float)(1 << 24);
+}
+
+double Percentile(Slice<double> sorted, double p)
+{
+    if(sorted.len <= 0) return 0.0;
+    
+    s64 idx = (s64)(p * (sorted.len - 1) + 0.5);
+    return sorted[idx];
+}
+
+void PrintArena(const char* name, Arena* arena, bool last)
+{
+    printf("    \"%s\": {\"used\": %llu, \"peak\": %llu, \"committed\": %llu}%s\n", name,
+           (unsigned long long)arena->offset, (unsigned long long)arena->peak, (unsigned long long)arena->committed, last? "" : ",");
+}
+
+// The simulation gets its input from here instead of the OS layer
+void PollAndProcessInput(bool inEditor) {}
+
+Input GetInput()
+{
+    return synthInput;
+}
+
+bool PressedKey(Input input, VirtualKeycode key)
+{
+    return input.virtualKeys[key] && !input.prev.virtualKeys[key];
+}
+
+bool PressedGamepadButton(Input input, GamepadButtonField button)
+{
+    return (input.gamepad.buttons & button) && !(input.prev.gamepad.buttons & button);
+}
+
+// Referenced by MainUpdate and the scene setup in entities.cpp,
+// but never called here since there's no editor, assets or renderer
+MeshHandle AcquireMeshAsync(const char* path) { return {}; }
+MaterialHandle AcquireMaterialAsync(const char* path) { return {}; }
+void OS_DearImguiBeginFrame() {}
+void OS_GetClientAreaSize(int* width, int* height) { *width = 0; *height = 0; }
+void R_ImGuiNewFrame() {}
+void UpdateEditor(Editor* editor, float deltaTime) {}
+void EditorLog(const char* fmt, ...) {}
+
+// Picking bounds come from the mesh, all entities use a 2x2x2 cube
+u32 GetMeshLoadCount() { return 0; }
+Mesh* GetAsset(MeshHandle handle)
+{
+    static Mesh cube =
+    {
+        .aabb   = {.min={-1.0f, -1.0f, -1.0f}, .max={1.0f, 1.0f, 1.0f}},
+        .sphere = {.center={0.0f, 0.0f, 0.0f}, .radius=1.7320508f},
+    };
+    return &cube;
+}